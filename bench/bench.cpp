@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "buffer_scanner.h"
+#include "corpus.h"
+#include "cpu_topology.h"
+#include "literal_matcher.h"
+#include "multi_literal_matcher.h"
+#include "newline_counter.h"
+#include "regex_matcher.h"
+#include "searcher.h"
+
+namespace fs = std::filesystem;
+
+/*
+ * The benchmarks of the search: microbenchmarks of the matcher kernels over a buffer in memory, and
+ * searches of generated directory trees with the Searcher of the library. Every benchmark is run a
+ * number of times and reports its best run; the results are printed as a table and written as JSON.
+ *
+ * Usage: specific_grep_bench [--corpus <directory>] [--output <json file>] [--scale <factor>]
+ *                            [--threads <count>] [--repeats <count>] [--seed <seed>]
+ */
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	// The size of the buffer of the microbenchmarks at scale 1.
+	constexpr std::size_t micro_buffer_size = 64 * 1024 * 1024;
+	// The least time every microbenchmark is run for, so that short runs are not dominated by the timer.
+	constexpr double micro_min_seconds = 0.5;
+
+	struct BenchOptions {
+		fs::path corpus = "bench_corpus";
+		fs::path output = "bench_results.json";
+		double scale = 1.0;
+		std::size_t threads = 0;
+		std::size_t repeats = 3;
+		std::uint64_t seed = 1;
+	};
+
+	struct MicroResult {
+		std::string name;
+		std::uint64_t bytes;
+		std::uint64_t matches;
+		double best_seconds;
+	};
+
+	struct EndToEndResult {
+		std::string corpus;
+		std::string query;
+		std::uint64_t files;
+		std::uint64_t bytes;
+		std::uint64_t matches;
+		double best_seconds;
+		double mean_seconds;
+	};
+
+	/**
+	 * The output of the scanner for the microbenchmarks: it only counts the matching lines, so that
+	 * what is measured is the matcher and the line accounting around the hits.
+	 */
+	struct CountLines {
+		std::uint64_t count = 0;
+
+		void operator()(std::size_t, std::uint64_t, const char*, const char*, std::uint32_t) {
+			++count;
+		}
+
+		void context(std::size_t, std::uint64_t, const char*, const char*) {
+		}
+
+		bool done() const {
+			return false;
+		}
+	};
+
+	double seconds(Clock::duration duration) {
+		return std::chrono::duration<double>(duration).count();
+	}
+
+	/**
+	 * Runs a benchmark over and over for at least micro_min_seconds and at least the number of repeats.
+	 *
+	 * @return The time of the fastest run, in seconds.
+	 */
+	template <typename Run>
+	double bestOf(std::size_t repeats, Run&& run) {
+		double best = 0;
+		double total = 0;
+		for (std::size_t i = 0; i < repeats || total < micro_min_seconds; ++i) {
+			const Clock::time_point start = Clock::now();
+			run();
+			const double elapsed = seconds(Clock::now() - start);
+			best = i == 0 ? elapsed : std::min(best, elapsed);
+			total += elapsed;
+		}
+		return best;
+	}
+
+	template <typename Matcher>
+	MicroResult benchmarkMatcher(const std::string& name, const Matcher& matcher, const std::string& text, std::size_t repeats) {
+		std::uint64_t matches = 0;
+		const double best = bestOf(repeats, [&] {
+			BasicBufferScanner<Matcher, CountLines> scanner(matcher, CountLines{}, BinaryPolicy::Text);
+			scanner.scan(text.data(), text.data() + text.size());
+			matches = scanner.output().count;
+		});
+		return { name, text.size(), matches, best };
+	}
+
+	std::vector<MicroResult> runMicrobenchmarks(const BenchOptions& options) {
+		std::string text;
+		TextGenerator generator(options.seed);
+		generator.appendLines(text, std::max<std::size_t>(1024 * 1024, static_cast<std::size_t>(micro_buffer_size * options.scale)), 0.001);
+
+		std::vector<MicroResult> results;
+		std::uint64_t newlines = 0;
+		const double newline_best = bestOf(options.repeats, [&] {
+			newlines = countNewlines(text.data(), text.data() + text.size());
+		});
+		results.push_back({ "newline_count", text.size(), newlines, newline_best });
+
+		results.push_back(benchmarkMatcher("literal_" + std::string(LiteralMatcher::kernelName()), LiteralMatcher(corpus_needle), text, options.repeats));
+		results.push_back(benchmarkMatcher("literal_ignore_case", LiteralMatcher(corpus_needle, true), text, options.repeats));
+
+		// Patterns of which only the needle occurs, as the usual list of names in a pattern file.
+		const std::vector<std::string> patterns = { corpus_needle, "wombat", "platypus", "numbat", "echidna", "bilby", "dingo", "wallaby" };
+		std::string error;
+		results.push_back(benchmarkMatcher("multi_literal_8", *MultiLiteralMatcher::create(patterns, false, error), text, options.repeats));
+		results.push_back(benchmarkMatcher("multi_literal_8_ignore_case", *MultiLiteralMatcher::create(patterns, true, error), text, options.repeats));
+
+		const std::unique_ptr<RegexMatcher> regex = RegexMatcher::compile("q[a-z]+ka", error);
+		if (regex != nullptr) {
+			results.push_back(benchmarkMatcher("regex_class", *regex, text, options.repeats));
+		}
+		const std::unique_ptr<RegexMatcher> alternation = RegexMatcher::compile("(wombat|quokka|bilby)[ ]+[a-z]+", error);
+		if (alternation != nullptr) {
+			results.push_back(benchmarkMatcher("regex_alternation", *alternation, text, options.repeats));
+		}
+		return results;
+	}
+
+	std::vector<EndToEndResult> runEndToEnd(const BenchOptions& options, bool& failed) {
+		struct Query {
+			const char* name;
+			bool regex;
+			bool case_insensitive;
+			ResultMode result_mode;
+			const char* search_string;
+		};
+		const Query queries[] = {
+			{ "literal", false, false, ResultMode::Lines, corpus_needle },
+			{ "ignore_case", false, true, ResultMode::Lines, corpus_needle },
+			{ "regex", true, false, ResultMode::Lines, "q[a-z]+ka" },
+			{ "count", false, false, ResultMode::Count, corpus_needle },
+			{ "files_with_matches", false, false, ResultMode::Files, corpus_needle }
+		};
+
+		Searcher searcher(options.threads);
+		std::vector<EndToEndResult> results;
+		for (const CorpusProfile& profile : benchmarkProfiles(options.scale)) {
+			std::string error;
+			std::cerr << "Preparing the corpus " << profile.name << "..." << std::endl;
+			if (!generateCorpus(options.corpus, profile, options.seed, error)) {
+				std::cerr << "Error: " << error << std::endl;
+				failed = true;
+				return results;
+			}
+			const fs::path tree = options.corpus / profile.name;
+			const std::uint64_t bytes = corpusSize(tree);
+
+			for (const Query& query : queries) {
+				SearchOptions search;
+				search.search_string = query.search_string;
+				search.regex = query.regex;
+				search.case_insensitive = query.case_insensitive;
+				search.result_mode = query.result_mode;
+				search.directory_path = tree.string();
+				const std::unique_ptr<LineMatcher> matcher = createMatcher(search, error);
+				if (matcher == nullptr) {
+					std::cerr << "Error: " << error << std::endl;
+					failed = true;
+					return results;
+				}
+
+				// The first run brings the tree into the page cache, the runs measured search it from there.
+				searcher.search(search, *matcher);
+				EndToEndResult result{ profile.name, query.name, 0, bytes, 0, 0, 0 };
+				double total = 0;
+				for (std::size_t i = 0; i < options.repeats; ++i) {
+					const Clock::time_point start = Clock::now();
+					const SearchResults found = searcher.search(search, *matcher);
+					const double elapsed = seconds(Clock::now() - start);
+					result.best_seconds = i == 0 ? elapsed : std::min(result.best_seconds, elapsed);
+					total += elapsed;
+					result.files = found.files_searched;
+					result.matches = found.matchCount();
+				}
+				result.mean_seconds = total / static_cast<double>(options.repeats);
+				results.push_back(result);
+			}
+		}
+		return results;
+	}
+
+	std::string jsonString(const std::string& text) {
+		std::string quoted = "\"";
+		for (const char c : text) {
+			if (c == '"' || c == '\\') {
+				quoted += '\\';
+			}
+			quoted += c;
+		}
+		return quoted + "\"";
+	}
+
+	double gigabytesPerSecond(std::uint64_t bytes, double seconds) {
+		return seconds > 0 ? static_cast<double>(bytes) / seconds / 1e9 : 0;
+	}
+
+	void writeJson(std::ostream& output, const BenchOptions& options, std::size_t threads, const std::vector<MicroResult>& micro, const std::vector<EndToEndResult>& end_to_end) {
+		output << std::setprecision(6);
+		output << "{\n";
+		output << "  \"format\": 1,\n";
+		output << "  \"config\": { \"scale\": " << options.scale << ", \"seed\": " << options.seed << ", \"threads\": " << threads << ", \"repeats\": " << options.repeats << " },\n";
+		output << "  \"machine\": { \"cpus\": " << availableCpuCount() << ", \"literal_kernel\": " << jsonString(LiteralMatcher::kernelName()) << " },\n";
+		output << "  \"micro\": [";
+		for (std::size_t i = 0; i < micro.size(); ++i) {
+			const MicroResult& result = micro[i];
+			output << (i == 0 ? "\n" : ",\n") << "    { \"name\": " << jsonString(result.name) << ", \"bytes\": " << result.bytes << ", \"matches\": " << result.matches
+				<< ", \"best_seconds\": " << result.best_seconds << ", \"gb_per_s\": " << gigabytesPerSecond(result.bytes, result.best_seconds) << " }";
+		}
+		output << "\n  ],\n";
+		output << "  \"end_to_end\": [";
+		for (std::size_t i = 0; i < end_to_end.size(); ++i) {
+			const EndToEndResult& result = end_to_end[i];
+			output << (i == 0 ? "\n" : ",\n") << "    { \"corpus\": " << jsonString(result.corpus) << ", \"query\": " << jsonString(result.query) << ", \"files\": " << result.files
+				<< ", \"bytes\": " << result.bytes << ", \"matches\": " << result.matches << ", \"best_wall_ms\": " << result.best_seconds * 1000 << ", \"mean_wall_ms\": " << result.mean_seconds * 1000
+				<< ", \"gb_per_s\": " << gigabytesPerSecond(result.bytes, result.best_seconds) << ", \"files_per_s\": " << (result.best_seconds > 0 ? static_cast<double>(result.files) / result.best_seconds : 0) << " }";
+		}
+		output << "\n  ]\n}\n";
+	}
+
+	void printTable(const std::vector<MicroResult>& micro, const std::vector<EndToEndResult>& end_to_end) {
+		std::cout << std::fixed << std::setprecision(2);
+		std::cout << std::left << std::setw(32) << "microbenchmark" << std::right << std::setw(12) << "GB/s" << std::setw(12) << "matches" << "\n";
+		for (const auto& result : micro) {
+			std::cout << std::left << std::setw(32) << result.name << std::right << std::setw(12) << gigabytesPerSecond(result.bytes, result.best_seconds) << std::setw(12) << result.matches << "\n";
+		}
+		std::cout << "\n" << std::left << std::setw(32) << "search" << std::right << std::setw(12) << "wall ms" << std::setw(12) << "GB/s" << std::setw(12) << "files/s" << std::setw(12) << "matches" << "\n";
+		for (const auto& result : end_to_end) {
+			std::cout << std::left << std::setw(32) << (result.corpus + "/" + result.query) << std::right << std::setw(12) << result.best_seconds * 1000 << std::setw(12) << gigabytesPerSecond(result.bytes, result.best_seconds)
+				<< std::setw(12) << (result.best_seconds > 0 ? static_cast<double>(result.files) / result.best_seconds : 0) << std::setw(12) << result.matches << "\n";
+		}
+	}
+
+	bool parseOptions(int argc, char* argv[], BenchOptions& options) {
+		for (int i = 1; i < argc; ++i) {
+			const bool has_value = i + 1 < argc;
+			try {
+				if (strcmp(argv[i], "--corpus") == 0 && has_value) {
+					options.corpus = argv[++i];
+				}
+				else if (strcmp(argv[i], "--output") == 0 && has_value) {
+					options.output = argv[++i];
+				}
+				else if (strcmp(argv[i], "--scale") == 0 && has_value) {
+					options.scale = std::stod(argv[++i]);
+				}
+				else if (strcmp(argv[i], "--threads") == 0 && has_value) {
+					options.threads = std::stoul(argv[++i]);
+				}
+				else if (strcmp(argv[i], "--repeats") == 0 && has_value) {
+					options.repeats = std::stoul(argv[++i]);
+				}
+				else if (strcmp(argv[i], "--seed") == 0 && has_value) {
+					options.seed = std::stoull(argv[++i]);
+				}
+				else {
+					return false;
+				}
+			}
+			catch (const std::exception&) {
+				return false;
+			}
+		}
+		return options.scale > 0 && options.repeats > 0;
+	}
+}
+
+
+int main(int argc, char* argv[]) {
+	BenchOptions options;
+	if (!parseOptions(argc, argv, options)) {
+		std::cerr << "Usage: " << fs::path(argv[0]).filename().string() << " [--corpus <directory>] [--output <json file>] [--scale <factor>] [--threads <count>] [--repeats <count>] [--seed <seed>]" << std::endl;
+		return 1;
+	}
+
+	const std::vector<MicroResult> micro = runMicrobenchmarks(options);
+	bool failed = false;
+	const std::vector<EndToEndResult> end_to_end = runEndToEnd(options, failed);
+	if (failed) {
+		return 1;
+	}
+
+	printTable(micro, end_to_end);
+	std::ofstream output(options.output);
+	writeJson(output, options, options.threads == 0 ? availableCpuCount() : options.threads, micro, end_to_end);
+	if (!output) {
+		std::cerr << "Error: could not write " << options.output.string() << std::endl;
+		return 1;
+	}
+	std::cout << "\nResults written to " << options.output.string() << std::endl;
+	return 0;
+}
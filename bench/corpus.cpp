@@ -0,0 +1,145 @@
+#include "corpus.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace {
+	// The words of the text, none of which contains the needle or a part of it that the benchmarks look for.
+	constexpr const char* words[] = {
+		"alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+		"india", "juliett", "kilo", "lima", "mike", "november", "oscar", "papa",
+		"romeo", "sierra", "tango", "uniform", "victor", "whiskey", "xray", "yankee",
+		"zulu", "request", "response", "handler", "session", "timeout", "buffer", "socket",
+		"thread", "worker", "config", "status", "error", "warning", "debug", "trace",
+		"2024-05-17", "12:34:56", "GET", "POST", "/api/v1/items", "200", "404", "500",
+		"user_id=42", "latency_ms=17", "retry", "commit", "rollback", "index", "query", "cache",
+		"{", "}", "=", "->", "#", "//", "return", "void"
+	};
+	constexpr std::size_t word_count = sizeof(words) / sizeof(words[0]);
+
+	// The name of the file next to a finished tree that describes it.
+	std::string markerName(const CorpusProfile& profile) {
+		return profile.name + ".corpus";
+	}
+
+	std::string describe(const CorpusProfile& profile, std::uint64_t seed) {
+		std::ostringstream description;
+		description << profile.name << ' ' << profile.file_count << ' ' << profile.file_size << ' ' << profile.depth << ' ' << profile.fan_out << ' ' << profile.hit_rate << ' ' << seed << '\n';
+		return description.str();
+	}
+
+	/**
+	 * @return The directory of a file: the files are dealt out to the leaves of the tree in turn.
+	 */
+	fs::path fileDirectory(const fs::path& tree, const CorpusProfile& profile, std::size_t file_index) {
+		fs::path directory = tree;
+		std::size_t leaf = file_index;
+		for (std::size_t level = 0; level < profile.depth; ++level) {
+			directory /= "d" + std::to_string(leaf % profile.fan_out);
+			leaf /= profile.fan_out;
+		}
+		return directory;
+	}
+}
+
+
+std::vector<CorpusProfile> benchmarkProfiles(double scale) {
+	auto scaled = [scale](std::size_t value) {
+		return std::max<std::size_t>(1, static_cast<std::size_t>(static_cast<double>(value) * scale));
+	};
+	return {
+		{ "small_files", scaled(20000), 4 * 1024, 2, 32, 0.001 },
+		{ "huge_files", 4, scaled(32 * 1024 * 1024), 0, 1, 0.0001 },
+		{ "deep_tree", scaled(4096), 8 * 1024, 12, 2, 0.001 },
+		{ "dense_hits", scaled(1000), 64 * 1024, 1, 16, 0.2 }
+	};
+}
+
+
+std::uint64_t TextGenerator::next() {
+	std::uint64_t z = (state_ += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+
+std::size_t TextGenerator::appendLines(std::string& text, std::size_t size, double hit_rate) {
+	const std::uint64_t hit_threshold = static_cast<std::uint64_t>(hit_rate * 1000000.0);
+	const std::size_t end = text.size() + size;
+	std::size_t hits = 0;
+	while (text.size() < end) {
+		const std::size_t line_words = 4 + next() % 13;
+		const std::size_t needle_position = next() % 1000000 < hit_threshold ? next() % line_words : line_words;
+		for (std::size_t i = 0; i < line_words; ++i) {
+			if (i > 0) {
+				text += ' ';
+			}
+			text += i == needle_position ? corpus_needle : words[next() % word_count];
+		}
+		text += '\n';
+		hits += needle_position < line_words ? 1 : 0;
+	}
+	return hits;
+}
+
+
+bool generateCorpus(const fs::path& root, const CorpusProfile& profile, std::uint64_t seed, std::string& error) {
+	const fs::path tree = root / profile.name;
+	const fs::path marker = root / markerName(profile);
+	const std::string description = describe(profile, seed);
+
+	// A tree that is there from the same profile and seed is used as it is.
+	{
+		std::ifstream existing(marker, std::ios::binary);
+		std::stringstream content;
+		content << existing.rdbuf();
+		if (existing.is_open() && content.str() == description) {
+			return true;
+		}
+	}
+
+	std::error_code fs_error;
+	fs::remove(marker, fs_error);
+	fs::remove_all(tree, fs_error);
+	std::string text;
+	for (std::size_t i = 0; i < profile.file_count; ++i) {
+		const fs::path directory = fileDirectory(tree, profile, i);
+		fs::create_directories(directory, fs_error);
+		const fs::path file_path = directory / ("f" + std::to_string(i) + ".txt");
+
+		// Every file has a seed of its own, so its text does not depend on the files before it.
+		TextGenerator generator(seed ^ (0x2545f4914f6cdd1dull * (i + 1)));
+		text.clear();
+		generator.appendLines(text, profile.file_size, profile.hit_rate);
+		std::ofstream file(file_path, std::ios::binary);
+		file.write(text.data(), static_cast<std::streamsize>(text.size()));
+		if (!file) {
+			error = "could not write " + file_path.string();
+			return false;
+		}
+	}
+
+	std::ofstream marker_file(marker, std::ios::binary);
+	marker_file << description;
+	if (!marker_file) {
+		error = "could not write " + marker.string();
+		return false;
+	}
+	return true;
+}
+
+
+std::uint64_t corpusSize(const fs::path& directory) {
+	std::uint64_t size = 0;
+	std::error_code error;
+	for (const auto& entry : fs::recursive_directory_iterator(directory, error)) {
+		if (entry.is_regular_file(error)) {
+			size += entry.file_size(error);
+		}
+	}
+	return size;
+}
@@ -0,0 +1,83 @@
+#ifndef SPECIFIC_GREP_BENCH_CORPUS_H
+#define SPECIFIC_GREP_BENCH_CORPUS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * The word every benchmark searches for. The generated text is made of other words, so the lines
+ * with the needle are exactly the ones the generator put it in.
+ */
+constexpr const char* corpus_needle = "quokka";
+
+/**
+ * The shape of a generated directory tree.
+ */
+struct CorpusProfile {
+	// The name of the profile, the name of the directory of its tree.
+	std::string name;
+	// The number of files.
+	std::size_t file_count;
+	// The size of every file in bytes, rounded to whole lines.
+	std::size_t file_size;
+	// The number of directory levels below the root the files are spread over.
+	std::size_t depth;
+	// The number of subdirectories of every directory above the last level.
+	std::size_t fan_out;
+	// The share of the lines that contain the needle, between 0 and 1.
+	double hit_rate;
+};
+
+/**
+ * @param scale The factor of the number of files and the size of the huge files, 1 for the full size.
+ * @return The profiles of the benchmarks: many small files, a few huge files, a deep tree, and a tree with dense hits.
+ */
+std::vector<CorpusProfile> benchmarkProfiles(double scale);
+
+/**
+ * Generates text lines of words, the same text for the same seed on every machine and every build.
+ * The generator is a SplitMix64, whose output is defined bit for bit, unlike the distributions of <random>.
+ */
+class TextGenerator {
+public:
+	explicit TextGenerator(std::uint64_t seed) : state_(seed) {
+	}
+
+	/**
+	 * Appends lines up to a size.
+	 *
+	 * @param text The text to append to.
+	 * @param size The size to append, rounded up to a whole line.
+	 * @param hit_rate The share of the lines that contain the needle.
+	 * @return The number of lines with the needle.
+	 */
+	std::size_t appendLines(std::string& text, std::size_t size, double hit_rate);
+
+private:
+	std::uint64_t next();
+
+	std::uint64_t state_;
+};
+
+/**
+ * Generates the tree of a profile below a directory, unless it is there already from the same
+ * profile and seed: a finished tree is marked with a file that describes it.
+ *
+ * @param root The directory to generate the trees of the profiles in.
+ * @param profile The profile of the tree.
+ * @param seed The seed of the text.
+ * @param error Set to the reason on failure.
+ * @return True on success, false if the tree could not be written.
+ */
+bool generateCorpus(const std::filesystem::path& root, const CorpusProfile& profile, std::uint64_t seed, std::string& error);
+
+/**
+ * @param directory The directory of a generated tree.
+ * @return The total size of the files of the tree in bytes.
+ */
+std::uint64_t corpusSize(const std::filesystem::path& directory);
+
+#endif
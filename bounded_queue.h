@@ -0,0 +1,131 @@
+#ifndef SPECIFIC_GREP_BOUNDED_QUEUE_H
+#define SPECIFIC_GREP_BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/**
+ * A bounded lock-free multi-producer multi-consumer queue.
+ *
+ * Every cell carries a sequence number that tells producers and consumers whose turn it is, so
+ * both ends only need a compare-and-swap on their own position (Dmitry Vyukov's bounded queue).
+ * The capacity is rounded up to a power of two.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+	/**
+	 * @param capacity The maximum number of elements the queue holds.
+	 */
+	explicit BoundedQueue(std::size_t capacity) {
+		std::size_t rounded = 2;
+		while (rounded < capacity) {
+			rounded *= 2;
+		}
+
+		mask_ = rounded - 1;
+		cells_ = std::make_unique<Cell[]>(rounded);
+		for (std::size_t i = 0; i < rounded; ++i) {
+			cells_[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	/**
+	 * @return The maximum number of elements the queue holds, the capacity rounded up.
+	 */
+	std::size_t capacity() const {
+		return mask_ + 1;
+	}
+
+	/**
+	 * Appends an element unless the queue is full.
+	 *
+	 * @param value The element to append, only moved from on success.
+	 * @return True if the element was appended, false if the queue is full.
+	 */
+	bool tryPush(T& value) {
+		std::size_t position = tail_.load(std::memory_order_relaxed);
+		Cell* cell;
+		while (true) {
+			cell = &cells_[position & mask_];
+			const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			const std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+
+			// The cell is free for this position: claim it.
+			if (difference == 0) {
+				if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			// The cell still holds the element from one lap ago: the queue is full.
+			else if (difference < 0) {
+				return false;
+			}
+			// Another producer claimed the position first.
+			else {
+				position = tail_.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->value = std::move(value);
+		cell->sequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Removes the oldest element unless the queue is empty.
+	 *
+	 * @param value Receives the element.
+	 * @return True if an element was removed, false if the queue is empty.
+	 */
+	bool tryPop(T& value) {
+		std::size_t position = head_.load(std::memory_order_relaxed);
+		Cell* cell;
+		while (true) {
+			cell = &cells_[position & mask_];
+			const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			const std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+
+			// The cell holds the element for this position: claim it.
+			if (difference == 0) {
+				if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			// The producer for this position has not finished yet: the queue is empty.
+			else if (difference < 0) {
+				return false;
+			}
+			// Another consumer claimed the position first.
+			else {
+				position = head_.load(std::memory_order_relaxed);
+			}
+		}
+
+		value = std::move(cell->value);
+		cell->value = T();
+		cell->sequence.store(position + mask_ + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	struct Cell {
+		std::atomic<std::size_t> sequence;
+		T value;
+	};
+
+	// Keep the producer and consumer positions on separate cache lines.
+	static constexpr std::size_t cache_line_size = 64;
+
+	std::unique_ptr<Cell[]> cells_;
+	std::size_t mask_ = 0;
+	alignas(cache_line_size) std::atomic<std::size_t> tail_{ 0 };
+	alignas(cache_line_size) std::atomic<std::size_t> head_{ 0 };
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include "buffer_scanner.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "newline_counter.h"
+#include "search_stats.h"
+
+
+bool parseBinaryPolicy(const std::string& name, BinaryPolicy& binary_policy) {
+	if (name == "skip") {
+		binary_policy = BinaryPolicy::Skip;
+	}
+	else if (name == "report") {
+		binary_policy = BinaryPolicy::Report;
+	}
+	else if (name == "text") {
+		binary_policy = BinaryPolicy::Text;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+
+void BufferScanner::probe(const char* data, std::size_t size) {
+	if (probed_) {
+		return;
+	}
+	probed_ = true;
+	// memchr runs a whole vector at a time, and text has no NUL byte to stop it early.
+	if (binary_policy_ != BinaryPolicy::Text && std::memchr(data, '\0', std::min(size, binary_probe_size)) != nullptr) {
+		report_binary_ = binary_policy_ == BinaryPolicy::Report;
+		done_ = binary_policy_ == BinaryPolicy::Skip;
+	}
+}
+
+
+void BufferScanner::feed(const char* data, std::size_t size) {
+	const StageTimer timer(SearchStage::Match);
+	probe(data, size);
+	if (done()) {
+		return;
+	}
+	const char* end = data + size;
+
+	// Complete the partial line from the previous block first.
+	if (!carry_.empty()) {
+		const char* newline = static_cast<const char*>(std::memchr(data, '\n', size));
+		if (newline == nullptr) {
+			carry_.insert(carry_.end(), data, end);
+			return;
+		}
+		carry_.insert(carry_.end(), data, newline + 1);
+		takeLines(carry_.data(), carry_.data() + carry_.size());
+		line_offset_ += carry_.size();
+		keepHistory(carry_.data(), carry_.data() + carry_.size());
+		carry_.clear();
+		if (done()) {
+			return;
+		}
+		data = newline + 1;
+	}
+
+	// Search all complete lines in place and keep the partial line at the end for the next block.
+	const char* last_newline = findLastNewline(data, end);
+	const char* lines_end = last_newline == nullptr ? data : last_newline + 1;
+	takeLines(data, lines_end);
+	line_offset_ += static_cast<std::uint64_t>(lines_end - data);
+	if (done()) {
+		return;
+	}
+	keepHistory(data, lines_end);
+	carry_.insert(carry_.end(), lines_end, end);
+}
+
+
+/**
+ * Searches a run of lines until the search is done, and hands it to the observer.
+ */
+void BufferScanner::takeLines(const char* begin, const char* end) {
+	if (!done_) {
+		scanLines(begin, end);
+	}
+	if (observer_ != nullptr) {
+		observer_->observeLines(begin, end);
+	}
+}
+
+
+/**
+ * Keeps the last lines of a run that was fed, with the ones kept before it if the run has fewer
+ * lines than the context before a match, for the context of the matches of the next block.
+ *
+ * @param begin The start of the run.
+ * @param end The end of the run, after a newline.
+ */
+void BufferScanner::keepHistory(const char* begin, const char* end) {
+	if (before_context_ == 0 || done_) {
+		return;
+	}
+	std::size_t lines = 0;
+	const char* start = findLastLines(begin, end, before_context_, lines);
+	if (lines < before_context_) {
+		std::size_t kept = 0;
+		const char* kept_start = findLastLines(history_.data(), history_.data() + history_.size(), before_context_ - lines, kept);
+		history_.erase(history_.begin(), history_.begin() + (kept_start - history_.data()));
+	}
+	else {
+		history_.clear();
+	}
+	history_.insert(history_.end(), start, end);
+}
+
+
+void BufferScanner::finish() {
+	if (!carry_.empty() && !done()) {
+		const StageTimer timer(SearchStage::Match);
+		takeLines(carry_.data(), carry_.data() + carry_.size());
+		line_offset_ += carry_.size();
+		carry_.clear();
+	}
+}
+
+
+void BufferScanner::scan(const char* begin, const char* end) {
+	const StageTimer timer(SearchStage::Match);
+	probe(begin, static_cast<std::size_t>(end - begin));
+	if (!done()) {
+		takeLines(begin, end);
+		line_offset_ += static_cast<std::uint64_t>(end - begin);
+	}
+}
@@ -0,0 +1,449 @@
+#ifndef SPECIFIC_GREP_BUFFER_SCANNER_H
+#define SPECIFIC_GREP_BUFFER_SCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "newline_counter.h"
+
+/**
+ * What to do with a file that has binary content, a NUL byte within its first binary_probe_size bytes.
+ */
+enum class BinaryPolicy {
+	// Skip the file without reading the rest of it.
+	Skip,
+	// Search the file up to its first match, which is reported with binary_match_line instead of the line.
+	Report,
+	// Search the file like text.
+	Text
+};
+
+/**
+ * The number of bytes at the start of a file that are looked at for a NUL byte. A NUL byte hardly
+ * ever occurs in text, but is in nearly every binary format within its first few kilobytes.
+ */
+constexpr std::size_t binary_probe_size = 32 * 1024;
+
+/**
+ * What is reported in place of the line for the first match of a binary file.
+ */
+constexpr std::string_view binary_match_line = "Binary file matches";
+
+/**
+ * Parses the name of a binary policy ("skip", "report" or "text").
+ *
+ * @param name The name of the binary policy.
+ * @param binary_policy Receives the binary policy.
+ * @return True on success, false if the name is unknown.
+ */
+bool parseBinaryPolicy(const std::string& name, BinaryPolicy& binary_policy);
+
+/**
+ * Finds the last lines of a run of complete lines, each of which ends with a newline.
+ *
+ * @param begin The start of the run.
+ * @param end The end of the run, after a newline.
+ * @param count The number of lines to find.
+ * @param lines Receives the number of lines found, fewer than count if the run has fewer.
+ * @return The start of the first of the lines found.
+ */
+inline const char* findLastLines(const char* begin, const char* end, std::size_t count, std::size_t& lines) {
+	const char* start = end;
+	lines = 0;
+	while (lines < count && start > begin) {
+		const char* newline = findLastNewline(begin, start - 1);
+		start = newline == nullptr ? begin : newline + 1;
+		++lines;
+	}
+	return start;
+}
+
+/**
+ * Takes every run of lines a scanner is fed, whether or not the scanner still searches it, such as to
+ * collect the trigrams of a file for the index while the file is searched.
+ */
+class LineObserver {
+public:
+	virtual ~LineObserver() = default;
+
+	/**
+	 * Takes a run of lines. The run starts at the start of a line and ends after a newline, or at the
+	 * end of the content.
+	 *
+	 * @param begin The start of the first line.
+	 * @param end The end of the last line.
+	 */
+	virtual void observeLines(const char* begin, const char* end) = 0;
+};
+
+/**
+ * Searches the content of a file for matching lines, block by block.
+ *
+ * The matcher runs over the raw bytes of a whole block; line boundaries and line numbers are only
+ * worked out around the hits, by looking for the newlines on either side of a hit and counting the
+ * newlines skipped since the previous hit. The blocks can be of any size: the partial line at the
+ * end of a block is kept and completed with the start of the next block.
+ *
+ * This class keeps the blocks together and is all the readers see. The search of the lines is left
+ * to BasicBufferScanner, which is compiled for every matcher and output, so the readers make a single
+ * virtual call per block.
+ *
+ * The first block is checked for binary content before anything is searched. Once the scanner needs
+ * no more of the content, done() tells the readers to stop reading, unless an observer takes every
+ * line of the content.
+ *
+ * Context lines around the matches are slices of the content like the matching lines. Only the lines
+ * before a match that lie in an earlier block are gone once the block is, so with context before the
+ * matches the scanner keeps a copy of the last complete lines of the content fed block by block, as
+ * many as the context has.
+ */
+class BufferScanner {
+public:
+	/**
+	 * @param binary_policy What to do with binary content.
+	 */
+	explicit BufferScanner(BinaryPolicy binary_policy = BinaryPolicy::Text) : binary_policy_(binary_policy) {
+	}
+
+	virtual ~BufferScanner() = default;
+
+	/**
+	 * Checks the start of the content for binary content, which feed() and scan() do by themselves
+	 * on their first call. A reader calls it first to find out whether the rest is needed at all.
+	 *
+	 * @param data The start of the content.
+	 * @param size The size of the start of the content that is available.
+	 */
+	void probe(const char* data, std::size_t size);
+
+	/**
+	 * @return True once the rest of the content is not needed: the content is binary and skipped, or its first match has been
+	 *         reported, and no observer takes the lines.
+	 */
+	bool done() const {
+		return done_ && observer_ == nullptr;
+	}
+
+	/**
+	 * @return True once the search of the content has ended, like done(), whether or not an observer still takes the lines.
+	 */
+	bool searchDone() const {
+		return done_;
+	}
+
+	/**
+	 * Searches the next block of the content.
+	 *
+	 * @param data The start of the block.
+	 * @param size The size of the block in bytes.
+	 */
+	void feed(const char* data, std::size_t size);
+
+	/**
+	 * Searches the last line if the content does not end with a newline. Call once after the last block.
+	 */
+	void finish();
+
+	/**
+	 * Searches content that is available in one piece, without copying any of it.
+	 *
+	 * @param begin The start of the content.
+	 * @param end The end of the content.
+	 */
+	void scan(const char* begin, const char* end);
+
+	/**
+	 * @return The number of newlines in the content scanned so far.
+	 */
+	std::size_t newlineCount() const {
+		return line_number_ - 1;
+	}
+
+	/**
+	 * Sets the offset of the content fed next in the file, for a reader that starts within the file.
+	 * The byte offsets of the matches count from it. Call before the first block.
+	 *
+	 * @param offset The offset of the content in bytes.
+	 */
+	void setContentOffset(std::uint64_t offset) {
+		line_offset_ = offset;
+	}
+
+	/**
+	 * Reports the lines around every match as context lines: the lines before and after it that do
+	 * not match themselves, each line once however many matches it is near. Call before the first block.
+	 *
+	 * @param before The number of lines before every match.
+	 * @param after The number of lines after every match.
+	 */
+	void setContext(std::size_t before, std::size_t after) {
+		before_context_ = before;
+		after_context_ = after;
+	}
+
+	/**
+	 * Hands every run of lines of the content to an observer as well, up to the end of the content
+	 * however early the search of it ends. Call before the first block.
+	 *
+	 * @param observer The observer, which must outlive the scan.
+	 */
+	void setObserver(LineObserver* observer) {
+		observer_ = observer;
+	}
+
+protected:
+	/**
+	 * Searches a run of lines. The run starts at the start of a line and ends after a newline,
+	 * or at the end of the content.
+	 *
+	 * @param begin The start of the first line.
+	 * @param end The end of the last line.
+	 */
+	virtual void scanLines(const char* begin, const char* end) = 0;
+
+	// The line number of the next line to scan.
+	std::size_t line_number_ = 1;
+	// The byte offset of the next line to scan in the content, the run of lines scanLines() gets starts there.
+	std::uint64_t line_offset_ = 0;
+	// Whether the content is binary and only its first match is reported.
+	bool report_binary_ = false;
+	// Whether the rest of the content is not needed.
+	bool done_ = false;
+	// The number of context lines before and after every match.
+	std::size_t before_context_ = 0;
+	std::size_t after_context_ = 0;
+	// The number of context lines still to report after the last match.
+	std::size_t after_pending_ = 0;
+	// The line number after the last line reported, a match or a context line, where the context before the next match starts at the earliest.
+	std::size_t reported_end_ = 1;
+	// The last complete lines fed before the run of lines scanLines() gets, up to before_context_ of them.
+	std::vector<char> history_;
+
+private:
+	void takeLines(const char* begin, const char* end);
+	void keepHistory(const char* begin, const char* end);
+
+	BinaryPolicy binary_policy_;
+	LineObserver* observer_ = nullptr;
+	bool probed_ = false;
+	// The partial line at the end of the previous block.
+	std::vector<char> carry_;
+};
+
+/**
+ * A scanner for one kind of matcher and one kind of output.
+ *
+ * Both are template parameters, so the loop over the hits is compiled for every combination, with
+ * the calls to the matcher and to the output made directly instead of through a virtual function or
+ * a std::function. The combination is picked once per search.
+ *
+ * The matcher needs findLine() and reportPatterns() like LineMatcher, and should be a final class so
+ * that its calls are resolved at compile time. The output is called for every matching line as
+ * output(line_number, byte_offset, line_begin, line_end, pattern), once for each pattern found in
+ * the line, with the offset of the start of the line in the content. Its
+ * done() is asked before every block and after every matching line, and ends the search of the
+ * content once it needs no more matches, like the first match of a binary file does. With context,
+ * see setContext(), every context line goes to output.context(line_number, byte_offset, line_begin,
+ * line_end), in line order with the matches.
+ */
+template <typename Matcher, typename Output>
+class BasicBufferScanner final : public BufferScanner {
+public:
+	/**
+	 * @param matcher The matcher to search with.
+	 * @param output The output to report the matching lines to.
+	 * @param binary_policy What to do with binary content.
+	 */
+	BasicBufferScanner(const Matcher& matcher, Output output, BinaryPolicy binary_policy) : BufferScanner(binary_policy), matcher_(matcher), output_(std::move(output)) {
+	}
+
+	/**
+	 * @return The output the matching lines were reported to.
+	 */
+	Output& output() {
+		return output_;
+	}
+
+protected:
+	void scanLines(const char* begin, const char* end) override {
+		if (output_.done()) {
+			done_ = true;
+			return;
+		}
+		if (before_context_ != 0 || after_context_ != 0) {
+			scanLinesWithContext(begin, end);
+			return;
+		}
+
+		// Everything before position has been searched, and counted has been counted up to.
+		const char* position = begin;
+		const char* counted = begin;
+		while (position < end) {
+			const char* hit = matcher_.findLine(position, end);
+			if (hit == nullptr) {
+				break;
+			}
+
+			// Find the boundaries of the line around the hit and count the lines skipped to get there.
+			const char* line_begin = findLastNewline(position, hit);
+			line_begin = line_begin == nullptr ? position : line_begin + 1;
+			const char* line_end = static_cast<const char*>(std::memchr(hit, '\n', end - hit));
+			line_end = line_end == nullptr ? end : line_end;
+			line_number_ += countNewlines(counted, line_begin);
+			const std::uint64_t byte_offset = line_offset_ + static_cast<std::uint64_t>(line_begin - begin);
+
+			if (report_binary_) {
+				reportBinary(byte_offset, line_begin, line_end);
+				return;
+			}
+			matcher_.reportPatterns(line_begin, line_end, [&](std::uint32_t pattern) {
+				output_(line_number_, byte_offset, line_begin, line_end, pattern);
+			});
+			if (output_.done()) {
+				done_ = true;
+				return;
+			}
+
+			// Continue after the line, a line is reported once however often it matches.
+			if (line_end == end) {
+				counted = end;
+				break;
+			}
+			position = line_end + 1;
+			counted = position;
+			++line_number_;
+		}
+
+		line_number_ += countNewlines(counted, end);
+	}
+
+private:
+	/**
+	 * Searches a run of lines like scanLines(), and reports the context lines around the matches.
+	 * The line number is kept up to date with the position, as the context is reported line by line.
+	 */
+	void scanLinesWithContext(const char* begin, const char* end) {
+		const std::size_t first_line = line_number_;
+		const char* position = begin;
+		while (position < end) {
+			const char* hit = matcher_.findLine(position, end);
+			const char* line_begin = end;
+			if (hit != nullptr) {
+				line_begin = findLastNewline(position, hit);
+				line_begin = line_begin == nullptr ? position : line_begin + 1;
+			}
+
+			// The context after the last match runs on up to this match, or the end of the run.
+			position = reportContextAfter(begin, position, line_begin);
+			if (hit == nullptr) {
+				break;
+			}
+			const char* line_end = static_cast<const char*>(std::memchr(hit, '\n', end - hit));
+			line_end = line_end == nullptr ? end : line_end;
+			const std::size_t line_number = line_number_ + countNewlines(position, line_begin);
+			const std::uint64_t byte_offset = line_offset_ + static_cast<std::uint64_t>(line_begin - begin);
+
+			if (report_binary_) {
+				line_number_ = line_number;
+				reportBinary(byte_offset, line_begin, line_end);
+				return;
+			}
+			reportContextBefore(begin, first_line, position, line_begin, line_number);
+			line_number_ = line_number;
+			matcher_.reportPatterns(line_begin, line_end, [&](std::uint32_t pattern) {
+				output_(line_number_, byte_offset, line_begin, line_end, pattern);
+			});
+			reported_end_ = line_number_ + 1;
+			after_pending_ = after_context_;
+			if (output_.done()) {
+				done_ = true;
+				return;
+			}
+
+			if (line_end == end) {
+				return;
+			}
+			position = line_end + 1;
+			++line_number_;
+		}
+
+		line_number_ += countNewlines(position, end);
+	}
+
+	/**
+	 * Reports the context lines still due after the last match, from the start of a line up to a limit.
+	 *
+	 * @return The start of the line after the last one reported.
+	 */
+	const char* reportContextAfter(const char* begin, const char* position, const char* limit) {
+		while (after_pending_ > 0 && position < limit) {
+			const char* line_end = static_cast<const char*>(std::memchr(position, '\n', limit - position));
+			line_end = line_end == nullptr ? limit : line_end;
+			output_.context(line_number_, line_offset_ + static_cast<std::uint64_t>(position - begin), position, line_end);
+			--after_pending_;
+			reported_end_ = line_number_ + 1;
+			if (line_end == limit) {
+				return limit;
+			}
+			position = line_end + 1;
+			++line_number_;
+		}
+		return position;
+	}
+
+	/**
+	 * Reports the context lines before a match that were not reported yet, from the run back to the
+	 * position and, at the start of the run, from the lines kept of the blocks before.
+	 */
+	void reportContextBefore(const char* begin, std::size_t first_line, const char* position, const char* line_begin, std::size_t line_number) {
+		const std::size_t wanted = std::min(before_context_, line_number - reported_end_);
+		if (wanted == 0) {
+			return;
+		}
+		std::size_t lines = 0;
+		const char* start = findLastLines(position, line_begin, wanted, lines);
+		if (lines < wanted && start == begin && !history_.empty()) {
+			const char* history_end = history_.data() + history_.size();
+			std::size_t history_lines = 0;
+			const char* history_start = findLastLines(history_.data(), history_end, wanted - lines, history_lines);
+			reportContextLines(history_start, history_end, first_line - history_lines, line_offset_ - static_cast<std::uint64_t>(history_end - history_start));
+		}
+		reportContextLines(start, line_begin, line_number - lines, line_offset_ + static_cast<std::uint64_t>(start - begin));
+	}
+
+	/**
+	 * Reports every line of a run of complete lines as a context line.
+	 */
+	void reportContextLines(const char* begin, const char* end, std::size_t line_number, std::uint64_t byte_offset) {
+		for (const char* line_begin = begin; line_begin < end; ++line_number) {
+			const char* line_end = static_cast<const char*>(std::memchr(line_begin, '\n', end - line_begin));
+			output_.context(line_number, byte_offset + static_cast<std::uint64_t>(line_begin - begin), line_begin, line_end);
+			line_begin = line_end + 1;
+		}
+	}
+
+	/**
+	 * Reports the first match of a binary file, once with the first pattern found in the line, and
+	 * ends the search of the file.
+	 */
+	void reportBinary(std::uint64_t byte_offset, const char* line_begin, const char* line_end) {
+		bool reported = false;
+		matcher_.reportPatterns(line_begin, line_end, [&](std::uint32_t pattern) {
+			if (!reported) {
+				output_(line_number_, byte_offset, binary_match_line.data(), binary_match_line.data() + binary_match_line.size(), pattern);
+				reported = true;
+			}
+		});
+		done_ = true;
+	}
+
+	const Matcher& matcher_;
+	Output output_;
+};
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef SPECIFIC_GREP_CANCEL_TOKEN_H
+#define SPECIFIC_GREP_CANCEL_TOKEN_H
+
+#include <atomic>
+
+/**
+ * Cancels the search it is handed to, see SearchHooks::cancel: the workers stop at their next block or
+ * match, and no further file is searched. A token belongs to a single search, so a cancel that comes
+ * late does not reach a later one, and a cancel before the search starts cancels it as soon as it does.
+ * Safe to call from any thread, and from the callback of the search.
+ */
+class CancelToken {
+public:
+	void cancel() {
+		cancelled_.store(true, std::memory_order_relaxed);
+	}
+
+	bool cancelled() const {
+		return cancelled_.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<bool> cancelled_{ false };
+};
+
+#endif
@@ -0,0 +1,193 @@
+#include "case_folding.h"
+
+#include <algorithm>
+
+namespace {
+	/**
+	 * Decodes the UTF-8 character at the start of some text.
+	 *
+	 * @return The length of the encoding, or 0 if the text does not start with a valid multibyte character.
+	 */
+	std::size_t decodeUtf8(const char* begin, const char* end, char32_t& code_point) {
+		const unsigned char lead = static_cast<unsigned char>(*begin);
+		std::size_t length;
+		if (lead >= 0xC2 && lead <= 0xDF) {
+			length = 2;
+			code_point = lead & 0x1F;
+		}
+		else if (lead >= 0xE0 && lead <= 0xEF) {
+			length = 3;
+			code_point = lead & 0x0F;
+		}
+		else if (lead >= 0xF0 && lead <= 0xF4) {
+			length = 4;
+			code_point = lead & 0x07;
+		}
+		else {
+			return 0;
+		}
+		if (static_cast<std::size_t>(end - begin) < length) {
+			return 0;
+		}
+		for (std::size_t i = 1; i < length; ++i) {
+			const unsigned char byte = static_cast<unsigned char>(begin[i]);
+			if ((byte & 0xC0) != 0x80) {
+				return 0;
+			}
+			code_point = (code_point << 6) | (byte & 0x3F);
+		}
+		return length;
+	}
+
+	std::string encodeUtf8(char32_t code_point) {
+		std::string encoding;
+		if (code_point < 0x800) {
+			encoding += static_cast<char>(0xC0 | (code_point >> 6));
+		}
+		else if (code_point < 0x10000) {
+			encoding += static_cast<char>(0xE0 | (code_point >> 12));
+			encoding += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+		}
+		else {
+			encoding += static_cast<char>(0xF0 | (code_point >> 18));
+			encoding += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+			encoding += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+		}
+		encoding += static_cast<char>(0x80 | (code_point & 0x3F));
+		return encoding;
+	}
+
+	/**
+	 * @return The other case of a letter outside ASCII, or 0 if it has none.
+	 */
+	char32_t otherCase(char32_t c) {
+		// Whole alphabets whose upper and lower case are a fixed distance apart.
+		if ((c >= 0x00C0 && c <= 0x00DE && c != 0x00D7) || (c >= 0x0391 && c <= 0x03AB && c != 0x03A2) || (c >= 0x0410 && c <= 0x042F) || (c >= 0xFF21 && c <= 0xFF3A)) {
+			return c + 0x20;
+		}
+		if ((c >= 0x00E0 && c <= 0x00FE && c != 0x00F7) || (c >= 0x03B1 && c <= 0x03CB && c != 0x03C2) || (c >= 0x0430 && c <= 0x044F) || (c >= 0xFF41 && c <= 0xFF5A)) {
+			return c - 0x20;
+		}
+		if (c >= 0x0400 && c <= 0x040F) {
+			return c + 0x50;
+		}
+		if (c >= 0x0450 && c <= 0x045F) {
+			return c - 0x50;
+		}
+		if (c >= 0x0531 && c <= 0x0556) {
+			return c + 0x30;
+		}
+		if (c >= 0x0561 && c <= 0x0586) {
+			return c - 0x30;
+		}
+
+		// Runs of letters paired upper case first, on an even code point.
+		if ((c >= 0x0100 && c <= 0x012F) || (c >= 0x0132 && c <= 0x0137) || (c >= 0x014A && c <= 0x0177) || (c >= 0x0460 && c <= 0x0481) || (c >= 0x048A && c <= 0x04BF) || (c >= 0x04D0 && c <= 0x052F) || (c >= 0x1E00 && c <= 0x1E95) || (c >= 0x1EA0 && c <= 0x1EFF)) {
+			return c ^ 1;
+		}
+		// Runs of letters paired upper case first, on an odd code point.
+		if ((c >= 0x0139 && c <= 0x0148) || (c >= 0x0179 && c <= 0x017E) || (c >= 0x04C1 && c <= 0x04CE)) {
+			return (c & 1) != 0 ? c + 1 : c - 1;
+		}
+
+		// The odd ones out.
+		switch (c) {
+			case 0x00FF: return 0x0178;
+			case 0x0178: return 0x00FF;
+			case 0x0386: return 0x03AC;
+			case 0x03AC: return 0x0386;
+			case 0x0388: case 0x0389: case 0x038A: return c + 0x25;
+			case 0x03AD: case 0x03AE: case 0x03AF: return c - 0x25;
+			case 0x038C: return 0x03CC;
+			case 0x03CC: return 0x038C;
+			case 0x038E: case 0x038F: return c + 0x3F;
+			case 0x03CD: case 0x03CE: return c - 0x3F;
+			case 0x04C0: return 0x04CF;
+			case 0x04CF: return 0x04C0;
+			default: return 0;
+		}
+	}
+}
+
+
+std::string foldAscii(std::string text) {
+	for (char& c : text) {
+		c = foldAscii(c);
+	}
+	return text;
+}
+
+
+bool hasNonAscii(const std::string& text) {
+	return std::any_of(text.begin(), text.end(), [](char c) { return static_cast<unsigned char>(c) >= 0x80; });
+}
+
+
+std::vector<std::string> utf8CaseVariants(const char* begin, const char* end, std::size_t& length) {
+	length = 1;
+	char32_t code_point;
+	const std::size_t encoding_length = decodeUtf8(begin, end, code_point);
+	if (encoding_length == 0) {
+		return {};
+	}
+	length = encoding_length;
+
+	// The Greek sigma has two lower cases, the final one is used at the end of words.
+	if (code_point == 0x03A3 || code_point == 0x03C2 || code_point == 0x03C3) {
+		std::vector<std::string> variants{std::string(begin, length)};
+		for (const char32_t sigma : {0x03A3, 0x03C2, 0x03C3}) {
+			if (sigma != code_point) {
+				variants.push_back(encodeUtf8(sigma));
+			}
+		}
+		return variants;
+	}
+
+	const char32_t other = otherCase(code_point);
+	if (other == 0) {
+		return {};
+	}
+	return {std::string(begin, length), encodeUtf8(other)};
+}
+
+
+std::vector<std::string> caseVariants(const std::string& text, std::size_t limit) {
+	std::vector<std::string> variants{std::string()};
+	const char* position = text.data();
+	const char* const end = text.data() + text.size();
+	while (position < end) {
+		if (static_cast<unsigned char>(*position) < 0x80) {
+			for (std::string& variant : variants) {
+				variant += foldAscii(*position);
+			}
+			++position;
+			continue;
+		}
+
+		std::size_t length;
+		const std::vector<std::string> cases = utf8CaseVariants(position, end, length);
+		if (!cases.empty() && variants.size() * cases.size() > limit) {
+			return {};
+		}
+		if (cases.empty()) {
+			for (std::string& variant : variants) {
+				variant.append(position, length);
+			}
+		}
+		else {
+			std::vector<std::string> expanded;
+			expanded.reserve(variants.size() * cases.size());
+			for (const std::string& variant : variants) {
+				for (const std::string& letter_case : cases) {
+					expanded.push_back(variant + letter_case);
+				}
+			}
+			variants = std::move(expanded);
+		}
+		position += length;
+	}
+
+	std::sort(variants.begin(), variants.end());
+	variants.erase(std::unique(variants.begin(), variants.end()), variants.end());
+	return variants;
+}
@@ -0,0 +1,79 @@
+#ifndef SPECIFIC_GREP_CASE_FOLDING_H
+#define SPECIFIC_GREP_CASE_FOLDING_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Case folding for the case-insensitive search.
+ *
+ * ASCII letters are folded to lower case, which the kernels do in-register by setting the case bit
+ * (0x20) of the bytes they compare against a letter. Letters outside ASCII have UTF-8 encodings of
+ * two or three bytes whose cases do not differ by a single bit, so instead of folding the content,
+ * the patterns are expanded into the encodings of all cases of their letters. The simple case mapping
+ * of the Latin, Greek, Cyrillic and Armenian scripts is covered.
+ */
+
+/**
+ * @return True if the byte is an ASCII letter.
+ */
+inline bool isAsciiLetter(unsigned char byte) {
+	return (byte | 0x20) >= 'a' && (byte | 0x20) <= 'z';
+}
+
+/**
+ * @return The byte with an ASCII upper case letter folded to lower case.
+ */
+inline char foldAscii(char c) {
+	return c >= 'A' && c <= 'Z' ? static_cast<char>(c | 0x20) : c;
+}
+
+/**
+ * Compares text with a folded string, ignoring the case of ASCII letters.
+ *
+ * @param text The text to compare.
+ * @param folded The string to compare with, with its ASCII letters in lower case.
+ * @param size The number of bytes to compare.
+ * @return True if the text equals the string but for the case of ASCII letters.
+ */
+inline bool equalsFolded(const char* text, const char* folded, std::size_t size) {
+	for (std::size_t i = 0; i < size; ++i) {
+		if (foldAscii(text[i]) != folded[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @return The string with its ASCII letters folded to lower case.
+ */
+std::string foldAscii(std::string text);
+
+/**
+ * @return True if the string has any byte outside ASCII.
+ */
+bool hasNonAscii(const std::string& text);
+
+/**
+ * Gives the UTF-8 encodings of all cases of the character at the start of some text.
+ *
+ * @param begin The start of the text.
+ * @param end The end of the text.
+ * @param length Set to the length of the character's encoding, 1 if the text does not start with a valid UTF-8 character outside ASCII.
+ * @return The encodings of all cases of the character, starting with the character itself, or nothing if it has no other case.
+ */
+std::vector<std::string> utf8CaseVariants(const char* begin, const char* end, std::size_t& length);
+
+/**
+ * Expands a string into its case variants: the ASCII letters are folded to lower case, and every
+ * letter outside ASCII is replaced with each of its cases in turn.
+ *
+ * @param text The string to expand.
+ * @param limit The most variants to give.
+ * @return The variants, without duplicates, or nothing if the string has more than limit of them.
+ */
+std::vector<std::string> caseVariants(const std::string& text, std::size_t limit);
+
+#endif
@@ -0,0 +1,24 @@
+#include "cpu_features.h"
+
+
+bool cpuHasAvx2() {
+#if defined(SPECIFIC_GREP_HAVE_AVX2)
+	// The feature flags may be queried from static initializers, before the runtime has filled them in.
+	__builtin_cpu_init();
+	static const bool has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi") && __builtin_cpu_supports("popcnt");
+	return has_avx2;
+#else
+	return false;
+#endif
+}
+
+
+bool cpuHasSsse3() {
+#if defined(SPECIFIC_GREP_HAVE_AVX2)
+	__builtin_cpu_init();
+	static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+	return has_ssse3;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,56 @@
+#ifndef SPECIFIC_GREP_CPU_FEATURES_H
+#define SPECIFIC_GREP_CPU_FEATURES_H
+
+// Vector instruction sets the kernels can be compiled for.
+#if defined(__x86_64__) || defined(_M_X64)
+#define SPECIFIC_GREP_X86_64 1
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SPECIFIC_GREP_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Compiles a single function for AVX2 without requiring it of the whole program.
+#if defined(SPECIFIC_GREP_X86_64) && (defined(__GNUC__) || defined(__clang__))
+#define SPECIFIC_GREP_HAVE_AVX2 1
+#define SPECIFIC_GREP_TARGET_AVX2 __attribute__((target("avx2,bmi,popcnt")))
+#define SPECIFIC_GREP_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+
+/**
+ * @return True if the CPU supports the AVX2 kernels.
+ */
+bool cpuHasAvx2();
+
+/**
+ * @return True if the CPU supports the SSSE3 kernels.
+ */
+bool cpuHasSsse3();
+
+/**
+ * @return The index of the lowest set bit of a non-zero mask.
+ */
+inline int lowestBit(unsigned int mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return static_cast<int>(index);
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+/**
+ * @return The index of the lowest set bit of a non-zero 64-bit mask.
+ */
+inline int lowestBit64(unsigned long long mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+	unsigned long index;
+	_BitScanForward64(&index, mask);
+	return static_cast<int>(index);
+#else
+	return __builtin_ctzll(mask);
+#endif
+}
+
+#endif
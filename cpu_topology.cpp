@@ -0,0 +1,195 @@
+#include "cpu_topology.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+	// The number of threads when the system does not tell its number of CPUs.
+	constexpr std::size_t fallback_cpu_count = 4;
+
+#ifdef __linux__
+	/**
+	 * @return The CPUs the program may run on, in ascending order, or nothing if the system does not tell.
+	 */
+	std::vector<unsigned int> allowedCpus() {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		std::vector<unsigned int> cpus;
+		if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+			return cpus;
+		}
+		for (unsigned int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+			if (CPU_ISSET(cpu, &set)) {
+				cpus.push_back(cpu);
+			}
+		}
+		return cpus;
+	}
+
+	/**
+	 * Parses a list of CPUs in the format of the kernel, such as "0-3,8,10-11".
+	 *
+	 * @return The CPUs of the list.
+	 */
+	std::vector<unsigned int> parseCpuList(const std::string& list) {
+		std::vector<unsigned int> cpus;
+		std::size_t position = 0;
+		while (position < list.size()) {
+			std::size_t end = list.find(',', position);
+			if (end == std::string::npos) {
+				end = list.size();
+			}
+			const std::string range = list.substr(position, end - position);
+			position = end + 1;
+			unsigned int first = 0;
+			unsigned int last = 0;
+			const int fields = std::sscanf(range.c_str(), "%u-%u", &first, &last);
+			if (fields < 1) {
+				continue;
+			}
+			if (fields == 1) {
+				last = first;
+			}
+			for (unsigned int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+				cpus.push_back(cpu);
+			}
+		}
+		return cpus;
+	}
+
+	/**
+	 * @param allowed The CPUs the program may run on, in ascending order.
+	 * @return The CPUs of every NUMA node the program may run on, in the order of the nodes, without the nodes it may not run on.
+	 */
+	std::vector<std::vector<unsigned int>> numaNodes(const std::vector<unsigned int>& allowed) {
+		std::vector<std::pair<unsigned int, std::vector<unsigned int>>> nodes;
+		std::error_code error;
+		for (const auto& entry : fs::directory_iterator("/sys/devices/system/node", error)) {
+			const std::string name = entry.path().filename().string();
+			if (name.size() <= 4 || name.compare(0, 4, "node") != 0 || name.find_first_not_of("0123456789", 4) != std::string::npos) {
+				continue;
+			}
+			std::ifstream file(entry.path() / "cpulist");
+			std::string list;
+			std::getline(file, list);
+			std::vector<unsigned int> cpus;
+			for (const unsigned int cpu : parseCpuList(list)) {
+				if (std::binary_search(allowed.begin(), allowed.end(), cpu)) {
+					cpus.push_back(cpu);
+				}
+			}
+			if (!cpus.empty()) {
+				nodes.emplace_back(static_cast<unsigned int>(std::stoul(name.substr(4))), std::move(cpus));
+			}
+		}
+		std::sort(nodes.begin(), nodes.end());
+
+		std::vector<std::vector<unsigned int>> node_cpus;
+		for (auto& node : nodes) {
+			node_cpus.push_back(std::move(node.second));
+		}
+		if (node_cpus.empty()) {
+			node_cpus.push_back(allowed);
+		}
+		return node_cpus;
+	}
+#endif
+}
+
+
+bool parsePinMode(const std::string& name, PinMode& pin_mode) {
+	if (name == "none") {
+		pin_mode = PinMode::None;
+	}
+	else if (name == "cpu") {
+		pin_mode = PinMode::Cpu;
+	}
+	else if (name == "node") {
+		pin_mode = PinMode::Node;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+
+std::size_t availableCpuCount() {
+#ifdef __linux__
+	// Fewer CPUs than the machine has may be allowed, as in a container or under taskset.
+	const std::size_t allowed = allowedCpus().size();
+	if (allowed > 0) {
+		return allowed;
+	}
+#endif
+	const std::size_t cpus = std::thread::hardware_concurrency();
+	return cpus > 0 ? cpus : fallback_cpu_count;
+}
+
+
+std::vector<std::vector<unsigned int>> planWorkerCpus(PinMode pin_mode, std::size_t worker_count) {
+	std::vector<std::vector<unsigned int>> plan;
+#ifdef __linux__
+	if (pin_mode == PinMode::None || worker_count == 0) {
+		return plan;
+	}
+	const std::vector<unsigned int> allowed = allowedCpus();
+	if (allowed.empty()) {
+		return plan;
+	}
+	const std::vector<std::vector<unsigned int>> nodes = numaNodes(allowed);
+
+	if (pin_mode == PinMode::Node) {
+		if (nodes.size() < 2) {
+			return plan;
+		}
+		// The workers with neighbouring indices share a node, so that they steal from each other first.
+		for (std::size_t i = 0; i < worker_count; ++i) {
+			plan.push_back(nodes[i * nodes.size() / worker_count]);
+		}
+		return plan;
+	}
+
+	// The CPUs in the order of their nodes, so that the workers of a node are neighbours too.
+	std::vector<unsigned int> cpus;
+	for (const auto& node : nodes) {
+		cpus.insert(cpus.end(), node.begin(), node.end());
+	}
+	for (std::size_t i = 0; i < worker_count; ++i) {
+		plan.push_back({ cpus[i % cpus.size()] });
+	}
+#else
+	if (pin_mode != PinMode::None) {
+		std::cerr << "Warning: threads cannot be pinned on this system, they run wherever the system puts them." << std::endl;
+	}
+#endif
+	return plan;
+}
+
+
+void pinCurrentThread(const std::vector<unsigned int>& cpus) {
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (const unsigned int cpu : cpus) {
+		CPU_SET(cpu, &set);
+	}
+	if (sched_setaffinity(0, sizeof(set), &set) == 0) {
+		return;
+	}
+#endif
+	static std::once_flag warning;
+	std::call_once(warning, [] { std::cerr << "Warning: a worker thread could not be pinned to its CPUs, it runs wherever the system puts it." << std::endl; });
+}
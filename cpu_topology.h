@@ -0,0 +1,54 @@
+#ifndef SPECIFIC_GREP_CPU_TOPOLOGY_H
+#define SPECIFIC_GREP_CPU_TOPOLOGY_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Where the worker threads of a pool may run.
+ */
+enum class PinMode {
+	// Wherever the system puts them.
+	None,
+	// Each on a CPU of its own, as far as there are CPUs; the workers on the same NUMA node are neighbours.
+	Cpu,
+	// Each on the CPUs of one NUMA node, the workers spread over the nodes in equal shares.
+	Node
+};
+
+/**
+ * Parses the name of a pin mode ("none", "cpu" or "node").
+ *
+ * @param name The name of the pin mode.
+ * @param pin_mode Receives the pin mode.
+ * @return True on success, false if the name is unknown.
+ */
+bool parsePinMode(const std::string& name, PinMode& pin_mode);
+
+/**
+ * @return The number of CPUs the program may run on, the default number of worker threads. At least 1.
+ */
+std::size_t availableCpuCount();
+
+/**
+ * Plans the CPUs of the workers of a pool. The CPUs are the ones the program may run on, and the
+ * NUMA nodes are read from /sys/devices/system/node; a machine without nodes is a single node.
+ *
+ * @param pin_mode Where the workers may run.
+ * @param worker_count The number of workers.
+ * @return The CPUs every worker may run on, by the index of the worker, or nothing if the workers
+ *         are not pinned: with PinMode::None, with PinMode::Node on a single node, or where threads
+ *         cannot be pinned.
+ */
+std::vector<std::vector<unsigned int>> planWorkerCpus(PinMode pin_mode, std::size_t worker_count);
+
+/**
+ * Pins the calling thread to a set of CPUs. A thread that fails to be pinned runs on, and the first
+ * failure is warned about.
+ *
+ * @param cpus The CPUs the thread may run on.
+ */
+void pinCurrentThread(const std::vector<unsigned int>& cpus);
+
+#endif
@@ -0,0 +1,155 @@
+#include "decompressor.h"
+
+#include <cstdint>
+#include <iostream>
+
+#ifdef SPECIFIC_GREP_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef SPECIFIC_GREP_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+#ifdef SPECIFIC_GREP_HAVE_ZLIB
+	class GzipDecompressor final : public Decompressor {
+	public:
+		GzipDecompressor() {
+			// 15 is the largest window, 16 selects the gzip header.
+			valid_ = inflateInit2(&stream_, 15 + 16) == Z_OK;
+		}
+
+		~GzipDecompressor() override {
+			if (valid_) {
+				inflateEnd(&stream_);
+			}
+		}
+
+		bool feed(const char* data, std::size_t size, BufferScanner& scanner) override {
+			if (!valid_) {
+				return false;
+			}
+			stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+			stream_.avail_in = static_cast<uInt>(size);
+
+			// Go on while there is input left, or the output was full and inflate may hold back more.
+			bool output_full = false;
+			while ((stream_.avail_in > 0 || output_full) && !scanner.done()) {
+				stream_.next_out = reinterpret_cast<Bytef*>(output_.data());
+				stream_.avail_out = static_cast<uInt>(output_.size());
+				const int result = inflate(&stream_, Z_NO_FLUSH);
+				const std::size_t produced = output_.size() - stream_.avail_out;
+				output_full = stream_.avail_out == 0;
+				if (produced > 0) {
+					scanner.feed(output_.data(), produced);
+				}
+
+				if (result == Z_STREAM_END) {
+					// Another stream may follow the one that ended.
+					complete_ = true;
+					if (stream_.avail_in > 0 && inflateReset(&stream_) != Z_OK) {
+						return false;
+					}
+					continue;
+				}
+				if (result == Z_BUF_ERROR) {
+					break;
+				}
+				if (result != Z_OK) {
+					return false;
+				}
+				complete_ = false;
+			}
+			return true;
+		}
+
+		bool complete() const override {
+			return complete_;
+		}
+
+	private:
+		z_stream stream_{};
+		bool valid_ = false;
+		bool complete_ = false;
+	};
+#endif
+
+#ifdef SPECIFIC_GREP_HAVE_ZSTD
+	class ZstdDecompressor final : public Decompressor {
+	public:
+		ZstdDecompressor() : stream_(ZSTD_createDStream()) {
+		}
+
+		~ZstdDecompressor() override {
+			ZSTD_freeDStream(stream_);
+		}
+
+		bool feed(const char* data, std::size_t size, BufferScanner& scanner) override {
+			if (stream_ == nullptr) {
+				return false;
+			}
+			ZSTD_inBuffer input{data, size, 0};
+
+			// Go on while there is input left, or the output was full and the stream may hold back more.
+			bool output_full = false;
+			while ((input.pos < input.size || output_full) && !scanner.done()) {
+				ZSTD_outBuffer output{output_.data(), output_.size(), 0};
+				const std::size_t result = ZSTD_decompressStream(stream_, &output, &input);
+				if (ZSTD_isError(result)) {
+					return false;
+				}
+				output_full = output.pos == output.size;
+				if (output.pos > 0) {
+					scanner.feed(output_.data(), output.pos);
+				}
+				// A frame is complete once the stream asks for no more input, another frame may follow it.
+				complete_ = result == 0;
+			}
+			return true;
+		}
+
+		bool complete() const override {
+			return complete_;
+		}
+
+	private:
+		ZSTD_DStream* stream_;
+		bool complete_ = false;
+	};
+#endif
+}
+
+
+Compression detectCompression(const char* data, std::size_t size) {
+	if (size < 4) {
+		return Compression::None;
+	}
+	const auto* bytes = reinterpret_cast<const unsigned char*>(data);
+	// The gzip magic and the deflate method, which is the only one in use.
+	if (bytes[0] == 0x1f && bytes[1] == 0x8b && bytes[2] == 0x08) {
+		return Compression::Gzip;
+	}
+	if (bytes[0] == 0x28 && bytes[1] == 0xb5 && bytes[2] == 0x2f && bytes[3] == 0xfd) {
+		return Compression::Zstd;
+	}
+	return Compression::None;
+}
+
+
+void warnDamagedFile(const std::filesystem::path& file_path) {
+	std::cerr << "Warning: the compressed file " << file_path.string() << " is truncated or corrupt, it was searched up to the damage." << std::endl;
+}
+
+
+std::unique_ptr<Decompressor> Decompressor::create(Compression compression) {
+	switch (compression) {
+#ifdef SPECIFIC_GREP_HAVE_ZLIB
+		case Compression::Gzip: return std::make_unique<GzipDecompressor>();
+#endif
+#ifdef SPECIFIC_GREP_HAVE_ZSTD
+		case Compression::Zstd: return std::make_unique<ZstdDecompressor>();
+#endif
+		default: return nullptr;
+	}
+}
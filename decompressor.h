@@ -0,0 +1,83 @@
+#ifndef SPECIFIC_GREP_DECOMPRESSOR_H
+#define SPECIFIC_GREP_DECOMPRESSOR_H
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "buffer_scanner.h"
+
+/**
+ * The formats of compressed files that are searched decompressed, told apart by their magic bytes.
+ */
+enum class Compression {
+	None,
+	Gzip,
+	Zstd
+};
+
+/**
+ * Tells whether content starts like a compressed file.
+ *
+ * @param data The start of the content.
+ * @param size The size of the start of the content that is available, at least 4 bytes to be recognized.
+ * @return The format of the content, Compression::None for any other content.
+ */
+Compression detectCompression(const char* data, std::size_t size);
+
+/**
+ * Warns that a compressed file is truncated or corrupt, and was only searched up to the damage.
+ *
+ * @param file_path The path of the file.
+ */
+void warnDamagedFile(const std::filesystem::path& file_path);
+
+/**
+ * Decompresses a compressed file as it is read, and passes the content on to a scanner in blocks,
+ * so a compressed file is searched in one pass without ever being written out.
+ *
+ * Gzip files are decompressed with zlib if the program is built with SPECIFIC_GREP_HAVE_ZLIB, and
+ * zstd files with libzstd if it is built with SPECIFIC_GREP_HAVE_ZSTD. Files made of several
+ * compressed streams one after another, as appending to a compressed log does, are decompressed
+ * in full.
+ */
+class Decompressor {
+public:
+	virtual ~Decompressor() = default;
+
+	/**
+	 * Creates a decompressor.
+	 *
+	 * @param compression The format of the content.
+	 * @return The decompressor, or nullptr if the program is built without support for the format.
+	 */
+	static std::unique_ptr<Decompressor> create(Compression compression);
+
+	/**
+	 * Decompresses the next block of the compressed content and passes the result to the scanner,
+	 * until the scanner is done.
+	 *
+	 * @param data The start of the block.
+	 * @param size The size of the block in bytes.
+	 * @param scanner The scanner to pass the content to.
+	 * @return True on success, false if the content is corrupt. The scanner gets everything up to the corruption.
+	 */
+	virtual bool feed(const char* data, std::size_t size, BufferScanner& scanner) = 0;
+
+	/**
+	 * @return True if the content read so far ends with a complete compressed stream.
+	 */
+	virtual bool complete() const = 0;
+
+protected:
+	Decompressor() : output_(block_size) {
+	}
+
+	// Size of the blocks the decompressed content is passed on in.
+	static constexpr std::size_t block_size = 256 * 1024;
+
+	std::vector<char> output_;
+};
+
+#endif
@@ -0,0 +1,159 @@
+#include "directory_walker.h"
+
+#include <iostream>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "search_stats.h"
+
+namespace fs = std::filesystem;
+
+
+DirectoryWalker::DirectoryWalker(TaskScheduler& scheduler, const PathFilter* filter) : scheduler_(scheduler), filter_(filter) {
+}
+
+
+void DirectoryWalker::walk(const fs::path& root, const FileCallback& on_file) {
+	scheduler_.submit([this, root, &on_file](std::size_t worker_index) {
+		walkDirectory(root, std::string(), nullptr, on_file, worker_index);
+	});
+}
+
+
+void DirectoryWalker::setDirectoryCallback(const DirectoryCallback* on_directory) {
+	on_directory_ = on_directory;
+}
+
+
+#ifndef _WIN32
+
+/**
+ * Lists one directory with readdir(), reports its regular files and submits a task for each subdirectory.
+ *
+ * @param directory The directory to list.
+ * @param relative_path The path of the directory relative to the root of the walk, for the filter.
+ * @param parent_rules The filter's rules in effect in the parent directory.
+ * @param on_file The callback to report regular files to.
+ * @param worker_index The index of the worker listing the directory.
+ */
+void DirectoryWalker::walkDirectory(const fs::path& directory, const std::string& relative_path, const PathFilter::Rules& parent_rules, const FileCallback& on_file, std::size_t worker_index) {
+	const StageTimer timer(SearchStage::Walk);
+	DIR* handle = opendir(directory.c_str());
+	if (handle == nullptr) {
+		std::cerr << "Error: could not open directory " << directory.string() << std::endl;
+		return;
+	}
+	if (on_directory_ != nullptr) {
+		(*on_directory_)(directory);
+	}
+	const PathFilter::Rules rules = filter_ != nullptr ? filter_->enterDirectory(parent_rules, directory, relative_path) : nullptr;
+
+	while (const dirent* entry = readdir(handle)) {
+		// Skip the entries for the directory itself and its parent.
+		const char* name = entry->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+			continue;
+		}
+
+		fs::path entry_path = directory / name;
+		unsigned char type = entry->d_type;
+
+		// Some file systems do not report the type, so look it up without following links.
+		if (type == DT_UNKNOWN) {
+			struct stat status;
+			if (lstat(entry_path.c_str(), &status) != 0) {
+				continue;
+			}
+			type = S_ISDIR(status.st_mode) ? DT_DIR : S_ISREG(status.st_mode) ? DT_REG : S_ISLNK(status.st_mode) ? DT_LNK : DT_UNKNOWN;
+		}
+
+		// A symbolic link counts as a regular file if its target is one; linked directories are not descended into.
+		if (type == DT_LNK) {
+			struct stat status;
+			if (stat(entry_path.c_str(), &status) != 0 || !S_ISREG(status.st_mode)) {
+				continue;
+			}
+			type = DT_REG;
+		}
+		if (type != DT_DIR && type != DT_REG) {
+			continue;
+		}
+
+		// Leave out what the filter excludes, a directory with everything below it.
+		std::string entry_relative_path;
+		if (filter_ != nullptr) {
+			entry_relative_path = relative_path.empty() ? std::string(name) : relative_path + '/' + name;
+			if (filter_->excludes(rules, entry_relative_path, name, type == DT_DIR)) {
+				continue;
+			}
+		}
+
+		if (type == DT_DIR) {
+			scheduler_.submit([this, subdirectory = std::move(entry_path), subdirectory_relative_path = std::move(entry_relative_path), rules, &on_file](std::size_t subdirectory_worker) {
+				walkDirectory(subdirectory, subdirectory_relative_path, rules, on_file, subdirectory_worker);
+			});
+		}
+		else {
+			on_file(entry_path, worker_index);
+		}
+	}
+
+	closedir(handle);
+}
+
+#else
+
+/**
+ * Lists one directory, reports its regular files and submits a task for each subdirectory.
+ * The directory iterator on Windows fills in the file type from the listing itself.
+ *
+ * @param directory The directory to list.
+ * @param relative_path The path of the directory relative to the root of the walk, for the filter.
+ * @param parent_rules The filter's rules in effect in the parent directory.
+ * @param on_file The callback to report regular files to.
+ * @param worker_index The index of the worker listing the directory.
+ */
+void DirectoryWalker::walkDirectory(const fs::path& directory, const std::string& relative_path, const PathFilter::Rules& parent_rules, const FileCallback& on_file, std::size_t worker_index) {
+	const StageTimer timer(SearchStage::Walk);
+	std::error_code error;
+	fs::directory_iterator iterator(directory, error);
+	if (error) {
+		std::cerr << "Error: could not open directory " << directory.string() << std::endl;
+		return;
+	}
+	if (on_directory_ != nullptr) {
+		(*on_directory_)(directory);
+	}
+	const PathFilter::Rules rules = filter_ != nullptr ? filter_->enterDirectory(parent_rules, directory, relative_path) : nullptr;
+
+	for (const auto& entry : iterator) {
+		const bool is_directory = entry.is_directory(error) && !entry.is_symlink(error);
+		if (!is_directory && !entry.is_regular_file(error)) {
+			continue;
+		}
+
+		// Leave out what the filter excludes, a directory with everything below it.
+		std::string entry_relative_path;
+		if (filter_ != nullptr) {
+			const std::string name = entry.path().filename().string();
+			entry_relative_path = relative_path.empty() ? name : relative_path + '/' + name;
+			if (filter_->excludes(rules, entry_relative_path, name, is_directory)) {
+				continue;
+			}
+		}
+
+		if (is_directory) {
+			scheduler_.submit([this, subdirectory = entry.path(), subdirectory_relative_path = std::move(entry_relative_path), rules, &on_file](std::size_t subdirectory_worker) {
+				walkDirectory(subdirectory, subdirectory_relative_path, rules, on_file, subdirectory_worker);
+			});
+		}
+		else {
+			on_file(entry.path(), worker_index);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef SPECIFIC_GREP_DIRECTORY_WALKER_H
+#define SPECIFIC_GREP_DIRECTORY_WALKER_H
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <string>
+
+#include "path_filter.h"
+#include "task_scheduler.h"
+
+/**
+ * Walks a directory tree in parallel on a task scheduler.
+ *
+ * Every directory is a separate task: it lists its entries, submits a task for each subdirectory
+ * and reports each regular file, so independent subtrees are listed by different workers at once.
+ * On POSIX systems the entries are read with readdir(), whose d_type tells regular files and
+ * directories apart without a stat per entry; only symbolic links and file systems that do not
+ * fill in d_type need a stat. Like std::filesystem::recursive_directory_iterator, the walk does
+ * not descend into symbolic links to directories but does report symbolic links to regular files.
+ * With a path filter, the entries it leaves out are dropped as they are listed, so a directory left
+ * out is never descended into.
+ */
+class DirectoryWalker {
+public:
+	/**
+	 * Called on a worker thread for every regular file found, with the index of that worker.
+	 */
+	using FileCallback = std::function<void(const std::filesystem::path&, std::size_t)>;
+
+	/**
+	 * Called on a worker thread for every directory walked, the root included, before its entries are listed.
+	 */
+	using DirectoryCallback = std::function<void(const std::filesystem::path&)>;
+
+	/**
+	 * @param scheduler The scheduler the directory tasks run on.
+	 * @param filter The filter of the entries to walk, or nullptr to walk every entry. It must stay valid until the walk is complete.
+	 */
+	explicit DirectoryWalker(TaskScheduler& scheduler, const PathFilter* filter = nullptr);
+
+	/**
+	 * Starts walking a directory tree. The walk runs on the scheduler's workers, so the call returns
+	 * right away; it is complete once TaskScheduler::wait() returns.
+	 *
+	 * @param root The directory at the top of the tree.
+	 * @param on_file The callback to report regular files to. It must stay valid until the walk is complete.
+	 */
+	void walk(const std::filesystem::path& root, const FileCallback& on_file);
+
+	/**
+	 * Sets the callback to report the directories of the following walks to, for instance to watch them for changes.
+	 *
+	 * @param on_directory The callback, which must stay valid until the walks are complete, or nullptr for none.
+	 */
+	void setDirectoryCallback(const DirectoryCallback* on_directory);
+
+private:
+	void walkDirectory(const std::filesystem::path& directory, const std::string& relative_path, const PathFilter::Rules& parent_rules, const FileCallback& on_file, std::size_t worker_index);
+
+	TaskScheduler& scheduler_;
+	const PathFilter* filter_;
+	const DirectoryCallback* on_directory_ = nullptr;
+};
+
+#endif
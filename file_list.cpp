@@ -0,0 +1,132 @@
+#include "file_list.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#ifdef SPECIFIC_GREP_HAVE_INOTIFY
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "directory_walker.h"
+
+namespace fs = std::filesystem;
+
+#ifdef SPECIFIC_GREP_HAVE_INOTIFY
+namespace {
+	// The changes to a directory that may change the list: its entries, itself, and the files written in it, for the ignore files.
+	constexpr std::uint32_t watched_events = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_CLOSE_WRITE | IN_ONLYDIR;
+}
+#endif
+
+
+FileList::FileList(fs::path root, const PathFilter* filter, TaskScheduler& scheduler) : root_(std::move(root)), filter_(filter), scheduler_(scheduler) {
+	walk();
+}
+
+
+FileList::~FileList() {
+#ifdef SPECIFIC_GREP_HAVE_INOTIFY
+	if (inotify_ >= 0) {
+		close(inotify_);
+	}
+#endif
+}
+
+
+const std::vector<fs::path>& FileList::files() {
+	if (changed()) {
+		walk();
+	}
+	return files_;
+}
+
+
+/**
+ * Reads the events of the watches since the last call.
+ *
+ * @return True if any of them may change the list, or if the tree is not watched.
+ */
+bool FileList::changed() {
+#ifdef SPECIFIC_GREP_HAVE_INOTIFY
+	if (!watching_) {
+		return true;
+	}
+
+	// Every event counts, an overflow of the queue and the end of a watch included, except for the files written that are no ignore files.
+	alignas(inotify_event) char buffer[64 * 1024];
+	bool changed = false;
+	for (;;) {
+		const ssize_t size = read(inotify_, buffer, sizeof(buffer));
+		if (size <= 0) {
+			break;
+		}
+		for (ssize_t offset = 0; offset < size;) {
+			const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+			offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+			if ((event->mask & IN_CLOSE_WRITE) != 0) {
+				const char* name = event->len > 0 ? event->name : "";
+				if (filter_ == nullptr || (std::strcmp(name, ".gitignore") != 0 && std::strcmp(name, ".ignore") != 0)) {
+					continue;
+				}
+			}
+			changed = true;
+		}
+	}
+	return changed;
+#else
+	return true;
+#endif
+}
+
+
+/**
+ * Walks the tree and watches every directory of it.
+ */
+void FileList::walk() {
+	++walk_count_;
+
+#ifdef SPECIFIC_GREP_HAVE_INOTIFY
+	// A new instance drops the watches of the last walk, whose directories may be gone by now.
+	if (inotify_ >= 0) {
+		close(inotify_);
+	}
+	inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	std::atomic<bool> all_watched = inotify_ >= 0;
+
+	// A directory is watched before it is listed, so no change made while it is listed is missed.
+	const DirectoryWalker::DirectoryCallback on_directory = [&](const fs::path& directory) {
+		if (inotify_ >= 0 && inotify_add_watch(inotify_, directory.c_str(), watched_events) < 0) {
+			all_watched.store(false, std::memory_order_relaxed);
+		}
+	};
+#endif
+
+	// Every worker collects the files it finds on its own, so the callback needs no synchronization.
+	std::vector<std::vector<fs::path>> worker_files(scheduler_.workerCount());
+	{
+		DirectoryWalker walker(scheduler_, filter_);
+#ifdef SPECIFIC_GREP_HAVE_INOTIFY
+		walker.setDirectoryCallback(&on_directory);
+#endif
+		const DirectoryWalker::FileCallback on_file = [&](const fs::path& file_path, std::size_t worker_index) {
+			worker_files[worker_index].push_back(file_path);
+		};
+		walker.walk(root_, on_file);
+		scheduler_.wait();
+	}
+
+	files_.clear();
+	for (auto& paths : worker_files) {
+		files_.insert(files_.end(), std::make_move_iterator(paths.begin()), std::make_move_iterator(paths.end()));
+	}
+
+#ifdef SPECIFIC_GREP_HAVE_INOTIFY
+	if (!all_watched && (walk_count_ == 1 || watching_)) {
+		std::cerr << "Warning: the directory " << root_.string() << " could not be watched for changes, it is walked again for every search." << std::endl;
+	}
+	watching_ = all_watched;
+#endif
+}
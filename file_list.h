@@ -0,0 +1,64 @@
+#ifndef SPECIFIC_GREP_FILE_LIST_H
+#define SPECIFIC_GREP_FILE_LIST_H
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+#include "path_filter.h"
+#include "task_scheduler.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/inotify.h>)
+#define SPECIFIC_GREP_HAVE_INOTIFY 1
+#endif
+#endif
+
+/**
+ * The regular files of a directory tree, kept in memory between searches and walked again only once
+ * the tree has changed.
+ *
+ * Every directory of the tree is watched with inotify for entries that are created, deleted or moved,
+ * and for changes to the ignore files when the filter reads them. Any such change makes the next call
+ * of files() walk the tree again; a tree that did not change is never walked again. Changes to the
+ * content of a file do not change the list, the file is read by every search anyway. Where inotify is
+ * not available, or the system runs out of watches, the tree is walked again for every search.
+ */
+class FileList {
+public:
+	/**
+	 * @param root The directory at the top of the tree.
+	 * @param filter The filter of the entries to list, or nullptr to list every file. It must outlive the list.
+	 * @param scheduler The scheduler to walk the tree on, which must be idle whenever the list is walked and outlive the list.
+	 */
+	FileList(std::filesystem::path root, const PathFilter* filter, TaskScheduler& scheduler);
+
+	~FileList();
+
+	FileList(const FileList&) = delete;
+	FileList& operator=(const FileList&) = delete;
+
+	/**
+	 * Brings the list up to date with the changes to the tree since the last call.
+	 *
+	 * @return The paths of all regular files in the tree, in no particular order.
+	 */
+	const std::vector<std::filesystem::path>& files();
+
+private:
+	bool changed();
+	void walk();
+
+	const std::filesystem::path root_;
+	const PathFilter* filter_;
+	TaskScheduler& scheduler_;
+	std::vector<std::filesystem::path> files_;
+	// The number of times the tree has been walked, to warn once when it cannot be watched.
+	std::size_t walk_count_ = 0;
+	// The inotify instance that watches every directory of the last walk, -1 if there is none.
+	int inotify_ = -1;
+	// Whether every directory of the last walk is watched.
+	bool watching_ = false;
+};
+
+#endif
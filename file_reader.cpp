@@ -0,0 +1,278 @@
+#include "file_reader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <sys/stat.h>
+#include <system_error>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#define lseek _lseeki64
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#define O_BINARY 0
+#endif
+
+#include "decompressor.h"
+#include "search_stats.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+	// Size of the blocks the line that runs over the end of a range is read in.
+	constexpr std::size_t line_tail_size = 4096;
+
+	/**
+	 * Opens a file for reading, counted in the statistics of the thread.
+	 *
+	 * @return The file descriptor, or -1 if the file could not be opened.
+	 */
+	int openFile(const fs::path& file_path) {
+		const StageTimer timer(SearchStage::Open);
+		const int file = open(file_path.c_str(), O_RDONLY | O_BINARY);
+		if (WorkerStats* stats = currentStats()) {
+			++(file < 0 ? stats->open_failures : stats->files_opened);
+		}
+		return file;
+	}
+
+	/**
+	 * Reads the next block of a file, counted in the statistics of the thread.
+	 *
+	 * @return The number of bytes read, 0 at the end of the file, or -1 on error.
+	 */
+	auto readBlock(int file, char* buffer, std::size_t size) {
+		const StageTimer timer(SearchStage::Read);
+		const auto bytes_read = read(file, buffer, static_cast<unsigned int>(size));
+		if (WorkerStats* stats = currentStats(); stats != nullptr && bytes_read > 0) {
+			stats->bytes_read += static_cast<std::uint64_t>(bytes_read);
+		}
+		return bytes_read;
+	}
+
+	/**
+	 * @return The buffer the calling thread reads all of its files into.
+	 */
+	std::vector<char>& threadBuffer() {
+		thread_local std::vector<char> buffer(read_block_size);
+		return buffer;
+	}
+
+	/**
+	 * Reads an open file block by block and feeds every block to the scanner, decompressed if the
+	 * first block shows that the file is compressed.
+	 *
+	 * @return True on success, false if the file could not be read to its end.
+	 */
+	bool readBlocks(int file, BufferScanner& scanner, const fs::path& file_path) {
+		std::vector<char>& buffer = threadBuffer();
+		std::unique_ptr<Decompressor> decompressor;
+		bool intact = true;
+		bool readable = true;
+		for (bool first = true; !scanner.done(); first = false) {
+			const auto bytes_read = readBlock(file, buffer.data(), buffer.size());
+			if (bytes_read < 0) {
+				readable = false;
+				break;
+			}
+			if (bytes_read == 0) {
+				break;
+			}
+			if (first) {
+				decompressor = Decompressor::create(detectCompression(buffer.data(), static_cast<std::size_t>(bytes_read)));
+			}
+			if (decompressor == nullptr) {
+				scanner.feed(buffer.data(), static_cast<std::size_t>(bytes_read));
+			}
+			else if (!decompressor->feed(buffer.data(), static_cast<std::size_t>(bytes_read), scanner)) {
+				intact = false;
+				break;
+			}
+		}
+		scanner.finish();
+		if (readable && decompressor != nullptr && (!intact || (!decompressor->complete() && !scanner.done()))) {
+			warnDamagedFile(file_path);
+		}
+		return readable;
+	}
+
+#ifndef _WIN32
+	/**
+	 * Maps an open file and scans it in one piece.
+	 *
+	 * @return True on success, false if the file could not be mapped.
+	 */
+	bool scanMapped(int file, std::size_t size, BufferScanner& scanner, const fs::path& file_path) {
+		void* mapping = nullptr;
+		{
+			const StageTimer timer(SearchStage::Read);
+			mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+		}
+		if (mapping == MAP_FAILED) {
+			return false;
+		}
+		const char* content = static_cast<const char*>(mapping);
+		if (WorkerStats* stats = currentStats()) {
+			stats->bytes_read += size;
+		}
+
+		// A compressed file is decompressed block by block straight from the mapping.
+		if (std::unique_ptr<Decompressor> decompressor = Decompressor::create(detectCompression(content, size))) {
+			madvise(mapping, size, MADV_SEQUENTIAL);
+			const bool intact = decompressor->feed(content, size, scanner);
+			scanner.finish();
+			if (!intact || (!decompressor->complete() && !scanner.done())) {
+				warnDamagedFile(file_path);
+			}
+			munmap(mapping, size);
+			return true;
+		}
+
+		// The file is scanned once from start to end: read ahead aggressively and drop pages behind,
+		// once its start shows that the rest is needed at all.
+		madvise(mapping, size, MADV_SEQUENTIAL);
+		scanner.probe(content, size);
+		if (!scanner.done()) {
+			madvise(mapping, size, MADV_WILLNEED);
+			scanner.scan(content, content + size);
+		}
+		munmap(mapping, size);
+		return true;
+	}
+#endif
+}
+
+
+bool parseReadMode(const std::string& name, ReadMode& read_mode) {
+	if (name == "auto") {
+		read_mode = ReadMode::Auto;
+	}
+	else if (name == "read") {
+		read_mode = ReadMode::Read;
+	}
+	else if (name == "mmap") {
+		read_mode = ReadMode::Mmap;
+	}
+	else if (name == "uring") {
+		read_mode = ReadMode::Uring;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+
+bool scanFile(const std::filesystem::path& file_path, ReadMode read_mode, BufferScanner& scanner) {
+	const int file = openFile(file_path);
+	if (file < 0) {
+		return false;
+	}
+
+#ifndef _WIN32
+	// Map regular files that are large enough for the read mode, everything else is read.
+	struct stat status;
+	if ((read_mode == ReadMode::Auto || read_mode == ReadMode::Mmap) && fstat(file, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0) {
+		const std::size_t size = static_cast<std::size_t>(status.st_size);
+		if ((read_mode == ReadMode::Mmap || size >= mmap_threshold) && scanMapped(file, size, scanner, file_path)) {
+			close(file);
+			return true;
+		}
+	}
+#endif
+
+	const bool readable = readBlocks(file, scanner, file_path);
+	close(file);
+	return readable;
+}
+
+
+bool scanFileRange(const std::filesystem::path& file_path, std::uint64_t begin, std::uint64_t end, BufferScanner& scanner) {
+	const int file = openFile(file_path);
+	if (file < 0) {
+		return false;
+	}
+
+	// Reading starts at the byte before the range, to tell whether the range starts with a line of its own.
+	std::uint64_t position = begin == 0 ? 0 : begin - 1;
+	if (lseek(file, static_cast<std::int64_t>(position), SEEK_SET) < 0) {
+		close(file);
+		return false;
+	}
+	std::vector<char>& buffer = threadBuffer();
+	bool started = begin == 0;
+	bool intact = true;
+	while (!scanner.done()) {
+		// Read no further than the end of the range, and then just enough to find the end of the last line.
+		const std::uint64_t wanted = position < end ? end - position : line_tail_size;
+		const auto bytes_read = readBlock(file, buffer.data(), static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), wanted)));
+		if (bytes_read < 0) {
+			intact = false;
+			break;
+		}
+		if (bytes_read == 0) {
+			break;
+		}
+		const char* data = buffer.data();
+		const char* data_end = data + bytes_read;
+		const std::uint64_t block_start = position;
+		position += static_cast<std::uint64_t>(bytes_read);
+
+		// Skip the rest of the line that started before the range, the range before owns it.
+		if (!started) {
+			const char* newline = static_cast<const char*>(std::memchr(data, '\n', data_end - data));
+			if (newline == nullptr) {
+				continue;
+			}
+			data = newline + 1;
+			started = true;
+			const std::uint64_t first_line = block_start + static_cast<std::uint64_t>(data - buffer.data());
+			if (first_line >= end) {
+				break;
+			}
+			scanner.setContentOffset(first_line);
+		}
+
+		// The line that holds the last byte of the range is the last one, it ends at its newline.
+		if (position >= end) {
+			const char* last_byte = block_start + 1 > end ? data : std::max<const char*>(data, buffer.data() + (end - 1 - block_start));
+			const char* newline = static_cast<const char*>(std::memchr(last_byte, '\n', data_end - last_byte));
+			if (newline != nullptr) {
+				scanner.feed(data, static_cast<std::size_t>(newline + 1 - data));
+				break;
+			}
+		}
+		scanner.feed(data, static_cast<std::size_t>(data_end - data));
+	}
+	scanner.finish();
+	close(file);
+	return intact;
+}
+
+
+bool readFileStamp(const fs::path& file_path, FileStamp& stamp) {
+#ifndef _WIN32
+	struct stat status;
+	if (stat(file_path.c_str(), &status) != 0) {
+		return false;
+	}
+	stamp.size = static_cast<std::uint64_t>(status.st_size);
+	stamp.modified_ns = static_cast<std::int64_t>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+	stamp.inode = static_cast<std::uint64_t>(status.st_ino);
+	return true;
+#else
+	std::error_code error;
+	stamp.size = fs::file_size(file_path, error);
+	if (error) {
+		return false;
+	}
+	stamp.modified_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(fs::last_write_time(file_path, error).time_since_epoch()).count();
+	stamp.inode = 0;
+	return !error;
+#endif
+}
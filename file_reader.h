@@ -0,0 +1,94 @@
+#ifndef SPECIFIC_GREP_FILE_READER_H
+#define SPECIFIC_GREP_FILE_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "buffer_scanner.h"
+
+/**
+ * How the content of a file is brought into memory for searching.
+ */
+enum class ReadMode {
+	// Map files of at least mmap_threshold bytes, read the others.
+	Auto,
+	// Read every file in blocks with read().
+	Read,
+	// Map every regular file that is not empty.
+	Mmap,
+	// Read many files at once through io_uring, where the system supports it.
+	Uring
+};
+
+/**
+ * The size from which ReadMode::Auto maps a file. Below it, setting up and tearing down the
+ * mapping costs more than copying the file into a buffer.
+ */
+constexpr std::size_t mmap_threshold = 1024 * 1024;
+
+/**
+ * The size of the blocks a file that is not mapped is read in.
+ */
+constexpr std::size_t read_block_size = 256 * 1024;
+
+/**
+ * Parses the name of a read mode ("auto", "read", "mmap" or "uring").
+ *
+ * @param name The name of the read mode.
+ * @param read_mode Receives the read mode.
+ * @return True on success, false if the name is unknown.
+ */
+bool parseReadMode(const std::string& name, ReadMode& read_mode);
+
+/**
+ * Passes the whole content of a file to a scanner. A mapped file is scanned in one piece straight
+ * from the page cache, with hints to the kernel to read ahead; otherwise the file is read in blocks
+ * into a buffer that the calling thread reuses for all of its files. Files that cannot be mapped,
+ * such as empty files, pipes and devices, are always read. ReadMode::Uring, which only applies to
+ * batches of files read with IoUringReader, reads a single file like ReadMode::Read. Reading stops
+ * early once the scanner is done with the file. A compressed file, see detectCompression(), is
+ * passed on decompressed.
+ *
+ * @param file_path The path of the file.
+ * @param read_mode How to bring the content into memory.
+ * @param scanner The scanner to pass the content to.
+ * @return True on success, false if the file could not be opened or read.
+ */
+bool scanFile(const std::filesystem::path& file_path, ReadMode read_mode, BufferScanner& scanner);
+
+/**
+ * Passes the lines of a byte range of a file to a scanner: every line that starts within the range,
+ * the last of which runs on past the end of the range up to its newline. The ranges that split a file
+ * one after another thus pass on every line of it exactly once. The range is read in blocks like
+ * ReadMode::Read, up to the block where the scanner is done, and is never decompressed or checked
+ * for binary content. The byte offsets of the lines are those in the file.
+ *
+ * @param file_path The path of the file.
+ * @param begin The offset of the first byte of the range.
+ * @param end The offset after the last byte of the range.
+ * @param scanner The scanner to pass the lines to.
+ * @return True on success, false if the file could not be opened or read.
+ */
+bool scanFileRange(const std::filesystem::path& file_path, std::uint64_t begin, std::uint64_t end, BufferScanner& scanner);
+
+/**
+ * What tells whether a file changed since it was last searched or indexed.
+ */
+struct FileStamp {
+	std::uint64_t size = 0;
+	std::int64_t modified_ns = 0;
+	std::uint64_t inode = 0;
+
+	bool operator==(const FileStamp&) const = default;
+};
+
+/**
+ * Reads the stamp of a file, following symbolic links.
+ *
+ * @return True on success, false if the file could not be looked up.
+ */
+bool readFileStamp(const std::filesystem::path& file_path, FileStamp& stamp);
+
+#endif
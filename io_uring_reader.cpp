@@ -0,0 +1,398 @@
+#include "io_uring_reader.h"
+
+#ifdef SPECIFIC_GREP_HAVE_IO_URING
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#endif
+
+#include "decompressor.h"
+#include "search_stats.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+	// Size of the buffer every file in flight is read into.
+	constexpr std::size_t block_size = 128 * 1024;
+
+	// The operation a slot waits for.
+	enum class Stage { Idle, Open, Read };
+}
+
+
+// A file in flight: its buffer, scanner, and how far it has been read.
+struct IoUringReader::Slot {
+	Stage stage = Stage::Idle;
+	std::size_t file_index = 0;
+	int file = -1;
+	std::uint64_t offset = 0;
+	std::unique_ptr<char[]> buffer;
+	BufferScanner* scanner = nullptr;
+	// The decompressor of a compressed file, which the first block tells.
+	std::unique_ptr<Decompressor> decompressor;
+};
+
+
+#ifdef SPECIFIC_GREP_HAVE_IO_URING
+
+// The memory shared with the kernel: the submission queue, the completion queue and the submission entries.
+struct IoUringReader::Ring {
+	int fd = -1;
+	unsigned int entries = 0;
+
+	void* sq_pointer = MAP_FAILED;
+	std::size_t sq_size = 0;
+	void* cq_pointer = MAP_FAILED;
+	std::size_t cq_size = 0;
+	io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+	std::size_t sqes_size = 0;
+
+	unsigned int* sq_head = nullptr;
+	unsigned int* sq_tail = nullptr;
+	unsigned int* sq_mask = nullptr;
+	unsigned int* sq_array = nullptr;
+	unsigned int* cq_head = nullptr;
+	unsigned int* cq_tail = nullptr;
+	unsigned int* cq_mask = nullptr;
+	io_uring_cqe* cqes = nullptr;
+
+	// Entries prepared since the last io_uring_enter().
+	unsigned int unsubmitted = 0;
+
+	/**
+	 * Sets up the ring and maps its queues.
+	 *
+	 * @return True on success.
+	 */
+	bool setup(unsigned int queue_depth) {
+		io_uring_params params;
+		std::memset(&params, 0, sizeof(params));
+		fd = static_cast<int>(syscall(__NR_io_uring_setup, queue_depth, &params));
+		if (fd < 0) {
+			return false;
+		}
+
+		// IORING_FEAT_RW_CUR_POS came with Linux 5.6, like IORING_OP_OPENAT and IORING_OP_READ.
+		if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+			return false;
+		}
+		entries = params.sq_entries;
+
+		// Newer kernels map both queues with a single mapping.
+		sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+		cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+		if (single_mmap) {
+			sq_size = cq_size = std::max(sq_size, cq_size);
+		}
+
+		sq_pointer = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if (sq_pointer == MAP_FAILED) {
+			return false;
+		}
+		if (single_mmap) {
+			cq_pointer = sq_pointer;
+		}
+		else {
+			cq_pointer = mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+			if (cq_pointer == MAP_FAILED) {
+				return false;
+			}
+		}
+		sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+		sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+		if (sqes == MAP_FAILED) {
+			return false;
+		}
+
+		char* sq = static_cast<char*>(sq_pointer);
+		sq_head = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+		sq_tail = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+		sq_mask = reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+		sq_array = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+		char* cq = static_cast<char*>(cq_pointer);
+		cq_head = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+		cq_tail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+		cq_mask = reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+		cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+		return true;
+	}
+
+	~Ring() {
+		if (sqes != MAP_FAILED) {
+			munmap(sqes, sqes_size);
+		}
+		if (cq_pointer != MAP_FAILED && cq_pointer != sq_pointer) {
+			munmap(cq_pointer, cq_size);
+		}
+		if (sq_pointer != MAP_FAILED) {
+			munmap(sq_pointer, sq_size);
+		}
+		if (fd >= 0) {
+			close(fd);
+		}
+	}
+
+	/**
+	 * @return A cleared submission entry to fill in. The queue never overflows, since no more
+	 * requests are in flight than it has entries.
+	 */
+	io_uring_sqe* nextEntry() {
+		const unsigned int tail = *sq_tail;
+		const unsigned int index = tail & *sq_mask;
+		io_uring_sqe* sqe = &sqes[index];
+		std::memset(sqe, 0, sizeof(*sqe));
+		sq_array[index] = index;
+		__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+		++unsubmitted;
+		return sqe;
+	}
+
+	/**
+	 * Submits the prepared entries and waits for at least one completion. Entries the kernel has
+	 * no room for at the moment are submitted again by the next call.
+	 *
+	 * @return True on success, false if the ring failed.
+	 */
+	bool submitAndWait() {
+		while (true) {
+			const long result = syscall(__NR_io_uring_enter, fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+			if (result >= 0) {
+				unsubmitted -= static_cast<unsigned int>(result);
+				return true;
+			}
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN && errno != EBUSY) {
+				return false;
+			}
+			// The kernel is short of resources for now, or wants the completions it has taken first.
+			if (*cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+				return true;
+			}
+			std::this_thread::yield();
+		}
+	}
+};
+
+
+IoUringReader::IoUringReader(unsigned int queue_depth) : ring_(std::make_unique<Ring>()) {
+	if (!ring_->setup(queue_depth)) {
+		ring_.reset();
+		return;
+	}
+
+	slots_.resize(ring_->entries);
+	for (auto& slot : slots_) {
+		slot.buffer = std::make_unique<char[]>(block_size);
+	}
+}
+
+
+IoUringReader::~IoUringReader() = default;
+
+
+bool IoUringReader::valid() const {
+	return ring_ != nullptr;
+}
+
+
+bool IoUringReader::supported() {
+	return true;
+}
+
+
+void IoUringReader::scanFiles(const std::vector<fs::path>& files, const ScannerFactory& make_scanner, const ErrorCallback& on_error) {
+	Ring& ring = *ring_;
+	std::size_t next_file = 0;
+	std::size_t in_flight = 0;
+
+	// Queues the open request of the next file of the batch in a free slot.
+	auto openNext = [&](std::size_t slot_index) {
+		Slot& slot = slots_[slot_index];
+		if (next_file == files.size()) {
+			slot.stage = Stage::Idle;
+			return;
+		}
+
+		slot.stage = Stage::Open;
+		slot.file_index = next_file++;
+		slot.offset = 0;
+		io_uring_sqe* sqe = ring.nextEntry();
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = reinterpret_cast<std::uint64_t>(files[slot.file_index].c_str());
+		sqe->open_flags = O_RDONLY | O_CLOEXEC;
+		sqe->user_data = slot_index;
+		++in_flight;
+	};
+
+	// Queues the read request of the next block of a slot's file.
+	auto readNext = [&](std::size_t slot_index) {
+		Slot& slot = slots_[slot_index];
+		slot.stage = Stage::Read;
+		io_uring_sqe* sqe = ring.nextEntry();
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = slot.file;
+		sqe->addr = reinterpret_cast<std::uint64_t>(slot.buffer.get());
+		sqe->len = static_cast<unsigned int>(block_size);
+		sqe->off = slot.offset;
+		sqe->user_data = slot_index;
+		++in_flight;
+	};
+
+	// Closes a slot's file and moves the slot on to the next file of the batch.
+	auto finishFile = [&](std::size_t slot_index) {
+		Slot& slot = slots_[slot_index];
+		if (slot.file >= 0) {
+			close(slot.file);
+			slot.file = -1;
+		}
+		slot.scanner = nullptr;
+		slot.decompressor.reset();
+		openNext(slot_index);
+	};
+
+	// Fill every slot with a file to begin with.
+	for (std::size_t i = 0; i < slots_.size(); ++i) {
+		openNext(i);
+	}
+
+	// The opens and the reads of the batch complete together, the time waiting for them counts as reading.
+	WorkerStats* const stats = currentStats();
+	while (in_flight > 0) {
+		bool submitted = false;
+		{
+			const StageTimer timer(SearchStage::Read);
+			submitted = ring.submitAndWait();
+		}
+		if (!submitted) {
+			break;
+		}
+
+		// Handle every completion that arrived and queue the follow-up request of its slot.
+		unsigned int head = *ring.cq_head;
+		const unsigned int tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; ++head) {
+			const io_uring_cqe& cqe = ring.cqes[head & *ring.cq_mask];
+			const std::size_t slot_index = static_cast<std::size_t>(cqe.user_data);
+			const int result = cqe.res;
+			Slot& slot = slots_[slot_index];
+			--in_flight;
+
+			if (stats != nullptr) {
+				if (slot.stage == Stage::Open) {
+					++(result < 0 ? stats->open_failures : stats->files_opened);
+				}
+				else if (result > 0) {
+					stats->bytes_read += static_cast<std::uint64_t>(result);
+				}
+			}
+
+			if (result < 0) {
+				on_error(slot.file_index);
+				finishFile(slot_index);
+			}
+			else if (slot.stage == Stage::Open) {
+				slot.file = result;
+				slot.scanner = &make_scanner(slot.file_index);
+				readNext(slot_index);
+			}
+			else if (result == 0) {
+				slot.scanner->finish();
+				if (slot.decompressor != nullptr && !slot.decompressor->complete()) {
+					warnDamagedFile(files[slot.file_index]);
+				}
+				finishFile(slot_index);
+			}
+			else {
+				const std::size_t size = static_cast<std::size_t>(result);
+				if (slot.offset == 0) {
+					slot.decompressor = Decompressor::create(detectCompression(slot.buffer.get(), size));
+				}
+				bool intact = true;
+				if (slot.decompressor == nullptr) {
+					slot.scanner->feed(slot.buffer.get(), size);
+				}
+				else {
+					intact = slot.decompressor->feed(slot.buffer.get(), size, *slot.scanner);
+				}
+				slot.offset += static_cast<std::uint64_t>(result);
+				// Stop reading a file as soon as the scanner needs no more of it.
+				if (slot.scanner->done() || !intact) {
+					slot.scanner->finish();
+					if (!intact) {
+						warnDamagedFile(files[slot.file_index]);
+					}
+					finishFile(slot_index);
+				}
+				else {
+					readNext(slot_index);
+				}
+			}
+		}
+		__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	// Only reached with files left over if the ring failed. Its requests in flight may still complete, so it is
+	// dropped rather than reused and valid() sends the later batches to read(); the buffers stay for the requests.
+	if (in_flight > 0) {
+		ring_.reset();
+	}
+
+	// Report the files left over as errors.
+	for (auto& slot : slots_) {
+		if (slot.stage != Stage::Idle) {
+			on_error(slot.file_index);
+			if (slot.file >= 0) {
+				close(slot.file);
+				slot.file = -1;
+			}
+			slot.scanner = nullptr;
+			slot.decompressor.reset();
+			slot.stage = Stage::Idle;
+		}
+	}
+	while (next_file < files.size()) {
+		on_error(next_file++);
+	}
+}
+
+#else
+
+struct IoUringReader::Ring {
+};
+
+
+IoUringReader::IoUringReader(unsigned int) {
+}
+
+
+IoUringReader::~IoUringReader() = default;
+
+
+bool IoUringReader::valid() const {
+	return false;
+}
+
+
+bool IoUringReader::supported() {
+	return false;
+}
+
+
+void IoUringReader::scanFiles(const std::vector<fs::path>& files, const ScannerFactory&, const ErrorCallback& on_error) {
+	for (std::size_t i = 0; i < files.size(); ++i) {
+		on_error(i);
+	}
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef SPECIFIC_GREP_IO_URING_READER_H
+#define SPECIFIC_GREP_IO_URING_READER_H
+
+// The io_uring backend needs the Linux kernel headers; without them ReadMode::Uring falls back to read().
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define SPECIFIC_GREP_HAVE_IO_URING 1
+#endif
+#endif
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "buffer_scanner.h"
+
+/**
+ * Reads many files at once through an io_uring submission queue.
+ *
+ * The opens and reads of a whole batch of files are queued to the kernel together, up to the queue
+ * depth, and every completed block is fed to the scanner of its file while the other reads are still
+ * in flight. A single thread thereby keeps as many requests pending as the queue is deep, which is
+ * what hides the latency of cold caches and network storage. The ring is set up with the raw system
+ * calls, so no liburing is needed.
+ */
+class IoUringReader {
+public:
+	/**
+	 * Gives the scanner for the file with the given index in the batch, which the caller keeps.
+	 */
+	using ScannerFactory = std::function<BufferScanner&(std::size_t file_index)>;
+
+	/**
+	 * Called for a file of the batch that could not be opened or read.
+	 */
+	using ErrorCallback = std::function<void(std::size_t file_index)>;
+
+	/**
+	 * Sets up the ring. Check valid() afterwards: the kernel may not support io_uring or forbid it.
+	 *
+	 * @param queue_depth The number of files read at the same time.
+	 */
+	explicit IoUringReader(unsigned int queue_depth);
+
+	~IoUringReader();
+
+	IoUringReader(const IoUringReader&) = delete;
+	IoUringReader& operator=(const IoUringReader&) = delete;
+
+	/**
+	 * @return True if the ring was set up and the kernel supports the operations needed, and the ring
+	 *         has not failed since.
+	 */
+	bool valid() const;
+
+	/**
+	 * Reads a batch of files, feeding each one to its own scanner block by block. The scanner of a
+	 * file is asked for when the file is opened and finished once its last block is fed.
+	 *
+	 * @param files The paths of the files to read.
+	 * @param make_scanner Creates the scanner for a file.
+	 * @param on_error Called for every file that could not be opened or read, and for the files left
+	 *                 over if the ring fails, which leaves the reader no longer valid().
+	 */
+	void scanFiles(const std::vector<std::filesystem::path>& files, const ScannerFactory& make_scanner, const ErrorCallback& on_error);
+
+	/**
+	 * @return True if this build includes the io_uring backend.
+	 */
+	static bool supported();
+
+private:
+	struct Ring;
+	struct Slot;
+
+	std::unique_ptr<Ring> ring_;
+	std::vector<Slot> slots_;
+};
+
+#endif
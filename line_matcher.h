@@ -0,0 +1,52 @@
+#ifndef SPECIFIC_GREP_LINE_MATCHER_H
+#define SPECIFIC_GREP_LINE_MATCHER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Decides which lines of a buffer match the search.
+ *
+ * The scanner hands a matcher whole runs of lines at once rather than single lines, so that a matcher
+ * can skip over the lines that cannot match as fast as its kernel allows.
+ *
+ * The scanner calls the matchers by their concrete type, see BasicBufferScanner, so the functions here
+ * are only virtual for the code that picks the matcher.
+ */
+class LineMatcher {
+public:
+	virtual ~LineMatcher() = default;
+
+	/**
+	 * Finds the first matching line in a run of lines.
+	 *
+	 * @param begin The start of the first line.
+	 * @param end The end of the last line, which is either after a newline or the end of the content.
+	 * @return A pointer to a character of the first matching line, or nullptr if no line matches.
+	 */
+	virtual const char* findLine(const char* begin, const char* end) const = 0;
+
+	/**
+	 * Gives literals one of which every matching line contains, so that an index can rule out the files
+	 * without any of them. The literals may have their ASCII letters folded to lower case.
+	 *
+	 * @return The literals, or nothing if they are not known.
+	 */
+	virtual std::vector<std::string> requiredLiterals() const = 0;
+
+	/**
+	 * Reports every pattern found in a matching line, once each. A matcher with a single pattern reports
+	 * pattern 0; a matcher with several patterns hides this function with its own.
+	 *
+	 * @param line_begin The start of the line.
+	 * @param line_end The end of the line, without its newline.
+	 * @param report Called with the index of every pattern.
+	 */
+	template <typename Report>
+	void reportPatterns(const char* /*line_begin*/, const char* /*line_end*/, Report&& report) const {
+		report(std::uint32_t{0});
+	}
+};
+
+#endif
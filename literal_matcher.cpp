@@ -0,0 +1,262 @@
+#include "literal_matcher.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "case_folding.h"
+#include "cpu_features.h"
+
+namespace {
+	/**
+	 * A kernel searching for a needle in a buffer. The exact kernels need a needle of at least two
+	 * bytes, the folded kernels take a needle of any length with its ASCII letters in lower case.
+	 */
+	using Kernel = const char* (*)(const char* begin, const char* end, const char* needle, std::size_t needle_size);
+
+	/**
+	 * Compares the middle of the needle, between its first and its last byte, at a position where both ends match.
+	 */
+	template <bool folded>
+	bool equalsMiddle(const char* position, const char* needle, std::size_t needle_size) {
+		if (needle_size <= 2) {
+			return true;
+		}
+		if constexpr (folded) {
+			return equalsFolded(position + 1, needle + 1, needle_size - 2);
+		}
+		else {
+			return std::memcmp(position + 1, needle + 1, needle_size - 2) == 0;
+		}
+	}
+
+	/**
+	 * Searches with memchr() for the first byte of the needle and compares the rest where it is found.
+	 * Also finishes the tail of the buffer that is too short for a full vector in the vectorized kernels.
+	 * The folded search compares every position, memchr() only looks for one byte.
+	 */
+	template <bool folded>
+	const char* findScalar(const char* begin, const char* end, const char* needle, std::size_t needle_size) {
+		const char* position = begin;
+		while (static_cast<std::size_t>(end - position) >= needle_size) {
+			if constexpr (folded) {
+				if (foldAscii(*position) == needle[0] && equalsFolded(position + 1, needle + 1, needle_size - 1)) {
+					return position;
+				}
+			}
+			else {
+				position = static_cast<const char*>(std::memchr(position, needle[0], (end - position) - needle_size + 1));
+				if (position == nullptr) {
+					return nullptr;
+				}
+				if (std::memcmp(position + 1, needle + 1, needle_size - 1) == 0) {
+					return position;
+				}
+			}
+			++position;
+		}
+		return nullptr;
+	}
+
+	/**
+	 * @return The bits to set in a byte of the content before comparing it with a byte of the needle:
+	 * the case bit for a letter in a folded search, so both cases of the letter compare equal to its
+	 * lower case, and nothing otherwise.
+	 */
+	template <bool folded>
+	char caseBit(char needle_byte) {
+		return folded && isAsciiLetter(static_cast<unsigned char>(needle_byte)) ? 0x20 : 0;
+	}
+
+#if defined(SPECIFIC_GREP_X86_64)
+	/**
+	 * Compares 16 positions per step against the first and the last byte of the needle.
+	 */
+	template <bool folded>
+	const char* findSse2(const char* begin, const char* end, const char* needle, std::size_t needle_size) {
+		const __m128i first = _mm_set1_epi8(needle[0]);
+		const __m128i last = _mm_set1_epi8(needle[needle_size - 1]);
+		const __m128i first_case = _mm_set1_epi8(caseBit<folded>(needle[0]));
+		const __m128i last_case = _mm_set1_epi8(caseBit<folded>(needle[needle_size - 1]));
+
+		const char* position = begin;
+		while (static_cast<std::size_t>(end - position) >= needle_size - 1 + 16) {
+			__m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position));
+			__m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position + needle_size - 1));
+			if constexpr (folded) {
+				block_first = _mm_or_si128(block_first, first_case);
+				block_last = _mm_or_si128(block_last, last_case);
+			}
+			unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+
+			// Compare the middle of the needle at every position where both ends match.
+			while (mask != 0) {
+				const int offset = lowestBit(mask);
+				if (equalsMiddle<folded>(position + offset, needle, needle_size)) {
+					return position + offset;
+				}
+				mask &= mask - 1;
+			}
+			position += 16;
+		}
+		return findScalar<folded>(position, end, needle, needle_size);
+	}
+#endif
+
+#if defined(SPECIFIC_GREP_HAVE_AVX2)
+	/**
+	 * Compares 32 positions per step against the first and the last byte of the needle.
+	 */
+	template <bool folded>
+	SPECIFIC_GREP_TARGET_AVX2
+	const char* findAvx2(const char* begin, const char* end, const char* needle, std::size_t needle_size) {
+		const __m256i first = _mm256_set1_epi8(needle[0]);
+		const __m256i last = _mm256_set1_epi8(needle[needle_size - 1]);
+		const __m256i first_case = _mm256_set1_epi8(caseBit<folded>(needle[0]));
+		const __m256i last_case = _mm256_set1_epi8(caseBit<folded>(needle[needle_size - 1]));
+
+		const char* position = begin;
+		while (static_cast<std::size_t>(end - position) >= needle_size - 1 + 32) {
+			__m256i block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(position));
+			__m256i block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(position + needle_size - 1));
+			if constexpr (folded) {
+				block_first = _mm256_or_si256(block_first, first_case);
+				block_last = _mm256_or_si256(block_last, last_case);
+			}
+			unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, last)));
+
+			// Compare the middle of the needle at every position where both ends match.
+			while (mask != 0) {
+				const int offset = lowestBit(mask);
+				if (equalsMiddle<folded>(position + offset, needle, needle_size)) {
+					return position + offset;
+				}
+				mask &= mask - 1;
+			}
+			position += 32;
+		}
+		return findScalar<folded>(position, end, needle, needle_size);
+	}
+#endif
+
+#if defined(SPECIFIC_GREP_NEON)
+	/**
+	 * Compares 16 positions per step against the first and the last byte of the needle.
+	 * NEON has no movemask, so the comparison is narrowed to a 64-bit mask with four bits per position.
+	 */
+	template <bool folded>
+	const char* findNeon(const char* begin, const char* end, const char* needle, std::size_t needle_size) {
+		const uint8x16_t first = vdupq_n_u8(static_cast<uint8_t>(needle[0]));
+		const uint8x16_t last = vdupq_n_u8(static_cast<uint8_t>(needle[needle_size - 1]));
+		const uint8x16_t first_case = vdupq_n_u8(static_cast<uint8_t>(caseBit<folded>(needle[0])));
+		const uint8x16_t last_case = vdupq_n_u8(static_cast<uint8_t>(caseBit<folded>(needle[needle_size - 1])));
+
+		const char* position = begin;
+		while (static_cast<std::size_t>(end - position) >= needle_size - 1 + 16) {
+			uint8x16_t block_first = vld1q_u8(reinterpret_cast<const uint8_t*>(position));
+			uint8x16_t block_last = vld1q_u8(reinterpret_cast<const uint8_t*>(position + needle_size - 1));
+			if constexpr (folded) {
+				block_first = vorrq_u8(block_first, first_case);
+				block_last = vorrq_u8(block_last, last_case);
+			}
+			const uint8x16_t matches = vandq_u8(vceqq_u8(block_first, first), vceqq_u8(block_last, last));
+			uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+
+			// Compare the middle of the needle at every position where both ends match.
+			while (mask != 0) {
+				const int offset = lowestBit64(mask) >> 2;
+				if (equalsMiddle<folded>(position + offset, needle, needle_size)) {
+					return position + offset;
+				}
+				mask &= ~(0xFull << (offset * 4));
+			}
+			position += 16;
+		}
+		return findScalar<folded>(position, end, needle, needle_size);
+	}
+#endif
+
+	/**
+	 * The exact and the folded variant of a kernel.
+	 */
+	struct Kernels {
+		Kernel exact;
+		Kernel folded;
+	};
+
+	/**
+	 * Picks the widest kernels the CPU supports.
+	 */
+	Kernels selectKernels(const char*& name) {
+#if defined(SPECIFIC_GREP_HAVE_AVX2)
+		if (cpuHasAvx2()) {
+			name = "avx2";
+			return {findAvx2<false>, findAvx2<true>};
+		}
+#endif
+#if defined(SPECIFIC_GREP_X86_64)
+		name = "sse2";
+		return {findSse2<false>, findSse2<true>};
+#elif defined(SPECIFIC_GREP_NEON)
+		name = "neon";
+		return {findNeon<false>, findNeon<true>};
+#else
+		name = "scalar";
+		return {findScalar<false>, findScalar<true>};
+#endif
+	}
+
+	const char* kernel_name = nullptr;
+	const Kernels kernels = selectKernels(kernel_name);
+}
+
+
+LiteralMatcher::LiteralMatcher(std::string needle, bool case_insensitive) : needle_(std::move(needle)), spans_lines_(needle_.find('\n') != std::string::npos) {
+	// A needle without letters has no case, it is searched for exactly.
+	case_insensitive_ = case_insensitive && std::any_of(needle_.begin(), needle_.end(), [](char c) { return isAsciiLetter(c); });
+	if (case_insensitive_) {
+		needle_ = foldAscii(std::move(needle_));
+	}
+}
+
+
+const char* LiteralMatcher::find(const char* begin, const char* end) const {
+	// An empty needle matches everywhere, like std::string::find.
+	if (needle_.empty()) {
+		return begin;
+	}
+	if (static_cast<std::size_t>(end - begin) < needle_.size()) {
+		return nullptr;
+	}
+	if (case_insensitive_) {
+		return kernels.folded(begin, end, needle_.data(), needle_.size());
+	}
+	if (needle_.size() == 1) {
+		return static_cast<const char*>(std::memchr(begin, needle_[0], end - begin));
+	}
+	return kernels.exact(begin, end, needle_.data(), needle_.size());
+}
+
+
+const char* LiteralMatcher::findLine(const char* begin, const char* end) const {
+	return spans_lines_ ? nullptr : find(begin, end);
+}
+
+
+std::vector<std::string> LiteralMatcher::requiredLiterals() const {
+	return {needle_};
+}
+
+
+const std::string& LiteralMatcher::needle() const {
+	return needle_;
+}
+
+
+bool LiteralMatcher::caseInsensitive() const {
+	return case_insensitive_;
+}
+
+
+const char* LiteralMatcher::kernelName() {
+	return kernel_name;
+}
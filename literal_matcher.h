@@ -0,0 +1,71 @@
+#ifndef SPECIFIC_GREP_LITERAL_MATCHER_H
+#define SPECIFIC_GREP_LITERAL_MATCHER_H
+
+#include <cstddef>
+#include <string>
+
+#include "line_matcher.h"
+
+/**
+ * Finds a literal string in a buffer with a vectorized kernel.
+ *
+ * The kernel compares a whole vector of positions at once against the first and the last byte of
+ * the needle and only compares the rest of the needle where both match, which on text rules out
+ * almost every position without a single branch. The widest kernel the CPU supports (AVX2 or SSE2
+ * on x86-64, NEON on ARM64, a memchr() loop elsewhere) is picked once at startup.
+ *
+ * A case-insensitive search folds the ASCII letters in-register instead of copying the content: the
+ * case bit is set in the bytes compared with a letter of the needle, which makes both cases of the
+ * letter equal to its lower case at the cost of one more instruction per vector.
+ */
+class LiteralMatcher final : public LineMatcher {
+public:
+	/**
+	 * @param needle The string to search for.
+	 * @param case_insensitive Whether to ignore the case of ASCII letters.
+	 */
+	explicit LiteralMatcher(std::string needle, bool case_insensitive = false);
+
+	/**
+	 * Finds the first occurrence of the needle in a buffer.
+	 *
+	 * @param begin The start of the buffer.
+	 * @param end The end of the buffer.
+	 * @return A pointer to the start of the first occurrence, or nullptr if there is none.
+	 */
+	const char* find(const char* begin, const char* end) const;
+
+	/**
+	 * Finds the first line that contains the needle.
+	 *
+	 * @param begin The start of the first line.
+	 * @param end The end of the last line.
+	 * @return A pointer to the first occurrence of the needle in the line, or nullptr if no line contains it.
+	 */
+	const char* findLine(const char* begin, const char* end) const override;
+
+	std::vector<std::string> requiredLiterals() const override;
+
+	/**
+	 * @return The string searched for, with its ASCII letters in lower case in a case-insensitive search.
+	 */
+	const std::string& needle() const;
+
+	/**
+	 * @return Whether the case of ASCII letters is ignored.
+	 */
+	bool caseInsensitive() const;
+
+	/**
+	 * @return The name of the kernel picked for this CPU, e.g. "avx2".
+	 */
+	static const char* kernelName();
+
+private:
+	std::string needle_;
+	// A needle with a newline in it spans lines, so no single line ever contains it.
+	bool spans_lines_;
+	bool case_insensitive_;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#include "mapped_file.h"
+
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+
+bool MappedFile::open(const fs::path& file_path) {
+	close();
+#ifndef _WIN32
+	const int file = ::open(file_path.c_str(), O_RDONLY);
+	if (file == -1) {
+		return false;
+	}
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size <= 0) {
+		::close(file);
+		return false;
+	}
+	void* mapping = mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if (mapping == MAP_FAILED) {
+		return false;
+	}
+	data_ = static_cast<const char*>(mapping);
+	size_ = static_cast<std::size_t>(status.st_size);
+#else
+	std::ifstream file(file_path, std::ios::binary);
+	copy_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	if (copy_.empty()) {
+		return false;
+	}
+	data_ = copy_.data();
+	size_ = copy_.size();
+#endif
+	return true;
+}
+
+
+void MappedFile::close() {
+#ifndef _WIN32
+	if (data_ != nullptr) {
+		munmap(const_cast<char*>(data_), size_);
+	}
+#endif
+	copy_.clear();
+	data_ = nullptr;
+	size_ = 0;
+}
+
+
+bool replaceFile(const fs::path& file_path, const std::vector<char>& content, std::string& error) {
+	fs::path temporary_path = file_path;
+	temporary_path += ".tmp";
+	{
+		std::ofstream output(temporary_path, std::ios::binary | std::ios::trunc);
+		output.write(content.data(), static_cast<std::streamsize>(content.size()));
+		if (!output) {
+			error = "could not write " + temporary_path.string();
+			return false;
+		}
+	}
+	std::error_code rename_error;
+	fs::rename(temporary_path, file_path, rename_error);
+	if (rename_error) {
+		error = "could not replace " + file_path.string() + ": " + rename_error.message();
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,60 @@
+#ifndef SPECIFIC_GREP_MAPPED_FILE_H
+#define SPECIFIC_GREP_MAPPED_FILE_H
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * A whole file mapped read-only into memory, for the on-disk tables kept between searches. Where
+ * files cannot be mapped, the file is read into a copy instead.
+ */
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/**
+	 * Maps a file, unmapping any file mapped before.
+	 *
+	 * @param file_path The path of the file.
+	 * @return True on success, false if the file could not be opened or is empty.
+	 */
+	bool open(const std::filesystem::path& file_path);
+
+	/**
+	 * Unmaps the file. Does nothing if none is mapped.
+	 */
+	void close();
+
+	const char* data() const {
+		return data_;
+	}
+
+	std::size_t size() const {
+		return size_;
+	}
+
+private:
+	const char* data_ = nullptr;
+	std::size_t size_ = 0;
+	// The copy of the file on systems where it is read instead of mapped.
+	std::vector<char> copy_;
+};
+
+/**
+ * Writes a file beside the one it replaces, and only renames it over the old one once it is complete,
+ * so a reader never sees a partly written file.
+ *
+ * @param file_path The path of the file to replace.
+ * @param content The new content of the file.
+ * @param error Set to the reason on failure.
+ * @return True on success, false if the file could not be written.
+ */
+bool replaceFile(const std::filesystem::path& file_path, const std::vector<char>& content, std::string& error);
+
+#endif
@@ -0,0 +1,440 @@
+#include "multi_literal_matcher.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "case_folding.h"
+#include "cpu_features.h"
+#include "regex_matcher.h"
+
+namespace {
+	constexpr std::uint32_t no_state = std::numeric_limits<std::uint32_t>::max();
+	// The most case variants searched for one pattern, a pattern with more is matched by a regular expression.
+	constexpr std::size_t max_case_variants = 256;
+
+	/**
+	 * A pattern with a newline in it spans lines, so no single line ever contains it.
+	 */
+	bool spansLines(const std::string& pattern) {
+		return pattern.find('\n') != std::string::npos;
+	}
+}
+
+
+/**
+ * The tables of the Teddy search. A pattern is put in one of eight buckets, and a bucket's bit is set
+ * in the tables at the low and the high nibble of each of the first bytes of its patterns.
+ */
+struct MultiLiteralMatcher::Teddy {
+	// Teddy only pays off while the buckets are small.
+	static constexpr std::size_t max_patterns = 32;
+	static constexpr int bucket_count = 8;
+	static constexpr int max_fingerprint = 3;
+
+	using Kernel = const char* (*)(const Teddy& teddy, const char* begin, const char* end);
+
+	// The number of leading bytes looked up, at most the length of the shortest pattern.
+	int fingerprint = 0;
+	alignas(16) std::uint8_t low[max_fingerprint][16] = {};
+	alignas(16) std::uint8_t high[max_fingerprint][16] = {};
+	std::vector<std::string> buckets[bucket_count];
+	// Whether the keys are folded, so the positions are compared ignoring the case of ASCII letters.
+	bool folded = false;
+	Kernel kernel = nullptr;
+	const char* kernel_name = nullptr;
+};
+
+namespace {
+	using Teddy = MultiLiteralMatcher::Teddy;
+
+	/**
+	 * Compares the patterns of the candidate buckets at a position.
+	 */
+	bool verifyTeddy(const Teddy& teddy, const char* position, const char* end, unsigned int buckets) {
+		while (buckets != 0) {
+			for (const auto& pattern : teddy.buckets[lowestBit(buckets)]) {
+				if (static_cast<std::size_t>(end - position) >= pattern.size()
+					&& (teddy.folded ? equalsFolded(position, pattern.data(), pattern.size()) : std::memcmp(position, pattern.data(), pattern.size()) == 0)) {
+					return true;
+				}
+			}
+			buckets &= buckets - 1;
+		}
+		return false;
+	}
+
+	/**
+	 * Looks up the tables one position at a time. Finishes the tail of the buffer that is too short
+	 * for a full vector in the vectorized kernels.
+	 */
+	const char* findTeddyScalar(const Teddy& teddy, const char* begin, const char* end) {
+		for (const char* position = begin; end - position >= teddy.fingerprint; ++position) {
+			unsigned int buckets = 0xff;
+			for (int i = 0; i < teddy.fingerprint; ++i) {
+				const auto byte = static_cast<unsigned char>(position[i]);
+				buckets &= teddy.low[i][byte & 0xf] & teddy.high[i][byte >> 4];
+			}
+			if (buckets != 0 && verifyTeddy(teddy, position, end, buckets)) {
+				return position;
+			}
+		}
+		return nullptr;
+	}
+
+#if defined(SPECIFIC_GREP_HAVE_AVX2)
+	/**
+	 * Looks up the buckets of 16 positions per step.
+	 */
+	SPECIFIC_GREP_TARGET_SSSE3
+	const char* findTeddySsse3(const Teddy& teddy, const char* begin, const char* end) {
+		const __m128i nibble = _mm_set1_epi8(0x0f);
+		__m128i low[Teddy::max_fingerprint];
+		__m128i high[Teddy::max_fingerprint];
+		for (int i = 0; i < teddy.fingerprint; ++i) {
+			low[i] = _mm_load_si128(reinterpret_cast<const __m128i*>(teddy.low[i]));
+			high[i] = _mm_load_si128(reinterpret_cast<const __m128i*>(teddy.high[i]));
+		}
+
+		alignas(16) std::uint8_t candidates[16];
+		const char* position = begin;
+		while (end - position >= 16 + teddy.fingerprint - 1) {
+			__m128i buckets = _mm_set1_epi8(-1);
+			for (int i = 0; i < teddy.fingerprint; ++i) {
+				const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position + i));
+				const __m128i low_buckets = _mm_shuffle_epi8(low[i], _mm_and_si128(block, nibble));
+				const __m128i high_buckets = _mm_shuffle_epi8(high[i], _mm_and_si128(_mm_srli_epi16(block, 4), nibble));
+				buckets = _mm_and_si128(buckets, _mm_and_si128(low_buckets, high_buckets));
+			}
+			unsigned int mask = ~static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(buckets, _mm_setzero_si128()))) & 0xffff;
+
+			// Compare the patterns at every position with a candidate bucket.
+			if (mask != 0) {
+				_mm_store_si128(reinterpret_cast<__m128i*>(candidates), buckets);
+				while (mask != 0) {
+					const int offset = lowestBit(mask);
+					if (verifyTeddy(teddy, position + offset, end, candidates[offset])) {
+						return position + offset;
+					}
+					mask &= mask - 1;
+				}
+			}
+			position += 16;
+		}
+		return findTeddyScalar(teddy, position, end);
+	}
+
+	/**
+	 * Looks up the buckets of 32 positions per step. The shuffle works within 128-bit lanes, so the tables are copied into both.
+	 */
+	SPECIFIC_GREP_TARGET_AVX2
+	const char* findTeddyAvx2(const Teddy& teddy, const char* begin, const char* end) {
+		const __m256i nibble = _mm256_set1_epi8(0x0f);
+		__m256i low[Teddy::max_fingerprint];
+		__m256i high[Teddy::max_fingerprint];
+		for (int i = 0; i < teddy.fingerprint; ++i) {
+			low[i] = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(teddy.low[i])));
+			high[i] = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(teddy.high[i])));
+		}
+
+		alignas(32) std::uint8_t candidates[32];
+		const char* position = begin;
+		while (end - position >= 32 + teddy.fingerprint - 1) {
+			__m256i buckets = _mm256_set1_epi8(-1);
+			for (int i = 0; i < teddy.fingerprint; ++i) {
+				const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(position + i));
+				const __m256i low_buckets = _mm256_shuffle_epi8(low[i], _mm256_and_si256(block, nibble));
+				const __m256i high_buckets = _mm256_shuffle_epi8(high[i], _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble));
+				buckets = _mm256_and_si256(buckets, _mm256_and_si256(low_buckets, high_buckets));
+			}
+			unsigned int mask = ~static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(buckets, _mm256_setzero_si256())));
+
+			// Compare the patterns at every position with a candidate bucket.
+			if (mask != 0) {
+				_mm256_store_si256(reinterpret_cast<__m256i*>(candidates), buckets);
+				while (mask != 0) {
+					const int offset = lowestBit(mask);
+					if (verifyTeddy(teddy, position + offset, end, candidates[offset])) {
+						return position + offset;
+					}
+					mask &= mask - 1;
+				}
+			}
+			position += 32;
+		}
+		return findTeddyScalar(teddy, position, end);
+	}
+#endif
+
+	/**
+	 * Picks the widest Teddy kernel the CPU supports.
+	 *
+	 * @return The kernel, or nullptr if the CPU has no byte shuffle, where the automaton is faster than Teddy.
+	 */
+	Teddy::Kernel selectTeddyKernel(const char*& name) {
+#if defined(SPECIFIC_GREP_HAVE_AVX2)
+		if (cpuHasAvx2()) {
+			name = "teddy-avx2";
+			return findTeddyAvx2;
+		}
+		if (cpuHasSsse3()) {
+			name = "teddy-ssse3";
+			return findTeddySsse3;
+		}
+#endif
+		name = nullptr;
+		return nullptr;
+	}
+}
+
+
+MultiLiteralMatcher::MultiLiteralMatcher(bool case_insensitive) : case_insensitive_(case_insensitive) {
+}
+
+
+std::unique_ptr<MultiLiteralMatcher> MultiLiteralMatcher::create(std::vector<std::string> patterns, bool case_insensitive, std::string& error) {
+	std::unique_ptr<MultiLiteralMatcher> matcher(new MultiLiteralMatcher(case_insensitive));
+	for (std::uint32_t id = 0; id < patterns.size(); ++id) {
+		if (spansLines(patterns[id])) {
+			continue;
+		}
+		if (!case_insensitive) {
+			matcher->keys_.push_back({std::move(patterns[id]), id});
+			continue;
+		}
+		std::vector<std::string> variants = caseVariants(patterns[id], max_case_variants);
+		if (variants.empty()) {
+			std::unique_ptr<RegexMatcher> pattern_matcher = RegexMatcher::compile(RegexMatcher::escape(patterns[id]), error, true);
+			if (pattern_matcher == nullptr) {
+				error = "the pattern " + std::to_string(id + 1) + " is too long to ignore case: " + error;
+				return nullptr;
+			}
+			matcher->case_patterns_.push_back({std::move(pattern_matcher), id});
+			continue;
+		}
+		for (auto& variant : variants) {
+			matcher->keys_.push_back({std::move(variant), id});
+		}
+	}
+	matcher->buildAutomaton();
+	matcher->buildTeddy();
+	return matcher;
+}
+
+
+std::unique_ptr<MultiLiteralMatcher> MultiLiteralMatcher::createExpanded(std::vector<std::string> literals, bool case_insensitive) {
+	std::unique_ptr<MultiLiteralMatcher> matcher(new MultiLiteralMatcher(case_insensitive));
+	for (std::uint32_t id = 0; id < literals.size(); ++id) {
+		if (!spansLines(literals[id])) {
+			matcher->keys_.push_back({std::move(literals[id]), id});
+		}
+	}
+	matcher->buildAutomaton();
+	matcher->buildTeddy();
+	return matcher;
+}
+
+
+MultiLiteralMatcher::~MultiLiteralMatcher() = default;
+
+
+/**
+ * Builds the trie of the patterns, then resolves every missing transition through the failure links
+ * in breadth-first order, so the search never has to follow a failure link itself.
+ */
+void MultiLiteralMatcher::buildAutomaton() {
+	std::fill(std::begin(byte_class_), std::end(byte_class_), 0);
+	for (const auto& key : keys_) {
+		for (const char c : key.text) {
+			const auto byte = static_cast<unsigned char>(c);
+			if (byte_class_[byte] == 0) {
+				byte_class_[byte] = static_cast<std::uint16_t>(class_count_++);
+				// The keys are folded, the upper case of a letter takes the class of its lower case.
+				if (case_insensitive_ && isAsciiLetter(byte)) {
+					byte_class_[byte ^ 0x20] = byte_class_[byte];
+				}
+			}
+		}
+	}
+
+	// The trie, with no_state for the transitions that are not in it.
+	std::vector<std::vector<std::uint32_t>> outputs(1);
+	transitions_.assign(class_count_, no_state);
+	for (const auto& key : keys_) {
+		std::uint32_t state = 0;
+		for (const char c : key.text) {
+			const std::size_t transition = state * class_count_ + byte_class_[static_cast<unsigned char>(c)];
+			if (transitions_[transition] == no_state) {
+				transitions_[transition] = static_cast<std::uint32_t>(outputs.size());
+				outputs.emplace_back();
+				transitions_.resize(transitions_.size() + class_count_, no_state);
+			}
+			state = transitions_[transition];
+		}
+		outputs[state].push_back(key.pattern);
+	}
+
+	// A state's failure link is its longest proper suffix in the trie, which is always shallower.
+	const std::size_t state_count = outputs.size();
+	std::vector<std::uint32_t> failure(state_count, 0);
+	output_link_.assign(state_count, no_state);
+	std::vector<std::uint32_t> queue;
+	queue.reserve(state_count);
+	for (std::size_t byte_class = 0; byte_class < class_count_; ++byte_class) {
+		std::uint32_t& target = transitions_[byte_class];
+		if (target == no_state) {
+			target = 0;
+		}
+		else {
+			queue.push_back(target);
+		}
+	}
+	for (std::size_t head = 0; head < queue.size(); ++head) {
+		const std::uint32_t state = queue[head];
+		const std::uint32_t fallback = failure[state];
+		output_link_[state] = outputs[fallback].empty() ? output_link_[fallback] : fallback;
+		for (std::size_t byte_class = 0; byte_class < class_count_; ++byte_class) {
+			std::uint32_t& target = transitions_[state * class_count_ + byte_class];
+			if (target == no_state) {
+				target = transitions_[fallback * class_count_ + byte_class];
+			}
+			else {
+				failure[target] = transitions_[fallback * class_count_ + byte_class];
+				queue.push_back(target);
+			}
+		}
+	}
+
+	matches_.resize(state_count);
+	output_begin_.reserve(state_count + 1);
+	for (std::size_t state = 0; state < state_count; ++state) {
+		matches_[state] = !outputs[state].empty() || output_link_[state] != no_state;
+		output_begin_.push_back(static_cast<std::uint32_t>(pattern_ids_.size()));
+		pattern_ids_.insert(pattern_ids_.end(), outputs[state].begin(), outputs[state].end());
+	}
+	output_begin_.push_back(static_cast<std::uint32_t>(pattern_ids_.size()));
+}
+
+
+/**
+ * Sets up Teddy for small sets of non-empty keys, when the CPU has a byte shuffle.
+ */
+void MultiLiteralMatcher::buildTeddy() {
+	std::size_t shortest = std::numeric_limits<std::size_t>::max();
+	for (const auto& key : keys_) {
+		shortest = std::min(shortest, key.text.size());
+	}
+	if (keys_.empty() || keys_.size() > Teddy::max_patterns || shortest == 0) {
+		return;
+	}
+
+	auto teddy = std::make_unique<Teddy>();
+	teddy->kernel = selectTeddyKernel(teddy->kernel_name);
+	if (teddy->kernel == nullptr) {
+		return;
+	}
+	teddy->fingerprint = static_cast<int>(std::min<std::size_t>(shortest, Teddy::max_fingerprint));
+	teddy->folded = case_insensitive_;
+	for (std::size_t i = 0; i < keys_.size(); ++i) {
+		const int bucket = static_cast<int>(i % Teddy::bucket_count);
+		const std::string& pattern = keys_[i].text;
+		teddy->buckets[bucket].push_back(pattern);
+		for (int position = 0; position < teddy->fingerprint; ++position) {
+			const auto byte = static_cast<unsigned char>(pattern[position]);
+			teddy->low[position][byte & 0xf] |= 1 << bucket;
+			teddy->high[position][byte >> 4] |= 1 << bucket;
+			// The cases of a letter differ in the high nibble only.
+			if (case_insensitive_ && isAsciiLetter(byte)) {
+				teddy->high[position][(byte ^ 0x20) >> 4] |= 1 << bucket;
+			}
+		}
+	}
+	teddy_ = std::move(teddy);
+}
+
+
+const char* MultiLiteralMatcher::findLine(const char* begin, const char* end) const {
+	// An empty pattern matches every line.
+	if (matches_[0]) {
+		return begin;
+	}
+	const char* found = keys_.empty() ? nullptr : teddy_ ? teddy_->kernel(*teddy_, begin, end) : findWithAutomaton(begin, end);
+
+	// The patterns of their own are only searched for up to the line the keys matched in.
+	for (const auto& case_pattern : case_patterns_) {
+		const char* search_end = end;
+		if (found != nullptr) {
+			const char* newline = static_cast<const char*>(std::memchr(found, '\n', end - found));
+			search_end = newline == nullptr ? end : newline + 1;
+		}
+		const char* pattern_found = case_pattern.matcher->findLine(begin, search_end);
+		if (pattern_found != nullptr && (found == nullptr || pattern_found < found)) {
+			found = pattern_found;
+		}
+	}
+	return found;
+}
+
+
+/**
+ * Runs the automaton over a line and collects the patterns ending anywhere in it, sorted and without duplicates.
+ */
+void MultiLiteralMatcher::collectPatterns(const char* line_begin, const char* line_end, std::vector<std::uint32_t>& found) const {
+	auto collect = [&](std::uint32_t state) {
+		for (; state != no_state; state = output_link_[state]) {
+			found.insert(found.end(), pattern_ids_.begin() + output_begin_[state], pattern_ids_.begin() + output_begin_[state + 1]);
+		}
+	};
+
+	std::uint32_t state = 0;
+	collect(state);
+	for (const char* position = line_begin; position < line_end; ++position) {
+		state = transitions_[state * class_count_ + byte_class_[static_cast<unsigned char>(*position)]];
+		if (matches_[state]) {
+			collect(state);
+		}
+	}
+
+	for (const auto& case_pattern : case_patterns_) {
+		if (case_pattern.matcher->findLine(line_begin, line_end) != nullptr) {
+			found.push_back(case_pattern.pattern);
+		}
+	}
+
+	std::sort(found.begin(), found.end());
+	found.erase(std::unique(found.begin(), found.end()), found.end());
+}
+
+
+std::vector<std::string> MultiLiteralMatcher::requiredLiterals() const {
+	// The patterns of their own have too many variants to give.
+	if (!case_patterns_.empty()) {
+		return {};
+	}
+	std::vector<std::string> literals;
+	literals.reserve(keys_.size());
+	for (const auto& key : keys_) {
+		literals.push_back(key.text);
+	}
+	return literals;
+}
+
+
+const char* MultiLiteralMatcher::engineName() const {
+	return teddy_ ? teddy_->kernel_name : "aho-corasick";
+}
+
+
+/**
+ * Runs the automaton until it reaches a state that some pattern ends in.
+ */
+const char* MultiLiteralMatcher::findWithAutomaton(const char* begin, const char* end) const {
+	std::uint32_t state = 0;
+	for (const char* position = begin; position < end; ++position) {
+		state = transitions_[state * class_count_ + byte_class_[static_cast<unsigned char>(*position)]];
+		if (matches_[state]) {
+			return position;
+		}
+	}
+	return nullptr;
+}
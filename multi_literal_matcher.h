@@ -0,0 +1,129 @@
+#ifndef SPECIFIC_GREP_MULTI_LITERAL_MATCHER_H
+#define SPECIFIC_GREP_MULTI_LITERAL_MATCHER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "line_matcher.h"
+
+class RegexMatcher;
+
+/**
+ * Searches for many literal patterns at once, in a single pass over the content.
+ *
+ * The patterns are compiled into an Aho-Corasick automaton whose transitions are all resolved in
+ * advance and laid out in one flat table, a row per state and a column per byte class, so the search
+ * costs one table lookup per byte whatever the number of patterns. Only the bytes that occur in the
+ * patterns get a class of their own, which keeps the rows short.
+ *
+ * Small sets of patterns are looked for with Teddy instead: the low and the high nibble of the first
+ * bytes of every position are looked up in small tables with a vector shuffle, which yields for 16 or
+ * 32 positions at once the buckets of patterns that may start there. Only those positions are then
+ * compared against the patterns of their buckets.
+ *
+ * A case-insensitive search folds the patterns to lower case and gives both cases of an ASCII letter
+ * the same byte class, or in Teddy the same bucket in both high nibbles. The letters outside ASCII are
+ * matched by searching for every case variant of a pattern, as a key of its own. A pattern with too
+ * many such letters to search for all its variants is matched by a case-insensitive regular expression
+ * of its own instead, which is run over the content the automaton has no match in.
+ */
+class MultiLiteralMatcher final : public LineMatcher {
+public:
+	/**
+	 * Creates the matcher for a set of patterns.
+	 *
+	 * @param patterns The patterns to search for, the index of a pattern is its ID in the matches.
+	 * @param case_insensitive Whether to ignore the case of letters.
+	 * @param error Set to the reason when a pattern is too long to ignore its case.
+	 * @return The matcher, or nullptr on error.
+	 */
+	static std::unique_ptr<MultiLiteralMatcher> create(std::vector<std::string> patterns, bool case_insensitive, std::string& error);
+
+	/**
+	 * Creates the matcher for literals that are given in every case of their letters outside ASCII
+	 * already, such as the required literals of a case-insensitive regular expression.
+	 *
+	 * @param literals The literals to search for, the index of a literal is its ID in the matches.
+	 * @param case_insensitive Whether to ignore the case of ASCII letters.
+	 * @return The matcher.
+	 */
+	static std::unique_ptr<MultiLiteralMatcher> createExpanded(std::vector<std::string> literals, bool case_insensitive);
+
+	~MultiLiteralMatcher() override;
+
+	const char* findLine(const char* begin, const char* end) const override;
+
+	std::vector<std::string> requiredLiterals() const override;
+
+	/**
+	 * Reports every pattern found in a matching line, once each.
+	 *
+	 * @param line_begin The start of the line.
+	 * @param line_end The end of the line, without its newline.
+	 * @param report Called with the index of every pattern.
+	 */
+	template <typename Report>
+	void reportPatterns(const char* line_begin, const char* line_end, Report&& report) const {
+		std::vector<std::uint32_t> found;
+		collectPatterns(line_begin, line_end, found);
+		for (const std::uint32_t pattern : found) {
+			report(pattern);
+		}
+	}
+
+	/**
+	 * @return The name of the engine used for the search: "aho-corasick", or the Teddy kernel.
+	 */
+	const char* engineName() const;
+
+	// The tables of the Teddy search, defined with its kernels.
+	struct Teddy;
+
+private:
+	explicit MultiLiteralMatcher(bool case_insensitive);
+
+	void buildAutomaton();
+	void buildTeddy();
+	const char* findWithAutomaton(const char* begin, const char* end) const;
+	void collectPatterns(const char* line_begin, const char* line_end, std::vector<std::uint32_t>& found) const;
+
+	/**
+	 * A string searched for: a pattern, or one of its case variants.
+	 */
+	struct Key {
+		std::string text;
+		std::uint32_t pattern;
+	};
+
+	/**
+	 * A pattern matched by a regular expression, as it has too many case variants to search for.
+	 */
+	struct CasePattern {
+		std::unique_ptr<RegexMatcher> matcher;
+		std::uint32_t pattern;
+	};
+
+	// The keys of all patterns that can match within a line.
+	std::vector<Key> keys_;
+	std::vector<CasePattern> case_patterns_;
+	bool case_insensitive_;
+
+	// The byte class of every byte: class 0 for the bytes in no pattern, a class of its own for every other byte.
+	std::uint16_t byte_class_[256];
+	std::size_t class_count_ = 1;
+	// The target state of every state and byte class, state 0 is the root.
+	std::vector<std::uint32_t> transitions_;
+	// Whether any pattern ends in a state, including the patterns ending in its suffixes.
+	std::vector<std::uint8_t> matches_;
+	// The patterns ending in every state, stored as ranges of pattern_ids_.
+	std::vector<std::uint32_t> output_begin_;
+	std::vector<std::uint32_t> pattern_ids_;
+	// The longest suffix of every state that some pattern ends in, or no_state.
+	std::vector<std::uint32_t> output_link_;
+
+	std::unique_ptr<Teddy> teddy_;
+};
+
+#endif
@@ -0,0 +1,124 @@
+#include "newline_counter.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "cpu_features.h"
+
+namespace {
+	using Counter = std::size_t (*)(const char* begin, const char* end);
+
+	std::size_t countScalar(const char* begin, const char* end) {
+		std::size_t count = 0;
+		for (const char* position = begin; position != end; ++position) {
+			count += *position == '\n';
+		}
+		return count;
+	}
+
+#if defined(SPECIFIC_GREP_X86_64)
+	/**
+	 * Counts 16 bytes per step. The comparison results are summed up per byte lane and only added up
+	 * across lanes every 255 steps, before a lane can overflow.
+	 */
+	std::size_t countSse2(const char* begin, const char* end) {
+		const __m128i newline = _mm_set1_epi8('\n');
+		const __m128i zero = _mm_setzero_si128();
+
+		std::size_t count = 0;
+		const char* position = begin;
+		while (end - position >= 16) {
+			__m128i lanes = zero;
+			for (int step = 0; step < 255 && end - position >= 16; ++step, position += 16) {
+				const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position));
+				lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(block, newline));
+			}
+			const __m128i sums = _mm_sad_epu8(lanes, zero);
+			count += static_cast<std::size_t>(_mm_cvtsi128_si64(sums)) + static_cast<std::size_t>(_mm_cvtsi128_si64(_mm_unpackhi_epi64(sums, sums)));
+		}
+		return count + countScalar(position, end);
+	}
+#endif
+
+#if defined(SPECIFIC_GREP_HAVE_AVX2)
+	/**
+	 * Counts 32 bytes per step, summing up per byte lane like the SSE2 counter.
+	 */
+	SPECIFIC_GREP_TARGET_AVX2
+	std::size_t countAvx2(const char* begin, const char* end) {
+		const __m256i newline = _mm256_set1_epi8('\n');
+		const __m256i zero = _mm256_setzero_si256();
+
+		std::size_t count = 0;
+		const char* position = begin;
+		while (end - position >= 32) {
+			__m256i lanes = zero;
+			for (int step = 0; step < 255 && end - position >= 32; ++step, position += 32) {
+				const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(position));
+				lanes = _mm256_sub_epi8(lanes, _mm256_cmpeq_epi8(block, newline));
+			}
+			const __m256i sums = _mm256_sad_epu8(lanes, zero);
+			count += static_cast<std::size_t>(_mm256_extract_epi64(sums, 0)) + static_cast<std::size_t>(_mm256_extract_epi64(sums, 1))
+				+ static_cast<std::size_t>(_mm256_extract_epi64(sums, 2)) + static_cast<std::size_t>(_mm256_extract_epi64(sums, 3));
+		}
+		return count + countScalar(position, end);
+	}
+#endif
+
+#if defined(SPECIFIC_GREP_NEON)
+	/**
+	 * Counts 16 bytes per step, summing up per byte lane like the SSE2 counter.
+	 */
+	std::size_t countNeon(const char* begin, const char* end) {
+		const uint8x16_t newline = vdupq_n_u8('\n');
+
+		std::size_t count = 0;
+		const char* position = begin;
+		while (end - position >= 16) {
+			uint8x16_t lanes = vdupq_n_u8(0);
+			for (int step = 0; step < 255 && end - position >= 16; ++step, position += 16) {
+				const uint8x16_t block = vld1q_u8(reinterpret_cast<const uint8_t*>(position));
+				lanes = vsubq_u8(lanes, vceqq_u8(block, newline));
+			}
+			count += vaddlvq_u8(lanes);
+		}
+		return count + countScalar(position, end);
+	}
+#endif
+
+	Counter selectCounter() {
+#if defined(SPECIFIC_GREP_HAVE_AVX2)
+		if (cpuHasAvx2()) {
+			return countAvx2;
+		}
+#endif
+#if defined(SPECIFIC_GREP_X86_64)
+		return countSse2;
+#elif defined(SPECIFIC_GREP_NEON)
+		return countNeon;
+#else
+		return countScalar;
+#endif
+	}
+
+	const Counter counter = selectCounter();
+}
+
+
+std::size_t countNewlines(const char* begin, const char* end) {
+	return counter(begin, end);
+}
+
+
+const char* findLastNewline(const char* begin, const char* end) {
+#if defined(__GLIBC__)
+	return static_cast<const char*>(memrchr(begin, '\n', end - begin));
+#else
+	for (const char* position = end; position != begin; --position) {
+		if (position[-1] == '\n') {
+			return position - 1;
+		}
+	}
+	return nullptr;
+#endif
+}
@@ -0,0 +1,24 @@
+#ifndef SPECIFIC_GREP_NEWLINE_COUNTER_H
+#define SPECIFIC_GREP_NEWLINE_COUNTER_H
+
+#include <cstddef>
+
+/**
+ * Counts the newline characters in a buffer, a whole vector at a time.
+ *
+ * @param begin The start of the buffer.
+ * @param end The end of the buffer.
+ * @return The number of '\n' characters between begin and end.
+ */
+std::size_t countNewlines(const char* begin, const char* end);
+
+/**
+ * Finds the last newline character in a buffer.
+ *
+ * @param begin The start of the buffer.
+ * @param end The end of the buffer.
+ * @return A pointer to the last '\n' between begin and end, or nullptr if there is none.
+ */
+const char* findLastNewline(const char* begin, const char* end);
+
+#endif
@@ -0,0 +1,40 @@
+#include "output_writer.h"
+
+
+OutputWriter::OutputWriter(std::ostream& output, std::size_t capacity) : output_(output), capacity_(capacity) {
+	// The buffer is filled up to its capacity and a line beyond, so it is hardly ever reallocated.
+	buffer_.reserve(capacity_ + capacity_ / 4);
+}
+
+
+OutputWriter::~OutputWriter() {
+	flush();
+}
+
+
+void OutputWriter::write(std::string_view text) {
+	if (text.size() >= capacity_ / 4) {
+		drain();
+		output_.write(text.data(), static_cast<std::streamsize>(text.size()));
+		return;
+	}
+	buffer_.append(text);
+	commit();
+}
+
+
+void OutputWriter::flush() {
+	drain();
+	output_.flush();
+}
+
+
+/**
+ * Writes the buffer to the output in one piece and empties it.
+ */
+void OutputWriter::drain() {
+	if (!buffer_.empty()) {
+		output_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+		buffer_.clear();
+	}
+}
@@ -0,0 +1,124 @@
+#ifndef SPECIFIC_GREP_OUTPUT_WRITER_H
+#define SPECIFIC_GREP_OUTPUT_WRITER_H
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "search_results.h"
+
+/**
+ * Appends the decimal digits of a number, without the locale and the formatting state of a stream.
+ *
+ * @param text The text to append to.
+ * @param number The number.
+ */
+inline void appendNumber(std::string& text, std::uint64_t number) {
+	char digits[20];
+	const auto [end, error] = std::to_chars(digits, digits + sizeof(digits), number);
+	text.append(digits, end);
+}
+
+/**
+ * Appends a match in the format of the result file: `<file>:<line number>: <line>`, or
+ * `<file>:<line number>:#<pattern ID>: <line>` with the pattern tags, and with the byte offset of
+ * the line after its number, `<file>:<line number>:<byte offset>: <line>`. A context line is
+ * `<file>-<line number>- <line>`, with a '-' for every ':' and without a pattern.
+ *
+ * @param text The text to append to.
+ * @param file_name The name of the file as written to the result file.
+ * @param match The match or context line.
+ * @param tag_patterns Whether to write the ID of the pattern, its line in the pattern file.
+ * @param byte_offsets Whether to write the byte offset of the line in the file.
+ */
+inline void appendMatchLine(std::string& text, std::string_view file_name, const MatchRecord& match, bool tag_patterns, bool byte_offsets) {
+	const char separator = match.isContext() ? '-' : ':';
+	text.append(file_name);
+	text += separator;
+	appendNumber(text, match.line_number);
+	text += separator;
+	if (byte_offsets) {
+		appendNumber(text, match.byte_offset);
+		text += separator;
+	}
+	if (tag_patterns && !match.isContext()) {
+		text += '#';
+		appendNumber(text, static_cast<std::uint64_t>(match.pattern_index) + 1);
+		text += ':';
+	}
+	text += ' ';
+	text.append(match.line());
+	text += '\n';
+}
+
+/**
+ * The line between two groups of lines with context that do not follow each other in a file, or are of different files.
+ */
+constexpr std::string_view context_group_separator = "--\n";
+
+
+/**
+ * Writes text to an output through a large buffer of its own, which goes to the output in one write
+ * whenever it is full, instead of a write, or with std::endl a flush, for every piece of every line.
+ * Text at least as large as a quarter of the buffer goes to the output straight away, after what is
+ * buffered, without being copied.
+ *
+ * The output is written to only when the buffer is full, when flushed, and when the writer is destroyed.
+ */
+class OutputWriter {
+public:
+	// The size of the buffer, from which it is written to the output.
+	static constexpr std::size_t default_capacity = 1024 * 1024;
+
+	/**
+	 * @param output The output to write to, which must outlive the writer.
+	 * @param capacity The size of the buffer.
+	 */
+	explicit OutputWriter(std::ostream& output, std::size_t capacity = default_capacity);
+
+	/**
+	 * Flushes the buffer.
+	 */
+	~OutputWriter();
+
+	OutputWriter(const OutputWriter&) = delete;
+	OutputWriter& operator=(const OutputWriter&) = delete;
+
+	/**
+	 * @return The buffer to append to directly, with the append functions; call commit() after appending.
+	 */
+	std::string& buffer() {
+		return buffer_;
+	}
+
+	/**
+	 * Writes the buffer to the output once it is full, after appending to it directly.
+	 */
+	void commit() {
+		if (buffer_.size() >= capacity_) {
+			drain();
+		}
+	}
+
+	/**
+	 * Writes text.
+	 */
+	void write(std::string_view text);
+
+	/**
+	 * Writes the buffer to the output and flushes the output.
+	 */
+	void flush();
+
+private:
+	void drain();
+
+	std::ostream& output_;
+	const std::size_t capacity_;
+	std::string buffer_;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef SPECIFIC_GREP_PARALLEL_SORT_H
+#define SPECIFIC_GREP_PARALLEL_SORT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+#include "task_scheduler.h"
+
+// The smallest number of elements every worker sorts; smaller ranges are not worth the tasks.
+constexpr std::size_t parallel_sort_min_slice = 16 * 1024;
+
+/**
+ * Sorts a range on the workers of a scheduler: every worker sorts a slice of the range, and the
+ * sorted slices are merged pairwise, all merges of a round at the same time, until one is left.
+ * A range too small for more than one slice is sorted on the calling thread. Like std::sort, the
+ * order of equal elements is unspecified.
+ *
+ * It waits for the scheduler, so it is to be called from outside the scheduler while nothing else
+ * runs on it, such as after a search.
+ *
+ * @param scheduler The scheduler to sort on.
+ * @param begin The start of the range.
+ * @param end The end of the range.
+ * @param compare The order, which is copied into every task.
+ */
+template <typename Iterator, typename Compare>
+void parallelSort(TaskScheduler& scheduler, Iterator begin, Iterator end, Compare compare) {
+	const std::size_t size = static_cast<std::size_t>(std::distance(begin, end));
+	const std::size_t slice_count = std::min(scheduler.workerCount(), size / parallel_sort_min_slice);
+	if (slice_count < 2) {
+		std::sort(begin, end, compare);
+		return;
+	}
+
+	std::vector<std::size_t> bounds(slice_count + 1);
+	for (std::size_t i = 0; i <= slice_count; ++i) {
+		bounds[i] = size * i / slice_count;
+	}
+	for (std::size_t i = 0; i < slice_count; ++i) {
+		scheduler.submit([begin, first = bounds[i], last = bounds[i + 1], compare](std::size_t) {
+			std::sort(begin + first, begin + last, compare);
+		});
+	}
+	scheduler.wait();
+
+	// Every round merges each run of sorted slices with the next one, doubling the runs.
+	for (std::size_t width = 1; width < slice_count; width *= 2) {
+		for (std::size_t i = 0; i + width < slice_count; i += 2 * width) {
+			scheduler.submit([begin, first = bounds[i], middle = bounds[i + width], last = bounds[std::min(i + 2 * width, slice_count)], compare](std::size_t) {
+				std::inplace_merge(begin + first, begin + middle, begin + last, compare);
+			});
+		}
+		scheduler.wait();
+	}
+}
+
+#endif
@@ -0,0 +1,301 @@
+#include "path_filter.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+/**
+ * The patterns of the ignore files of one directory, on top of the ones of the directories above.
+ */
+struct PathFilter::IgnoreRules {
+	Rules parent;
+	// The path of the directory relative to the root of the walk, empty for the root.
+	std::string base;
+	GlobSet globs;
+	// Whether each pattern takes the entries it matches back in, for the patterns starting with '!'.
+	std::vector<bool> negated;
+};
+
+namespace {
+	bool hasWildcard(std::string_view pattern) {
+		return pattern.find_first_of("*?[\\") != std::string_view::npos;
+	}
+
+	/**
+	 * Matches a character against the class at the start of a pattern, "[abc]", "[a-z]" or "[!abc]".
+	 *
+	 * @param length Set to the length of the class, or 0 if it is not closed and the '[' is an ordinary character.
+	 * @return True if the character is in the class.
+	 */
+	bool matchClass(std::string_view pattern, char c, std::size_t& length) {
+		std::size_t i = 1;
+		const bool negated = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+		if (negated) {
+			++i;
+		}
+
+		// A ']' right at the start is part of the class.
+		bool matched = false;
+		const std::size_t first = i;
+		while (i < pattern.size() && (pattern[i] != ']' || i == first)) {
+			unsigned char low = static_cast<unsigned char>(pattern[i]);
+			if (low == '\\' && i + 1 < pattern.size()) {
+				low = static_cast<unsigned char>(pattern[++i]);
+			}
+			unsigned char high = low;
+			if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+				i += 2;
+				high = static_cast<unsigned char>(pattern[i]);
+				if (high == '\\' && i + 1 < pattern.size()) {
+					high = static_cast<unsigned char>(pattern[++i]);
+				}
+			}
+			matched = matched || (low <= static_cast<unsigned char>(c) && static_cast<unsigned char>(c) <= high);
+			++i;
+		}
+		if (i >= pattern.size()) {
+			length = 0;
+			return false;
+		}
+		length = i + 1;
+		return matched != negated;
+	}
+
+	/**
+	 * Matches a whole text against a glob.
+	 */
+	bool matchGlob(std::string_view pattern, std::string_view text) {
+		std::size_t p = 0;
+		std::size_t t = 0;
+		while (p < pattern.size()) {
+			if (pattern[p] == '*') {
+				// A "**" component matches no component at all, or any number of them.
+				const bool any_components = p + 1 < pattern.size() && pattern[p + 1] == '*' && (p == 0 || pattern[p - 1] == '/') && (p + 2 == pattern.size() || pattern[p + 2] == '/');
+				if (any_components) {
+					if (p + 2 == pattern.size()) {
+						return true;
+					}
+					const std::string_view rest = pattern.substr(p + 3);
+					for (std::size_t start = t;;) {
+						if (matchGlob(rest, text.substr(start))) {
+							return true;
+						}
+						const std::size_t slash = text.find('/', start);
+						if (slash == std::string_view::npos) {
+							return false;
+						}
+						start = slash + 1;
+					}
+				}
+
+				// Any other run of stars matches anything within the component.
+				while (p < pattern.size() && pattern[p] == '*') {
+					++p;
+				}
+				const std::string_view rest = pattern.substr(p);
+				for (std::size_t start = t;; ++start) {
+					if (matchGlob(rest, text.substr(start))) {
+						return true;
+					}
+					if (start == text.size() || text[start] == '/') {
+						return false;
+					}
+				}
+			}
+
+			if (t == text.size()) {
+				return false;
+			}
+			if (pattern[p] == '?') {
+				if (text[t] == '/') {
+					return false;
+				}
+				++p;
+				++t;
+				continue;
+			}
+			if (pattern[p] == '[') {
+				std::size_t length;
+				const bool matched = matchClass(pattern.substr(p), text[t], length);
+				if (length != 0) {
+					if (!matched || text[t] == '/') {
+						return false;
+					}
+					p += length;
+					++t;
+					continue;
+				}
+			}
+			if (pattern[p] == '\\' && p + 1 < pattern.size()) {
+				++p;
+			}
+			if (pattern[p] != text[t]) {
+				return false;
+			}
+			++p;
+			++t;
+		}
+		return t == text.size();
+	}
+
+	/**
+	 * Adds the patterns of an ignore file to the rules of its directory. A missing file adds nothing.
+	 */
+	void readIgnoreFile(const fs::path& file_path, GlobSet& globs, std::vector<bool>& negated) {
+		std::ifstream file(file_path, std::ios::binary);
+		if (!file.is_open()) {
+			return;
+		}
+
+		std::string line;
+		while (std::getline(file, line)) {
+			if (!line.empty() && line.back() == '\r') {
+				line.pop_back();
+			}
+			if (line.empty() || line[0] == '#') {
+				continue;
+			}
+			bool negation = false;
+			if (line[0] == '!') {
+				negation = true;
+				line.erase(0, 1);
+			}
+			else if (line[0] == '\\' && line.size() > 1 && (line[1] == '!' || line[1] == '#')) {
+				line.erase(0, 1);
+			}
+			// Trailing spaces are dropped, unless quoted with a backslash.
+			while (!line.empty() && line.back() == ' ' && !(line.size() > 1 && line[line.size() - 2] == '\\')) {
+				line.pop_back();
+			}
+			if (line.empty() || line == "/") {
+				continue;
+			}
+			globs.add(line);
+			negated.push_back(negation);
+		}
+	}
+}
+
+
+void GlobSet::add(std::string_view glob) {
+	const auto id = static_cast<std::uint32_t>(globs_.size());
+	Glob parsed{std::string(glob), false, false};
+	std::string& pattern = parsed.pattern;
+	while (pattern.size() > 1 && pattern.back() == '/') {
+		pattern.pop_back();
+		parsed.directory_only = true;
+	}
+	if (pattern.size() > 1 && pattern.front() == '/') {
+		pattern.erase(0, 1);
+		parsed.anchored = true;
+	}
+	else {
+		parsed.anchored = pattern.find('/') != std::string::npos;
+	}
+	// "**/name" matches the name at any depth, like "name" does.
+	if (parsed.anchored && pattern.starts_with("**/") && pattern.find('/', 3) == std::string::npos) {
+		pattern.erase(0, 3);
+		parsed.anchored = false;
+	}
+
+	if (!hasWildcard(pattern)) {
+		(parsed.anchored ? paths_ : names_)[pattern].push_back(id);
+	}
+	else if (!parsed.anchored && pattern.size() > 2 && pattern[0] == '*' && pattern[1] == '.' && !hasWildcard(std::string_view(pattern).substr(1))) {
+		extensions_[pattern.substr(1)].push_back(id);
+	}
+	else {
+		general_.push_back(id);
+	}
+	globs_.push_back(std::move(parsed));
+}
+
+
+int GlobSet::findLast(std::string_view path, std::string_view name, bool is_directory) const {
+	int last = no_match;
+	auto lookUp = [&](const GlobTable& table, std::string_view key) {
+		const auto found = table.find(key);
+		if (found == table.end()) {
+			return;
+		}
+		for (const std::uint32_t id : found->second) {
+			if (!globs_[id].directory_only || is_directory) {
+				last = std::max(last, static_cast<int>(id));
+			}
+		}
+	};
+	if (!names_.empty()) {
+		lookUp(names_, name);
+	}
+	if (!paths_.empty()) {
+		lookUp(paths_, path);
+	}
+	// Every extension of the name, "c.tar.gz" has ".tar.gz" and ".gz".
+	if (!extensions_.empty()) {
+		for (std::size_t dot = name.find('.'); dot != std::string_view::npos; dot = name.find('.', dot + 1)) {
+			lookUp(extensions_, name.substr(dot));
+		}
+	}
+
+	// The other globs are matched from the last one down, until one matches or the rest come before the match found already.
+	for (auto id = general_.rbegin(); id != general_.rend() && static_cast<int>(*id) > last; ++id) {
+		const Glob& glob = globs_[*id];
+		if ((!glob.directory_only || is_directory) && matchGlob(glob.pattern, glob.anchored ? path : name)) {
+			last = static_cast<int>(*id);
+			break;
+		}
+	}
+	return last;
+}
+
+
+PathFilter::PathFilter(const std::vector<std::string>& include_globs, const std::vector<std::string>& exclude_globs, bool ignore_files) : ignore_files_(ignore_files) {
+	for (const auto& glob : include_globs) {
+		includes_.add(glob);
+	}
+	for (const auto& glob : exclude_globs) {
+		excludes_.add(glob);
+	}
+}
+
+
+PathFilter::Rules PathFilter::enterDirectory(const Rules& parent, const fs::path& directory, std::string_view relative_path) const {
+	if (!ignore_files_) {
+		return parent;
+	}
+
+	// The .ignore file comes last, so its patterns win over the ones of .gitignore.
+	auto rules = std::make_shared<IgnoreRules>();
+	readIgnoreFile(directory / ".gitignore", rules->globs, rules->negated);
+	readIgnoreFile(directory / ".ignore", rules->globs, rules->negated);
+	if (rules->globs.empty()) {
+		return parent;
+	}
+	rules->parent = parent;
+	rules->base = relative_path;
+	return rules;
+}
+
+
+bool PathFilter::excludes(const Rules& rules, std::string_view relative_path, std::string_view name, bool is_directory) const {
+	if (ignore_files_ && is_directory && name == ".git") {
+		return true;
+	}
+	if (!excludes_.empty() && excludes_.matches(relative_path, name, is_directory)) {
+		return true;
+	}
+	if (!is_directory && !includes_.empty() && !includes_.matches(relative_path, name, false)) {
+		return true;
+	}
+
+	// The deepest ignore file with a matching pattern decides.
+	for (const IgnoreRules* level = rules.get(); level != nullptr; level = level->parent.get()) {
+		const std::string_view path = level->base.empty() ? relative_path : relative_path.substr(level->base.size() + 1);
+		const int id = level->globs.findLast(path, name, is_directory);
+		if (id != GlobSet::no_match) {
+			return !level->negated[id];
+		}
+	}
+	return false;
+}
@@ -0,0 +1,144 @@
+#ifndef SPECIFIC_GREP_PATH_FILTER_H
+#define SPECIFIC_GREP_PATH_FILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A set of globs that is matched against a path all at once.
+ *
+ * The globs follow the rules of .gitignore: '*' matches anything but a slash, '?' one character but
+ * a slash, "[...]" a character of a class, '\' quotes the next character, and "**" matches any number
+ * of directories when it is a whole path component. A glob with a slash, other than a trailing one,
+ * is matched against the whole path relative to its base directory, any other glob only against the
+ * name, at any depth; a trailing slash only matches directories.
+ *
+ * Most globs in practice are plain names ("node_modules") or extensions ("*.o"), so those are looked
+ * up in hash tables by the name and each of its extensions, and only the other globs are matched one
+ * by one. Which globs match is settled by a few lookups, however many globs there are.
+ */
+class GlobSet {
+public:
+	/**
+	 * Returned by findLast() when no glob matches.
+	 */
+	static constexpr int no_match = -1;
+
+	/**
+	 * Adds a glob, which gets the ID of the number of globs added before it.
+	 *
+	 * @param glob The glob, which must not be empty.
+	 */
+	void add(std::string_view glob);
+
+	/**
+	 * @return True if no glob has been added.
+	 */
+	bool empty() const {
+		return globs_.empty();
+	}
+
+	/**
+	 * Finds the glob added last of the ones that match a path.
+	 *
+	 * @param path The path relative to the base directory of the globs, with '/' between its components.
+	 * @param name The last component of the path.
+	 * @param is_directory Whether the path is a directory.
+	 * @return The ID of the glob, or no_match.
+	 */
+	int findLast(std::string_view path, std::string_view name, bool is_directory) const;
+
+	/**
+	 * @return True if any glob matches the path, see findLast().
+	 */
+	bool matches(std::string_view path, std::string_view name, bool is_directory) const {
+		return findLast(path, name, is_directory) != no_match;
+	}
+
+private:
+	struct Glob {
+		std::string pattern;
+		// Whether the pattern is matched against the whole path rather than the name.
+		bool anchored;
+		bool directory_only;
+	};
+
+	struct StringHash {
+		using is_transparent = void;
+		std::size_t operator()(std::string_view text) const {
+			return std::hash<std::string_view>{}(text);
+		}
+	};
+
+	using GlobTable = std::unordered_map<std::string, std::vector<std::uint32_t>, StringHash, std::equal_to<>>;
+
+	std::vector<Glob> globs_;
+	// The globs that are a plain name, a plain path, or '*' and a plain extension, by what they match.
+	GlobTable names_;
+	GlobTable paths_;
+	GlobTable extensions_;
+	// The other globs, in the order they were added.
+	std::vector<std::uint32_t> general_;
+};
+
+/**
+ * Decides which entries the directory walk leaves out, before it descends into a directory or reports
+ * a file, so the subtrees it leaves out are never even listed.
+ *
+ * An entry is left out if it matches an exclude glob, if it is a file and there are include globs but
+ * it matches none of them, or if it is ignored by the .gitignore or .ignore files of its directory or
+ * the ones above. As with git, the deepest ignore file with a matching pattern decides, the last
+ * matching pattern within it wins, and a pattern starting with '!' takes an entry back in. A .ignore
+ * file overrides the .gitignore file next to it. The .git directories themselves are left out along
+ * with the ignored entries.
+ */
+class PathFilter {
+public:
+	/**
+	 * The ignore patterns in effect in a directory, shared with its subdirectories that have no ignore files of their own.
+	 */
+	struct IgnoreRules;
+	using Rules = std::shared_ptr<const IgnoreRules>;
+
+	/**
+	 * @param include_globs The globs one of which every file must match, none to search every file.
+	 * @param exclude_globs The globs of the files and directories to leave out.
+	 * @param ignore_files Whether to read the .gitignore and .ignore files of the directories walked.
+	 */
+	PathFilter(const std::vector<std::string>& include_globs, const std::vector<std::string>& exclude_globs, bool ignore_files);
+
+	/**
+	 * Gives the rules in effect in a directory, reading its ignore files. Called once per directory, before its entries are checked.
+	 *
+	 * @param parent The rules in effect in the parent directory, nullptr for the root of the walk.
+	 * @param directory The path of the directory.
+	 * @param relative_path The path of the directory relative to the root of the walk, empty for the root.
+	 * @return The rules in effect in the directory.
+	 */
+	Rules enterDirectory(const Rules& parent, const std::filesystem::path& directory, std::string_view relative_path) const;
+
+	/**
+	 * Checks an entry of a directory. Safe to call from all workers at once.
+	 *
+	 * @param rules The rules in effect in the directory, from enterDirectory().
+	 * @param relative_path The path of the entry relative to the root of the walk.
+	 * @param name The name of the entry.
+	 * @param is_directory Whether the entry is a directory.
+	 * @return True if the walk leaves the entry out.
+	 */
+	bool excludes(const Rules& rules, std::string_view relative_path, std::string_view name, bool is_directory) const;
+
+private:
+	GlobSet includes_;
+	GlobSet excludes_;
+	bool ignore_files_;
+};
+
+#endif
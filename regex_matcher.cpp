@@ -0,0 +1,1233 @@
+#include "regex_matcher.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+#include "case_folding.h"
+#include "literal_matcher.h"
+#include "multi_literal_matcher.h"
+#include "newline_counter.h"
+
+namespace {
+	using State = RegexMatcher::NfaState;
+
+	// Limits that keep a hostile expression from exhausting the stack or the memory.
+	constexpr int max_nesting = 256;
+	constexpr int max_repeat = 1000;
+	constexpr std::size_t max_nfa_states = 100000;
+	// The most strings a set of literals is kept with, Teddy searches at most twice as many.
+	constexpr std::size_t max_literal_set = 16;
+	// The most bytes a class may have to be taken as a set of literals.
+	constexpr std::size_t max_literal_bytes = 4;
+
+	/**
+	 * A node of the parsed expression.
+	 */
+	struct Node {
+		enum class Kind {
+			Empty,
+			Bytes,
+			LineStart,
+			LineEnd,
+			Concat,
+			Alternate,
+			Repeat
+		};
+
+		Kind kind = Kind::Empty;
+		std::bitset<256> bytes;
+		std::vector<Node> children;
+		// The bounds of a repeat, max is -1 when unbounded.
+		int min = 0;
+		int max = -1;
+	};
+
+	/**
+	 * Adds the bytes for which an ASCII classification function holds.
+	 */
+	void addAscii(std::bitset<256>& bytes, int (*predicate)(int)) {
+		for (int byte = 0; byte < 128; ++byte) {
+			if (predicate(byte)) {
+				bytes.set(byte);
+			}
+		}
+	}
+
+	/**
+	 * Adds the other case of the ASCII letters in a set.
+	 */
+	void foldCase(std::bitset<256>& bytes) {
+		for (int letter = 'a'; letter <= 'z'; ++letter) {
+			if (bytes.test(letter) || bytes.test(letter ^ 0x20)) {
+				bytes.set(letter);
+				bytes.set(letter ^ 0x20);
+			}
+		}
+	}
+
+	int isWordCharacter(int byte) {
+		return std::isalnum(byte) || byte == '_';
+	}
+
+	int hexValue(char c) {
+		if (c >= '0' && c <= '9') {
+			return c - '0';
+		}
+		if (c >= 'a' && c <= 'f') {
+			return c - 'a' + 10;
+		}
+		if (c >= 'A' && c <= 'F') {
+			return c - 'A' + 10;
+		}
+		return -1;
+	}
+
+	/**
+	 * A recursive descent parser for the extended regular expression syntax.
+	 *
+	 * Ignoring case, every byte set gets both cases of its ASCII letters, before a class is negated, and
+	 * a letter outside ASCII becomes an alternation of the UTF-8 encodings of its cases.
+	 */
+	class Parser {
+	public:
+		Parser(const std::string& pattern, std::string& error, bool case_insensitive) : pattern_(pattern), error_(error), case_insensitive_(case_insensitive) {
+		}
+
+		bool parse(Node& root) {
+			if (!parseAlternation(root, 0)) {
+				return false;
+			}
+			if (position_ != pattern_.size()) {
+				return fail("unmatched )");
+			}
+			return true;
+		}
+
+	private:
+		bool atEnd() const {
+			return position_ == pattern_.size();
+		}
+
+		char peek() const {
+			return pattern_[position_];
+		}
+
+		bool fail(const std::string& message) {
+			error_ = message;
+			return false;
+		}
+
+		bool parseAlternation(Node& node, int depth) {
+			if (depth > max_nesting) {
+				return fail("too deeply nested");
+			}
+
+			Node first;
+			if (!parseConcat(first, depth)) {
+				return false;
+			}
+			if (atEnd() || peek() != '|') {
+				node = std::move(first);
+				return true;
+			}
+
+			node.kind = Node::Kind::Alternate;
+			node.children.push_back(std::move(first));
+			while (!atEnd() && peek() == '|') {
+				++position_;
+				Node next;
+				if (!parseConcat(next, depth)) {
+					return false;
+				}
+				node.children.push_back(std::move(next));
+			}
+			return true;
+		}
+
+		bool parseConcat(Node& node, int depth) {
+			node.kind = Node::Kind::Concat;
+			while (!atEnd() && peek() != '|' && peek() != ')') {
+				Node atom;
+				if (!parseAtom(atom, depth) || !parseQuantifiers(atom)) {
+					return false;
+				}
+				node.children.push_back(std::move(atom));
+			}
+
+			if (node.children.empty()) {
+				node.kind = Node::Kind::Empty;
+			}
+			else if (node.children.size() == 1) {
+				Node only = std::move(node.children[0]);
+				node = std::move(only);
+			}
+			return true;
+		}
+
+		bool parseAtom(Node& node, int depth) {
+			const char c = pattern_[position_++];
+			switch (c) {
+			case '(':
+				if (pattern_.compare(position_, 2, "?:") == 0) {
+					position_ += 2;
+				}
+				else if (!atEnd() && peek() == '?') {
+					return fail("unsupported group syntax (?" + pattern_.substr(position_ + 1, 1));
+				}
+				if (!parseAlternation(node, depth + 1)) {
+					return false;
+				}
+				if (atEnd() || peek() != ')') {
+					return fail("missing )");
+				}
+				++position_;
+				return true;
+			case '[':
+				node.kind = Node::Kind::Bytes;
+				return parseClass(node.bytes);
+			case '.':
+				node.kind = Node::Kind::Bytes;
+				node.bytes.set();
+				node.bytes.reset('\n');
+				return true;
+			case '^':
+				node.kind = Node::Kind::LineStart;
+				return true;
+			case '$':
+				node.kind = Node::Kind::LineEnd;
+				return true;
+			case '\\':
+				node.kind = Node::Kind::Bytes;
+				if (!parseEscape(node.bytes, false)) {
+					return false;
+				}
+				if (case_insensitive_) {
+					foldCase(node.bytes);
+				}
+				return true;
+			case '*':
+			case '+':
+			case '?':
+				return fail(std::string("nothing to repeat before ") + c);
+			default:
+				if (case_insensitive_ && static_cast<unsigned char>(c) >= 0x80) {
+					return parseCasedCharacter(node);
+				}
+				node.kind = Node::Kind::Bytes;
+				node.bytes.set(static_cast<unsigned char>(c));
+				if (case_insensitive_) {
+					foldCase(node.bytes);
+				}
+				return true;
+			}
+		}
+
+		/**
+		 * Parses a character outside ASCII, which starts at the byte before the position, into the alternation of its cases.
+		 * A byte that does not start a valid UTF-8 character, or a character without case, stays a single byte.
+		 */
+		bool parseCasedCharacter(Node& node) {
+			std::size_t length;
+			const std::vector<std::string> variants = utf8CaseVariants(pattern_.data() + position_ - 1, pattern_.data() + pattern_.size(), length);
+			if (variants.empty()) {
+				node.kind = Node::Kind::Bytes;
+				node.bytes.set(static_cast<unsigned char>(pattern_[position_ - 1]));
+				return true;
+			}
+
+			node.kind = Node::Kind::Alternate;
+			for (const std::string& variant : variants) {
+				Node sequence;
+				sequence.kind = Node::Kind::Concat;
+				for (const char byte : variant) {
+					Node byte_node;
+					byte_node.kind = Node::Kind::Bytes;
+					byte_node.bytes.set(static_cast<unsigned char>(byte));
+					sequence.children.push_back(std::move(byte_node));
+				}
+				node.children.push_back(std::move(sequence));
+			}
+			position_ += length - 1;
+			return true;
+		}
+
+		bool parseQuantifiers(Node& atom) {
+			while (!atEnd()) {
+				int min = 0;
+				int max = -1;
+				const char c = peek();
+				if (c == '*') {
+					++position_;
+				}
+				else if (c == '+') {
+					min = 1;
+					++position_;
+				}
+				else if (c == '?') {
+					max = 1;
+					++position_;
+				}
+				else if (c == '{') {
+					bool is_count = false;
+					if (!parseCount(min, max, is_count)) {
+						return false;
+					}
+					// A brace that does not start a count is a literal, which the next atom picks up.
+					if (!is_count) {
+						return true;
+					}
+				}
+				else {
+					return true;
+				}
+
+				// Lazy repeats match the same lines as greedy ones.
+				if (!atEnd() && peek() == '?') {
+					++position_;
+				}
+
+				Node repeat;
+				repeat.kind = Node::Kind::Repeat;
+				repeat.min = min;
+				repeat.max = max;
+				repeat.children.push_back(std::move(atom));
+				atom = std::move(repeat);
+			}
+			return true;
+		}
+
+		/**
+		 * Parses "{n}", "{n,}" or "{n,m}". Leaves the position alone when the brace does not start a count.
+		 */
+		bool parseCount(int& min, int& max, bool& is_count) {
+			std::size_t position = position_ + 1;
+			auto readNumber = [&](int& value) {
+				const std::size_t digits_start = position;
+				value = 0;
+				while (position < pattern_.size() && std::isdigit(static_cast<unsigned char>(pattern_[position]))) {
+					value = std::min(value * 10 + (pattern_[position] - '0'), max_repeat + 1);
+					++position;
+				}
+				return position != digits_start;
+			};
+
+			if (!readNumber(min)) {
+				return true;
+			}
+			max = min;
+			if (position < pattern_.size() && pattern_[position] == ',') {
+				++position;
+				if (!readNumber(max)) {
+					max = -1;
+				}
+			}
+			if (position >= pattern_.size() || pattern_[position] != '}') {
+				return true;
+			}
+
+			if (min > max_repeat || max > max_repeat) {
+				return fail("repeat count over " + std::to_string(max_repeat));
+			}
+			if (max != -1 && max < min) {
+				return fail("invalid repeat count");
+			}
+			position_ = position + 1;
+			is_count = true;
+			return true;
+		}
+
+		bool parseClass(std::bitset<256>& bytes) {
+			bool negated = false;
+			if (!atEnd() && peek() == '^') {
+				negated = true;
+				++position_;
+			}
+
+			bool first = true;
+			while (true) {
+				if (atEnd()) {
+					return fail("missing ]");
+				}
+				if (peek() == ']' && !first) {
+					++position_;
+					break;
+				}
+				first = false;
+
+				int low = -1;
+				if (!parseClassAtom(bytes, low)) {
+					return false;
+				}
+				if (low == -1 || position_ + 1 >= pattern_.size() || peek() != '-' || pattern_[position_ + 1] == ']') {
+					if (low != -1) {
+						bytes.set(low);
+					}
+					continue;
+				}
+
+				++position_;
+				int high = -1;
+				std::bitset<256> range_end;
+				if (!parseClassAtom(range_end, high)) {
+					return false;
+				}
+				if (high == -1 || high < low) {
+					return fail("invalid range in []");
+				}
+				for (int byte = low; byte <= high; ++byte) {
+					bytes.set(byte);
+				}
+			}
+
+			if (case_insensitive_) {
+				foldCase(bytes);
+			}
+			if (negated) {
+				bytes.flip();
+				bytes.reset('\n');
+			}
+			return true;
+		}
+
+		/**
+		 * Parses a single byte or a named class inside "[...]".
+		 *
+		 * @param single Set to the byte when the atom is a single byte, left at -1 when it is a class added to bytes.
+		 */
+		bool parseClassAtom(std::bitset<256>& bytes, int& single) {
+			if (pattern_.compare(position_, 2, "[:") == 0) {
+				const std::size_t name_end = pattern_.find(":]", position_ + 2);
+				if (name_end == std::string::npos) {
+					return fail("missing :]");
+				}
+				const std::string name = pattern_.substr(position_ + 2, name_end - position_ - 2);
+				static const std::map<std::string, int (*)(int)> classes = {
+					{"alnum", std::isalnum}, {"alpha", std::isalpha}, {"blank", std::isblank},
+					{"cntrl", std::iscntrl}, {"digit", std::isdigit}, {"graph", std::isgraph},
+					{"lower", std::islower}, {"print", std::isprint}, {"punct", std::ispunct},
+					{"space", std::isspace}, {"upper", std::isupper}, {"xdigit", std::isxdigit},
+					{"word", isWordCharacter}};
+				const auto found = classes.find(name);
+				if (found == classes.end()) {
+					return fail("unknown class [:" + name + ":]");
+				}
+				addAscii(bytes, found->second);
+				position_ = name_end + 2;
+				return true;
+			}
+
+			const char c = pattern_[position_++];
+			if (c != '\\') {
+				single = static_cast<unsigned char>(c);
+				return true;
+			}
+
+			std::bitset<256> escaped;
+			if (!parseEscape(escaped, true)) {
+				return false;
+			}
+			if (escaped.count() == 1) {
+				for (int byte = 0; byte < 256; ++byte) {
+					if (escaped.test(byte)) {
+						single = byte;
+					}
+				}
+			}
+			else {
+				bytes |= escaped;
+			}
+			return true;
+		}
+
+		bool parseEscape(std::bitset<256>& bytes, bool in_class) {
+			if (atEnd()) {
+				return fail("trailing \\");
+			}
+
+			const char c = pattern_[position_++];
+			switch (c) {
+			case 'd':
+			case 'D':
+				addAscii(bytes, std::isdigit);
+				break;
+			case 'w':
+			case 'W':
+				addAscii(bytes, isWordCharacter);
+				break;
+			case 's':
+			case 'S':
+				addAscii(bytes, std::isspace);
+				break;
+			case 'n':
+				bytes.set('\n');
+				return true;
+			case 't':
+				bytes.set('\t');
+				return true;
+			case 'r':
+				bytes.set('\r');
+				return true;
+			case 'f':
+				bytes.set('\f');
+				return true;
+			case 'v':
+				bytes.set('\v');
+				return true;
+			case 'x': {
+				const int high = position_ < pattern_.size() ? hexValue(pattern_[position_]) : -1;
+				const int low = position_ + 1 < pattern_.size() ? hexValue(pattern_[position_ + 1]) : -1;
+				if (high == -1 || low == -1) {
+					return fail("\\x needs two hex digits");
+				}
+				position_ += 2;
+				bytes.set(high * 16 + low);
+				return true;
+			}
+			default:
+				if (c >= '1' && c <= '9') {
+					return fail("backreferences are not supported");
+				}
+				if (!in_class && (c == 'b' || c == 'B' || c == 'A' || c == 'z' || c == 'Z' || c == '<' || c == '>')) {
+					return fail(std::string("the assertion \\") + c + " is not supported");
+				}
+				if (std::isalnum(static_cast<unsigned char>(c))) {
+					return fail(std::string("unknown escape \\") + c);
+				}
+				bytes.set(static_cast<unsigned char>(c));
+				return true;
+			}
+
+			if (std::isupper(static_cast<unsigned char>(c))) {
+				bytes.flip();
+				bytes.reset('\n');
+			}
+			return true;
+		}
+
+		const std::string& pattern_;
+		std::string& error_;
+		const bool case_insensitive_;
+		std::size_t position_ = 0;
+	};
+
+	/**
+	 * Builds the Thompson NFA of a parsed expression.
+	 */
+	class Compiler {
+	public:
+		Compiler(std::vector<State>& states, std::vector<std::bitset<256>>& byte_sets) : states_(states), byte_sets_(byte_sets) {
+		}
+
+		/**
+		 * @return The start state, or -1 if the NFA grew too large.
+		 */
+		int compile(const Node& root) {
+			Fragment fragment;
+			if (!build(root, fragment)) {
+				return -1;
+			}
+			patch(fragment.outs, add(State::Kind::Match));
+			return too_large_ ? -1 : fragment.start;
+		}
+
+	private:
+		// A dangling output of a state: the state and whether it is the second output.
+		using Out = std::pair<int, bool>;
+
+		/**
+		 * A piece of the NFA with one entry and the outputs still to connect.
+		 */
+		struct Fragment {
+			int start = -1;
+			std::vector<Out> outs;
+		};
+
+		int add(State::Kind kind, int byte_set = -1) {
+			if (states_.size() >= max_nfa_states) {
+				too_large_ = true;
+			}
+			State state;
+			state.kind = kind;
+			state.byte_set = byte_set;
+			states_.push_back(state);
+			return static_cast<int>(states_.size()) - 1;
+		}
+
+		void patch(const std::vector<Out>& outs, int target) {
+			for (const auto& [state, second] : outs) {
+				(second ? states_[state].out1 : states_[state].out) = target;
+			}
+		}
+
+		Fragment single(State::Kind kind, int byte_set = -1) {
+			const int state = add(kind, byte_set);
+			return {state, {{state, false}}};
+		}
+
+		/**
+		 * Appends a fragment to a sequence, which starts out with no start state.
+		 */
+		void append(Fragment& sequence, Fragment next) {
+			if (sequence.start == -1) {
+				sequence = std::move(next);
+				return;
+			}
+			patch(sequence.outs, next.start);
+			sequence.outs = std::move(next.outs);
+		}
+
+		bool build(const Node& node, Fragment& fragment) {
+			if (too_large_) {
+				return false;
+			}
+
+			switch (node.kind) {
+			case Node::Kind::Empty:
+				fragment = single(State::Kind::Jump);
+				return true;
+			case Node::Kind::Bytes:
+				byte_sets_.push_back(node.bytes);
+				fragment = single(State::Kind::Bytes, static_cast<int>(byte_sets_.size()) - 1);
+				return true;
+			case Node::Kind::LineStart:
+				fragment = single(State::Kind::LineStart);
+				return true;
+			case Node::Kind::LineEnd:
+				fragment = single(State::Kind::LineEnd);
+				return true;
+			case Node::Kind::Concat:
+				for (const Node& child : node.children) {
+					Fragment next;
+					if (!build(child, next)) {
+						return false;
+					}
+					append(fragment, std::move(next));
+				}
+				return true;
+			case Node::Kind::Alternate: {
+				// A chain of splits, one per alternative but the last.
+				std::vector<Out> outs;
+				Out entry{-1, false};
+				for (std::size_t i = 0; i < node.children.size(); ++i) {
+					Fragment branch;
+					if (!build(node.children[i], branch)) {
+						return false;
+					}
+					int target = branch.start;
+					if (i + 1 < node.children.size()) {
+						const int split = add(State::Kind::Split);
+						states_[split].out = branch.start;
+						target = split;
+					}
+					if (entry.first == -1) {
+						fragment.start = target;
+					}
+					else {
+						patch({entry}, target);
+					}
+					entry = {target, true};
+					outs.insert(outs.end(), branch.outs.begin(), branch.outs.end());
+				}
+				fragment.outs = std::move(outs);
+				return true;
+			}
+			case Node::Kind::Repeat:
+				return buildRepeat(node, fragment);
+			}
+			return false;
+		}
+
+		bool buildRepeat(const Node& node, Fragment& fragment) {
+			const Node& child = node.children[0];
+
+			// The mandatory copies, except the last one of an unbounded repeat, which loops.
+			const int copies = node.max == -1 && node.min > 0 ? node.min - 1 : node.min;
+			for (int i = 0; i < copies; ++i) {
+				Fragment copy;
+				if (!build(child, copy)) {
+					return false;
+				}
+				append(fragment, std::move(copy));
+			}
+
+			if (node.max == -1) {
+				Fragment body;
+				if (!build(child, body)) {
+					return false;
+				}
+				const int split = add(State::Kind::Split);
+				states_[split].out = body.start;
+				patch(body.outs, split);
+				append(fragment, {node.min > 0 ? body.start : split, {{split, true}}});
+			}
+			else {
+				for (int i = node.min; i < node.max; ++i) {
+					Fragment body;
+					if (!build(child, body)) {
+						return false;
+					}
+					const int split = add(State::Kind::Split);
+					states_[split].out = body.start;
+					body.outs.push_back({split, true});
+					append(fragment, {split, std::move(body.outs)});
+				}
+			}
+
+			if (fragment.start == -1) {
+				fragment = single(State::Kind::Jump);
+			}
+			return true;
+		}
+
+		std::vector<State>& states_;
+		std::vector<std::bitset<256>>& byte_sets_;
+		bool too_large_ = false;
+	};
+
+	/**
+	 * A set of literals, sorted and without duplicates.
+	 */
+	using LiteralSet = std::vector<std::string>;
+
+	/**
+	 * What a node tells about the literals in its matches. Ignoring case, the literals have their ASCII
+	 * letters in lower case, and are searched for ignoring case.
+	 */
+	struct LiteralInfo {
+		// Set when the node only ever matches one of these strings.
+		std::optional<LiteralSet> exact;
+		// Strings one of which is found in every match of the node, empty if none is known.
+		LiteralSet required;
+	};
+
+	void normalize(LiteralSet& set) {
+		std::sort(set.begin(), set.end());
+		set.erase(std::unique(set.begin(), set.end()), set.end());
+	}
+
+	std::size_t shortest(const LiteralSet& set) {
+		std::size_t length = set.empty() ? 0 : set[0].size();
+		for (const auto& literal : set) {
+			length = std::min(length, literal.size());
+		}
+		return length;
+	}
+
+	/**
+	 * @return The set that filters better: the one whose shortest literal is longer, or else the smaller one.
+	 */
+	const LiteralSet& better(const LiteralSet& a, const LiteralSet& b) {
+		const std::size_t a_shortest = shortest(a);
+		const std::size_t b_shortest = shortest(b);
+		if (a_shortest != b_shortest) {
+			return b_shortest > a_shortest ? b : a;
+		}
+		return !b.empty() && (a.empty() || b.size() < a.size()) ? b : a;
+	}
+
+	/**
+	 * @return Every literal of one set followed by every literal of the other, or nothing if there would be too many.
+	 */
+	std::optional<LiteralSet> concatenate(const LiteralSet& a, const LiteralSet& b) {
+		if (a.size() * b.size() > max_literal_set) {
+			return std::nullopt;
+		}
+		LiteralSet joined;
+		for (const auto& head : a) {
+			for (const auto& tail : b) {
+				joined.push_back(head + tail);
+			}
+		}
+		normalize(joined);
+		return joined;
+	}
+
+	LiteralInfo extractLiterals(const Node& node, bool case_insensitive) {
+		LiteralInfo info;
+		switch (node.kind) {
+		case Node::Kind::Empty:
+		case Node::Kind::LineStart:
+		case Node::Kind::LineEnd:
+			info.exact = LiteralSet{""};
+			break;
+		case Node::Kind::Bytes: {
+			LiteralSet bytes;
+			for (int byte = 0; byte < 256 && bytes.size() <= max_literal_bytes * 2; ++byte) {
+				if (node.bytes.test(byte)) {
+					const char c = static_cast<char>(byte);
+					bytes.emplace_back(1, case_insensitive ? foldAscii(c) : c);
+				}
+			}
+			normalize(bytes);
+			if (bytes.size() <= max_literal_bytes) {
+				info.exact = std::move(bytes);
+			}
+			break;
+		}
+		case Node::Kind::Concat: {
+			// Adjacent exact children join into one run, any other child ends the run, and so does a run growing too large.
+			LiteralSet run{""};
+			bool all_exact = true;
+			for (const Node& child : node.children) {
+				LiteralInfo child_info = extractLiterals(child, case_insensitive);
+				if (child_info.exact) {
+					if (auto joined = concatenate(run, *child_info.exact)) {
+						run = std::move(*joined);
+						continue;
+					}
+					all_exact = false;
+					info.required = better(info.required, run);
+					run = std::move(*child_info.exact);
+					continue;
+				}
+				all_exact = false;
+				info.required = better(better(info.required, run), child_info.required);
+				run = LiteralSet{""};
+			}
+			if (all_exact) {
+				info.exact = run;
+			}
+			info.required = better(info.required, run);
+			break;
+		}
+		case Node::Kind::Alternate: {
+			// Every alternative contributes its own literals.
+			LiteralSet exact;
+			LiteralSet required;
+			bool all_exact = true;
+			bool all_required = true;
+			for (const Node& child : node.children) {
+				const LiteralInfo child_info = extractLiterals(child, case_insensitive);
+				if (child_info.exact) {
+					exact.insert(exact.end(), child_info.exact->begin(), child_info.exact->end());
+				}
+				else {
+					all_exact = false;
+				}
+				all_required = all_required && !child_info.required.empty();
+				required.insert(required.end(), child_info.required.begin(), child_info.required.end());
+			}
+			normalize(exact);
+			normalize(required);
+			if (all_exact && exact.size() <= max_literal_set) {
+				info.exact = std::move(exact);
+			}
+			else if (all_required && required.size() <= max_literal_set) {
+				info.required = std::move(required);
+			}
+			break;
+		}
+		case Node::Kind::Repeat: {
+			const LiteralInfo child_info = extractLiterals(node.children[0], case_insensitive);
+			if (node.min == 0) {
+				break;
+			}
+			if (child_info.exact && node.min == node.max) {
+				std::optional<LiteralSet> repeated = LiteralSet{""};
+				for (int i = 0; repeated && i < node.min; ++i) {
+					repeated = concatenate(*repeated, *child_info.exact);
+				}
+				if (repeated) {
+					info.exact = std::move(repeated);
+					break;
+				}
+			}
+			info.required = child_info.required;
+			break;
+		}
+		}
+
+		if (info.exact) {
+			info.required = *info.exact;
+		}
+		return info;
+	}
+
+	std::atomic<std::uint64_t> next_matcher_id{0};
+}
+
+
+/**
+ * The lazily built DFA of a matcher, owned by a single thread.
+ *
+ * A DFA state is the set of NFA states the search can be in, reduced to the states that consume
+ * input and the match state. The transitions of a state are filled in the first time they are taken.
+ * The newline is a byte class of its own: its transition leads to the match state when the line ends
+ * in a match, and back to the start state otherwise.
+ */
+class RegexMatcher::Dfa {
+public:
+	// The transition table is flushed when it would grow over this many entries.
+	static constexpr std::size_t max_table_entries = std::size_t{1} << 20;
+
+	explicit Dfa(const RegexMatcher& regex) : regex_(regex), owner_(regex.id_), stride_(regex.class_representative_.size()),
+		max_states_(std::max<std::size_t>(16, max_table_entries / stride_)), marks_(regex.states_.size(), 0) {
+	}
+
+	/**
+	 * @return The id of the matcher the DFA belongs to, which stays valid after the matcher is gone.
+	 */
+	std::uint64_t owner() const {
+		return owner_;
+	}
+
+	/**
+	 * @return The state at the start of a line.
+	 */
+	int start() {
+		if (start_ == -1) {
+			std::vector<int> set;
+			newGeneration();
+			closure(regex_.start_, true, false, set);
+			set.push_back(line_start_key);
+			start_ = intern(set);
+		}
+		return start_;
+	}
+
+	int next(int state, std::uint8_t byte_class) {
+		const int target = table_[state * stride_ + byte_class];
+		return target >= 0 ? target : compute(state, byte_class);
+	}
+
+	/**
+	 * @return Whether the state is the match state or the dead state, the two states that end the search of a line.
+	 */
+	bool isFinal(int state) const {
+		return flags_[state] != 0;
+	}
+
+	bool isMatch(int state) const {
+		return flags_[state] == match_flag;
+	}
+
+private:
+	static constexpr std::uint8_t match_flag = 1;
+	static constexpr std::uint8_t dead_flag = 2;
+	// Stands for the set of the match state, which is never looked into.
+	static constexpr int match_key = -1;
+	// Tells the start state apart from a state with the same NFA states later in the line.
+	static constexpr int line_start_key = -2;
+
+	/**
+	 * Forgets the NFA states visited while building the previous set.
+	 */
+	void newGeneration() {
+		if (++generation_ == 0) {
+			std::fill(marks_.begin(), marks_.end(), 0);
+			generation_ = 1;
+		}
+	}
+
+	/**
+	 * Adds the states consuming input or matching that are reachable from a state without consuming input.
+	 */
+	void closure(int state, bool at_line_start, bool at_line_end, std::vector<int>& set) {
+		stack_.push_back(state);
+		while (!stack_.empty()) {
+			const int current = stack_.back();
+			stack_.pop_back();
+			if (current == -1 || marks_[current] == generation_) {
+				continue;
+			}
+			marks_[current] = generation_;
+
+			const State& nfa_state = regex_.states_[current];
+			switch (nfa_state.kind) {
+			case State::Kind::Bytes:
+			case State::Kind::Match:
+				set.push_back(current);
+				break;
+			case State::Kind::LineStart:
+				if (at_line_start) {
+					stack_.push_back(nfa_state.out);
+				}
+				break;
+			case State::Kind::LineEnd:
+				// Kept in the set until the newline shows whether the line ends here.
+				if (at_line_end) {
+					stack_.push_back(nfa_state.out);
+				}
+				else {
+					set.push_back(current);
+				}
+				break;
+			case State::Kind::Split:
+				stack_.push_back(nfa_state.out1);
+				stack_.push_back(nfa_state.out);
+				break;
+			case State::Kind::Jump:
+				stack_.push_back(nfa_state.out);
+				break;
+			}
+		}
+	}
+
+	int compute(int state, std::uint8_t byte_class) {
+		std::vector<int> set;
+		newGeneration();
+		const bool newline = byte_class == regex_.byte_class_[static_cast<unsigned char>('\n')];
+		const std::vector<int>& source = sets_[state];
+		if (newline) {
+			// An empty line ends where it starts.
+			const bool at_line_start = !source.empty() && source.front() == line_start_key;
+			for (int nfa_state : source) {
+				if (nfa_state >= 0 && regex_.states_[nfa_state].kind == State::Kind::LineEnd) {
+					closure(regex_.states_[nfa_state].out, at_line_start, true, set);
+				}
+			}
+		}
+		else {
+			const unsigned char byte = regex_.class_representative_[byte_class];
+			for (int nfa_state : source) {
+				if (nfa_state < 0) {
+					continue;
+				}
+				const State& nfa = regex_.states_[nfa_state];
+				if (nfa.kind == State::Kind::Bytes && regex_.byte_sets_[nfa.byte_set].test(byte)) {
+					closure(nfa.out, false, false, set);
+				}
+			}
+			// The search is unanchored: a match can start after any byte.
+			closure(regex_.start_, false, false, set);
+		}
+
+		// Building the target may flush the cache, which leaves the source state behind.
+		const bool flush = sets_.size() >= max_states_;
+		if (flush) {
+			clear();
+		}
+
+		// A line that ends without a match starts the next line over.
+		const int target = newline && !containsMatch(set) ? start() : intern(set);
+		if (!flush) {
+			table_[state * stride_ + byte_class] = target;
+		}
+		return target;
+	}
+
+	bool containsMatch(const std::vector<int>& set) const {
+		return std::any_of(set.begin(), set.end(), [&](int nfa_state) {
+			return nfa_state >= 0 && regex_.states_[nfa_state].kind == State::Kind::Match;
+		});
+	}
+
+	/**
+	 * @return The DFA state for a set of NFA states, added if it is new.
+	 */
+	int intern(std::vector<int>& set) {
+		// All sets with the match state in them end the search of the line the same way.
+		if (containsMatch(set)) {
+			set.assign(1, match_key);
+		}
+		std::sort(set.begin(), set.end());
+		std::string key(reinterpret_cast<const char*>(set.data()), set.size() * sizeof(int));
+		const auto [found, inserted] = index_.try_emplace(std::move(key), static_cast<int>(sets_.size()));
+		if (!inserted) {
+			return found->second;
+		}
+
+		std::uint8_t flags = 0;
+		if (set.size() == 1 && set[0] == match_key) {
+			flags = match_flag;
+			set.clear();
+		}
+		else if (set.empty()) {
+			flags = dead_flag;
+		}
+		sets_.push_back(set);
+		flags_.push_back(flags);
+		table_.resize(table_.size() + stride_, -1);
+		return found->second;
+	}
+
+	void clear() {
+		sets_.clear();
+		index_.clear();
+		flags_.clear();
+		table_.clear();
+		start_ = -1;
+	}
+
+	const RegexMatcher& regex_;
+	const std::uint64_t owner_;
+	const std::size_t stride_;
+	const std::size_t max_states_;
+	std::vector<std::vector<int>> sets_;
+	std::unordered_map<std::string, int> index_;
+	std::vector<std::uint8_t> flags_;
+	// The target of every state and byte class, -1 until the transition is first taken.
+	std::vector<int> table_;
+	int start_ = -1;
+	// Marks the NFA states already visited while building the current set.
+	std::vector<std::uint32_t> marks_;
+	std::uint32_t generation_ = 0;
+	std::vector<int> stack_;
+};
+
+
+std::unique_ptr<RegexMatcher> RegexMatcher::compile(const std::string& pattern, std::string& error, bool case_insensitive) {
+	Node root;
+	Parser parser(pattern, error, case_insensitive);
+	if (!parser.parse(root)) {
+		return nullptr;
+	}
+
+	std::vector<State> states;
+	std::vector<std::bitset<256>> byte_sets;
+	const int start = Compiler(states, byte_sets).compile(root);
+	if (start == -1) {
+		error = "expression too large";
+		return nullptr;
+	}
+
+	LiteralSet required = extractLiterals(root, case_insensitive).required;
+	if (shortest(required) == 0) {
+		required.clear();
+	}
+	return std::unique_ptr<RegexMatcher>(new RegexMatcher(std::move(states), std::move(byte_sets), start, std::move(required), case_insensitive));
+}
+
+
+std::string RegexMatcher::escape(const std::string& literal) {
+	std::string escaped;
+	for (const char c : literal) {
+		// Escaping anything but a letter or a digit makes it literal, the bytes outside ASCII are literal as they are.
+		if (static_cast<unsigned char>(c) < 0x80 && !std::isalnum(static_cast<unsigned char>(c))) {
+			escaped += '\\';
+		}
+		escaped += c;
+	}
+	return escaped;
+}
+
+
+RegexMatcher::RegexMatcher(std::vector<NfaState> states, std::vector<std::bitset<256>> byte_sets, int start, std::vector<std::string> required_literals, bool case_insensitive)
+	: states_(std::move(states)), byte_sets_(std::move(byte_sets)), start_(start), required_literals_(std::move(required_literals)), id_(next_matcher_id++) {
+	// Bytes in the same sets share a class; the newline always gets a class of its own.
+	std::map<std::vector<bool>, std::uint8_t> classes;
+	for (int byte = 0; byte < 256; ++byte) {
+		std::vector<bool> signature;
+		signature.reserve(byte_sets_.size() + 1);
+		signature.push_back(byte == '\n');
+		for (const auto& byte_set : byte_sets_) {
+			signature.push_back(byte_set.test(byte));
+		}
+		const auto [found, inserted] = classes.try_emplace(std::move(signature), static_cast<std::uint8_t>(class_representative_.size()));
+		if (inserted) {
+			class_representative_.push_back(static_cast<std::uint8_t>(byte));
+		}
+		byte_class_[byte] = found->second;
+	}
+
+	if (required_literals_.size() == 1) {
+		prefilter_ = std::make_unique<LiteralMatcher>(required_literals_[0], case_insensitive);
+	}
+	else if (!required_literals_.empty()) {
+		// The required literals have every case of their letters outside ASCII already.
+		prefilter_ = MultiLiteralMatcher::createExpanded(required_literals_, case_insensitive);
+	}
+}
+
+
+const char* RegexMatcher::findLine(const char* begin, const char* end) const {
+	Dfa& dfa = this->dfa();
+
+	// An expression that matches the empty line matches every line.
+	if (dfa.isMatch(dfa.start())) {
+		return begin;
+	}
+	if (!prefilter_) {
+		return findWithDfa(dfa, begin, end);
+	}
+
+	// Only the lines containing a required literal can match.
+	const char* position = begin;
+	while (position < end) {
+		const char* hit = prefilter_->findLine(position, end);
+		if (hit == nullptr) {
+			return nullptr;
+		}
+
+		const char* line_begin = findLastNewline(position, hit);
+		line_begin = line_begin == nullptr ? position : line_begin + 1;
+		const char* line_end = static_cast<const char*>(std::memchr(hit, '\n', end - hit));
+		line_end = line_end == nullptr ? end : line_end;
+		if (matchesLine(dfa, line_begin, line_end)) {
+			return hit;
+		}
+		if (line_end == end) {
+			return nullptr;
+		}
+		position = line_end + 1;
+	}
+	return nullptr;
+}
+
+
+std::vector<std::string> RegexMatcher::requiredLiterals() const {
+	return required_literals_;
+}
+
+
+/**
+ * Runs the DFA over a run of lines, restarting at every newline.
+ */
+const char* RegexMatcher::findWithDfa(Dfa& dfa, const char* begin, const char* end) const {
+	int state = dfa.start();
+	for (const char* position = begin; position < end; ++position) {
+		state = dfa.next(state, byte_class_[static_cast<unsigned char>(*position)]);
+		if (!dfa.isFinal(state)) {
+			continue;
+		}
+		if (dfa.isMatch(state)) {
+			return position;
+		}
+
+		// Nothing on the rest of the line can match any more.
+		position = static_cast<const char*>(std::memchr(position, '\n', end - position));
+		if (position == nullptr) {
+			return nullptr;
+		}
+		state = dfa.start();
+	}
+
+	// The last line has no newline, so end it by hand.
+	if (end > begin && end[-1] != '\n' && dfa.isMatch(dfa.next(state, byte_class_[static_cast<unsigned char>('\n')]))) {
+		return end - 1;
+	}
+	return nullptr;
+}
+
+
+/**
+ * Runs the DFA over a single line without its newline.
+ */
+bool RegexMatcher::matchesLine(Dfa& dfa, const char* begin, const char* end) const {
+	int state = dfa.start();
+	for (const char* position = begin; position < end; ++position) {
+		state = dfa.next(state, byte_class_[static_cast<unsigned char>(*position)]);
+		if (dfa.isFinal(state)) {
+			return dfa.isMatch(state);
+		}
+	}
+	return dfa.isMatch(dfa.next(state, byte_class_[static_cast<unsigned char>('\n')]));
+}
+
+
+/**
+ * @return The DFA cache of the calling thread, built anew when the thread last searched with another matcher.
+ */
+RegexMatcher::Dfa& RegexMatcher::dfa() const {
+	thread_local std::unique_ptr<Dfa> cache;
+	if (cache == nullptr || cache->owner() != id_) {
+		cache = std::make_unique<Dfa>(*this);
+	}
+	return *cache;
+}
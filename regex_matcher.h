@@ -0,0 +1,100 @@
+#ifndef SPECIFIC_GREP_REGEX_MATCHER_H
+#define SPECIFIC_GREP_REGEX_MATCHER_H
+
+#include <bitset>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "line_matcher.h"
+
+/**
+ * Searches for lines matching a regular expression.
+ *
+ * The expression is compiled to a Thompson NFA, which is turned into a DFA lazily while searching:
+ * a DFA state is only built the first time the search reaches it, and the built states are cached per
+ * worker thread. The cache is bounded; when it is full it is flushed and rebuilt from the current state,
+ * so the search stays linear in the size of the input whatever the expression.
+ *
+ * A literal that every match must contain is extracted from the expression when there is one, or
+ * else a small set of literals one of which every match contains. The literal kernel, or Teddy for a
+ * set, then skips straight to the lines containing them, and only those lines are run through the DFA.
+ * Ignoring case, the letters outside ASCII match through the alternation of their cases, which keeps
+ * both in the literal set, so the search of UTF-8 text stays vectorized.
+ *
+ * The syntax is the usual extended syntax: literals, ".", "[...]" classes with ranges and "[:name:]"
+ * classes, "\d \w \s" and their negations, "^" and "$" for the start and the end of the line, groups,
+ * "|", "*", "+", "?" and "{n,m}". The expression works on bytes; backreferences and word boundaries
+ * are not supported.
+ */
+class RegexMatcher final : public LineMatcher {
+public:
+	/**
+	 * Compiles a regular expression.
+	 *
+	 * @param pattern The regular expression.
+	 * @param error Set to the reason when the expression is invalid.
+	 * @param case_insensitive Whether to ignore the case of letters.
+	 * @return The matcher, or nullptr if the expression is invalid.
+	 */
+	static std::unique_ptr<RegexMatcher> compile(const std::string& pattern, std::string& error, bool case_insensitive = false);
+
+	/**
+	 * @return A regular expression matching a literal string.
+	 */
+	static std::string escape(const std::string& literal);
+
+	const char* findLine(const char* begin, const char* end) const override;
+
+	/**
+	 * @return The literals one of which every match contains, empty if the expression has none.
+	 */
+	std::vector<std::string> requiredLiterals() const override;
+
+	/**
+	 * A compiled NFA state.
+	 */
+	struct NfaState {
+		enum class Kind : std::uint8_t {
+			// Consumes a byte of the set.
+			Bytes,
+			// Consumes the end of the line.
+			LineEnd,
+			// Passes only at the start of the line.
+			LineStart,
+			// Passes to both outputs.
+			Split,
+			// Passes to the output.
+			Jump,
+			Match
+		};
+
+		Kind kind;
+		int out = -1;
+		int out1 = -1;
+		int byte_set = -1;
+	};
+
+private:
+	class Dfa;
+
+	RegexMatcher(std::vector<NfaState> states, std::vector<std::bitset<256>> byte_sets, int start, std::vector<std::string> required_literals, bool case_insensitive);
+
+	const char* findWithDfa(Dfa& dfa, const char* begin, const char* end) const;
+	bool matchesLine(Dfa& dfa, const char* begin, const char* end) const;
+	Dfa& dfa() const;
+
+	std::vector<NfaState> states_;
+	std::vector<std::bitset<256>> byte_sets_;
+	int start_;
+	// The bytes are grouped into classes that no state of the NFA tells apart, which keeps the DFA table small.
+	std::uint8_t byte_class_[256];
+	std::vector<std::uint8_t> class_representative_;
+	std::vector<std::string> required_literals_;
+	std::unique_ptr<LineMatcher> prefilter_;
+	// Identifies the matcher to the per-thread DFA caches.
+	std::uint64_t id_;
+};
+
+#endif
@@ -0,0 +1,276 @@
+#include "result_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+#include <tuple>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+/**
+ * The start of the cache file. All offsets are in bytes from the start of the file.
+ */
+struct ResultCache::Header {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t reserved;
+	std::uint64_t entry_count;
+	std::uint64_t entries_offset;
+	std::uint64_t paths_offset;
+	std::uint64_t paths_size;
+	std::uint64_t matches_offset;
+	std::uint64_t matches_size;
+};
+
+/**
+ * A file searched for a query, in the order of the queries and then of the paths.
+ */
+struct ResultCache::EntryRecord {
+	std::uint64_t query_hash;
+	std::uint64_t size;
+	std::int64_t modified_ns;
+	std::uint64_t inode;
+	// The path, from the start of the paths.
+	std::uint64_t path_offset;
+	std::uint32_t path_length;
+	std::uint32_t match_count;
+	// The matches, from the start of the matches, each a StoredMatch followed by its line.
+	std::uint64_t matches_offset;
+	std::uint64_t matches_size;
+};
+
+/**
+ * A match as laid out in the cache, unaligned.
+ */
+struct ResultCache::StoredMatch {
+	std::uint64_t line_number;
+	std::uint64_t byte_offset;
+	std::uint32_t pattern_index;
+	std::uint32_t line_length;
+};
+
+namespace {
+	constexpr char cache_magic[8] = {'S', 'G', 'R', 'C', 'A', 'C', 'H', 'E'};
+	constexpr std::uint32_t cache_version = 2;
+
+	template <typename T>
+	void appendRaw(std::vector<char>& out, const T& value) {
+		const char* bytes = reinterpret_cast<const char*>(&value);
+		out.insert(out.end(), bytes, bytes + sizeof(T));
+	}
+
+	void alignTo8(std::vector<char>& out) {
+		out.resize((out.size() + 7) & ~std::size_t{7}, 0);
+	}
+}
+
+
+ResultCache::ResultCache(fs::path cache_path, std::uint64_t query_hash) : cache_path_(std::move(cache_path)), query_hash_(query_hash) {
+	std::error_code error;
+	if (fs::exists(cache_path_, error) && !open()) {
+		std::cerr << "Warning: ignoring the invalid result cache " << cache_path_.string() << ", it is rebuilt." << std::endl;
+		close();
+	}
+}
+
+
+ResultCache::~ResultCache() {
+	close();
+}
+
+
+std::uint64_t ResultCache::hashQuery(std::string_view query) {
+	// FNV-1a.
+	std::uint64_t hash = 0xcbf29ce484222325;
+	for (const char c : query) {
+		hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+	}
+	return hash;
+}
+
+
+/**
+ * Maps the old cache and checks that its tables lie within the file.
+ */
+bool ResultCache::open() {
+	if (!file_.open(cache_path_) || file_.size() < sizeof(Header)) {
+		return false;
+	}
+	const std::size_t size = file_.size();
+	header_ = reinterpret_cast<const Header*>(file_.data());
+	auto fits = [&](std::uint64_t offset, std::uint64_t count, std::uint64_t element_size) {
+		return offset <= size && count <= (size - offset) / element_size;
+	};
+	if (std::memcmp(header_->magic, cache_magic, sizeof(cache_magic)) != 0 || header_->version != cache_version
+		|| !fits(header_->entries_offset, header_->entry_count, sizeof(EntryRecord))
+		|| !fits(header_->paths_offset, header_->paths_size, 1)
+		|| !fits(header_->matches_offset, header_->matches_size, 1)) {
+		return false;
+	}
+	entries_ = reinterpret_cast<const EntryRecord*>(file_.data() + header_->entries_offset);
+	for (std::uint64_t i = 0; i < header_->entry_count; ++i) {
+		const EntryRecord& entry = entries_[i];
+		if (entry.path_offset > header_->paths_size || entry.path_length > header_->paths_size - entry.path_offset
+			|| entry.matches_offset > header_->matches_size || entry.matches_size > header_->matches_size - entry.matches_offset) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+void ResultCache::close() {
+	file_.close();
+	header_ = nullptr;
+	entries_ = nullptr;
+}
+
+
+std::string_view ResultCache::entryPath(const EntryRecord& entry) const {
+	return std::string_view(file_.data() + header_->paths_offset + entry.path_offset, entry.path_length);
+}
+
+
+const ResultCache::EntryRecord* ResultCache::findEntry(std::uint64_t query_hash, std::string_view path) const {
+	if (header_ == nullptr) {
+		return nullptr;
+	}
+	const EntryRecord* end = entries_ + header_->entry_count;
+	const EntryRecord* found = std::lower_bound(entries_, end, std::tie(query_hash, path), [&](const EntryRecord& entry, const auto& value) {
+		return std::make_tuple(entry.query_hash, entryPath(entry)) < value;
+	});
+	return found != end && found->query_hash == query_hash && entryPath(*found) == path ? found : nullptr;
+}
+
+
+/**
+ * Decodes the matches of an entry.
+ *
+ * @return True on success, false if the matches run out of the entry.
+ */
+bool ResultCache::decodeMatches(const EntryRecord& entry, std::vector<Match>& matches) const {
+	matches.clear();
+	const char* position = file_.data() + header_->matches_offset + entry.matches_offset;
+	const char* const end = position + entry.matches_size;
+	for (std::uint32_t i = 0; i < entry.match_count; ++i) {
+		StoredMatch match;
+		if (static_cast<std::size_t>(end - position) < sizeof(match)) {
+			return false;
+		}
+		std::memcpy(&match, position, sizeof(match));
+		position += sizeof(match);
+		if (static_cast<std::size_t>(end - position) < match.line_length) {
+			return false;
+		}
+		matches.push_back({match.line_number, match.pattern_index, std::string_view(position, match.line_length), match.byte_offset});
+		position += match.line_length;
+	}
+	return true;
+}
+
+
+bool ResultCache::find(const fs::path& file_path, std::vector<Match>& matches) {
+	FileStamp stamp;
+	if (!readFileStamp(file_path, stamp)) {
+		return false;
+	}
+	const EntryRecord* entry = findEntry(query_hash_, file_path.string());
+	if (entry == nullptr || !(stamp == FileStamp{entry->size, entry->modified_ns, entry->inode}) || !decodeMatches(*entry, matches)) {
+		return false;
+	}
+	hits_.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+
+void ResultCache::store(const fs::path& file_path, const FileStamp& stamp, const std::vector<Match>& matches) {
+	Entry entry{query_hash_, file_path.string(), stamp, static_cast<std::uint32_t>(matches.size()), {}};
+	for (const auto& match : matches) {
+		const StoredMatch stored{match.line_number, match.byte_offset, match.pattern_index, static_cast<std::uint32_t>(match.line.size())};
+		entry.matches.append(reinterpret_cast<const char*>(&stored), sizeof(stored));
+		entry.matches.append(match.line);
+	}
+	std::lock_guard lock(stored_mutex_);
+	stored_.push_back(std::move(entry));
+}
+
+
+bool ResultCache::save(std::string& error) {
+	// Nothing to write when every file came from the cache.
+	if (stored_.empty()) {
+		return true;
+	}
+	std::sort(stored_.begin(), stored_.end(), [](const Entry& lhs, const Entry& rhs) {
+		return std::tie(lhs.query_hash, lhs.path) < std::tie(rhs.query_hash, rhs.path);
+	});
+
+	// Merge the files searched with the old entries, which are kept while their files are unchanged.
+	// The files of the old entries are only looked up once, however many queries they have entries for.
+	std::vector<char> entry_table;
+	std::vector<char> paths;
+	std::vector<char> match_data;
+	std::uint64_t entry_count = 0;
+	auto addEntry = [&](std::uint64_t query_hash, std::string_view path, const FileStamp& stamp, std::uint32_t match_count, std::string_view matches) {
+		appendRaw(entry_table, EntryRecord{query_hash, stamp.size, stamp.modified_ns, stamp.inode, paths.size(), static_cast<std::uint32_t>(path.size()), match_count, match_data.size(), matches.size()});
+		paths.insert(paths.end(), path.begin(), path.end());
+		match_data.insert(match_data.end(), matches.begin(), matches.end());
+		++entry_count;
+	};
+	std::unordered_map<std::string_view, bool> unchanged;
+	auto isUnchanged = [&](const EntryRecord& entry) {
+		const std::string_view path = entryPath(entry);
+		auto [found, inserted] = unchanged.try_emplace(path, false);
+		if (inserted) {
+			FileStamp stamp;
+			found->second = readFileStamp(fs::path(path), stamp) && stamp == FileStamp{entry.size, entry.modified_ns, entry.inode};
+		}
+		return found->second;
+	};
+
+	const std::uint64_t old_count = header_ == nullptr ? 0 : header_->entry_count;
+	std::uint64_t old_index = 0;
+	for (std::size_t i = 0; i <= stored_.size(); ++i) {
+		for (; old_index < old_count; ++old_index) {
+			const EntryRecord& entry = entries_[old_index];
+			const auto key = std::make_tuple(entry.query_hash, entryPath(entry));
+			if (i < stored_.size() && !(key < std::make_tuple(stored_[i].query_hash, std::string_view(stored_[i].path)))) {
+				break;
+			}
+			if (isUnchanged(entry)) {
+				addEntry(entry.query_hash, entryPath(entry), FileStamp{entry.size, entry.modified_ns, entry.inode}, entry.match_count,
+					std::string_view(file_.data() + header_->matches_offset + entry.matches_offset, entry.matches_size));
+			}
+		}
+		if (i < stored_.size()) {
+			const Entry& entry = stored_[i];
+			// The old entry of a file searched again is replaced.
+			if (old_index < old_count && entries_[old_index].query_hash == entry.query_hash && entryPath(entries_[old_index]) == entry.path) {
+				++old_index;
+			}
+			addEntry(entry.query_hash, entry.path, entry.stamp, entry.match_count, entry.matches);
+		}
+	}
+
+	Header header{};
+	std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+	header.version = cache_version;
+	header.entry_count = entry_count;
+	std::vector<char> content;
+	appendRaw(content, header);
+	alignTo8(content);
+	header.entries_offset = content.size();
+	content.insert(content.end(), entry_table.begin(), entry_table.end());
+	header.paths_offset = content.size();
+	header.paths_size = paths.size();
+	content.insert(content.end(), paths.begin(), paths.end());
+	header.matches_offset = content.size();
+	header.matches_size = match_data.size();
+	content.insert(content.end(), match_data.begin(), match_data.end());
+	std::memcpy(content.data(), &header, sizeof(header));
+
+	// The old cache is unmapped before it is replaced, which ends the lines of the matches found in it.
+	close();
+	return replaceFile(cache_path_, content, error);
+}
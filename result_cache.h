@@ -0,0 +1,130 @@
+#ifndef SPECIFIC_GREP_RESULT_CACHE_H
+#define SPECIFIC_GREP_RESULT_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "file_reader.h"
+#include "mapped_file.h"
+#include "search_results.h"
+
+/**
+ * An on-disk cache of the matches of every file searched, for running the same search over and over.
+ *
+ * Every entry holds the matches of one file for one query, the hash of what was searched for and how,
+ * and is only used while the size, mtime and inode of the file are those it had when it was searched.
+ * The search replays the matches of the files that are unchanged and only reads the others, so a
+ * repeated search of a tree that hardly changes costs little more than the lookup of its files. Files
+ * without matches are kept too, they are what most of the cache is.
+ *
+ * The file is memory-mapped and holds a table of the entries sorted by query and path, pointing to
+ * the lines of their matches. The cache is written again once the search is done, if any file was
+ * searched: the new cache is written next to the old one and renamed over it. The entries of other
+ * queries are kept as long as their files are unchanged.
+ */
+class ResultCache {
+public:
+	/**
+	 * A match of a cached file. The line points into the cache, and stays valid until save().
+	 */
+	using Match = LineMatch;
+
+	/**
+	 * Opens the cache. A missing cache is empty; an unreadable one is ignored with a warning and rebuilt.
+	 *
+	 * @param cache_path The path of the cache file.
+	 * @param query_hash The hash of the search, see hashQuery().
+	 */
+	ResultCache(std::filesystem::path cache_path, std::uint64_t query_hash);
+	~ResultCache();
+
+	ResultCache(const ResultCache&) = delete;
+	ResultCache& operator=(const ResultCache&) = delete;
+
+	/**
+	 * @return The hash of a description of a search: what it is for and everything that changes its matches.
+	 */
+	static std::uint64_t hashQuery(std::string_view query);
+
+	/**
+	 * Looks up the matches of a file found by the walk. Safe to call from all workers at once.
+	 *
+	 * @param file_path The path of the file.
+	 * @param matches Set to the matches of the file, in the order they were found, if it is cached.
+	 * @return True if the file is cached and unchanged, false if it has to be searched.
+	 */
+	bool find(const std::filesystem::path& file_path, std::vector<Match>& matches);
+
+	/**
+	 * Records the matches of a file that was searched. Safe to call from all workers at once.
+	 *
+	 * @param file_path The path of the file.
+	 * @param stamp The stamp of the file from before it was read.
+	 * @param matches The matches of the file, the lines are copied.
+	 */
+	void store(const std::filesystem::path& file_path, const FileStamp& stamp, const std::vector<Match>& matches);
+
+	/**
+	 * Writes the cache, if any file was searched. Call once after the walk.
+	 *
+	 * @param error Set to the reason on failure.
+	 * @return True on success, false if the cache could not be written.
+	 */
+	bool save(std::string& error);
+
+	/**
+	 * @return The number of files whose matches came from the cache.
+	 */
+	std::size_t filesCached() const {
+		return hits_.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * @return The number of files searched and stored in the cache.
+	 */
+	std::size_t filesStored() const {
+		return stored_.size();
+	}
+
+private:
+	struct Header;
+	struct EntryRecord;
+	struct StoredMatch;
+
+	/**
+	 * An entry of the new cache, with its matches already laid out.
+	 */
+	struct Entry {
+		std::uint64_t query_hash;
+		std::string path;
+		FileStamp stamp;
+		std::uint32_t match_count;
+		std::string matches;
+	};
+
+	bool open();
+	void close();
+	const EntryRecord* findEntry(std::uint64_t query_hash, std::string_view path) const;
+	std::string_view entryPath(const EntryRecord& entry) const;
+	bool decodeMatches(const EntryRecord& entry, std::vector<Match>& matches) const;
+
+	std::filesystem::path cache_path_;
+	std::uint64_t query_hash_;
+	// The old cache as mapped from disk, empty if there is none.
+	MappedFile file_;
+	const Header* header_ = nullptr;
+	const EntryRecord* entries_ = nullptr;
+
+	std::atomic<std::size_t> hits_ = 0;
+	// The files searched, kept under the mutex since misses are rare once the cache is warm.
+	std::mutex stored_mutex_;
+	std::vector<Entry> stored_;
+};
+
+#endif
@@ -0,0 +1,204 @@
+#include "result_format.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "output_writer.h"
+
+namespace {
+	// The parts of a binary result file start at a multiple of this.
+	constexpr std::uint64_t part_alignment = 8;
+
+	std::uint64_t alignPart(std::uint64_t offset) {
+		return (offset + part_alignment - 1) / part_alignment * part_alignment;
+	}
+
+	template <typename Record>
+	void appendRecord(std::string& text, const Record& record) {
+		text.append(reinterpret_cast<const char*>(&record), sizeof(record));
+	}
+
+	/**
+	 * Writes a binary result file: the header, the files, the matches of the files, their paths, and the lines of the matches.
+	 *
+	 * @param output The output of the result file.
+	 * @param files Every file with matches and its number of matches, or of records with context lines, in order.
+	 * @param matches The matches of the files in order, or nullptr for a file of counts only.
+	 * @param file_paths The path of every file of the path table, by its index.
+	 * @param flags The flags of the header.
+	 */
+	void writeBinary(std::ostream& output, const std::vector<std::pair<std::uint32_t, std::size_t>>& files, const std::vector<const MatchRecord*>* matches, const std::vector<std::string>& file_paths, std::uint32_t flags) {
+		// The sizes of the parts come first, the header holds all their offsets.
+		std::uint64_t paths_size = 0;
+		for (const auto& [file_index, match_count] : files) {
+			paths_size += file_paths[file_index].size();
+		}
+		std::uint64_t lines_size = 0;
+		const std::uint64_t record_count = matches ? matches->size() : 0;
+		if (matches) {
+			for (const MatchRecord* match : *matches) {
+				lines_size += match->line_length;
+				flags |= match->isContext() ? result_file_context : 0;
+			}
+		}
+
+		ResultFileHeader header{};
+		std::memcpy(header.magic, result_file_magic, sizeof(header.magic));
+		header.version = result_file_version;
+		header.flags = flags;
+		header.file_count = files.size();
+		header.record_count = record_count;
+		header.files_offset = sizeof(ResultFileHeader);
+		header.matches_offset = header.files_offset + files.size() * sizeof(ResultFileFile);
+		header.strings_offset = header.matches_offset + record_count * sizeof(ResultFileMatch);
+		header.strings_size = alignPart(paths_size + lines_size);
+
+		OutputWriter writer(output);
+		appendRecord(writer.buffer(), header);
+
+		// The paths of the files are first in the strings, the lines after them.
+		std::uint64_t path_offset = 0;
+		std::uint64_t first_match = 0;
+		for (const auto& [file_index, file_records] : files) {
+			ResultFileFile file{};
+			file.path_offset = path_offset;
+			file.path_length = static_cast<std::uint32_t>(file_paths[file_index].size());
+			file.match_count = file_records;
+			if (matches) {
+				// The records of the file hold its context lines as well, which are not matches.
+				const auto file_begin = matches->begin() + static_cast<std::ptrdiff_t>(first_match);
+				file.match_count = static_cast<std::uint64_t>(std::count_if(file_begin, file_begin + static_cast<std::ptrdiff_t>(file_records), [](const MatchRecord* match) { return !match->isContext(); }));
+				file.record_count = file_records;
+				file.first_match = first_match;
+			}
+			appendRecord(writer.buffer(), file);
+			writer.commit();
+			path_offset += file.path_length;
+			first_match += file_records;
+		}
+
+		if (matches) {
+			std::uint64_t line_offset = paths_size;
+			auto match = matches->begin();
+			for (std::uint32_t i = 0; i < files.size(); ++i) {
+				for (const auto file_end = match + static_cast<std::ptrdiff_t>(files[i].second); match != file_end; ++match) {
+					ResultFileMatch record{};
+					record.line_number = (*match)->line_number;
+					record.byte_offset = (*match)->byte_offset;
+					record.line_offset = line_offset;
+					record.line_length = (*match)->line_length;
+					record.file_index = i;
+					record.pattern_index = (*match)->pattern_index;
+					appendRecord(writer.buffer(), record);
+					writer.commit();
+					line_offset += record.line_length;
+				}
+			}
+		}
+
+		for (const auto& [file_index, file_matches] : files) {
+			writer.write(file_paths[file_index]);
+		}
+		if (matches) {
+			for (const MatchRecord* match : *matches) {
+				writer.write(match->line());
+			}
+		}
+		writer.write(std::string_view("\0\0\0\0\0\0\0", header.strings_size - paths_size - lines_size));
+	}
+}
+
+
+bool parseResultFormat(const std::string& name, ResultFormat& result_format) {
+	if (name == "text") {
+		result_format = ResultFormat::Text;
+	}
+	else if (name == "binary") {
+		result_format = ResultFormat::Binary;
+	}
+	else if (name == "jsonl") {
+		result_format = ResultFormat::JsonLines;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+
+const char* resultFileExtension(ResultFormat result_format) {
+	switch (result_format) {
+	case ResultFormat::Binary: return ".sgr";
+	case ResultFormat::JsonLines: return ".jsonl";
+	default: return ".txt";
+	}
+}
+
+
+void writeBinaryResults(std::ostream& output, const OrderedMatches& ordered, const std::vector<std::string>& file_paths, bool tag_patterns) {
+	writeBinary(output, ordered.files, &ordered.matches, file_paths, tag_patterns ? result_file_tagged : 0);
+}
+
+
+void writeBinaryCounts(std::ostream& output, const std::vector<std::pair<std::uint32_t, std::size_t>>& files, const std::vector<std::string>& file_paths) {
+	writeBinary(output, files, nullptr, file_paths, result_file_counts_only);
+}
+
+
+void appendJsonString(std::string& text, std::string_view value) {
+	static constexpr char hex_digits[] = "0123456789abcdef";
+	text += '"';
+	std::size_t begin = 0;
+	for (std::size_t i = 0; i < value.size(); ++i) {
+		const unsigned char byte = static_cast<unsigned char>(value[i]);
+		if (byte >= 0x20 && byte != '"' && byte != '\\') {
+			continue;
+		}
+		text.append(value.substr(begin, i - begin));
+		begin = i + 1;
+		switch (byte) {
+		case '"': text += "\\\""; break;
+		case '\\': text += "\\\\"; break;
+		case '\t': text += "\\t"; break;
+		case '\r': text += "\\r"; break;
+		case '\n': text += "\\n"; break;
+		default:
+			text += "\\u00";
+			text += hex_digits[byte >> 4];
+			text += hex_digits[byte & 0xf];
+		}
+	}
+	text.append(value.substr(begin));
+	text += '"';
+}
+
+
+void appendJsonMatch(std::string& text, std::string_view file_path, const MatchRecord& match, bool tag_patterns) {
+	text += "{\"path\":";
+	appendJsonString(text, file_path);
+	text += ",\"line\":";
+	appendNumber(text, match.line_number);
+	text += ",\"offset\":";
+	appendNumber(text, match.byte_offset);
+	if (match.isContext()) {
+		text += ",\"context\":true";
+	}
+	else if (tag_patterns) {
+		text += ",\"pattern\":";
+		appendNumber(text, static_cast<std::uint64_t>(match.pattern_index) + 1);
+	}
+	text += ",\"text\":";
+	appendJsonString(text, match.line());
+	text += "}\n";
+}
+
+
+void appendJsonFile(std::string& text, std::string_view file_path, std::size_t match_count, bool with_count) {
+	text += "{\"path\":";
+	appendJsonString(text, file_path);
+	if (with_count) {
+		text += ",\"count\":";
+		appendNumber(text, match_count);
+	}
+	text += "}\n";
+}
@@ -0,0 +1,168 @@
+#ifndef SPECIFIC_GREP_RESULT_FORMAT_H
+#define SPECIFIC_GREP_RESULT_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "result_order.h"
+#include "search_results.h"
+
+/**
+ * The format of the result file.
+ */
+enum class ResultFormat {
+	// One line per match, `<file>:<line number>: <line>`, with the stem of the file.
+	Text,
+	// The binary result file described below, to be mapped and read without parsing.
+	Binary,
+	// One JSON object per line and match, with the full path of the file.
+	JsonLines
+};
+
+/**
+ * How the matches are written to the result file.
+ */
+struct ResultLayout {
+	ResultFormat format = ResultFormat::Text;
+	// Whether to write the ID of the pattern found with every match, its line in the pattern file.
+	bool tag_patterns = false;
+	// Whether the text format writes the byte offset of every line, which the other formats always hold.
+	bool byte_offsets = false;
+	// Whether the matches come with context lines, whose groups the text format separates with context_group_separator.
+	bool context = false;
+};
+
+/**
+ * Parses the name of a result format: "text", "binary" or "jsonl".
+ *
+ * @param name The name of the result format.
+ * @param result_format Receives the result format.
+ * @return True on success, false if the name is unknown.
+ */
+bool parseResultFormat(const std::string& name, ResultFormat& result_format);
+
+/**
+ * @param result_format A result format.
+ * @return The extension of the result file in the format: ".txt", ".sgr" or ".jsonl".
+ */
+const char* resultFileExtension(ResultFormat result_format);
+
+
+/*
+ * The binary result file: a header, a table of the files with matches, a table of the matches and
+ * the strings the tables refer to, the paths and the lines. Every part starts at a multiple of 8 and
+ * every record is of a fixed size, so a reader maps the file and uses the records as they are, in
+ * the byte order of the machine that wrote them. The files and the matches are in the order of the
+ * text result file, the matches of every file in a row. With ResultMode::Count and ResultMode::Files
+ * the file has no matches, only the number of matches of every file. Context lines are records of
+ * the table of the matches with the pattern index context_line, among the matches of their file in
+ * the order of the lines; they are counted as records but not as matches.
+ */
+
+constexpr char result_file_magic[8] = { 'S', 'G', 'R', 'E', 'S', 'U', 'L', 'T' };
+constexpr std::uint32_t result_file_version = 1;
+// The flag of a result file with the numbers of matches of the files only.
+constexpr std::uint32_t result_file_counts_only = 1;
+// The flag of a result file with the patterns of a pattern file, see ResultFileMatch::pattern_index.
+constexpr std::uint32_t result_file_tagged = 2;
+// The flag of a result file with context lines among the matches.
+constexpr std::uint32_t result_file_context = 4;
+
+struct ResultFileHeader {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t flags;
+	std::uint64_t file_count;
+	// The number of records in the table of the matches, the matches and the context lines.
+	std::uint64_t record_count;
+	// The offsets of the parts from the start of the result file.
+	std::uint64_t files_offset;
+	std::uint64_t matches_offset;
+	std::uint64_t strings_offset;
+	std::uint64_t strings_size;
+};
+
+struct ResultFileFile {
+	// The path of the file as the search found it, from the start of the strings.
+	std::uint64_t path_offset;
+	std::uint32_t path_length;
+	std::uint32_t reserved;
+	// The number of matches of the file, without its context lines.
+	std::uint64_t match_count;
+	// The number of records of the file in the table of the matches, its matches and its context lines.
+	std::uint64_t record_count;
+	// The index of the first record of the file in the table of the matches.
+	std::uint64_t first_match;
+};
+
+struct ResultFileMatch {
+	// The 1-based number of the line in the file.
+	std::uint64_t line_number;
+	// The offset of the start of the line in the file, in the decompressed content of a compressed file.
+	std::uint64_t byte_offset;
+	// The text of the line without its newline, from the start of the strings.
+	std::uint64_t line_offset;
+	std::uint32_t line_length;
+	// The index of the file in the table of the files.
+	std::uint32_t file_index;
+	// The index of the pattern found in the line, its line in the pattern file minus one, or context_line.
+	std::uint32_t pattern_index;
+	std::uint32_t reserved;
+};
+
+static_assert(sizeof(ResultFileHeader) == 64 && sizeof(ResultFileFile) == 40 && sizeof(ResultFileMatch) == 40, "the records of the result file have a fixed size");
+
+/**
+ * Writes the ordered matches of a search as a binary result file.
+ *
+ * @param output The output of the result file.
+ * @param ordered The matches in order, see orderMatches.
+ * @param file_paths The path of every file of the path table, by its index.
+ * @param tag_patterns Whether the search was for the patterns of a pattern file.
+ */
+void writeBinaryResults(std::ostream& output, const OrderedMatches& ordered, const std::vector<std::string>& file_paths, bool tag_patterns);
+
+/**
+ * Writes the numbers of matches of the files as a binary result file without matches.
+ *
+ * @param output The output of the result file.
+ * @param files Every file with matches and its number of matches, in order, see orderCountedFiles.
+ * @param file_paths The path of every file of the path table, by its index.
+ */
+void writeBinaryCounts(std::ostream& output, const std::vector<std::pair<std::uint32_t, std::size_t>>& files, const std::vector<std::string>& file_paths);
+
+/**
+ * Appends a string as a JSON string, quoted and escaped. The bytes of the string are kept as they
+ * are, apart from the escapes, so a line that is not UTF-8 is not either.
+ */
+void appendJsonString(std::string& text, std::string_view value);
+
+/**
+ * Appends a match as a line of JSON Lines: `{"path":...,"line":...,"offset":...,"text":...}`,
+ * with a "pattern" between the offset and the text with the pattern tags, and a `"context":true`
+ * there instead for a context line.
+ *
+ * @param text The text to append to.
+ * @param file_path The path of the file.
+ * @param match The match or context line.
+ * @param tag_patterns Whether to write the ID of the pattern, its line in the pattern file.
+ */
+void appendJsonMatch(std::string& text, std::string_view file_path, const MatchRecord& match, bool tag_patterns);
+
+/**
+ * Appends a file with matches as a line of JSON Lines: `{"path":...,"count":...}`, or only with
+ * the path.
+ *
+ * @param text The text to append to.
+ * @param file_path The path of the file.
+ * @param match_count The number of matches of the file.
+ * @param with_count Whether to write the number of matches.
+ */
+void appendJsonFile(std::string& text, std::string_view file_path, std::size_t match_count, bool with_count);
+
+#endif
@@ -0,0 +1,170 @@
+#include "result_order.h"
+
+#include <algorithm>
+#include <tuple>
+
+#include "parallel_sort.h"
+
+namespace {
+	// The number of matches the files sorted by one task add up to, at the least.
+	constexpr std::size_t file_sort_slice = 64 * 1024;
+	// The number of matches from which a file is sorted on all workers, as it fills at least two slices of parallelSort.
+	constexpr std::size_t large_file_matches = 2 * parallel_sort_min_slice;
+
+	// Matches of a worker in a row that are all of the same file.
+	struct Run {
+		const MatchRecord* begin;
+		const MatchRecord* end;
+		// The place of the run among the matches of its file.
+		std::size_t offset;
+		// The number of context lines of the run.
+		std::size_t context_lines;
+	};
+
+	// The files with the most matches first, and the files with as many by their index, so the order does not depend on the workers.
+	bool moreMatches(const std::pair<std::uint32_t, std::size_t>& lhs, const std::pair<std::uint32_t, std::size_t>& rhs) {
+		return lhs.second != rhs.second ? lhs.second > rhs.second : lhs.first < rhs.first;
+	}
+
+	bool earlierLine(const MatchRecord* lhs, const MatchRecord* rhs) {
+		return std::tie(lhs->line_number, lhs->pattern_index) < std::tie(rhs->line_number, rhs->pattern_index);
+	}
+
+	void sortFileMatches(std::vector<const MatchRecord*>::iterator begin, std::vector<const MatchRecord*>::iterator end) {
+		if (!std::is_sorted(begin, end, earlierLine)) {
+			std::sort(begin, end, earlierLine);
+		}
+	}
+}
+
+
+OrderedMatches orderMatches(const SearchResults& results, TaskScheduler& scheduler) {
+	OrderedMatches ordered;
+	const std::size_t worker_count = results.workers.size();
+
+	// Every worker finds the runs of its own matches.
+	std::vector<std::vector<Run>> worker_runs(worker_count);
+	for (std::size_t i = 0; i < worker_count; ++i) {
+		scheduler.submit([&, i](std::size_t) {
+			const std::vector<MatchRecord>& matches = results.workers[i].matches;
+			std::vector<Run>& runs = worker_runs[i];
+			for (std::size_t begin = 0, end = 0; begin < matches.size(); begin = end) {
+				std::size_t context_lines = 0;
+				while (end < matches.size() && matches[end].file_index == matches[begin].file_index) {
+					context_lines += matches[end].isContext() ? 1 : 0;
+					++end;
+				}
+				runs.push_back({ matches.data() + begin, matches.data() + end, 0, context_lines });
+			}
+		});
+	}
+	scheduler.wait();
+
+	// Count the matches of every file and give every run its place among them; there are about as many runs as files.
+	// The files are sorted by their matches alone, but the context lines take their places among them.
+	std::vector<std::size_t> file_counts(results.paths.size());
+	std::vector<std::size_t> file_context_lines(results.paths.size());
+	for (auto& runs : worker_runs) {
+		for (auto& run : runs) {
+			std::size_t& count = file_counts[run.begin->file_index];
+			run.offset = count;
+			count += static_cast<std::size_t>(run.end - run.begin);
+			file_context_lines[run.begin->file_index] += run.context_lines;
+		}
+	}
+	for (std::uint32_t file_index = 0; file_index < file_counts.size(); ++file_index) {
+		if (file_counts[file_index] > 0) {
+			ordered.files.emplace_back(file_index, file_counts[file_index]);
+		}
+	}
+	parallelSort(scheduler, ordered.files.begin(), ordered.files.end(), [&](const auto& lhs, const auto& rhs) {
+		return moreMatches({ lhs.first, lhs.second - file_context_lines[lhs.first] }, { rhs.first, rhs.second - file_context_lines[rhs.first] });
+	});
+
+	// The matches of every file start where those of the files before it end, and every worker copies its runs there.
+	std::vector<std::size_t> file_starts(results.paths.size());
+	std::size_t total = 0;
+	for (const auto& [file_index, count] : ordered.files) {
+		file_starts[file_index] = total;
+		total += count;
+	}
+	ordered.matches.resize(total);
+	for (std::size_t i = 0; i < worker_count; ++i) {
+		scheduler.submit([&, i](std::size_t) {
+			for (const auto& run : worker_runs[i]) {
+				std::size_t position = file_starts[run.begin->file_index] + run.offset;
+				for (const MatchRecord* match = run.begin; match != run.end; ++match) {
+					ordered.matches[position++] = match;
+				}
+			}
+		});
+	}
+	scheduler.wait();
+
+	// Sort the matches of every file by line, in tasks of several files each and a file too large for a task on all workers.
+	std::vector<std::size_t> large_files;
+	std::size_t slice_begin = 0;
+	std::size_t slice_matches = 0;
+	auto submitSlice = [&](std::size_t slice_end) {
+		if (slice_begin < slice_end) {
+			scheduler.submit([&, slice_begin, slice_end](std::size_t) {
+				for (std::size_t i = slice_begin; i < slice_end; ++i) {
+					const auto begin = ordered.matches.begin() + file_starts[ordered.files[i].first];
+					sortFileMatches(begin, begin + ordered.files[i].second);
+				}
+			});
+		}
+		slice_begin = slice_end;
+		slice_matches = 0;
+	};
+	for (std::size_t i = 0; i < ordered.files.size(); ++i) {
+		const std::size_t count = ordered.files[i].second;
+		if (count >= large_file_matches) {
+			submitSlice(i);
+			large_files.push_back(i);
+			slice_begin = i + 1;
+			continue;
+		}
+		slice_matches += count;
+		if (slice_matches >= file_sort_slice) {
+			submitSlice(i + 1);
+		}
+	}
+	submitSlice(ordered.files.size());
+	scheduler.wait();
+	for (const std::size_t i : large_files) {
+		const auto begin = ordered.matches.begin() + file_starts[ordered.files[i].first];
+		const auto end = begin + ordered.files[i].second;
+		if (!std::is_sorted(begin, end, earlierLine)) {
+			parallelSort(scheduler, begin, end, earlierLine);
+		}
+	}
+
+	return ordered;
+}
+
+
+std::vector<std::pair<std::uint32_t, std::size_t>> orderCountedFiles(const SearchResults& results, TaskScheduler& scheduler) {
+	std::vector<std::pair<std::uint32_t, std::size_t>> files;
+	for (const auto& worker : results.workers) {
+		files.insert(files.end(), worker.counted_files.begin(), worker.counted_files.end());
+	}
+
+	// A split file was counted by every worker that searched one of its ranges, its counts are added up.
+	std::vector<std::size_t> file_counts(results.paths.size());
+	bool split = false;
+	for (const auto& [file_index, count] : files) {
+		split = split || file_counts[file_index] > 0;
+		file_counts[file_index] += count;
+	}
+	if (split) {
+		files.clear();
+		for (std::uint32_t file_index = 0; file_index < file_counts.size(); ++file_index) {
+			if (file_counts[file_index] > 0) {
+				files.emplace_back(file_index, file_counts[file_index]);
+			}
+		}
+	}
+	parallelSort(scheduler, files.begin(), files.end(), moreMatches);
+	return files;
+}
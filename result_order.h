@@ -0,0 +1,51 @@
+#ifndef SPECIFIC_GREP_RESULT_ORDER_H
+#define SPECIFIC_GREP_RESULT_ORDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "search_results.h"
+#include "task_scheduler.h"
+
+/**
+ * The matches of a search in the order of the result file: the files with the most matches first,
+ * and the matches of every file by line number, and those of a line by pattern. The context lines
+ * are among the matches of their files, in the order of their lines.
+ */
+struct OrderedMatches {
+	// Every file with matches and its number of matches and context lines, in order.
+	std::vector<std::pair<std::uint32_t, std::size_t>> files;
+	// The matches in order, those of every file together and in the order of the files.
+	std::vector<const MatchRecord*> matches;
+};
+
+/**
+ * Orders the matches the workers kept, on the workers of a scheduler.
+ *
+ * A worker keeps the matches of a file together, in the order of their lines, apart from the ranges
+ * of a split file that other workers searched. So every worker's matches are runs of one file each:
+ * the workers find their runs, the runs are counted into the files, the files are sorted, and every
+ * worker copies its runs straight to the place of their file. Only the matches of a file that came in
+ * several runs, or with several patterns on a line, need sorting, each file on its own.
+ *
+ * Waits for the scheduler, see parallelSort.
+ *
+ * @param results The results of a search with ResultMode::Lines.
+ * @param scheduler The scheduler to order on.
+ * @return The ordered matches, which point into the results.
+ */
+OrderedMatches orderMatches(const SearchResults& results, TaskScheduler& scheduler);
+
+/**
+ * Orders the files the workers counted the matches of, the files with the most matches first.
+ * Waits for the scheduler, see parallelSort.
+ *
+ * @param results The results of a search with ResultMode::Count or ResultMode::Files.
+ * @param scheduler The scheduler to order on.
+ * @return Every counted file and its number of matches, in order.
+ */
+std::vector<std::pair<std::uint32_t, std::size_t>> orderCountedFiles(const SearchResults& results, TaskScheduler& scheduler);
+
+#endif
@@ -0,0 +1,122 @@
+#include "result_stream.h"
+
+#include "output_writer.h"
+
+
+ResultStream::ResultStream(std::ostream& output, const ResultLayout& layout, std::size_t capacity) : output_(output), layout_(layout), queue_(capacity) {
+	writer_ = std::thread(&ResultStream::writerLoop, this);
+}
+
+
+ResultStream::~ResultStream() {
+	close();
+}
+
+
+void ResultStream::push(std::unique_ptr<ResultBlock> block) {
+	if (!writer_.joinable()) {
+		return;
+	}
+
+	// Sleep while the writer catches up with a full queue.
+	const std::ptrdiff_t capacity = static_cast<std::ptrdiff_t>(queue_.capacity());
+	while (!queue_.tryPush(block)) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		room_cv_.wait(lock, [this, capacity] { return queued_.load() < capacity; });
+	}
+	if (queued_.fetch_add(1) == 0) {
+		notify(ready_cv_);
+	}
+}
+
+
+void ResultStream::close() {
+	if (writer_.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			closing_ = true;
+		}
+		ready_cv_.notify_one();
+		writer_.join();
+	}
+}
+
+
+/**
+ * Writes blocks as they arrive until the stream is closed and the queue is empty.
+ */
+void ResultStream::writerLoop() {
+	const std::ptrdiff_t capacity = static_cast<std::ptrdiff_t>(queue_.capacity());
+	std::unique_ptr<ResultBlock> block;
+	while (true) {
+		if (queue_.tryPop(block)) {
+			// Wake up the workers once a full queue has room again.
+			if (queued_.fetch_sub(1) >= capacity) {
+				notify(room_cv_);
+			}
+			write(*block);
+			block.reset();
+			continue;
+		}
+
+		// Nothing to write: sleep until a block is queued or the stream is closed. Every block is
+		// pushed before close(), so a closed stream only has the blocks left that are in the queue.
+		bool closing;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			ready_cv_.wait(lock, [this] { return closing_ || queued_.load() > 0; });
+			closing = closing_;
+		}
+		if (closing) {
+			while (queue_.tryPop(block)) {
+				write(*block);
+			}
+			return;
+		}
+	}
+}
+
+
+/**
+ * Wakes up the threads waiting on a condition after a change of the queue.
+ *
+ * @param condition The condition that changed.
+ */
+void ResultStream::notify(std::condition_variable& condition) {
+	// Taking the mutex orders the notification after a waiting thread's predicate check.
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+	}
+	condition.notify_all();
+}
+
+
+/**
+ * Writes the matches of a block in the format of the result file and flushes them.
+ *
+ * @param block The matches of a file.
+ */
+void ResultStream::write(const ResultBlock& block) {
+	// The lines of the block are formatted into one piece, which goes to the output in a single write.
+	text_.clear();
+	if (layout_.format == ResultFormat::JsonLines) {
+		const std::string file_path = block.file_path.string();
+		for (const auto& match : block.matches.matches) {
+			appendJsonMatch(text_, file_path, match, layout_.tag_patterns);
+		}
+	}
+	else {
+		const std::string file_name = block.file_path.stem().string();
+		std::uint64_t previous_line = 0;
+		for (const auto& match : block.matches.matches) {
+			if (layout_.context && (previous_line == 0 ? written_ : match.line_number > previous_line + 1)) {
+				text_.append(context_group_separator);
+			}
+			previous_line = match.line_number;
+			appendMatchLine(text_, file_name, match, layout_.tag_patterns, layout_.byte_offsets);
+		}
+	}
+	written_ = true;
+	output_.write(text_.data(), static_cast<std::streamsize>(text_.size()));
+	output_.flush();
+}
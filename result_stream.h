@@ -0,0 +1,97 @@
+#ifndef SPECIFIC_GREP_RESULT_STREAM_H
+#define SPECIFIC_GREP_RESULT_STREAM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+#include "bounded_queue.h"
+#include "result_format.h"
+#include "search_results.h"
+
+/**
+ * The matches of one file, handed from the worker that searched it to the writer thread.
+ */
+struct ResultBlock {
+	// The size of the first block of the arena, most files have only a few matching lines.
+	static constexpr std::size_t initial_arena_size = 4 * 1024;
+
+	// The path of the file, written with its stem or in full depending on the format.
+	std::filesystem::path file_path;
+	// The matches of the file in line order, with an arena of their own.
+	WorkerResults matches{ initial_arena_size };
+};
+
+/**
+ * Writes the matches of each file to the result output as soon as the file has been searched: the
+ * result file, or the connection to a client of the server.
+ *
+ * Workers push a block per file with matches into a bounded queue that a writer thread drains,
+ * writing and releasing each block right away. Memory use is thereby bounded by the queue's capacity
+ * instead of the size of the whole result, and the first results appear while the search goes on.
+ * A worker that gets ahead of the writer sleeps until there is room in the queue, and the writer
+ * sleeps until a block arrives. The binary format cannot be streamed, as its header holds the sizes
+ * of the whole result.
+ */
+class ResultStream {
+public:
+	/**
+	 * Starts the writer thread.
+	 *
+	 * @param output The output to write to, which must stay valid until the stream is closed.
+	 * @param layout How to write the matches, in ResultFormat::Text or ResultFormat::JsonLines.
+	 * @param capacity The number of blocks that may wait for the writer.
+	 */
+	ResultStream(std::ostream& output, const ResultLayout& layout, std::size_t capacity = 1024);
+
+	/**
+	 * Writes the remaining blocks and stops the writer thread.
+	 */
+	~ResultStream();
+
+	ResultStream(const ResultStream&) = delete;
+	ResultStream& operator=(const ResultStream&) = delete;
+
+	/**
+	 * Hands a block to the writer thread, waiting while the queue is full.
+	 *
+	 * @param block The matches of a file.
+	 */
+	void push(std::unique_ptr<ResultBlock> block);
+
+	/**
+	 * Writes the remaining blocks and stops the writer thread.
+	 */
+	void close();
+
+private:
+	void writerLoop();
+	void write(const ResultBlock& block);
+	void notify(std::condition_variable& condition);
+
+	std::ostream& output_;
+	const ResultLayout layout_;
+	// Whether a block was written, which the next group of context lines is separated from.
+	bool written_ = false;
+	// The text of the block being written, kept for the next block.
+	std::string text_;
+	BoundedQueue<std::unique_ptr<ResultBlock>> queue_;
+	// Number of blocks pushed and not yet popped, counted after the push and the pop, used to put the threads to sleep.
+	std::atomic<std::ptrdiff_t> queued_{ 0 };
+
+	std::mutex mutex_;
+	// Wakes up the writer once a block is queued or the stream is closed.
+	std::condition_variable ready_cv_;
+	// Wakes up the workers waiting for room once the writer takes a block from a full queue.
+	std::condition_variable room_cv_;
+	bool closing_ = false;
+	std::thread writer_;
+};
+
+#endif
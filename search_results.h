@@ -0,0 +1,218 @@
+#ifndef SPECIFIC_GREP_SEARCH_RESULTS_H
+#define SPECIFIC_GREP_SEARCH_RESULTS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * The pattern index of a context line, a line around a match that is reported with it without matching.
+ */
+constexpr std::uint32_t context_line = UINT32_MAX;
+
+/**
+ * A matching line, or a context line around one. The line itself is stored in the arena of the worker that found it.
+ */
+struct MatchRecord {
+	// The index of the file in the search's PathTable.
+	std::uint32_t file_index;
+	// The length of the line in bytes.
+	std::uint32_t line_length;
+	// The 1-based number of the line in the file.
+	std::uint64_t line_number;
+	// The offset of the start of the line in the file, in the decompressed content of a compressed file.
+	std::uint64_t byte_offset;
+	// The text of the line in the worker's arena.
+	const char* line_text;
+	// The index of the pattern found in the line, 0 when there is a single one, or context_line.
+	std::uint32_t pattern_index;
+
+	/**
+	 * @return The text of the matching line.
+	 */
+	std::string_view line() const {
+		return std::string_view(line_text, line_length);
+	}
+
+	/**
+	 * @return Whether the line is a context line rather than a match.
+	 */
+	bool isContext() const {
+		return pattern_index == context_line;
+	}
+};
+
+// Every match of a search is kept as a record, so its size is that of the whole result.
+static_assert(sizeof(void*) != 8 || sizeof(MatchRecord) == 40, "a MatchRecord takes 40 bytes on a 64-bit platform");
+
+/**
+ * A matching line that is handed on rather than stored: the line points into a buffer of whoever
+ * hands it on, such as the result cache.
+ */
+struct LineMatch {
+	// The 1-based number of the line in the file.
+	std::uint64_t line_number;
+	// The index of the pattern found in the line, or context_line.
+	std::uint32_t pattern_index;
+	std::string_view line;
+	// The offset of the start of the line in the file.
+	std::uint64_t byte_offset = 0;
+};
+
+/**
+ * The paths of the files with matches, each stored once and referred to by its index.
+ * Files are only added once they turn out to have a match, so most files never take the lock.
+ * The path strings live in the arena of the worker that added them.
+ */
+class PathTable {
+public:
+	// A path as stored in the table, in the native encoding of std::filesystem::path.
+	using PathView = std::basic_string_view<std::filesystem::path::value_type>;
+
+	PathTable() = default;
+	PathTable(PathTable&& other) noexcept : paths_(std::move(other.paths_)) {
+	}
+	PathTable& operator=(PathTable&& other) noexcept {
+		paths_ = std::move(other.paths_);
+		return *this;
+	}
+
+	/**
+	 * Adds a path. Safe to call from several threads at once.
+	 *
+	 * @param path The path to add.
+	 * @param arena The arena of the calling worker to copy the path string into.
+	 * @return The index of the path.
+	 */
+	std::uint32_t add(const std::filesystem::path& path, std::pmr::memory_resource& arena) {
+		const auto& native = path.native();
+		auto* text = static_cast<std::filesystem::path::value_type*>(arena.allocate(native.size() * sizeof(native[0]), alignof(std::filesystem::path::value_type)));
+		std::copy(native.begin(), native.end(), text);
+
+		std::lock_guard<std::mutex> lock(*mutex_);
+		paths_.emplace_back(text, native.size());
+		return static_cast<std::uint32_t>(paths_.size() - 1);
+	}
+
+	/**
+	 * @param index The index of a path.
+	 * @return The path.
+	 */
+	PathView path(std::uint32_t index) const {
+		return paths_[index];
+	}
+
+	/**
+	 * @param index The index of a path.
+	 * @return The file name of the path without its extension.
+	 */
+	std::string stem(std::uint32_t index) const {
+		return std::filesystem::path(paths_[index]).stem().string();
+	}
+
+	/**
+	 * @return The number of paths.
+	 */
+	std::size_t size() const {
+		return paths_.size();
+	}
+
+private:
+	std::vector<PathView> paths_;
+	std::unique_ptr<std::mutex> mutex_ = std::make_unique<std::mutex>();
+};
+
+/**
+ * The matches found by one worker thread, in the order it found them.
+ *
+ * The text of the matching lines and of the paths the worker adds to the PathTable is bump-allocated
+ * from the worker's own arena, a chain of ever larger blocks that is only released as a whole with the
+ * results. Workers thereby never contend in malloc() over the many small strings a search produces.
+ */
+struct WorkerResults {
+	// The size of the first block of the arena, later blocks grow geometrically.
+	static constexpr std::size_t initial_arena_size = 64 * 1024;
+
+	// The ID of the worker's thread.
+	std::thread::id thread_id;
+	// The matches, and the context lines reported with them.
+	std::vector<MatchRecord> matches;
+	// The number of the context lines among the matches.
+	std::size_t context_lines = 0;
+	// The files whose matches this worker streamed out or only counted instead of keeping them, with their number of matches.
+	std::vector<std::pair<std::uint32_t, std::size_t>> counted_files;
+	// Owns the text of all matching lines and of the paths this worker added.
+	std::unique_ptr<std::pmr::monotonic_buffer_resource> arena;
+
+	WorkerResults() : WorkerResults(initial_arena_size) {
+	}
+
+	/**
+	 * @param arena_size The size of the first block of the arena.
+	 */
+	explicit WorkerResults(std::size_t arena_size) : arena(std::make_unique<std::pmr::monotonic_buffer_resource>(arena_size)) {
+	}
+
+	/**
+	 * Appends a match or a context line, copying the line into the arena.
+	 *
+	 * @param file_index The index of the file in the search's PathTable.
+	 * @param line_number The 1-based number of the line in the file.
+	 * @param byte_offset The offset of the start of the line in the file.
+	 * @param line_begin The start of the line.
+	 * @param line_end The end of the line.
+	 * @param pattern_index The index of the pattern found in the line, or context_line.
+	 */
+	void add(std::uint32_t file_index, std::uint64_t line_number, std::uint64_t byte_offset, const char* line_begin, const char* line_end, std::uint32_t pattern_index) {
+		const std::size_t line_length = static_cast<std::size_t>(line_end - line_begin);
+		char* line_text = static_cast<char*>(arena->allocate(line_length, 1));
+		std::copy(line_begin, line_end, line_text);
+		matches.push_back({ file_index, static_cast<std::uint32_t>(line_length), line_number, byte_offset, line_text, pattern_index });
+		context_lines += pattern_index == context_line ? 1 : 0;
+	}
+
+	/**
+	 * @return The number of matches, without the context lines.
+	 */
+	std::size_t matchCount() const {
+		return matches.size() - context_lines;
+	}
+};
+
+/**
+ * Everything a search found.
+ */
+struct SearchResults {
+	PathTable paths;
+	// The matches of every worker thread, including the ones that found nothing.
+	std::vector<WorkerResults> workers;
+	// The total number of files searched.
+	std::size_t files_searched = 0;
+	// Whether the search was cancelled before it was done.
+	bool cancelled = false;
+
+	/**
+	 * @return The total number of matching lines, kept or streamed out, without the context lines.
+	 */
+	std::size_t matchCount() const {
+		std::size_t count = 0;
+		for (const auto& worker : workers) {
+			count += worker.matchCount();
+			for (const auto& [file_index, file_matches] : worker.counted_files) {
+				count += file_matches;
+			}
+		}
+		return count;
+	}
+};
+
+#endif
@@ -0,0 +1,423 @@
+#include "search_server.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+
+#ifndef _WIN32
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+#ifndef _WIN32
+namespace {
+	// The limits of a query, which keep a broken client from making the server allocate without bound.
+	constexpr std::uint32_t max_argument_count = 4096;
+	constexpr std::uint32_t max_argument_size = 1024 * 1024;
+	// The time after which a query that has sent nothing sends a keep-alive frame, well within the timeout of its client.
+	constexpr int keep_alive_seconds = client_timeout_seconds / 3;
+
+#ifdef MSG_NOSIGNAL
+	constexpr int send_flags = MSG_NOSIGNAL;
+#else
+	constexpr int send_flags = 0;
+#endif
+
+	bool sendAll(int connection, const char* data, std::size_t size) {
+		while (size > 0) {
+			const ssize_t sent = send(connection, data, size, send_flags);
+			if (sent < 0 && errno == EINTR) {
+				continue;
+			}
+			if (sent <= 0) {
+				return false;
+			}
+			data += sent;
+			size -= static_cast<std::size_t>(sent);
+		}
+		return true;
+	}
+
+	/**
+	 * @return True once all of the bytes are received, false if the connection ends or fails first.
+	 */
+	bool receiveAll(int connection, char* data, std::size_t size) {
+		while (size > 0) {
+			const ssize_t received = recv(connection, data, size, 0);
+			if (received < 0 && errno == EINTR) {
+				continue;
+			}
+			if (received <= 0) {
+				return false;
+			}
+			data += received;
+			size -= static_cast<std::size_t>(received);
+		}
+		return true;
+	}
+
+	bool sendNumber(int connection, std::uint32_t number) {
+		return sendAll(connection, reinterpret_cast<const char*>(&number), sizeof(number));
+	}
+
+	bool receiveNumber(int connection, std::uint32_t& number) {
+		return receiveAll(connection, reinterpret_cast<char*>(&number), sizeof(number));
+	}
+
+	bool sendFrame(int connection, char type, const char* data, std::size_t size) {
+		return sendAll(connection, &type, 1) && sendNumber(connection, static_cast<std::uint32_t>(size)) && sendAll(connection, data, size);
+	}
+
+	/**
+	 * An output that sends what is written to it to the client in frames of one type, a frame
+	 * whenever its buffer is full or it is flushed. Once the client is gone, or does not take a frame
+	 * in time, the output is dropped and the search of the query cancelled. The frames of a query are
+	 * sent under its mutex, so they do not interleave.
+	 */
+	class FrameBuffer final : public std::streambuf {
+	public:
+		FrameBuffer(int connection, char type, CancelToken& cancel, std::mutex& send_mutex) : connection_(connection), type_(type), cancel_(cancel), send_mutex_(send_mutex), buffer_(64 * 1024) {
+			setp(buffer_.data(), buffer_.data() + buffer_.size());
+		}
+
+	protected:
+		int_type overflow(int_type c) override {
+			sendBuffered();
+			if (!traits_type::eq_int_type(c, traits_type::eof())) {
+				*pptr() = traits_type::to_char_type(c);
+				pbump(1);
+			}
+			return traits_type::not_eof(c);
+		}
+
+		int sync() override {
+			sendBuffered();
+			return 0;
+		}
+
+	private:
+		void sendBuffered() {
+			const std::size_t size = static_cast<std::size_t>(pptr() - pbase());
+			// The outputs of a query share its connection, once one of them cannot send none of them tries again.
+			if (size > 0 && !cancel_.cancelled()) {
+				std::lock_guard<std::mutex> lock(send_mutex_);
+				if (!sendFrame(connection_, type_, pbase(), size)) {
+					cancel_.cancel();
+				}
+			}
+			setp(buffer_.data(), buffer_.data() + buffer_.size());
+		}
+
+		const int connection_;
+		const char type_;
+		CancelToken& cancel_;
+		std::mutex& send_mutex_;
+		std::vector<char> buffer_;
+	};
+
+	/**
+	 * Watches the connection of a query while it is answered and cancels its search once the client
+	 * hangs up, which the outputs would only learn from their next send, if they send anything
+	 * before the search is done. The client sends nothing after its query, so whatever it still
+	 * sends is dropped. While the connection is quiet the watcher sends keep-alive frames, so the
+	 * client does not time out on a search that sends nothing until it is done.
+	 */
+	class HangUpWatcher {
+	public:
+		HangUpWatcher(int connection, CancelToken& cancel, std::mutex& send_mutex) {
+			// The watcher is woken up through a pipe once the answer is complete.
+			if (pipe2(wake_up_, O_CLOEXEC) != 0) {
+				wake_up_[0] = wake_up_[1] = -1;
+				return;
+			}
+			thread_ = std::thread([this, connection, &cancel, &send_mutex] { watch(connection, cancel, send_mutex); });
+		}
+
+		~HangUpWatcher() {
+			if (thread_.joinable()) {
+				const char byte = 0;
+				while (write(wake_up_[1], &byte, 1) < 0 && errno == EINTR) {
+				}
+				thread_.join();
+			}
+			for (const int end : wake_up_) {
+				if (end >= 0) {
+					close(end);
+				}
+			}
+		}
+
+		HangUpWatcher(const HangUpWatcher&) = delete;
+		HangUpWatcher& operator=(const HangUpWatcher&) = delete;
+
+	private:
+		void watch(int connection, CancelToken& cancel, std::mutex& send_mutex) {
+			pollfd watched[2] = { { connection, POLLIN, 0 }, { wake_up_[0], POLLIN, 0 } };
+			while (!cancel.cancelled()) {
+				const int ready = poll(watched, 2, keep_alive_seconds * 1000);
+				if (ready < 0) {
+					if (errno == EINTR) {
+						continue;
+					}
+					return;
+				}
+				if (ready == 0) {
+					std::lock_guard<std::mutex> lock(send_mutex);
+					if (!sendFrame(connection, 'K', nullptr, 0)) {
+						cancel.cancel();
+						return;
+					}
+					continue;
+				}
+				if (watched[1].revents != 0) {
+					return;
+				}
+				if ((watched[0].revents & (POLLHUP | POLLERR | POLLNVAL)) != 0) {
+					cancel.cancel();
+					return;
+				}
+				char data[256];
+				const ssize_t received = recv(connection, data, sizeof(data), MSG_DONTWAIT);
+				if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+					cancel.cancel();
+					return;
+				}
+			}
+		}
+
+		int wake_up_[2];
+		std::thread thread_;
+	};
+
+	/**
+	 * Fills in the address of a socket.
+	 *
+	 * @return True on success, false if the path does not fit.
+	 */
+	bool socketAddress(const fs::path& socket_path, sockaddr_un& address, std::string& error) {
+		const std::string path = socket_path.string();
+		address = {};
+		address.sun_family = AF_UNIX;
+		if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+			error = "the socket path " + path + " is empty or too long";
+			return false;
+		}
+		std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+		return true;
+	}
+}
+#endif
+
+
+SearchServer::SearchServer(fs::path socket_path) : socket_path_(std::move(socket_path)) {
+}
+
+
+SearchServer::~SearchServer() {
+#ifndef _WIN32
+	if (socket_ >= 0) {
+		close(socket_);
+		unlink(socket_path_.c_str());
+	}
+#endif
+}
+
+
+bool SearchServer::listen(std::string& error) {
+#ifndef _WIN32
+	sockaddr_un address;
+	if (!socketAddress(socket_path_, address, error)) {
+		return false;
+	}
+
+	// A socket that nothing answers on is left over from a server that stopped.
+	struct stat status;
+	if (lstat(socket_path_.c_str(), &status) == 0) {
+		if (!S_ISSOCK(status.st_mode)) {
+			error = socket_path_.string() + " exists and is not a socket";
+			return false;
+		}
+		const int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+		const bool answered = probe >= 0 && connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+		if (probe >= 0) {
+			close(probe);
+		}
+		if (answered) {
+			error = "a server is already listening on " + socket_path_.string();
+			return false;
+		}
+		unlink(socket_path_.c_str());
+	}
+
+	socket_ = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (socket_ < 0 || bind(socket_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(socket_, 16) != 0) {
+		error = "could not listen on " + socket_path_.string() + ": " + std::strerror(errno);
+		if (socket_ >= 0) {
+			close(socket_);
+			socket_ = -1;
+		}
+		return false;
+	}
+	return true;
+#else
+	error = "the server is not supported on this system";
+	return false;
+#endif
+}
+
+
+void SearchServer::serve(const QueryHandler& handler) {
+#ifndef _WIN32
+	// A client that goes away in the middle of an answer must not stop the server.
+	std::signal(SIGPIPE, SIG_IGN);
+	while (true) {
+		const int connection = accept(socket_, nullptr, nullptr);
+		if (connection < 0) {
+			if (errno != EINTR) {
+				std::cerr << "Warning: could not accept a connection: " << std::strerror(errno) << std::endl;
+			}
+			continue;
+		}
+		// A client that stops sending or taking frames is dropped after a while rather than holding up every query after it.
+		const timeval timeout{ client_timeout_seconds, 0 };
+		setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		answer(connection, handler);
+		close(connection);
+	}
+#endif
+}
+
+
+/**
+ * Reads a query from a connection and sends the answer back.
+ */
+void SearchServer::answer(int connection, const QueryHandler& handler) {
+#ifndef _WIN32
+	std::uint32_t count;
+	std::vector<std::string> arguments;
+	if (!receiveNumber(connection, count) || count == 0 || count > max_argument_count) {
+		return;
+	}
+	for (std::uint32_t i = 0; i < count; ++i) {
+		std::uint32_t size;
+		if (!receiveNumber(connection, size) || size > max_argument_size) {
+			return;
+		}
+		std::string& argument = arguments.emplace_back(size, '\0');
+		if (!receiveAll(connection, argument.data(), size)) {
+			return;
+		}
+	}
+
+	CancelToken cancel;
+	std::mutex send_mutex;
+	FrameBuffer result_buffer(connection, 'R', cancel, send_mutex);
+	FrameBuffer log_buffer(connection, 'L', cancel, send_mutex);
+	FrameBuffer summary_buffer(connection, 'S', cancel, send_mutex);
+	std::ostream results(&result_buffer);
+	std::ostream log(&log_buffer);
+	std::ostream summary(&summary_buffer);
+	std::string error;
+	const fs::path working_directory = arguments.front();
+	arguments.erase(arguments.begin());
+	bool answered;
+	{
+		const HangUpWatcher watcher(connection, cancel, send_mutex);
+		answered = handler(working_directory, arguments, results, log, summary, cancel, error);
+	}
+	results.flush();
+	log.flush();
+	summary.flush();
+	if (cancel.cancelled()) {
+		return;
+	}
+	if (answered) {
+		sendFrame(connection, 'D', nullptr, 0);
+	}
+	else {
+		sendFrame(connection, 'E', error.data(), error.size());
+	}
+#endif
+}
+
+
+bool querySearchServer(const fs::path& socket_path, const std::vector<std::string>& arguments, std::ostream& results, std::ostream& log, std::ostream& summary, std::string& error) {
+#ifndef _WIN32
+	sockaddr_un address;
+	if (!socketAddress(socket_path, address, error)) {
+		return false;
+	}
+	const int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (connection < 0 || connect(connection, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+		error = "could not connect to the server at " + socket_path.string() + ": " + std::strerror(errno);
+		if (connection >= 0) {
+			close(connection);
+		}
+		return false;
+	}
+	// A server that stops answering is given up on, the server sends a keep-alive frame while a search sends nothing.
+	const timeval timeout{ client_timeout_seconds, 0 };
+	setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	std::vector<std::string> query = { fs::current_path().string() };
+	query.insert(query.end(), arguments.begin(), arguments.end());
+	bool sent = sendNumber(connection, static_cast<std::uint32_t>(query.size()));
+	for (const auto& argument : query) {
+		sent = sent && sendNumber(connection, static_cast<std::uint32_t>(argument.size())) && sendAll(connection, argument.data(), argument.size());
+	}
+	if (!sent) {
+		error = "could not send the query to the server";
+		close(connection);
+		return false;
+	}
+
+	// Write every frame to its output as it arrives, until the frame that ends the answer.
+	std::vector<char> data;
+	bool complete = false;
+	bool rejected = false;
+	while (!complete) {
+		errno = 0;
+		char type;
+		std::uint32_t size;
+		if (!receiveAll(connection, &type, 1) || !receiveNumber(connection, size)) {
+			break;
+		}
+		data.resize(size);
+		if (!receiveAll(connection, data.data(), size)) {
+			break;
+		}
+		switch (type) {
+			case 'R': results.write(data.data(), size); break;
+			case 'L': log.write(data.data(), size); break;
+			case 'S': summary.write(data.data(), size); break;
+			case 'E': error.assign(data.data(), size); rejected = true; complete = true; break;
+			case 'D': complete = true; break;
+			default: break;
+		}
+	}
+	const bool timed_out = errno == EAGAIN || errno == EWOULDBLOCK;
+	close(connection);
+	if (!complete) {
+		error = timed_out ? "the server sent nothing for " + std::to_string(client_timeout_seconds) + " seconds, the answer is incomplete" : "the server closed the connection before the answer was complete";
+		return false;
+	}
+	return !rejected;
+#else
+	error = "the server is not supported on this system";
+	return false;
+#endif
+}
@@ -0,0 +1,96 @@
+#ifndef SPECIFIC_GREP_SEARCH_SERVER_H
+#define SPECIFIC_GREP_SEARCH_SERVER_H
+
+#include <filesystem>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "cancel_token.h"
+
+/**
+ * Answers a query: runs the search given by the arguments of its command line, the search string
+ * first, as if run in the working directory of the client, and writes the result file, the log file
+ * and the summary of the search to the outputs. The search is to be cancelled with the token, which
+ * the server cancels once the client is gone.
+ *
+ * @return True on success, false with the reason in the error if the query is rejected.
+ */
+using QueryHandler = std::function<bool(const std::filesystem::path& working_directory, const std::vector<std::string>& arguments, std::ostream& results, std::ostream& log, std::ostream& summary, const CancelToken& cancel, std::string& error)>;
+
+/**
+ * Serves searches over a Unix domain socket, so that a client gets the answer of a process that
+ * keeps its state in memory between searches, instead of starting over for every search.
+ *
+ * The queries are answered one after another, each on a connection of its own, and every search
+ * runs on all threads of the server. A query is the number of its arguments followed by each
+ * argument as its length and its bytes, the numbers as 32-bit integers in the byte order of the
+ * machine; the first argument is the working directory of the client. It is answered by a series
+ * of frames, each a type byte and a 32-bit length followed by that many bytes. Frames of type 'R'
+ * carry the result file, 'L' the log file and 'S' the summary, and 'K' frames are empty and keep a
+ * quiet connection alive. The last frame is 'D', empty, once the query is answered, or 'E' with
+ * the reason it was rejected; the server closes the connection after it, and an answer without
+ * one is incomplete. The result frames are sent while the search goes on. A client that goes away
+ * is dropped and its search cancelled, and so is a client that stops taking the frames, once a
+ * send has waited client_timeout_seconds for it, so it cannot hold up the queries after it.
+ *
+ * Unix domain sockets are local to the machine, so the server and its clients share the file
+ * system. Not available on Windows.
+ */
+// The time a send or a receive waits for a client before the client is dropped, and a client for the server.
+constexpr int client_timeout_seconds = 30;
+
+class SearchServer {
+public:
+	/**
+	 * @param socket_path The path to listen on.
+	 */
+	explicit SearchServer(std::filesystem::path socket_path);
+
+	/**
+	 * Stops listening and removes the socket.
+	 */
+	~SearchServer();
+
+	SearchServer(const SearchServer&) = delete;
+	SearchServer& operator=(const SearchServer&) = delete;
+
+	/**
+	 * Starts listening on the socket. A stale socket left by a server that stopped is replaced.
+	 *
+	 * @param error Set to the reason on failure.
+	 * @return True on success, false if the socket cannot be listened on.
+	 */
+	bool listen(std::string& error);
+
+	/**
+	 * Answers queries until the process is stopped.
+	 *
+	 * @param handler The handler that answers every query.
+	 */
+	void serve(const QueryHandler& handler);
+
+private:
+	void answer(int connection, const QueryHandler& handler);
+
+	const std::filesystem::path socket_path_;
+	int socket_ = -1;
+};
+
+/**
+ * Sends a query to a server, from the current working directory, and writes its answer to the
+ * outputs as it arrives.
+ *
+ * @param socket_path The path the server listens on.
+ * @param arguments The arguments of the search, the search string first.
+ * @param results The output for the result file.
+ * @param log The output for the log file.
+ * @param summary The output for the summary.
+ * @param error Set to the reason on failure.
+ * @return True on success, false if the server could not be reached, rejected the query, or its
+ *         answer ended early or stopped arriving for client_timeout_seconds.
+ */
+bool querySearchServer(const std::filesystem::path& socket_path, const std::vector<std::string>& arguments, std::ostream& results, std::ostream& log, std::ostream& summary, std::string& error);
+
+#endif
@@ -0,0 +1,189 @@
+#include "search_stats.h"
+
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+namespace {
+	// The statistics the current thread counts in, if any.
+	thread_local WorkerStats* current_stats = nullptr;
+
+	constexpr const char* stage_names[search_stage_count] = { "walk", "open", "read", "match", "merge", "write", "log" };
+
+	double milliseconds(std::uint64_t nanoseconds) {
+		return static_cast<double>(nanoseconds) / 1e6;
+	}
+
+	std::int64_t nanosecondsSince(std::chrono::steady_clock::time_point origin, std::chrono::steady_clock::time_point time) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(time - origin).count();
+	}
+
+	/**
+	 * @return The number of matches a worker found, of the lines it kept and of the files it counted.
+	 */
+	std::uint64_t workerMatchCount(const WorkerResults& worker) {
+		std::uint64_t count = worker.matches.size();
+		for (const auto& [file_index, file_matches] : worker.counted_files) {
+			count += file_matches;
+		}
+		return count;
+	}
+
+	/**
+	 * Writes the time of every stage of a thread, or of all of them, as a JSON object.
+	 */
+	void writeStages(std::ostream& output, const std::uint64_t (&stage_ns)[search_stage_count]) {
+		output << "{ ";
+		for (std::size_t i = 0; i < search_stage_count; ++i) {
+			output << (i == 0 ? "" : ", ") << "\"" << stage_names[i] << "\": " << milliseconds(stage_ns[i]);
+		}
+		output << " }";
+	}
+
+	/**
+	 * Writes the counters of a thread as a JSON object.
+	 */
+	void writeThread(std::ostream& output, const std::string& name, const WorkerStats& stats, std::uint64_t matches, std::uint64_t search_ns) {
+		output << "    { \"thread\": \"" << name << "\", \"matches\": " << matches << ", \"files_opened\": " << stats.files_opened
+			<< ", \"open_failures\": " << stats.open_failures << ", \"bytes_read\": " << stats.bytes_read << ", \"tasks\": " << stats.tasks
+			<< ", \"steals\": " << stats.steals << ", \"busy_ms\": " << milliseconds(stats.busy_ns)
+			<< ", \"wait_ms\": " << milliseconds(search_ns > stats.busy_ns ? search_ns - stats.busy_ns : 0) << ", \"stages_ms\": ";
+		writeStages(output, stats.stage_ns);
+		output << ", \"stage_calls\": { ";
+		for (std::size_t i = 0; i < search_stage_count; ++i) {
+			output << (i == 0 ? "" : ", ") << "\"" << stage_names[i] << "\": " << stats.stage_calls[i];
+		}
+		output << " } }";
+	}
+}
+
+
+const char* searchStageName(SearchStage stage) {
+	return stage_names[static_cast<std::size_t>(stage)];
+}
+
+
+void WorkerStats::record(SearchStage stage, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+	const std::size_t index = static_cast<std::size_t>(stage);
+	stage_ns[index] += static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+	++stage_calls[index];
+	if (tracing && spans.size() < max_spans) {
+		spans.push_back({ stage, nanosecondsSince(origin, start), nanosecondsSince(origin, end) });
+	}
+}
+
+
+SearchStats::SearchStats(std::size_t worker_count, bool tracing) : origin_(std::chrono::steady_clock::now()), workers_(worker_count) {
+	for (auto& worker : workers_) {
+		worker.tracing = tracing;
+		worker.origin = origin_;
+	}
+	caller_.tracing = tracing;
+	caller_.origin = origin_;
+}
+
+
+WorkerStats& SearchStats::worker(std::size_t worker_index) {
+	return workers_[worker_index];
+}
+
+
+WorkerStats& SearchStats::caller() {
+	return caller_;
+}
+
+
+std::size_t SearchStats::workerCount() const {
+	return workers_.size();
+}
+
+
+void SearchStats::markSearch(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+	search_ns_ += static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+
+void SearchStats::writeReport(std::ostream& report, const SearchResults& results, double elapsed_ms) const {
+	WorkerStats total;
+	std::uint64_t matches = 0;
+	auto add = [&total](const WorkerStats& stats) {
+		total.files_opened += stats.files_opened;
+		total.open_failures += stats.open_failures;
+		total.bytes_read += stats.bytes_read;
+		total.tasks += stats.tasks;
+		total.steals += stats.steals;
+		for (std::size_t i = 0; i < search_stage_count; ++i) {
+			total.stage_ns[i] += stats.stage_ns[i];
+		}
+	};
+	for (const auto& worker : workers_) {
+		add(worker);
+	}
+	add(caller_);
+	for (const auto& worker : results.workers) {
+		matches += workerMatchCount(worker);
+	}
+
+	// The times are written in fixed point, the default precision would round long ones.
+	std::ostringstream output;
+	output << std::fixed << std::setprecision(3);
+	output << "{\n";
+	output << "  \"format\": 1,\n";
+	output << "  \"elapsed_ms\": " << elapsed_ms << ",\n";
+	output << "  \"search_ms\": " << milliseconds(search_ns_) << ",\n";
+	output << "  \"cancelled\": " << (results.cancelled ? "true" : "false") << ",\n";
+	output << "  \"totals\": { \"files_searched\": " << results.files_searched << ", \"files_with_matches\": " << results.paths.size() << ", \"matches\": " << matches
+		<< ", \"files_opened\": " << total.files_opened << ", \"open_failures\": " << total.open_failures << ", \"bytes_read\": " << total.bytes_read
+		<< ", \"tasks\": " << total.tasks << ", \"steals\": " << total.steals << " },\n";
+	output << "  \"stages_ms\": ";
+	writeStages(output, total.stage_ns);
+	output << ",\n";
+	output << "  \"threads\": [\n";
+	writeThread(output, "main", caller_, 0, 0);
+	for (std::size_t i = 0; i < workers_.size(); ++i) {
+		output << ",\n";
+		writeThread(output, "worker " + std::to_string(i), workers_[i], i < results.workers.size() ? workerMatchCount(results.workers[i]) : 0, search_ns_);
+	}
+	output << "\n  ]\n";
+	output << "}\n";
+	report << output.str();
+}
+
+
+void SearchStats::writeTrace(std::ostream& trace) const {
+	// The times of the trace events are in microseconds, written in fixed point like the report.
+	std::ostringstream output;
+	output << std::fixed << std::setprecision(3);
+	output << "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	output << "  { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": { \"name\": \"main\" } }";
+	for (std::size_t i = 0; i < workers_.size(); ++i) {
+		output << ",\n  { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << i + 1 << ", \"args\": { \"name\": \"worker " << i << "\" } }";
+	}
+	auto writeSpans = [&output](const WorkerStats& stats, std::size_t track) {
+		for (const auto& span : stats.spans) {
+			output << ",\n  { \"name\": \"" << searchStageName(span.stage) << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << track
+				<< ", \"ts\": " << static_cast<double>(span.start_ns) / 1e3 << ", \"dur\": " << static_cast<double>(span.end_ns - span.start_ns) / 1e3 << " }";
+		}
+	};
+	writeSpans(caller_, 0);
+	for (std::size_t i = 0; i < workers_.size(); ++i) {
+		writeSpans(workers_[i], i + 1);
+	}
+	output << "\n] }\n";
+	trace << output.str();
+}
+
+
+WorkerStats* currentStats() {
+	return current_stats;
+}
+
+
+StatsBinding::StatsBinding(WorkerStats* stats) : previous_(current_stats) {
+	current_stats = stats;
+}
+
+
+StatsBinding::~StatsBinding() {
+	current_stats = previous_;
+}
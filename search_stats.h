@@ -0,0 +1,186 @@
+#ifndef SPECIFIC_GREP_SEARCH_STATS_H
+#define SPECIFIC_GREP_SEARCH_STATS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "search_results.h"
+
+/**
+ * The stages the time of a search is spent in.
+ */
+enum class SearchStage {
+	// Listing the directories and handing out their files.
+	Walk,
+	// Opening the files.
+	Open,
+	// Reading the files; the pages of a mapped file are read while it is matched instead.
+	Read,
+	// Searching the lines of the content.
+	Match,
+	// Grouping and sorting the matches of all threads for the result file.
+	Merge,
+	// Writing the result file.
+	Write,
+	// Writing the log file.
+	Log
+};
+
+// The number of stages.
+constexpr std::size_t search_stage_count = 7;
+
+/**
+ * @return The name of a stage in the reports.
+ */
+const char* searchStageName(SearchStage stage);
+
+
+/**
+ * The counters and the stage times of one thread of a search, written by that thread alone and
+ * read once the search is done. Every thread has a cache line of its own, so counting costs no
+ * more than an add.
+ */
+struct alignas(64) WorkerStats {
+	// A stage of the thread, for the trace.
+	struct Span {
+		SearchStage stage;
+		// The start and the end in nanoseconds since the start of the statistics.
+		std::int64_t start_ns;
+		std::int64_t end_ns;
+	};
+
+	// The largest number of spans a thread records, so a trace of a huge search stays a size that viewers can open.
+	static constexpr std::size_t max_spans = 200000;
+
+	std::uint64_t files_opened = 0;
+	std::uint64_t open_failures = 0;
+	std::uint64_t bytes_read = 0;
+	// The number of tasks the thread ran, and how many of them it stole from another worker.
+	std::uint64_t tasks = 0;
+	std::uint64_t steals = 0;
+	// The time the thread spent running tasks.
+	std::uint64_t busy_ns = 0;
+	std::uint64_t stage_ns[search_stage_count] = {};
+	std::uint64_t stage_calls[search_stage_count] = {};
+	// Whether to record the spans.
+	bool tracing = false;
+	std::vector<Span> spans;
+	// The start of the statistics the spans are relative to.
+	std::chrono::steady_clock::time_point origin;
+
+	/**
+	 * Adds the time of a stage.
+	 */
+	void record(SearchStage stage, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+};
+
+
+/**
+ * The statistics of a search: the counters and the stage times of every worker and of the thread
+ * that started the search, aggregated once it is done. Nothing is counted unless a search is given
+ * statistics, and then only the threads that work for it count.
+ */
+class SearchStats {
+public:
+	/**
+	 * @param worker_count The number of workers of the searcher.
+	 * @param tracing Whether to record every stage of every thread for a trace.
+	 */
+	SearchStats(std::size_t worker_count, bool tracing);
+
+	/**
+	 * @return The statistics of a worker.
+	 */
+	WorkerStats& worker(std::size_t worker_index);
+
+	/**
+	 * @return The statistics of the thread that started the search and writes its results.
+	 */
+	WorkerStats& caller();
+
+	/**
+	 * @return The number of workers.
+	 */
+	std::size_t workerCount() const;
+
+	/**
+	 * Adds the wall time of a search, which the workers that were not busy spent waiting for tasks.
+	 */
+	void markSearch(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+	/**
+	 * Writes the report as JSON: the totals, the time of every stage, and the counters of every thread.
+	 *
+	 * @param output The output of the report.
+	 * @param results The results of the search, for the matches of every worker.
+	 * @param elapsed_ms The wall time of the whole run in milliseconds.
+	 */
+	void writeReport(std::ostream& output, const SearchResults& results, double elapsed_ms) const;
+
+	/**
+	 * Writes the recorded stages in the Chrome trace event format, one track per thread, for
+	 * chrome://tracing or Perfetto.
+	 *
+	 * @param output The output of the trace.
+	 */
+	void writeTrace(std::ostream& output) const;
+
+private:
+	std::chrono::steady_clock::time_point origin_;
+	std::vector<WorkerStats> workers_;
+	WorkerStats caller_;
+	std::uint64_t search_ns_ = 0;
+};
+
+
+/**
+ * @return The statistics the calling thread counts in, or nullptr if it counts nothing.
+ */
+WorkerStats* currentStats();
+
+/**
+ * Makes the calling thread count in statistics for the lifetime of the binding.
+ */
+class StatsBinding {
+public:
+	explicit StatsBinding(WorkerStats* stats);
+	~StatsBinding();
+
+	StatsBinding(const StatsBinding&) = delete;
+	StatsBinding& operator=(const StatsBinding&) = delete;
+
+private:
+	WorkerStats* previous_;
+};
+
+/**
+ * Adds the time from its construction to its destruction to a stage of the calling thread, if the
+ * thread counts in statistics. Without statistics, it does not even read the clock.
+ */
+class StageTimer {
+public:
+	explicit StageTimer(SearchStage stage) : stats_(currentStats()), stage_(stage) {
+		if (stats_ != nullptr) {
+			start_ = std::chrono::steady_clock::now();
+		}
+	}
+
+	~StageTimer() {
+		if (stats_ != nullptr) {
+			stats_->record(stage_, start_, std::chrono::steady_clock::now());
+		}
+	}
+
+	StageTimer(const StageTimer&) = delete;
+	StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+	WorkerStats* stats_;
+	SearchStage stage_;
+	std::chrono::steady_clock::time_point start_;
+};
+
+#endif
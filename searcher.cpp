@@ -0,0 +1,1176 @@
+#include "searcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <optional>
+
+#include "case_folding.h"
+#include "decompressor.h"
+#include "directory_walker.h"
+#include "io_uring_reader.h"
+#include "literal_matcher.h"
+#include "multi_literal_matcher.h"
+#include "path_filter.h"
+#include "regex_matcher.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+	// The number of files every thread reads at the same time with io_uring.
+	constexpr unsigned int uring_queue_depth = 32;
+
+	// The number of files of a given list every task of the search hands out.
+	constexpr std::size_t file_slice_size = 64;
+
+	/**
+	 * The number of matches the whole search may report, shared by all workers. Once it is reached, the
+	 * workers stop searching their files at the next block or match, and no further file is searched.
+	 */
+	class MatchLimit {
+	public:
+		explicit MatchLimit(std::uint64_t max_count) : max_count_(max_count) {
+		}
+
+		/**
+		 * Takes a match from the limit.
+		 *
+		 * @return True if the match may be reported, false once the limit is reached.
+		 */
+		bool take() {
+			// The counter is only written while the limit is not reached, so the workers stop contending for it at the end.
+			return !reached() && taken_.fetch_add(1, std::memory_order_relaxed) < max_count_;
+		}
+
+		bool reached() const {
+			return taken_.load(std::memory_order_relaxed) >= max_count_;
+		}
+
+	private:
+		const std::uint64_t max_count_;
+		std::atomic<std::uint64_t> taken_ = 0;
+	};
+
+
+	struct SplitFile;
+
+
+	/**
+	 * The state shared by all search tasks of one search.
+	 */
+	struct SearchContext {
+		const LineMatcher& matcher;
+		const ReadMode read_mode;
+		const BinaryPolicy binary_policy;
+		PathTable& paths;
+		// The stream to hand the matches of each file to, or nullptr to keep them in the workers' results.
+		ResultStream* const stream;
+		// The cache to record the matches of every file searched in, or nullptr if there is none.
+		ResultCache* const cache;
+		const ResultMode result_mode;
+		// The limit of the matches of the whole search, or nullptr if there is none.
+		MatchLimit* const limit;
+		// The callback to hand the matches of each file to, or nullptr.
+		const MatchCallback* const on_matches;
+		// The token the search is cancelled with, or nullptr.
+		const CancelToken* const cancel;
+		// The number of context lines before and after every match.
+		const std::size_t before_context;
+		const std::size_t after_context;
+		// The split files of every worker whose matches are numbered once the search is done, see numberSplitMatches.
+		std::vector<std::vector<std::shared_ptr<SplitFile>>>* const split_files;
+	};
+
+
+	/**
+	 * Takes a match from the limit of the search, if it has one.
+	 *
+	 * @return True if the match may be reported.
+	 */
+	bool takeMatch(const SearchContext& context) {
+		return context.limit == nullptr || context.limit->take();
+	}
+
+
+	/**
+	 * @return True once the search has reported as many matches as it may, or is cancelled.
+	 */
+	bool searchStopped(const SearchContext& context) {
+		return (context.limit != nullptr && context.limit->reached()) || (context.cancel != nullptr && context.cancel->cancelled());
+	}
+
+
+	/**
+	 * Matches kept aside with copies of their lines, for the outputs that hand them on once a file, or
+	 * a part of it, has been searched.
+	 */
+	class MatchBuffer {
+	public:
+		void add(std::size_t line_number, std::uint64_t byte_offset, const char* line_begin, const char* line_end, std::uint32_t pattern) {
+			entries_.push_back({line_number, byte_offset, pattern, lines_.size(), static_cast<std::size_t>(line_end - line_begin)});
+			lines_.append(line_begin, line_end);
+			context_lines_ += pattern == context_line ? 1 : 0;
+		}
+
+		/**
+		 * Appends the matches to a list. Their lines point into the buffer.
+		 *
+		 * @param matches The list to append to.
+		 * @param lines_before The number of lines to add to the line number of every match.
+		 */
+		void appendTo(std::vector<LineMatch>& matches, std::uint64_t lines_before) const {
+			for (const auto& entry : entries_) {
+				matches.push_back({entry.line_number + lines_before, entry.pattern, std::string_view(lines_).substr(entry.offset, entry.length), entry.byte_offset});
+			}
+		}
+
+		std::size_t size() const {
+			return entries_.size();
+		}
+
+		/**
+		 * @return The number of matches, without the context lines.
+		 */
+		std::size_t matchCount() const {
+			return entries_.size() - context_lines_;
+		}
+
+	private:
+		struct Entry {
+			std::size_t line_number;
+			std::uint64_t byte_offset;
+			std::uint32_t pattern;
+			std::size_t offset;
+			std::size_t length;
+		};
+
+		std::vector<Entry> entries_;
+		// The lines of the matches, one after another.
+		std::string lines_;
+		std::size_t context_lines_ = 0;
+	};
+
+
+	/**
+	 * Records the matches of a file in the result cache, if the search has one. The stamp of the file is
+	 * taken before it is read, so a file that changes while it is searched is searched again next time.
+	 */
+	class CacheRecording {
+	public:
+		/**
+		 * @param cache The result cache of the search, or nullptr.
+		 * @param file_path The path of the file to be searched.
+		 */
+		CacheRecording(ResultCache* cache, const fs::path& file_path) : cache_(cache), file_path_(file_path) {
+			if (cache_ != nullptr && !readFileStamp(file_path_, stamp_)) {
+				cache_ = nullptr;
+			}
+		}
+
+		void add(std::size_t line_number, std::uint64_t byte_offset, const char* line_begin, const char* line_end, std::uint32_t pattern) {
+			if (cache_ != nullptr) {
+				matches_.add(line_number, byte_offset, line_begin, line_end, pattern);
+			}
+		}
+
+		/**
+		 * Stores the matches once the whole file has been searched.
+		 *
+		 * @param complete Whether the whole file could be read. The matches of a file that could not are not stored.
+		 */
+		void finish(bool complete) {
+			if (cache_ == nullptr || !complete) {
+				return;
+			}
+			std::vector<LineMatch> matches;
+			matches.reserve(matches_.size());
+			matches_.appendTo(matches, 0);
+			cache_->store(file_path_, stamp_, matches);
+		}
+
+	private:
+		ResultCache* cache_;
+		const fs::path& file_path_;
+		FileStamp stamp_;
+		MatchBuffer matches_;
+	};
+
+
+	/**
+	 * Collects the matches of a file in the results of the worker that searches it.
+	 * The file is added to the path table on its first match, so files without matches cost nothing.
+	 */
+	class CollectMatches {
+	public:
+		/**
+		 * @param context The state of the search.
+		 * @param file_path The path of the file to be searched.
+		 * @param results The results of the current worker.
+		 */
+		CollectMatches(const SearchContext& context, const fs::path& file_path, WorkerResults& results) : context_(context), file_path_(file_path), results_(results), recording_(context.cache, file_path) {
+		}
+
+		void operator()(std::size_t line_number, std::uint64_t byte_offset, const char* line_begin, const char* line_end, std::uint32_t pattern) {
+			if (!takeMatch(context_)) {
+				return;
+			}
+			if (!file_index_) {
+				file_index_ = context_.paths.add(file_path_, *results_.arena);
+			}
+			results_.add(*file_index_, line_number, byte_offset, line_begin, line_end, pattern);
+			recording_.add(line_number, byte_offset, line_begin, line_end, pattern);
+		}
+
+		void context(std::size_t line_number, std::uint64_t byte_offset, const char* line_begin, const char* line_end) {
+			// Past the limit, the context of the last matches is left out with the matches beyond them.
+			if (searchStopped(context_)) {
+				return;
+			}
+			if (!file_index_) {
+				file_index_ = context_.paths.add(file_path_, *results_.arena);
+			}
+			results_.add(*file_index_, line_number, byte_offset, line_begin, line_end, context_line);
+			recording_.add(line_number, byte_offset, line_begin, line_end, context_line);
+		}
+
+		bool done() const {
+			return searchStopped(context_);
+		}
+
+		/**
+		 * Called once the whole file has been searched.
+		 *
+		 * @param complete Whether the whole file could be read.
+		 */
+		void finish(bool complete) {
+			// A file whose search was cut short by the limit may have more matches than were found.
+			recording_.finish(complete && !done());
+		}
+
+	private:
+		const SearchContext& context_;
+		const fs::path& file_path_;
+		WorkerResults& results_;
+		// The index of the file in the path table, once it has a match.
+		std::optional<std::uint32_t> file_index_;
+		CacheRecording recording_;
+	};
+
+
+	/**
+	 * Collects the matches of a file in a block of their own, and hands the block to the result stream
+	 * once the file has been searched. The worker's results only keep count of the matches.
+	 */
+	class StreamMatches {
+	public:
+		/**
+		 * @param context The state of the search.
+		 * @param file_path The path of the file to be searched.
+		 * @param results The results of the current worker.
+		 */
+		StreamMatches(const SearchContext& context, const fs::path& file_path, WorkerResults& results) : context_(context), file_path_(file_path), results_(results), recording_(context.cache, file_path) {
+		}
+
+		void operator()(std::size_t line_number, std::uint64_t byte_offset, const char* line_begin, const char* line_end, std::uint32_t pattern) {
+			if (!takeMatch(context_)) {
+				return;
+			}
+			if (!block_) {
+				file_index_ = context_.paths.add(file_path_, *results_.arena);
+				block_ = std::make_unique<ResultBlock>();
+				block_->file_path = file_path_;
+			}
+			block_->matches.add(file_index_, line_number, byte_offset, line_begin, line_end, pattern);
+			recording_.add(line_number, byte_offset, line_begin, line_end, pattern);
+		}
+
+		void context(std::size_t line_number, std::uint64_t byte_offset, const char* line_begin, const char* line_end) {
+			if (searchStopped(context_)) {
+				return;
+			}
+			if (!block_) {
+				file_index_ = context_.paths.add(file_path_, *results_.arena);
+				block_ = std::make_unique<ResultBlock>();
+				block_->file_path = file_path_;
+			}
+			block_->matches.add(file_index_, line_number, byte_offset, line_begin, line_end, context_line);
+			recording_.add(line_number, byte_offset, line_begin, line_end, context_line);
+		}
+
+		bool done() const {
+			return searchStopped(context_);
+		}
+
+		/**
+		 * Called once the whole file has been searched.
+		 *
+		 * @param complete Whether the whole file could be read.
+		 */
+		void finish(bool complete) {
+			recording_.finish(complete && !done());
+			if (block_) {
+				results_.counted_files.emplace_back(file_index_, block_->matches.matchCount());
+				context_.stream->push(std::move(block_));
+			}
+		}
+
+	private:
+		const SearchContext& context_;
+		const fs::path& file_path_;
+		WorkerResults& results_;
+		std::uint32_t file_index_ = 0;
+		// The matches of the file, once it has a match.
+		std::unique_ptr<ResultBlock> block_;
+		CacheRecording recording_;
+	};
+
+
+	/**
+	 * Keeps the matches of a file aside, and hands them to the callback of the search once the file has
+	 * been searched. The worker's results only keep count of the matches.
+	 */
+	class CallbackMatches {
+	public:
+		/**
+		 * @param context The state of the search.
+		 * @param file_path The path of the file to be searched.
+		 * @param results The results of the current worker.
+		 */
+		CallbackMatches(const SearchContext& context, const fs::path& file_path, WorkerResults& results) : context_(context), file_path_(file_path), results_(results), recording_(context.cache, file_path) {
+		}
+
+		void operator()(std::size_t line_number, std::uint64_t byte_offset, const char* line_begin, const char* line_end, std::uint32_t pattern) {
+			if (!takeMatch(context_)) {
+				return;
+			}
+			matches_.add(line_number, byte_offset, line_begin, line_end, pattern);
+			recording_.add(line_number, byte_offset, line_begin, line_end, pattern);
+		}
+
+		void context(std::size_t line_number, std::uint64_t byte_offset, const char* line_begin, const char* line_end) {
+			if (searchStopped(context_)) {
+				return;
+			}
+			matches_.add(line_number, byte_offset, line_begin, line_end, context_line);
+			recording_.add(line_number, byte_offset, line_begin, line_end, context_line);
+		}
+
+		bool done() const {
+			return searchStopped(context_);
+		}
+
+		/**
+		 * Called once the whole file has been searched.
+		 *
+		 * @param complete Whether the whole file could be read.
+		 */
+		void finish(bool complete) {
+			recording_.finish(complete && !done());
+			if (matches_.matchCount() > 0) {
+				std::vector<LineMatch> matches;
+				matches.reserve(matches_.size());
+				matches_.appendTo(matches, 0);
+				results_.counted_files.emplace_back(context_.paths.add(file_path_, *results_.arena), matches_.matchCount());
+				(*context_.on_matches)(file_path_, matches);
+			}
+		}
+
+	private:
+		const SearchContext& context_;
+		const fs::path& file_path_;
+		WorkerResults& results_;
+		MatchBuffer matches_;
+		CacheRecording recording_;
+	};
+
+
+	/**
+	 * Counts the matches of a file without keeping any line, and adds the count to the results of the
+	 * worker once the file has been searched. For ResultMode::Files, the count stops at the first match,
+	 * and with it the search of the file.
+	 */
+	class CountMatches {
+	public:
+		/**
+		 * @param context The state of the search.
+		 * @param file_path The path of the file to be searched.
+		 * @param results The results of the current worker.
+		 */
+		CountMatches(const SearchContext& context, const fs::path& file_path, WorkerResults& results) : context_(context), file_path_(file_path), results_(results), recording_(context.cache, file_path) {
+		}
+
+		void operator()(std::size_t line_number, std::uint64_t byte_offset, const char* line_begin, const char* line_end, std::uint32_t pattern) {
+			if (!takeMatch(context_)) {
+				return;
+			}
+			++count_;
+			recording_.add(line_number, byte_offset, line_begin, line_end, pattern);
+		}
+
+		// Counts are never searched with context lines.
+		void context(std::size_t, std::uint64_t, const char*, const char*) {
+		}
+
+		bool done() const {
+			return (context_.result_mode == ResultMode::Files && count_ > 0) || searchStopped(context_);
+		}
+
+		/**
+		 * Called once the whole file has been searched.
+		 *
+		 * @param complete Whether the whole file could be read.
+		 */
+		void finish(bool complete) {
+			recording_.finish(complete && !done());
+			if (count_ > 0) {
+				results_.counted_files.emplace_back(context_.paths.add(file_path_, *results_.arena), count_);
+			}
+		}
+
+	private:
+		const SearchContext& context_;
+		const fs::path& file_path_;
+		WorkerResults& results_;
+		std::size_t count_ = 0;
+		CacheRecording recording_;
+	};
+
+
+	/**
+	 * A file that changed since the trigram index was written, which its search indexes again from the
+	 * content it reads, rather than the index reading it once more.
+	 */
+	struct IndexUpdate {
+		// The index, or nullptr if the file is not indexed.
+		TrigramIndex* index = nullptr;
+		// The stamp of the file taken before it was read.
+		FileStamp stamp;
+		// The index of the worker that searches the file.
+		std::size_t worker_index = 0;
+	};
+
+
+	/**
+	 * Searches for a given string in a file and collects every matching line.
+	 * The file is mapped or read in large blocks that are searched as a whole, so only matching lines are ever copied.
+	 *
+	 * @tparam Matcher The type of the search's matcher.
+	 * @tparam Output Where the matches go: CollectMatches or StreamMatches.
+	 * @param context The state of the search.
+	 * @param file_path The path of the file to search in.
+	 * @param results The results of the current worker.
+	 * @param update The index to record the trigrams of the file in, which reads the file to its end.
+	 */
+	template <typename Matcher, typename Output>
+	void searchFileForString(const SearchContext& context, const fs::path& file_path, WorkerResults& results, const IndexUpdate& update = {}) {
+		BasicBufferScanner<Matcher, Output> scanner(static_cast<const Matcher&>(context.matcher), Output(context, file_path, results), context.binary_policy);
+		scanner.setContext(context.before_context, context.after_context);
+		TrigramCollector collector;
+		if (update.index != nullptr) {
+			scanner.setObserver(&collector);
+		}
+
+		// Search the file, if it could not be opened, output an error message
+		const bool complete = scanFile(file_path, context.read_mode, scanner);
+		if (!complete) {
+			std::cerr << "Error: could not open file " << file_path.string() << " due to permission issues." << std::endl;
+		}
+		scanner.output().finish(complete);
+		if (update.index != nullptr && complete) {
+			update.index->addFile(file_path, update.stamp, collector.take(), update.worker_index);
+		}
+	}
+
+
+	/**
+	 * Hands the matches of a file that were found beforehand to the output, as if the file had been
+	 * searched: the matches of an unchanged file from the result cache.
+	 *
+	 * @tparam Output Where the matches go: CollectMatches or StreamMatches.
+	 * @param context The state of the search.
+	 * @param file_path The path of the file.
+	 * @param matches The matches of the file, in the order of their lines.
+	 * @param results The results of the current worker.
+	 */
+	template <typename Output>
+	void replayMatches(const SearchContext& context, const fs::path& file_path, const std::vector<LineMatch>& matches, WorkerResults& results) {
+		// The matches are not recorded in the cache by the output, they are either there already or stored by the caller.
+		const SearchContext replay_context{ context.matcher, context.read_mode, context.binary_policy, context.paths, context.stream, nullptr, context.result_mode, context.limit, context.on_matches, context.cancel, context.before_context, context.after_context, context.split_files };
+		Output output(replay_context, file_path, results);
+		for (const auto& match : matches) {
+			if (match.pattern_index == context_line) {
+				output.context(match.line_number, match.byte_offset, match.line.data(), match.line.data() + match.line.size());
+				continue;
+			}
+			output(match.line_number, match.byte_offset, match.line.data(), match.line.data() + match.line.size(), match.pattern_index);
+			if (output.done()) {
+				break;
+			}
+		}
+		output.finish(true);
+	}
+
+
+	/**
+	 * Where the matches of the ranges of a split file go, for the output selectSearchFunctions picks.
+	 */
+	enum class SplitOutput {
+		// Into the results of the worker that searches the range, as CollectMatches.
+		Results,
+		// Kept until the whole file is searched, and then handed to the stream or the callback of the search.
+		HandOn,
+		// Only counted, as CountMatches.
+		Count
+	};
+
+
+	/**
+	 * @param context The state of the search.
+	 * @return Where the matches of the ranges of a split file go.
+	 */
+	SplitOutput splitOutput(const SearchContext& context) {
+		if (context.result_mode != ResultMode::Lines) {
+			return SplitOutput::Count;
+		}
+		return context.stream == nullptr && context.on_matches == nullptr ? SplitOutput::Results : SplitOutput::HandOn;
+	}
+
+
+	/**
+	 * A file that is searched in ranges at the same time, see searchFileInChunks.
+	 */
+	struct SplitFile {
+		struct Chunk {
+			// The index of the worker that searched the range, which its matches count for.
+			std::size_t worker = 0;
+			// The matches of the range with their lines, kept until the whole file is searched to hand them on or to cache them.
+			MatchBuffer matches;
+			// The matches of the range among the matches of its worker, with SplitOutput::Results.
+			std::size_t records_begin = 0;
+			std::size_t records_end = 0;
+			// The number of matches of the range, without the context lines.
+			std::size_t count = 0;
+			// The number of lines of the range, which the line numbers of the ranges after it start from.
+			std::uint64_t newlines = 0;
+			// The number of lines of the ranges before it, set once the whole file is searched.
+			std::uint64_t lines_before = 0;
+			// The trigrams of the range, sorted, when the file is indexed again.
+			std::vector<std::uint32_t> trigrams;
+			bool intact = false;
+			// Whether the search of the range stopped before its end, at the limit or at the first match.
+			bool cut_short = false;
+		};
+
+		SplitFile(const fs::path& file_path, const FileStamp& file_stamp, std::size_t chunk_count, SplitOutput split_output, TrigramIndex* trigram_index) : path(file_path), stamp(file_stamp), output(split_output), index(trigram_index), chunks(chunk_count), remaining(chunk_count) {
+		}
+
+		/**
+		 * Adds the file to the path table on the first call, so all ranges refer to it by the same index.
+		 *
+		 * @param paths The path table of the search.
+		 * @param arena The arena of the calling worker.
+		 * @return The index of the file in the path table.
+		 */
+		std::uint32_t fileIndex(PathTable& paths, std::pmr::memory_resource& arena) {
+			std::call_once(file_added_, [&] { file_index_ = paths.add(path, arena); });
+			return file_index_;
+		}
+
+		const fs::path path;
+		// The stamp of the file taken before it was read, for the result cache and the index.
+		const FileStamp stamp;
+		const SplitOutput output;
+		// The index to record the trigrams of the file in, or nullptr if the file is not indexed.
+		TrigramIndex* const index;
+		std::vector<Chunk> chunks;
+		// The number of ranges still being searched.
+		std::atomic<std::size_t> remaining;
+		// Set once a range finds a match, with ResultMode::Files, which ends the search of all ranges.
+		std::atomic<bool> found = false;
+
+	private:
+		std::once_flag file_added_;
+		std::uint32_t file_index_ = 0;
+	};
+
+
+	/**
+	 * Takes the matches of a range of a split file, with their line numbers counted from the start of the
+	 * range, and takes them from the limit as they are found, like the outputs of whole files. With
+	 * SplitOutput::Results, they are added to the results of the worker that searches the range; with
+	 * SplitOutput::HandOn, their lines are kept until the whole file is searched; with SplitOutput::Count,
+	 * they are only counted. Their lines are kept as well when the result cache records them.
+	 */
+	class ChunkMatches {
+	public:
+		/**
+		 * @param context The state of the search.
+		 * @param split The file the range is part of.
+		 * @param chunk The range.
+		 * @param results The results of the worker that searches the range.
+		 */
+		ChunkMatches(const SearchContext& context, SplitFile& split, SplitFile::Chunk& chunk, WorkerResults& results) : context_(context), split_(split), chunk_(chunk), results_(results), keep_lines_(split.output == SplitOutput::HandOn || context.cache != nullptr) {
+		}
+
+		void operator()(std::size_t line_number, std::uint64_t byte_offset, const char* line_begin, const char* line_end, std::uint32_t pattern) {
+			// The first match of ResultMode::Files is taken by the range that finds it first.
+			if (context_.result_mode == ResultMode::Files && split_.found.exchange(true, std::memory_order_relaxed)) {
+				return;
+			}
+			if (!takeMatch(context_)) {
+				return;
+			}
+			++chunk_.count;
+			add(line_number, byte_offset, line_begin, line_end, pattern);
+		}
+
+		void context(std::size_t line_number, std::uint64_t byte_offset, const char* line_begin, const char* line_end) {
+			if (searchStopped(context_)) {
+				return;
+			}
+			add(line_number, byte_offset, line_begin, line_end, context_line);
+		}
+
+		bool done() const {
+			return (context_.result_mode == ResultMode::Files && split_.found.load(std::memory_order_relaxed)) || searchStopped(context_);
+		}
+
+	private:
+		void add(std::size_t line_number, std::uint64_t byte_offset, const char* line_begin, const char* line_end, std::uint32_t pattern) {
+			if (split_.output == SplitOutput::Results) {
+				results_.add(split_.fileIndex(context_.paths, *results_.arena), line_number, byte_offset, line_begin, line_end, pattern);
+			}
+			if (keep_lines_) {
+				chunk_.matches.add(line_number, byte_offset, line_begin, line_end, pattern);
+			}
+		}
+
+		const SearchContext& context_;
+		SplitFile& split_;
+		SplitFile::Chunk& chunk_;
+		WorkerResults& results_;
+		const bool keep_lines_;
+	};
+
+
+	/**
+	 * Tells whether a file can be split into ranges: its content must be searched as it is, from any
+	 * offset. Compressed files are decompressed from the start, and binary files are skipped or only
+	 * searched up to their first match, unless they are searched as text.
+	 *
+	 * @param file_path The path of the file.
+	 * @param binary_policy What the search does with binary content.
+	 * @return True if the file can be split.
+	 */
+	bool isSplittable(const fs::path& file_path, BinaryPolicy binary_policy) {
+		std::ifstream file(file_path, std::ios::binary);
+		std::vector<char> start(binary_probe_size);
+		file.read(start.data(), static_cast<std::streamsize>(start.size()));
+		const auto size = static_cast<std::size_t>(file.gcount());
+		if (detectCompression(start.data(), size) != Compression::None) {
+			return false;
+		}
+		return binary_policy == BinaryPolicy::Text || std::memchr(start.data(), '\0', size) == nullptr;
+	}
+
+
+	/**
+	 * Puts the matches of the ranges of a split file together once the last range has been searched:
+	 * every range learns the number of lines before it, which its line numbers are moved on by, and
+	 * the kept matches are handed to the stream or the callback of the search, and to the result cache.
+	 * The trigrams of the ranges make up the ones of the file for the index, as no trigram spans a line.
+	 *
+	 * @param context The state of the search.
+	 * @param split The file and the matches of its ranges.
+	 * @param worker_index The index of the worker that searched the last range.
+	 */
+	void finishSplitFile(const SearchContext& context, SplitFile& split, std::size_t worker_index) {
+		bool intact = true;
+		bool cut_short = false;
+		std::size_t count = 0;
+		std::uint64_t lines_before = 0;
+		for (auto& chunk : split.chunks) {
+			chunk.lines_before = lines_before;
+			lines_before += chunk.newlines;
+			intact = intact && chunk.intact;
+			cut_short = cut_short || chunk.cut_short;
+			count += chunk.count;
+		}
+		if (!intact) {
+			std::cerr << "Error: could not open file " << split.path.string() << " due to permission issues." << std::endl;
+		}
+
+		std::vector<LineMatch> matches;
+		for (const auto& chunk : split.chunks) {
+			chunk.matches.appendTo(matches, chunk.lines_before);
+		}
+		if (split.output == SplitOutput::HandOn && count > 0) {
+			if (context.stream != nullptr) {
+				auto block = std::make_unique<ResultBlock>();
+				block->file_path = split.path;
+				// The path table already holds the file, which the ranges that found its matches added.
+				const std::uint32_t file_index = split.fileIndex(context.paths, *block->matches.arena);
+				for (const auto& match : matches) {
+					block->matches.add(file_index, match.line_number, match.byte_offset, match.line.data(), match.line.data() + match.line.size(), match.pattern_index);
+				}
+				context.stream->push(std::move(block));
+			}
+			else {
+				(*context.on_matches)(split.path, matches);
+			}
+		}
+		if (context.cache != nullptr && intact && !cut_short) {
+			context.cache->store(split.path, split.stamp, matches);
+		}
+		if (split.index != nullptr && intact) {
+			std::vector<std::uint32_t> trigrams;
+			for (const auto& chunk : split.chunks) {
+				trigrams.insert(trigrams.end(), chunk.trigrams.begin(), chunk.trigrams.end());
+			}
+			std::sort(trigrams.begin(), trigrams.end());
+			trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+			split.index->addFile(split.path, split.stamp, trigrams, worker_index);
+		}
+		for (auto& chunk : split.chunks) {
+			chunk.matches = MatchBuffer();
+			chunk.trigrams = std::vector<std::uint32_t>();
+		}
+	}
+
+
+	/**
+	 * Moves the line numbers of the matches of split files, which the ranges added to the results of
+	 * their workers, from the start of their ranges on to the start of their files. Only done once the
+	 * workers are idle, as every worker only adds to its own results while the search goes on.
+	 *
+	 * @param split_files The split files with SplitOutput::Results that every worker started.
+	 * @param workers The results of all workers.
+	 */
+	void numberSplitMatches(const std::vector<std::vector<std::shared_ptr<SplitFile>>>& split_files, std::vector<WorkerResults>& workers) {
+		for (const auto& worker_splits : split_files) {
+			for (const auto& split : worker_splits) {
+				for (const auto& chunk : split->chunks) {
+					std::vector<MatchRecord>& matches = workers[chunk.worker].matches;
+					for (std::size_t i = chunk.records_begin; i < chunk.records_end; ++i) {
+						matches[i].line_number += chunk.lines_before;
+					}
+				}
+			}
+		}
+	}
+
+
+	/**
+	 * Searches a large file in ranges of split_size bytes that are searched at the same time, each a
+	 * task of its own, so a single file is spread over every worker. Each range is searched from the
+	 * first line that starts within it up to the end of the line that runs over its end, with line
+	 * numbers counted from its own start, and its matches count for the worker that searched it. Once
+	 * the last range is done, the matches are moved on to their real line numbers, see finishSplitFile.
+	 * Files that cannot be split are searched in one piece.
+	 *
+	 * @tparam Matcher The type of the search's matcher.
+	 * @tparam Output Where the matches of a file that cannot be split go: CollectMatches or StreamMatches.
+	 * @param context The state of the search.
+	 * @param scheduler The scheduler to search the ranges on.
+	 * @param workers The results of all workers, every range adds to the ones of the worker that searches it.
+	 * @param file_path The path of the file to search in.
+	 * @param stamp The stamp of the file, which holds its size.
+	 * @param split_size The size of the ranges.
+	 * @param index The index to record the trigrams of the file in, or nullptr if the file is not indexed.
+	 * @param worker_index The index of the current worker.
+	 */
+	template <typename Matcher, typename Output>
+	void searchFileInChunks(const SearchContext& context, TaskScheduler& scheduler, std::vector<WorkerResults>& workers, const fs::path& file_path, const FileStamp& stamp, std::uint64_t split_size, TrigramIndex* index, std::size_t worker_index) {
+		if (!isSplittable(file_path, context.binary_policy)) {
+			searchFileForString<Matcher, Output>(context, file_path, workers[worker_index], IndexUpdate{ index, stamp, worker_index });
+			return;
+		}
+
+		const std::size_t chunk_count = static_cast<std::size_t>((stamp.size + split_size - 1) / split_size);
+		auto split = std::make_shared<SplitFile>(file_path, stamp, chunk_count, splitOutput(context), index);
+		if (split->output == SplitOutput::Results) {
+			(*context.split_files)[worker_index].push_back(split);
+		}
+		for (std::size_t i = 0; i < chunk_count; ++i) {
+			scheduler.submit([&context, &workers, split, split_size, i](std::size_t chunk_worker) {
+				// The last range goes on to the end of the file, in case the file grew since its size was taken.
+				const std::uint64_t begin = i * split_size;
+				const std::uint64_t end = i + 1 == split->chunks.size() ? UINT64_MAX : begin + split_size;
+				SplitFile::Chunk& chunk = split->chunks[i];
+				WorkerResults& results = workers[chunk_worker];
+				chunk.worker = chunk_worker;
+				chunk.records_begin = results.matches.size();
+				BasicBufferScanner<Matcher, ChunkMatches> scanner(static_cast<const Matcher&>(context.matcher), ChunkMatches(context, *split, chunk, results), BinaryPolicy::Text);
+				scanner.setContext(context.before_context, context.after_context);
+				TrigramCollector collector;
+				if (split->index != nullptr) {
+					scanner.setObserver(&collector);
+				}
+				chunk.intact = scanFileRange(split->path, begin, end, scanner);
+				chunk.trigrams = collector.take();
+				chunk.newlines = scanner.newlineCount();
+				chunk.cut_short = scanner.searchDone();
+				chunk.records_end = results.matches.size();
+				if (split->output != SplitOutput::Results && chunk.count > 0) {
+					results.counted_files.emplace_back(split->fileIndex(context.paths, *results.arena), chunk.count);
+				}
+				if (split->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+					finishSplitFile(context, *split, chunk_worker);
+				}
+			});
+		}
+	}
+
+
+	/**
+	 * @return The io_uring reader of the calling thread, which sets up its ring on first use.
+	 */
+	IoUringReader& threadUringReader() {
+		thread_local IoUringReader reader(uring_queue_depth);
+		return reader;
+	}
+
+
+	/**
+	 * Searches for a given string in a batch of files that are all read at the same time through io_uring,
+	 * and collects every matching line like searchFileForString.
+	 * Falls back to reading the files one after another if the system does not support io_uring.
+	 *
+	 * @tparam Matcher The type of the search's matcher.
+	 * @tparam Output Where the matches go: CollectMatches or StreamMatches.
+	 * @param context The state of the search.
+	 * @param files_to_search The paths of the files to search in.
+	 * @param results The results of the current worker.
+	 */
+	template <typename Matcher, typename Output>
+	void searchFilesWithIoUring(const SearchContext& context, const std::vector<fs::path>& files_to_search, WorkerResults& results) {
+		IoUringReader& reader = threadUringReader();
+		if (!reader.valid()) {
+			static std::once_flag warning;
+			std::call_once(warning, [] { std::cerr << "Warning: io_uring is not available, reading files with read() instead." << std::endl; });
+			const SearchContext read_context{ context.matcher, ReadMode::Read, context.binary_policy, context.paths, context.stream, context.cache, context.result_mode, context.limit, context.on_matches, context.cancel, context.before_context, context.after_context, context.split_files };
+			for (const auto& file_path : files_to_search) {
+				searchFileForString<Matcher, Output>(read_context, file_path, results);
+			}
+			return;
+		}
+
+		const Matcher& matcher = static_cast<const Matcher&>(context.matcher);
+		std::vector<std::optional<BasicBufferScanner<Matcher, Output>>> scanners(files_to_search.size());
+		std::vector<std::uint8_t> failed(files_to_search.size(), 0);
+		reader.scanFiles(files_to_search, [&](std::size_t file_index) -> BufferScanner& {
+			BufferScanner& scanner = scanners[file_index].emplace(matcher, Output(context, files_to_search[file_index], results), context.binary_policy);
+			scanner.setContext(context.before_context, context.after_context);
+			return scanner;
+		}, [&](std::size_t file_index) {
+			failed[file_index] = 1;
+			std::cerr << "Error: could not open file " << files_to_search[file_index].string() << " due to permission issues." << std::endl;
+		});
+		for (std::size_t i = 0; i < scanners.size(); ++i) {
+			if (scanners[i]) {
+				scanners[i]->output().finish(failed[i] == 0);
+			}
+		}
+	}
+
+
+	/**
+	 * The search functions compiled for one combination of matcher and output.
+	 */
+	struct SearchFunctions {
+		void (*search_file)(const SearchContext& context, const fs::path& file_path, WorkerResults& results, const IndexUpdate& update);
+		void (*search_batch)(const SearchContext& context, const std::vector<fs::path>& files_to_search, WorkerResults& results);
+		void (*search_split)(const SearchContext& context, TaskScheduler& scheduler, std::vector<WorkerResults>& workers, const fs::path& file_path, const FileStamp& stamp, std::uint64_t split_size, TrigramIndex* index, std::size_t worker_index);
+		void (*replay)(const SearchContext& context, const fs::path& file_path, const std::vector<LineMatch>& matches, WorkerResults& results);
+	};
+
+	template <typename Matcher, typename Output>
+	constexpr SearchFunctions search_functions{ &searchFileForString<Matcher, Output>, &searchFilesWithIoUring<Matcher, Output>, &searchFileInChunks<Matcher, Output>, &replayMatches<Output> };
+
+
+	/**
+	 * Picks the search functions for the type of the matcher.
+	 *
+	 * @tparam Output Where the matches go.
+	 * @param matcher The matcher of the search, one of the types createMatcher creates.
+	 * @return The search functions.
+	 */
+	template <typename Output>
+	SearchFunctions selectForMatcher(const LineMatcher& matcher) {
+		if (dynamic_cast<const RegexMatcher*>(&matcher) != nullptr) {
+			return search_functions<RegexMatcher, Output>;
+		}
+		if (dynamic_cast<const MultiLiteralMatcher*>(&matcher) != nullptr) {
+			return search_functions<MultiLiteralMatcher, Output>;
+		}
+		return search_functions<LiteralMatcher, Output>;
+	}
+
+
+	/**
+	 * Picks the search functions for the matcher and the output of a search. Done once per search,
+	 * so no search task ever checks the options again.
+	 *
+	 * @param context The state of the search.
+	 * @return The search functions.
+	 */
+	SearchFunctions selectSearchFunctions(const SearchContext& context) {
+		if (context.result_mode != ResultMode::Lines) {
+			return selectForMatcher<CountMatches>(context.matcher);
+		}
+		if (context.on_matches != nullptr) {
+			return selectForMatcher<CallbackMatches>(context.matcher);
+		}
+		if (context.stream == nullptr) {
+			return selectForMatcher<CollectMatches>(context.matcher);
+		}
+		return selectForMatcher<StreamMatches>(context.matcher);
+	}
+}
+
+
+bool readPatternFile(const std::string& filename, std::vector<std::string>& patterns) {
+	std::ifstream pattern_file(filename, std::ios::binary);
+	if (!pattern_file.is_open()) {
+		return false;
+	}
+
+	std::string pattern;
+	while (std::getline(pattern_file, pattern)) {
+		if (!pattern.empty() && pattern.back() == '\r') {
+			pattern.pop_back();
+		}
+		patterns.push_back(pattern);
+	}
+	return !pattern_file.bad();
+}
+
+
+std::unique_ptr<LineMatcher> createMatcher(const SearchOptions& options, std::string& error) {
+	if (options.pattern_file) {
+		std::vector<std::string> patterns;
+		if (!readPatternFile(options.search_string, patterns)) {
+			error = "could not read the pattern file " + options.search_string;
+			return nullptr;
+		}
+		if (patterns.empty()) {
+			error = "the pattern file " + options.search_string + " has no patterns";
+			return nullptr;
+		}
+		std::unique_ptr<MultiLiteralMatcher> matcher = MultiLiteralMatcher::create(std::move(patterns), options.case_insensitive, error);
+		if (matcher == nullptr) {
+			error = "in the pattern file " + options.search_string + ", " + error;
+		}
+		return matcher;
+	}
+	if (options.regex) {
+		std::unique_ptr<RegexMatcher> matcher = RegexMatcher::compile(options.search_string, error, options.case_insensitive);
+		if (matcher == nullptr) {
+			error = "invalid regular expression: " + error;
+		}
+		return matcher;
+	}
+	// The literal kernel folds ASCII only, the cases of other letters are matched by the expression of the literal.
+	if (options.case_insensitive && hasNonAscii(options.search_string)) {
+		std::unique_ptr<RegexMatcher> matcher = RegexMatcher::compile(RegexMatcher::escape(options.search_string), error, true);
+		if (matcher == nullptr) {
+			error = "the search string is too long to ignore case: " + error;
+		}
+		return matcher;
+	}
+	return std::make_unique<LiteralMatcher>(options.search_string, options.case_insensitive);
+}
+
+
+std::string describeQuery(const SearchOptions& options) {
+	std::string query = options.pattern_file ? "patterns" : options.regex ? "regex" : "literal";
+	query += options.case_insensitive ? " ignore_case" : "";
+	query += options.binary_policy == BinaryPolicy::Skip ? " binary_skip" : options.binary_policy == BinaryPolicy::Report ? " binary_report" : " binary_text";
+	// The context lines are kept with the matches.
+	if (options.before_context != 0 || options.after_context != 0) {
+		query += " context " + std::to_string(options.before_context) + " " + std::to_string(options.after_context);
+	}
+	query += '\n';
+
+	// A pattern file is described by its patterns, which may change between searches.
+	std::vector<std::string> patterns;
+	if (!options.pattern_file || !readPatternFile(options.search_string, patterns)) {
+		patterns = { options.search_string };
+	}
+	for (const auto& pattern : patterns) {
+		query += pattern;
+		query += '\n';
+	}
+	return query;
+}
+
+
+Searcher::Searcher(std::size_t thread_count, PinMode pin_mode) : scheduler_(thread_count == 0 ? availableCpuCount() : thread_count, pin_mode) {
+}
+
+
+SearchResults Searcher::search(const SearchOptions& options, const LineMatcher& matcher, const SearchHooks& hooks) {
+	// The directory tree is walked in parallel on the workers, and every regular file becomes a search task on the
+	// same workers as soon as the walk finds it, so the search starts while the walk goes on, and a thread that
+	// happens to get the big files does not keep the others waiting.
+	TaskScheduler& scheduler = scheduler_;
+	const std::size_t thread_count = scheduler.workerCount();
+	ResultStream* const stream = hooks.stream;
+	TrigramIndex* const index = hooks.index;
+	ResultCache* const cache = hooks.cache;
+	const std::vector<fs::path>* const files = hooks.files;
+	// The workers count in the statistics by their index, which statistics of another size do not have.
+	SearchStats* stats = hooks.stats;
+	if (stats != nullptr && stats->workerCount() != thread_count) {
+		std::cerr << "Warning: the statistics have " << stats->workerCount() << " workers and the searcher " << thread_count << ", nothing is counted." << std::endl;
+		stats = nullptr;
+	}
+	const auto search_start = std::chrono::steady_clock::now();
+	scheduler.setStats(stats);
+	SearchResults results;
+	results.workers.resize(thread_count);
+	std::atomic<std::size_t> files_searched = 0;
+	std::vector<std::vector<std::shared_ptr<SplitFile>>> split_files(thread_count);
+	std::optional<MatchLimit> limit;
+	if (options.max_count != 0) {
+		limit.emplace(options.max_count);
+	}
+	const SearchContext context{ matcher, options.read_mode, options.binary_policy, results.paths, stream, cache, options.result_mode, limit ? &*limit : nullptr, stream == nullptr ? hooks.on_matches : nullptr, hooks.cancel, options.result_mode == ResultMode::Lines ? options.before_context : 0, options.result_mode == ResultMode::Lines ? options.after_context : 0, &split_files };
+	const SearchFunctions search = selectSearchFunctions(context);
+	const std::uint64_t split_size = options.split_size == 0 ? 0 : std::max(options.split_size, min_split_size);
+	{
+		// The filters are applied by the walk, so the directories they leave out are never listed.
+		std::optional<PathFilter> filter;
+		if (files == nullptr && (!options.include_globs.empty() || !options.exclude_globs.empty() || options.ignore_files)) {
+			filter.emplace(options.include_globs, options.exclude_globs, options.ignore_files);
+		}
+
+		DirectoryWalker walker(scheduler, filter ? &*filter : nullptr);
+
+		// With io_uring, every thread collects the files it finds into batches that are read at the same time.
+		const bool batched = options.read_mode == ReadMode::Uring && IoUringReader::supported();
+		std::vector<std::vector<fs::path>> worker_batches(thread_count);
+		auto submitBatch = [&](std::vector<fs::path>& batch) {
+			scheduler.submit([&, files = std::move(batch)](std::size_t worker_index) {
+				search.search_batch(context, files, results.workers[worker_index]);
+			});
+			batch.clear();
+		};
+
+		// Submit a search task per regular file (or batch of them) in the directory and its subdirectories as soon as the walk finds it.
+		const DirectoryWalker::FileCallback on_file = [&](const fs::path& file_path, std::size_t walker_index) {
+			// Once the limit is reached, the rest of the walk searches nothing.
+			if (searchStopped(context)) {
+				return;
+			}
+			files_searched.fetch_add(1, std::memory_order_relaxed);
+
+			// The index rules out the unchanged files that cannot match, and files that changed are indexed again by their search.
+			TrigramIndex* reindex = nullptr;
+			FileStamp index_stamp;
+			if (index != nullptr) {
+				const TrigramIndex::Action action = index->check(file_path, walker_index, index_stamp);
+				if (action == TrigramIndex::Action::Skip) {
+					return;
+				}
+				if (action == TrigramIndex::Action::IndexAndSearch) {
+					reindex = index;
+				}
+			}
+
+			// The matches of an unchanged file come from the cache, only the other files are read.
+			if (cache != nullptr) {
+				thread_local std::vector<LineMatch> cached_matches;
+				if (cache->find(file_path, cached_matches)) {
+					search.replay(context, file_path, cached_matches, results.workers[walker_index]);
+					// The index reads a file the search does not.
+					if (reindex != nullptr) {
+						scheduler.submit([&, file_path, index_stamp](std::size_t worker_index) {
+							index->indexFile(file_path, index_stamp, worker_index);
+						});
+					}
+					return;
+				}
+			}
+
+			// A large file is spread over all workers, rather than keeping one of them busy alone; not with context, which crosses the ranges.
+			FileStamp stamp;
+			if (split_size != 0 && context.before_context == 0 && context.after_context == 0 && readFileStamp(file_path, stamp) && stamp.size >= split_size) {
+				scheduler.submit([&, file_path, stamp, reindex](std::size_t worker_index) {
+					search.search_split(context, scheduler, results.workers, file_path, stamp, split_size, reindex, worker_index);
+				});
+				return;
+			}
+			// A file indexed again is searched on its own, as the index takes its lines one file at a time per thread.
+			if (batched && reindex == nullptr) {
+				worker_batches[walker_index].push_back(file_path);
+				if (worker_batches[walker_index].size() == uring_queue_depth) {
+					submitBatch(worker_batches[walker_index]);
+				}
+				return;
+			}
+			scheduler.submit([&, file_path, reindex, index_stamp](std::size_t worker_index) {
+				search.search_file(context, file_path, results.workers[worker_index], IndexUpdate{ reindex, index_stamp, worker_index });
+			});
+		};
+		if (files == nullptr) {
+			walker.walk(options.directory_path, on_file);
+		}
+		else {
+			// The files of a list are handed out in slices, like the walk hands out the files of a directory.
+			for (std::size_t begin = 0; begin < files->size(); begin += file_slice_size) {
+				scheduler.submit([&, begin](std::size_t worker_index) {
+					const std::size_t end = std::min(files->size(), begin + file_slice_size);
+					for (std::size_t i = begin; i < end; ++i) {
+						on_file((*files)[i], worker_index);
+					}
+				});
+			}
+		}
+		scheduler.wait();
+
+		// Search the partial batches left over once the walk is done.
+		if (batched) {
+			for (auto& batch : worker_batches) {
+				if (!batch.empty()) {
+					submitBatch(batch);
+				}
+			}
+			scheduler.wait();
+		}
+
+		// A walk that stopped early did not find every file, the index keeps the ones it did not get to.
+		if (index != nullptr && searchStopped(context)) {
+			index->markIncomplete();
+		}
+
+		// The matches of the ranges of split files were numbered from the start of their ranges.
+		numberSplitMatches(split_files, results.workers);
+
+		// Record the ID of every thread, including the ones that never got a file.
+		for (std::size_t i = 0; i < thread_count; ++i) {
+			results.workers[i].thread_id = scheduler.workerThreadId(i);
+		}
+	}
+
+	results.files_searched = files_searched.load();
+	results.cancelled = hooks.cancel != nullptr && hooks.cancel->cancelled();
+	scheduler.setStats(nullptr);
+	if (stats != nullptr) {
+		stats->markSearch(search_start, std::chrono::steady_clock::now());
+	}
+	return results;
+}
+
+
+std::size_t Searcher::threadCount() const {
+	return scheduler_.workerCount();
+}
+
+
+TaskScheduler& Searcher::scheduler() {
+	return scheduler_;
+}
@@ -0,0 +1,198 @@
+#ifndef SPECIFIC_GREP_SEARCHER_H
+#define SPECIFIC_GREP_SEARCHER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "buffer_scanner.h"
+#include "cancel_token.h"
+#include "cpu_topology.h"
+#include "file_reader.h"
+#include "line_matcher.h"
+#include "result_cache.h"
+#include "result_stream.h"
+#include "search_results.h"
+#include "search_stats.h"
+#include "task_scheduler.h"
+#include "trigram_index.h"
+
+// The size from which a file is split into ranges of this size that are searched at the same time.
+constexpr std::uint64_t default_split_size = 64 * 1024 * 1024;
+// The smallest size a file is split into, a block read: smaller ranges cost more in tasks than they gain.
+constexpr std::uint64_t min_split_size = read_block_size;
+
+
+/**
+ * What the search reports of the matches.
+ */
+enum class ResultMode {
+	// Every matching line.
+	Lines,
+	// The number of matches of every file, without keeping any line.
+	Count,
+	// The files with a match, each read only up to its first match.
+	Files
+};
+
+
+/**
+ * What to search for, where, and how.
+ */
+struct SearchOptions {
+	// The string to search for.
+	std::string search_string;
+	// Whether the search string is a regular expression rather than a literal.
+	bool regex = false;
+	// Whether the search string names a file of literal patterns, one per line, to search for all at once.
+	bool pattern_file = false;
+	// Whether to ignore the case of letters.
+	bool case_insensitive = false;
+	// The directory to search in, including its subdirectories.
+	std::string directory_path;
+	// The number of threads of the Searcher to search with, 0 for one per CPU the program may run on.
+	int thread_count = 0;
+	// Where the threads of the Searcher run.
+	PinMode pin_mode = PinMode::None;
+	// How to bring the content of the files into memory.
+	ReadMode read_mode = ReadMode::Auto;
+	// What to do with files that have binary content.
+	BinaryPolicy binary_policy = BinaryPolicy::Report;
+	// The globs one of which every file searched must match, none to search every file.
+	std::vector<std::string> include_globs;
+	// The globs of the files and directories to leave out.
+	std::vector<std::string> exclude_globs;
+	// Whether to leave out what the .gitignore and .ignore files of the directory tree ignore.
+	bool ignore_files = false;
+	// The size from which a file is split into ranges that are searched at the same time, 0 to search every file in one piece.
+	// A smaller size than min_split_size splits at min_split_size. Files are not split with context lines, which may lie in the
+	// ranges on either side.
+	std::uint64_t split_size = default_split_size;
+	// What to report of the matches.
+	ResultMode result_mode = ResultMode::Lines;
+	// The number of matches after which the whole search stops, 0 for no limit.
+	std::uint64_t max_count = 0;
+	// The number of context lines to report before and after every match, with ResultMode::Lines.
+	std::size_t before_context = 0;
+	std::size_t after_context = 0;
+};
+
+
+/**
+ * Reads the patterns of a pattern file, one per line. An empty line is an empty pattern, which matches every line.
+ *
+ * @param filename The name of the pattern file.
+ * @param patterns The patterns, the pattern on line n of the file has the index n - 1.
+ * @return True on success, false if the file could not be read.
+ */
+bool readPatternFile(const std::string& filename, std::vector<std::string>& patterns);
+
+/**
+ * Creates the matcher for the search string: a literal one, a regular expression, or the patterns of a pattern file.
+ *
+ * @param options What to search for.
+ * @param error Set to the reason when the matcher cannot be created.
+ * @return The matcher, or nullptr on error.
+ */
+std::unique_ptr<LineMatcher> createMatcher(const SearchOptions& options, std::string& error);
+
+/**
+ * Describes a search for the result cache: what is searched for, and every option that changes which lines match.
+ *
+ * @param options What to search for.
+ * @return The description, which differs for any two searches that can match different lines.
+ */
+std::string describeQuery(const SearchOptions& options);
+
+
+/**
+ * Takes the matches of a file with matches, once the file has been searched. Called on the worker
+ * threads of the search, for several files at once. The lines of the matches are only valid during
+ * the call.
+ *
+ * @param file_path The path of the file.
+ * @param matches The matches of the file, in the order of their lines, with the context lines among them.
+ */
+using MatchCallback = std::function<void(const std::filesystem::path& file_path, const std::vector<LineMatch>& matches)>;
+
+
+/**
+ * What a search takes its files from and hands its matches to besides its options. Every part is
+ * optional; without any, the directory is walked and every match is kept in the results.
+ */
+struct SearchHooks {
+	// The files of the directory, such as the resident list of the server, or nullptr to walk the directory for them.
+	const std::vector<std::filesystem::path>* files = nullptr;
+	// The stream to write the matches of each file to as soon as it is searched, or nullptr.
+	ResultStream* stream = nullptr;
+	// The callback to hand the matches of each file to as soon as it is searched, or nullptr. Not used together with a stream.
+	const MatchCallback* on_matches = nullptr;
+	// The trigram index to skip the files that cannot match with and to keep up to date, or nullptr to search every file.
+	TrigramIndex* index = nullptr;
+	// The result cache to take the matches of unchanged files from and to record the others in, or nullptr to search every file.
+	ResultCache* cache = nullptr;
+	// The statistics to count the work of the search in, or nullptr to count nothing. They must be created with
+	// Searcher::threadCount() workers, statistics of any other size are left empty with a warning.
+	SearchStats* stats = nullptr;
+	// The token to cancel the search with, or nullptr if it cannot be cancelled.
+	const CancelToken* cancel = nullptr;
+};
+
+
+/**
+ * The search engine: searches directory trees for the lines that match, on a pool of worker threads
+ * that is started once and kept for every search, so a program that searches many times pays for
+ * the threads and their io_uring rings only once.
+ *
+ * The matches are kept in the results as compact records, one per matching line, or handed to a
+ * result stream or a callback file by file as the search goes on. With ResultMode::Count and
+ * ResultMode::Files, only the number of matches of every file is kept. A search can be cancelled
+ * from any thread with the token of its hooks.
+ *
+ * One search runs at a time; search() is not to be called from several threads at once.
+ */
+class Searcher {
+public:
+	/**
+	 * Starts the worker threads.
+	 *
+	 * @param thread_count The number of threads to search with, 0 for one per CPU the program may run on.
+	 * @param pin_mode Where the threads run. Pinned to a NUMA node, a worker keeps the buffers and the
+	 *                 results it allocates on the memory of its node.
+	 */
+	explicit Searcher(std::size_t thread_count, PinMode pin_mode = PinMode::None);
+
+	Searcher(const Searcher&) = delete;
+	Searcher& operator=(const Searcher&) = delete;
+
+	/**
+	 * Searches a directory and its subdirectories for the lines that match. Every worker collects its
+	 * own results, so the workers only synchronize to add a file to the path table.
+	 *
+	 * @param options What to search for, where, and how. The number of threads is the one of the searcher.
+	 * @param matcher The matcher for the search string, see createMatcher.
+	 * @param hooks What the search takes its files from and hands its matches to.
+	 * @return The search results: the matches of every thread, the paths of the files they are in, and the total number of files searched.
+	 */
+	SearchResults search(const SearchOptions& options, const LineMatcher& matcher, const SearchHooks& hooks = {});
+
+	/**
+	 * @return The number of worker threads, which the statistics of the hooks of a search must be created with.
+	 */
+	std::size_t threadCount() const;
+
+	/**
+	 * @return The scheduler of the worker threads, for other work between the searches, such as walking a directory.
+	 */
+	TaskScheduler& scheduler();
+
+private:
+	TaskScheduler scheduler_;
+};
+
+#endif
@@ -1,268 +1,290 @@
 #include <iostream>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <cstring>
 #include <vector>
 #include <string>
 #include <fstream>
 #include <filesystem>
 #include <thread>
-#include <future>
 #include <regex>
-#include <set>
-#include <map>
+#include <numeric>
+#include <optional>
+#include <algorithm>
+#include <tuple>
+#include <sstream>
 #include <math.h>
 
-namespace fs = std::filesystem;
+#include "file_list.h"
+#include "output_writer.h"
+#include "path_filter.h"
+#include "result_cache.h"
+#include "result_format.h"
+#include "result_order.h"
+#include "result_stream.h"
+#include "search_results.h"
+#include "search_server.h"
+#include "search_stats.h"
+#include "searcher.h"
+#include "trigram_index.h"
 
-/**
- * Searches for a given string in a vector of files and returns a vector of tuples that contain
- * the thread ID, file path, line number, and line that matches the search string.
- *
- * @param search_string The string to search for.
- * @param files_to_search A vector of file paths to search in.
- * @return A vector of tuples containing thread ID, file path, line number, and line that match the search string.
- */
-std::vector<std::tuple<std::thread::id, std::string, int, std::string>> searchFilesForString(const std::string& search_string, const std::vector<fs::path>& files_to_search) {
-	// Initialize the vector that will contain the search results
-	std::vector<std::tuple<std::thread::id, std::string, int, std::string>> results;
+namespace fs = std::filesystem;
 
-	// Get the ID of the current thread
-	std::thread::id thread_id = std::this_thread::get_id();
+// The clock of the elapsed time.
+using Clock = std::chrono::steady_clock;
 
-	// Loop through each file path in the vector and search for the string
-	for (const auto& file_path : files_to_search) {
-		// Open the file for reading
-		std::ifstream file(file_path);
+// The number of matches the result file is formatted in chunks of, a chunk per task.
+constexpr std::size_t format_chunk_matches = 16 * 1024;
+// The number of files whose names a task finds.
+constexpr std::size_t file_names_slice = 4096;
 
-		// If the file could not be opened, output an error message
-		if (!file.good()) {
-			std::cerr << "Error: could not open file " << file_path.string() << " due to permission issues." << std::endl;
-			continue;
-		}
 
-		// If the file was successfully opened, read each line and search for the string
-		std::string line;
-		int line_number = 0;
-		while (std::getline(file, line)) {
-			++line_number;
-			if (line.find(search_string) != std::string::npos) {
-				// If the string was found, add the search results to the vector
-				results.emplace_back(thread_id, file_path.filename().stem().string(), line_number, line);
+/**
+ * Finds the name every file with matches is written with on the threads of the search: its stem,
+ * or its whole path as the search found it.
+ *
+ * @param results The search results with the paths of the files.
+ * @param full_paths Whether to find the paths instead of the stems.
+ * @param scheduler The scheduler of the threads of the search.
+ * @return The name of every file of the path table, by its index.
+ */
+std::vector<std::string> fileNames(const SearchResults& results, bool full_paths, TaskScheduler& scheduler) {
+	std::vector<std::string> file_names(results.paths.size());
+	for (std::size_t begin = 0; begin < file_names.size(); begin += file_names_slice) {
+		scheduler.submit([&, begin](std::size_t) {
+			const std::size_t end = std::min(file_names.size(), begin + file_names_slice);
+			for (std::size_t i = begin; i < end; ++i) {
+				const auto file_index = static_cast<std::uint32_t>(i);
+				file_names[i] = full_paths ? fs::path(results.paths.path(file_index)).string() : results.paths.stem(file_index);
 			}
-		}
-		file.close();
-	}
-
-	// Add entry for thread id storage if there was no file with the string in files subset
-	if (results.empty()) {
-		results.emplace_back(thread_id, "", NULL, "");
+		});
 	}
-
-	// Return the vector of search results
-	return results;
+	scheduler.wait();
+	return file_names;
 }
 
 
 /**
- * Search a directory and its subdirectories for files containing a given string.
+ * Writes the results in the format of the result file: with ResultFormat::Text one line per match
+ * with the name of the file, the line number, and the content of the line, with ResultFormat::JsonLines
+ * a JSON object per match, and with ResultFormat::Binary the binary result file.
  *
- * @param search_string The string to search for.
- * @param directory_path The path to the directory to search.
- * @param thread_count The number of threads to use for the search.
- * @return A pair containing a vector of tuples representing the search results and an integer representing the total number of files searched.
+ * @param output_file The output of the result file.
+ * @param results The search results to write.
+ * @param file_names The name of every file as the format writes it, see fileNames.
+ * @param layout How to write the matches.
+ * @param scheduler The scheduler of the threads of the search, to sort and format the matches on.
  */
-std::pair<std::vector<std::tuple<std::thread::id, std::string, int, std::string>>, int> searchDirectoryForString(const std::string& search_string, const std::string& directory_path, const int thread_count) {
-	// Create a vector of paths to all regular files in the directory and its subdirectories.
-	std::vector<fs::path> files_to_search;
-	for (const auto& file : fs::recursive_directory_iterator(directory_path)) {
-		if (fs::is_regular_file(file)) {
-			files_to_search.push_back(file.path());
-		}
+void writeResults(std::ostream& output_file, const SearchResults& results, const std::vector<std::string>& file_names, const ResultLayout& layout, TaskScheduler& scheduler) {
+	// Sort the files by number of matches, and the matches of each file by line number and those of a line by pattern, on the threads of the search.
+	std::optional<StageTimer> merge_timer(std::in_place, SearchStage::Merge);
+	const OrderedMatches ordered = orderMatches(results, scheduler);
+	merge_timer.reset();
+	const StageTimer write_timer(SearchStage::Write);
+	if (layout.format == ResultFormat::Binary) {
+		writeBinaryResults(output_file, ordered, file_names, layout.tag_patterns);
+		return;
 	}
 
-	// Calculate the number of files to search per thread.
-	const int files_per_thread = files_to_search.size() / thread_count;
-
-	// Create a vector of futures representing the search results for each thread.
-	std::vector<std::future<std::vector<std::tuple<std::thread::id, std::string, int, std::string>>>> futures;
-	for (int i = 0; i < thread_count; ++i) {
-		const int start_index = i * files_per_thread;
-		const int end_index = (i + 1) == thread_count ? files_to_search.size() : (i + 1) * files_per_thread;
-		const std::vector<fs::path> files_subset(files_to_search.begin() + start_index, files_to_search.begin() + end_index);
-
-		// Launch a new thread to search the subset of files.
-		std::future<std::vector<std::tuple<std::thread::id, std::string, int, std::string>>> result = std::async(std::launch::async, searchFilesForString, std::cref(search_string), files_subset);
-		futures.emplace_back(std::move(result));
+	// Cut the files into chunks of about the same number of matches, each formatted by a task of its own.
+	struct Chunk {
+		std::size_t files_begin;
+		std::size_t files_end;
+		std::size_t matches_begin;
+	};
+	std::vector<Chunk> chunks;
+	std::size_t chunk_matches = 0;
+	std::size_t matches_begin = 0;
+	for (std::size_t i = 0; i < ordered.files.size(); ++i) {
+		if (chunks.empty() || chunk_matches >= format_chunk_matches) {
+			chunks.push_back({ i, i, matches_begin });
+			chunk_matches = 0;
+		}
+		chunks.back().files_end = i + 1;
+		chunk_matches += ordered.files[i].second;
+		matches_begin += ordered.files[i].second;
 	}
 
-	// Collect the results from each thread and combine them into a single vector.
-	std::vector<std::tuple<std::thread::id, std::string, int, std::string>> results;
-	for (auto& future : futures) {
-		std::vector<std::tuple<std::thread::id, std::string, int, std::string>> result = future.get();
-		results.insert(results.end(), result.begin(), result.end());
+	// The workers format a round of chunks while this thread writes the round before, so the output is only ever held a round at a time.
+	const std::size_t round_size = 2 * scheduler.workerCount();
+	std::vector<std::string> rounds[2] = { std::vector<std::string>(round_size), std::vector<std::string>(round_size) };
+	auto submitRound = [&](std::size_t round) {
+		for (std::size_t slot = 0; slot < round_size && round * round_size + slot < chunks.size(); ++slot) {
+			scheduler.submit([&, round, slot](std::size_t) {
+				const Chunk& chunk = chunks[round * round_size + slot];
+				std::string& text = rounds[round % 2][slot];
+				auto match = ordered.matches.begin() + static_cast<std::ptrdiff_t>(chunk.matches_begin);
+				for (std::size_t i = chunk.files_begin; i < chunk.files_end; ++i) {
+					const auto& [file_index, match_count] = ordered.files[i];
+					// The groups of context lines are separated, but for the first of the whole file.
+					const bool first_file = round * round_size + slot == 0 && i == chunk.files_begin;
+					std::uint64_t previous_line = 0;
+					for (const auto file_end = match + static_cast<std::ptrdiff_t>(match_count); match != file_end; ++match) {
+						if (layout.format == ResultFormat::JsonLines) {
+							appendJsonMatch(text, file_names[file_index], **match, layout.tag_patterns);
+							continue;
+						}
+						if (layout.context && (previous_line == 0 ? !first_file : (*match)->line_number > previous_line + 1)) {
+							text.append(context_group_separator);
+						}
+						previous_line = (*match)->line_number;
+						appendMatchLine(text, file_names[file_index], **match, layout.tag_patterns, layout.byte_offsets);
+					}
+				}
+			});
+		}
+	};
+
+	OutputWriter writer(output_file);
+	submitRound(0);
+	scheduler.wait();
+	for (std::size_t round = 0; round * round_size < chunks.size(); ++round) {
+		submitRound(round + 1);
+		for (auto& text : rounds[round % 2]) {
+			writer.write(text);
+			text.clear();
+		}
+		scheduler.wait();
 	}
-
-	// Return a pair containing the search results and the total number of files searched.
-	return std::make_pair(results, files_to_search.size());
 }
 
 
 /**
- * Writes the results to a file in the specified format.
- * The results are a vector of tuples, each containing a thread ID, a file path, a line number,
- * and the content of the line.
+ * Writes the files with matches in the format of the result file, one line or JSON object per file
+ * with its name, and with its number of matches for ResultMode::Count, or the binary result file
+ * without matches.
  *
- * @param output_filename The name of the output file to write to.
- * @param results A vector of tuples containing the results to write to the file.
+ * @param output_file The output of the result file.
+ * @param results The search results to write.
+ * @param file_names The name of every file as the format writes it, see fileNames.
+ * @param result_format The format of the result file.
+ * @param result_mode What the search reported, ResultMode::Count or ResultMode::Files.
+ * @param scheduler The scheduler of the threads of the search, to sort the files on.
  */
-void writeResultsToFile(const std::string& output_filename, const std::vector<std::tuple<std::thread::id, std::string, int, std::string>>& results) {
-	// Map to store the file patterns (line numbers and content) for each file.
-	std::map<std::string, std::vector<std::tuple<int, std::string>>> file_patterns_map;
-
-	// Populate the map with file patterns.
-	for (const auto& result : results) {
-		// Extract the relevant values from the tuple.
-		const auto& [thread_id, file_path, line_number, line_content] = result;
-
-		// Check that the values are not empty or zero.
-		if (!file_path.empty() && line_number && !line_content.empty()) {
-			// Add the line number and content to the vector for this file path.
-			file_patterns_map[file_path].push_back({ line_number, line_content });
-		}
-	}
-
-	// Sort the patterns for each file by line number.
-	for (auto& [file_path, patterns] : file_patterns_map) {
-		std::sort(patterns.begin(), patterns.end(), [](const auto& lhs, const auto& rhs) {
-			return std::get<0>(lhs) < std::get<0>(rhs);
-			});
-	}
-
-	// Sort the files by number of patterns.
-	std::vector<std::pair<std::string, std::vector<std::tuple<int, std::string>>>> sorted_files(file_patterns_map.begin(), file_patterns_map.end());
-	std::sort(sorted_files.begin(), sorted_files.end(), [](const auto& lhs, const auto& rhs) {
-		return lhs.second.size() > rhs.second.size();
-		});
-
-	// Write the sorted patterns to the output file.
-	std::ofstream output_file(output_filename + ".txt");
-	if (!output_file.is_open()) {
-		std::cerr << "Could not open output file" << std::endl;
+void writeCounts(std::ostream& output_file, const SearchResults& results, const std::vector<std::string>& file_names, ResultFormat result_format, ResultMode result_mode, TaskScheduler& scheduler) {
+	// Sort the files by number of matches.
+	std::optional<StageTimer> merge_timer(std::in_place, SearchStage::Merge);
+	const std::vector<std::pair<std::uint32_t, std::size_t>> files = orderCountedFiles(results, scheduler);
+	merge_timer.reset();
+
+	const StageTimer write_timer(SearchStage::Write);
+	if (result_format == ResultFormat::Binary) {
+		writeBinaryCounts(output_file, files, file_names);
 		return;
 	}
-
-	// Iterate over each file's patterns and write them to the output file.
-	for (const auto& [file_path, patterns] : sorted_files) {
-		for (const auto& [line_number, line_content] : patterns) {
-			// Write the file path, line number, and content in the specified format.
-			output_file << file_path << ":" << line_number << ": " << line_content << std::endl;
+	OutputWriter writer(output_file);
+	for (const auto& [file_index, match_count] : files) {
+		std::string& text = writer.buffer();
+		if (result_format == ResultFormat::JsonLines) {
+			appendJsonFile(text, file_names[file_index], match_count, result_mode == ResultMode::Count);
+			writer.commit();
+			continue;
+		}
+		text.append(file_names[file_index]);
+		if (result_mode == ResultMode::Count) {
+			text += ':';
+			appendNumber(text, match_count);
 		}
+		text += '\n';
+		writer.commit();
 	}
-
-	output_file.close();
 }
 
 
 /**
- * Writes log information to a file.
+ * Writes log information in the format of the log file: for every thread, the files of the matches it found.
  *
- * @param filename The name of the file to write to.
- * @param results A vector of tuples containing log information for each thread.
+ * @param output_file The output of the log file.
+ * @param results The search results holding the matches of each thread.
+ * @param file_names The name of every file, see fileNames.
  */
-void writeLogToFile(const std::string& filename, const std::vector<std::tuple<std::thread::id, std::string, int, std::string>>& results) {
-	// Open the output file for writing.
-	std::ofstream output_file(filename + ".log");
-	if (!output_file.is_open()) {
-		std::cerr << "Unable to open file for writing: " << filename << std::endl;
-		return;
-	}
-
-	// Create a map to store the files associated with each thread.
-	std::map<std::thread::id, std::vector<std::string>> threads_to_files;
-
-	// Populate the map with file names for each thread.
-	for (const auto& result : results) {
-		std::thread::id thread_id = std::get<0>(result);
-		std::string file_name = std::get<1>(result);
-		threads_to_files[thread_id].push_back(file_name);
+void writeLog(std::ostream& output_file, const SearchResults& results, const std::vector<std::string>& file_names) {
+	const StageTimer timer(SearchStage::Log);
+
+	// Count the names of each thread, one per match, leaving out the context lines.
+	std::vector<std::pair<const WorkerResults*, std::size_t>> thread_names;
+	for (const auto& worker : results.workers) {
+		std::size_t name_count = worker.matchCount();
+		for (const auto& [file_index, file_matches] : worker.counted_files) {
+			name_count += file_matches;
+		}
+		thread_names.emplace_back(&worker, name_count);
 	}
 
-	// Convert the map to a vector of pairs.
-	std::vector<std::pair<std::thread::id, std::vector<std::string>>> thread_file_pairs;
-	std::copy(threads_to_files.begin(), threads_to_files.end(), std::back_inserter(thread_file_pairs));
+	// Sort the threads by the number of files associated with each thread, the threads without any last.
+	std::sort(thread_names.begin(), thread_names.end(), [](const auto& lhs, const auto& rhs) {
+		return lhs.second > rhs.second;
+		});
 
-	// Sort the vector of thread-file pairs by the number of files associated with each thread.
-	std::sort(thread_file_pairs.begin(), thread_file_pairs.end(), [](const auto& lhs, const auto& rhs) {
-		if (lhs.second[0] == "" && rhs.second[0] != "") {
-			return false;
-		}
-		else if (lhs.second[0] != "" && rhs.second[0] == "") {
-			return true;
+	// Write the names of every thread, separated with commas, without one after the last; a thread without matches gets a single empty name.
+	OutputWriter writer(output_file);
+	for (const auto& [worker, name_count] : thread_names) {
+		std::ostringstream thread_id;
+		thread_id << worker->thread_id;
+		std::string& text = writer.buffer();
+		text.append(thread_id.str());
+		text += ':';
+		std::size_t written = 0;
+		auto appendName = [&](const std::string& name) {
+			text += ' ';
+			text.append(name);
+			if (++written < name_count) {
+				text += ',';
+			}
+			writer.commit();
+		};
+		for (const auto& match : worker->matches) {
+			if (!match.isContext()) {
+				appendName(file_names[match.file_index]);
+			}
 		}
-		else {
-			return lhs.second.size() > rhs.second.size();
+		for (const auto& [file_index, file_matches] : worker->counted_files) {
+			for (std::size_t i = 0; i < file_matches; ++i) {
+				appendName(file_names[file_index]);
+			}
 		}
-		});
-
-	// Write the sorted thread-file pairs to the output file.
-	for (const auto& [thread_id, file_names] : thread_file_pairs) {
-		output_file << thread_id << ":";
-		for (const auto& file_name : file_names) {
-			output_file << " " << file_name << ",";
+		if (name_count == 0) {
+			text += ' ';
 		}
-		// Remove the trailing comma and add a newline character.
-		output_file.seekp(-1, std::ios_base::end);
-		output_file << std::endl;
+		text += '\n';
+		writer.commit();
 	}
-
-	// Close the output file.
-	output_file.close();
 }
 
 
 /**
 * Print the search results to the console, including the number of searched files,
-* the number of files containing the search pattern, the number of unique pattern occurrences,
+* the number of files containing the search pattern, the number of pattern occurrences,
 * the name of the result file, the name of the log file, the number of threads used in the search,
 * and the elapsed time.
 *
-* @param results A pair consisting of the search results and the number of searched files.
+* @param output The output to print to, the console or a client of the server.
+* @param results The search results.
 * @param thread_count The number of threads used in the search.
 * @param log_filename The name of the log file to be generated.
 * @param result_filename The name of the result file to be generated.
+* @param result_format The format of the result file, which gives its extension.
+* @param output_directory The directory the result and log files are written in.
 * @param timer_start The time at which the search began.
 */
-void printSearchResults(const std::pair<std::vector<std::tuple<std::thread::id, std::string, int, std::string>>, int>& results, int thread_count, std::string log_filename, std::string result_filename, int& timer_start) {
-	// Extract search results.
-	std::vector<std::tuple<std::thread::id, std::string, int, std::string>> results_vector = results.first;
-
+void printSearchResults(std::ostream& output, const SearchResults& results, int thread_count, std::string log_filename, std::string result_filename, ResultFormat result_format, const std::string& output_directory, const Clock::time_point& timer_start) {
 	// Print number of searched files.
-	std::cout << "Searched files: " << results.second << std::endl;
+	output << "Searched files: " << results.files_searched << std::endl;
 
-	// Count files with pattern and pattern occurrences.
-	std::set<std::string> files_with_pattern;
-	std::set<std::tuple<std::string, int>> pattern_occurrences;
-	for (const auto& result : results_vector) {
-		if (std::get<2>(result) != 0) {
-			files_with_pattern.insert(std::get<1>(result));
-			pattern_occurrences.insert(std::make_tuple(std::get<1>(result), std::get<2>(result)));
-		}
-	}
-
-	// Print number of files with pattern and number of unique pattern occurrences.
-	std::cout << "Files with pattern: " << files_with_pattern.size() << std::endl;
-	std::cout << "Patterns number: " << pattern_occurrences.size() << std::endl;
-
-	// Get current directory.
-	std::string cur_directory = fs::current_path().string();
+	// Print number of files with pattern and number of pattern occurrences.
+	// Every file in the path table has at least one match, and every match is a different line.
+	output << "Files with pattern: " << results.paths.size() << std::endl;
+	output << "Patterns number: " << results.matchCount() << std::endl;
 
 	// Print name of result file and log file, number of threads used, and elapsed time.
-	std::cout << "Result file: " << cur_directory << "\\" << result_filename << ".txt" << std::endl;
-	std::cout << "Log file: " << cur_directory << "\\" << log_filename << ".log" << std::endl;
-	std::cout << "Used threads: " << thread_count << std::endl;
-
-	// Stop the timer and calculate the elapsed time of the program
-	int timer_stop = clock();
-	double elapsed_time_ms = (timer_stop - timer_start) / (double)CLOCKS_PER_SEC * 1000;
-	std::cout << "Elapsed time: " << elapsed_time_ms << "[ms]" << std::endl;
+	output << "Result file: " << output_directory << "\\" << result_filename << resultFileExtension(result_format) << std::endl;
+	output << "Log file: " << output_directory << "\\" << log_filename << ".log" << std::endl;
+	output << "Used threads: " << thread_count << std::endl;
+
+	// Stop the timer and calculate the elapsed wall time of the program, clock() would add up the time of every thread
+	double elapsed_time_ms = std::chrono::duration<double, std::milli>(Clock::now() - timer_start).count();
+	output << "Elapsed time: " << elapsed_time_ms << "[ms]" << std::endl;
 }
 
 
@@ -291,28 +313,31 @@ bool isValidFilename(const std::string& filename) {
  * @param dir_opt A reference to a boolean that tracks whether the directory option has already been set.
  * @param directory_path A reference to a string that stores the path of the starting directory.
  * @param argv The command line arguments.
- * @param i The index of the current option.
+ * @param i The index of the option's value.
+ * @param working_directory The directory a relative path is relative to, empty for the current one.
+ * @param errors The output of the error messages.
  *
  * @return True on success, false on error.
  */
-bool setStartingDirectory(bool& dir_opt, std::string& directory_path, char* argv[], int i)
+bool setStartingDirectory(bool& dir_opt, std::string& directory_path, char* argv[], int i, const fs::path& working_directory, std::ostream& errors)
 {
 	// Check if the directory option has already been set
 	if (dir_opt == true) {
-		std::cerr << "Error: multiple usage of the starting directory option" << std::endl;
+		errors << "Error: multiple usage of the starting directory option" << std::endl;
 		return false;
 	}
 
 	// Append the directory to the current directory path
-	directory_path = directory_path + "\\" + argv[i * 2 + 1];
+	directory_path = directory_path + "\\" + argv[i];
 
 	// Check if the directory exists
 	if (!fs::exists(directory_path)) {
-		if (!fs::exists(argv[i * 2 + 1])) {
-			std::cerr << "Error: directory does not exist" << std::endl;
+		const fs::path path = working_directory / argv[i];
+		if (!fs::exists(path)) {
+			errors << "Error: directory does not exist" << std::endl;
 			return false;
 		}
-		directory_path = argv[i * 2 + 1];
+		directory_path = path.string();
 	}
 
 	// Set the directory option to true indicating that this option has been set
@@ -328,22 +353,23 @@ bool setStartingDirectory(bool& dir_opt, std::string& directory_path, char* argv
  * @param log_filename_opt A boolean reference indicating if the log filename option has already been set.
  * @param log_filename A string reference to store the log filename.
  * @param argv A character array containing the command line arguments.
- * @param i The index of the current argument being processed.
+ * @param i The index of the option's value.
+ * @param errors The output of the error messages.
  *
  * @return True on success, false on error.
  */
-bool setLogFilename(bool& log_filename_opt, std::string& log_filename, char* argv[], int i)
+bool setLogFilename(bool& log_filename_opt, std::string& log_filename, char* argv[], int i, std::ostream& errors)
 {
 	// Check if option already used
 	if (log_filename_opt == true) {
-		std::cerr << "Error: multiple usage of the log filename option" << std::endl;
+		errors << "Error: multiple usage of the log filename option" << std::endl;
 		return false;
 	}
 
 	// Set log filename and check if valid
-	log_filename = argv[i * 2 + 1];
+	log_filename = argv[i];
 	if (!isValidFilename(log_filename)) {
-		std::cerr << "Error: invalid log filename" << std::endl;
+		errors << "Error: invalid log filename" << std::endl;
 		return false;
 	}
 
@@ -361,22 +387,23 @@ bool setLogFilename(bool& log_filename_opt, std::string& log_filename, char* arg
  * @param result_filename_opt A boolean flag to indicate if the result filename option has been set.
  * @param result_filename A reference to the string that will hold the result filename.
  * @param argv The command line arguments.
- * @param i The index of the current argument being processed.
+ * @param i The index of the option's value.
+ * @param errors The output of the error messages.
  *
  * @return True on success, false on error.
  */
-bool setResultFilename(bool& result_filename_opt, std::string& result_filename, char* argv[], int i)
+bool setResultFilename(bool& result_filename_opt, std::string& result_filename, char* argv[], int i, std::ostream& errors)
 {
 	// Check if option already used
 	if (result_filename_opt == true) {
-		std::cerr << "Error: multiple usage of the result filename option" << std::endl;
+		errors << "Error: multiple usage of the result filename option" << std::endl;
 		return false;
 	}
 
 	// Set result filename and check if valid
-	result_filename = argv[i * 2 + 1];
+	result_filename = argv[i];
 	if (!isValidFilename(result_filename)) {
-		std::cerr << "Error: invalid result filename" << std::endl;
+		errors << "Error: invalid result filename" << std::endl;
 		return false;
 	}
 
@@ -393,31 +420,32 @@ bool setResultFilename(bool& result_filename_opt, std::string& result_filename,
  * @param thread_cnt_opt A boolean flag indicating whether the thread count option has already been set.
  * @param thread_cnt An integer indicating the number of threads to be used in the program.
  * @param argv The command-line arguments.
- * @param i The index of the current argument being processed.
+ * @param i The index of the option's value.
+ * @param errors The output of the error messages.
  *
  * @return True on success, false on error.
  */
-bool setThreadCount(bool& thread_cnt_opt, int& thread_cnt, char* argv[], int i)
+bool setThreadCount(bool& thread_cnt_opt, int& thread_cnt, char* argv[], int i, std::ostream& errors)
 {
 	// Check if option already used
 	if (thread_cnt_opt == true) {
-		std::cerr << "Error: multiple usage of the thread count option" << std::endl;
+		errors << "Error: multiple usage of the thread count option" << std::endl;
 		return false;
 	}
 
 	// Set thread count and catch invalid argument
 	try {
-		thread_cnt = std::stoi(argv[i * 2 + 1]);
+		thread_cnt = std::stoi(argv[i]);
 	}
 	catch (const std::invalid_argument& e) {
-		std::cerr << "Error: invalid thread count" << std::endl;
+		errors << "Error: invalid thread count" << std::endl;
 		return false;
 	}
 
 	// Check if thread count is valid
 	if (thread_cnt < 1) {
-		std::cerr << "Error: invalid thread count" << std::endl;
-		return 1;
+		errors << "Error: invalid thread count" << std::endl;
+		return false;
 	}
 
 	thread_cnt_opt = true;
@@ -426,123 +454,1026 @@ bool setThreadCount(bool& thread_cnt_opt, int& thread_cnt, char* argv[], int i)
 }
 
 
+/**
+ * Sets the pin mode, which decides where the threads of the search run.
+ *
+ * @param pin_opt A boolean flag indicating whether the pin option has already been set.
+ * @param pin_mode A reference to the pin mode to be set.
+ * @param argv The command-line arguments.
+ * @param i The index of the option's value.
+ * @param errors The output of the error messages.
+ *
+ * @return True on success, false on error.
+ */
+bool setPinMode(bool& pin_opt, PinMode& pin_mode, char* argv[], int i, std::ostream& errors)
+{
+	// Check if option already used
+	if (pin_opt == true) {
+		errors << "Error: multiple usage of the pin option" << std::endl;
+		return false;
+	}
+
+	// Set pin mode and check if valid
+	if (!parsePinMode(argv[i], pin_mode)) {
+		errors << "Error: invalid pin mode" << std::endl;
+		return false;
+	}
+
+	pin_opt = true;
+
+	return true;
+}
+
+
+/**
+ * Sets the read mode, which decides whether files are mapped into memory or read into a buffer.
+ *
+ * @param read_mode_opt A boolean flag indicating whether the read mode option has already been set.
+ * @param read_mode A reference to the read mode to be set.
+ * @param argv The command-line arguments.
+ * @param i The index of the option's value.
+ * @param errors The output of the error messages.
+ *
+ * @return True on success, false on error.
+ */
+bool setReadMode(bool& read_mode_opt, ReadMode& read_mode, char* argv[], int i, std::ostream& errors)
+{
+	// Check if option already used
+	if (read_mode_opt == true) {
+		errors << "Error: multiple usage of the read mode option" << std::endl;
+		return false;
+	}
+
+	// Set read mode and check if valid
+	if (!parseReadMode(argv[i], read_mode)) {
+		errors << "Error: invalid read mode" << std::endl;
+		return false;
+	}
+
+	read_mode_opt = true;
+
+	return true;
+}
+
+
+/**
+ * Sets the format of the result file.
+ *
+ * @param format_opt A boolean flag indicating whether the format option has already been set.
+ * @param result_format A reference to the result format to be set.
+ * @param argv The command-line arguments.
+ * @param i The index of the option's value.
+ * @param errors The output of the error messages.
+ *
+ * @return True on success, false on error.
+ */
+bool setResultFormat(bool& format_opt, ResultFormat& result_format, char* argv[], int i, std::ostream& errors)
+{
+	// Check if option already used
+	if (format_opt == true) {
+		errors << "Error: multiple usage of the format option" << std::endl;
+		return false;
+	}
+
+	// Set result format and check if valid
+	if (!parseResultFormat(argv[i], result_format)) {
+		errors << "Error: invalid result format" << std::endl;
+		return false;
+	}
+
+	format_opt = true;
+
+	return true;
+}
+
+
+/**
+ * Sets the binary policy, which decides what happens to files with binary content.
+ *
+ * @param binary_opt A boolean flag indicating whether the binary option has already been set.
+ * @param binary_policy A reference to the binary policy to be set.
+ * @param argv The command-line arguments.
+ * @param i The index of the option's value.
+ * @param errors The output of the error messages.
+ *
+ * @return True on success, false on error.
+ */
+bool setBinaryPolicy(bool& binary_opt, BinaryPolicy& binary_policy, char* argv[], int i, std::ostream& errors)
+{
+	// Check if option already used
+	if (binary_opt == true) {
+		errors << "Error: multiple usage of the binary option" << std::endl;
+		return false;
+	}
+
+	// Set binary policy and check if valid
+	if (!parseBinaryPolicy(argv[i], binary_policy)) {
+		errors << "Error: invalid binary policy" << std::endl;
+		return false;
+	}
+
+	binary_opt = true;
+
+	return true;
+}
+
+
+/**
+ * Sets the number of matches after which the whole search stops.
+ *
+ * @param max_count_opt A boolean flag indicating whether the max count option has already been set.
+ * @param max_count A reference to the number to be set.
+ * @param argv The command-line arguments.
+ * @param i The index of the option's value.
+ * @param errors The output of the error messages.
+ *
+ * @return True on success, false on error.
+ */
+bool setMaxCount(bool& max_count_opt, std::uint64_t& max_count, char* argv[], int i, std::ostream& errors)
+{
+	// Check if option already used
+	if (max_count_opt == true) {
+		errors << "Error: multiple usage of the max count option" << std::endl;
+		return false;
+	}
+
+	// Set max count and check if valid
+	const std::string value = argv[i];
+	if (value.empty() || value.size() > 18 || value.find_first_not_of("0123456789") != std::string::npos || std::stoull(value) == 0) {
+		errors << "Error: invalid max count" << std::endl;
+		return false;
+	}
+	max_count = std::stoull(value);
+
+	max_count_opt = true;
+
+	return true;
+}
+
+
+/**
+ * Sets a number of context lines around every match.
+ *
+ * @param context_opt A boolean flag indicating whether the option has already been set.
+ * @param context_lines A reference to the number to be set.
+ * @param option_name The name of the option for the error messages.
+ * @param argv The command-line arguments.
+ * @param i The index of the option's value.
+ * @param errors The output of the error messages.
+ *
+ * @return True on success, false on error.
+ */
+bool setContextLines(bool& context_opt, std::size_t& context_lines, const char* option_name, char* argv[], int i, std::ostream& errors)
+{
+	// Check if option already used
+	if (context_opt == true) {
+		errors << "Error: multiple usage of the " << option_name << " option" << std::endl;
+		return false;
+	}
+
+	// Set the number of lines and check if valid
+	const std::string value = argv[i];
+	if (value.empty() || value.size() > 9 || value.find_first_not_of("0123456789") != std::string::npos) {
+		errors << "Error: invalid " << option_name << std::endl;
+		return false;
+	}
+	context_lines = std::stoul(value);
+
+	context_opt = true;
+
+	return true;
+}
+
+
+/**
+ * Sets the size from which files are split into ranges that are searched at the same time,
+ * in bytes or with a K, M or G suffix for KiB, MiB or GiB. A size of 0 turns splitting off, any
+ * other size must be at least min_split_size.
+ *
+ * @param split_size_opt A boolean flag indicating whether the split size option has already been set.
+ * @param split_size A reference to the size to be set.
+ * @param argv The command-line arguments.
+ * @param i The index of the option's value.
+ * @param errors The output of the error messages.
+ *
+ * @return True on success, false on error.
+ */
+bool setSplitSize(bool& split_size_opt, std::uint64_t& split_size, char* argv[], int i, std::ostream& errors)
+{
+	// Check if option already used
+	if (split_size_opt == true) {
+		errors << "Error: multiple usage of the split size option" << std::endl;
+		return false;
+	}
+
+	// Set split size and check if valid
+	const std::string value = argv[i];
+	std::size_t digits = 0;
+	while (digits < value.size() && value[digits] >= '0' && value[digits] <= '9') {
+		++digits;
+	}
+	const std::string suffix = value.substr(digits);
+	const int shift = suffix.empty() ? 0 : suffix == "K" ? 10 : suffix == "M" ? 20 : suffix == "G" ? 30 : -1;
+	if (digits == 0 || digits > 12 || shift < 0) {
+		errors << "Error: invalid split size" << std::endl;
+		return false;
+	}
+	split_size = std::stoull(value.substr(0, digits)) << shift;
+	if (split_size != 0 && split_size < min_split_size) {
+		errors << "Error: the split size must be 0 or at least " << (min_split_size >> 10) << "K" << std::endl;
+		return false;
+	}
+
+	split_size_opt = true;
+
+	return true;
+}
+
+
+/**
+ * Adds a glob to the include or exclude globs, which can be given any number of times.
+ *
+ * @param globs A reference to the globs to add to.
+ * @param argv The command-line arguments.
+ * @param i The index of the option's value.
+ * @param errors The output of the error messages.
+ *
+ * @return True on success, false on error.
+ */
+bool addGlob(std::vector<std::string>& globs, char* argv[], int i, std::ostream& errors)
+{
+	// An empty glob matches nothing
+	if (argv[i][0] == '\0') {
+		errors << "Error: invalid glob" << std::endl;
+		return false;
+	}
+
+	globs.push_back(argv[i]);
+
+	return true;
+}
+
+
+/**
+ * Sets the path of the trigram index file, which need not exist yet.
+ *
+ * @param index_opt A boolean flag indicating whether the index option has already been set.
+ * @param index_path A reference to the path to be set.
+ * @param argv The command-line arguments.
+ * @param i The index of the option's value.
+ * @param working_directory The directory a relative path is relative to, empty for the current one.
+ * @param errors The output of the error messages.
+ *
+ * @return True on success, false on error.
+ */
+bool setIndexPath(bool& index_opt, std::string& index_path, char* argv[], int i, const fs::path& working_directory, std::ostream& errors)
+{
+	// Check if option already used
+	if (index_opt == true) {
+		errors << "Error: multiple usage of the index option" << std::endl;
+		return false;
+	}
+
+	// The index is rewritten in place, so it cannot be a directory
+	index_path = (working_directory / argv[i]).string();
+	if (index_path.empty() || fs::is_directory(index_path)) {
+		errors << "Error: invalid index file" << std::endl;
+		return false;
+	}
+
+	index_opt = true;
+
+	return true;
+}
+
+
+/**
+ * Sets the path of the result cache file, which need not exist yet.
+ *
+ * @param cache_opt A boolean flag indicating whether the cache option has already been set.
+ * @param cache_path A reference to the path to be set.
+ * @param argv The command-line arguments.
+ * @param i The index of the option's value.
+ * @param working_directory The directory a relative path is relative to, empty for the current one.
+ * @param errors The output of the error messages.
+ *
+ * @return True on success, false on error.
+ */
+bool setCachePath(bool& cache_opt, std::string& cache_path, char* argv[], int i, const fs::path& working_directory, std::ostream& errors)
+{
+	// Check if option already used
+	if (cache_opt == true) {
+		errors << "Error: multiple usage of the cache option" << std::endl;
+		return false;
+	}
+
+	// The cache is rewritten in place, so it cannot be a directory
+	cache_path = (working_directory / argv[i]).string();
+	if (cache_path.empty() || fs::is_directory(cache_path)) {
+		errors << "Error: invalid cache file" << std::endl;
+		return false;
+	}
+
+	cache_opt = true;
+
+	return true;
+}
+
+
+/**
+ * Sets the path of a report file of the search, such as the statistics or the trace.
+ *
+ * @param report_opt A boolean flag indicating whether the option has already been set.
+ * @param report_path A reference to the path to be set.
+ * @param option_name The name of the option for the error messages.
+ * @param argv The command-line arguments.
+ * @param i The index of the option's value.
+ * @param working_directory The directory a relative path is relative to, empty for the current one.
+ * @param errors The output of the error messages.
+ *
+ * @return True on success, false on error.
+ */
+bool setReportPath(bool& report_opt, std::string& report_path, const char* option_name, char* argv[], int i, const fs::path& working_directory, std::ostream& errors)
+{
+	// Check if option already used
+	if (report_opt == true) {
+		errors << "Error: multiple usage of the " << option_name << " option" << std::endl;
+		return false;
+	}
+
+	report_path = (working_directory / argv[i]).string();
+	if (report_path.empty() || fs::is_directory(report_path)) {
+		errors << "Error: invalid " << option_name << " file" << std::endl;
+		return false;
+	}
+
+	report_opt = true;
+
+	return true;
+}
+
+
+/**
+ * Sets the socket of the server that runs the search, see --serve.
+ *
+ * @param server_opt A boolean flag indicating whether the server option has already been set.
+ * @param server_socket A reference to the path to be set.
+ * @param argv The command-line arguments.
+ * @param i The index of the option's value.
+ * @param errors The output of the error messages.
+ *
+ * @return True on success, false on error.
+ */
+bool setServerSocket(bool& server_opt, std::string& server_socket, char* argv[], int i, std::ostream& errors)
+{
+	// Check if option already used
+	if (server_opt == true) {
+		errors << "Error: multiple usage of the server option" << std::endl;
+		return false;
+	}
+
+	server_socket = argv[i];
+	if (server_socket.empty()) {
+		errors << "Error: invalid server socket" << std::endl;
+		return false;
+	}
+
+	server_opt = true;
+
+	return true;
+}
+
+
+/**
+ * Sets an option that is a flag without a value.
+ *
+ * @param flag_opt A boolean flag indicating whether the option has already been set.
+ * @param flag A reference to the flag to be set.
+ * @param option_name The name of the option for the error message.
+ * @param errors The output of the error messages.
+ *
+ * @return True on success, false on error.
+ */
+bool setFlag(bool& flag_opt, bool& flag, const char* option_name, std::ostream& errors)
+{
+	// Check if option already used
+	if (flag_opt == true) {
+		errors << "Error: multiple usage of the " << option_name << " option" << std::endl;
+		return false;
+	}
+
+	flag = true;
+	flag_opt = true;
+
+	return true;
+}
+
+
+/**
+ * The settings of a run of the program.
+ */
+struct ProgramOptions {
+	SearchOptions search;
+	// The name of the log file without its extension.
+	std::string log_filename;
+	// The name of the result file without its extension.
+	std::string result_filename;
+	// The directory the result and log files are written in.
+	std::string output_directory;
+	// The format of the result file, which gives its extension.
+	ResultFormat result_format = ResultFormat::Text;
+	// Whether the text result file holds the byte offset of every line.
+	bool byte_offsets = false;
+	// Write the matches of each file as soon as it is searched instead of sorting all of them.
+	bool stream_results = false;
+	// The path of the trigram index to search with, empty to search without one.
+	std::string index_path;
+	// The path of the result cache to search with, empty to search without one.
+	std::string cache_path;
+	// The socket of the server to send the search to, empty to search in this process.
+	std::string server_socket;
+	// The path of the JSON report of the statistics of the search, empty to count nothing.
+	std::string stats_path;
+	// The path of the Chrome trace of the stages of the search, empty to record none.
+	std::string trace_path;
+};
+
+
 /**
  * Sets additional options for the program based on the provided command line arguments.
  *
  * @param argc The number of command line arguments.
  * @param filename The name of the program.
  * @param argv An array of the command line arguments.
- * @param directory_path The directory to search in.
- * @param log_filename The name of the log file.
- * @param result_filename The name of the result file.
- * @param thread_cnt The number of threads to use.
+ * @param options The settings to be set, holding the defaults on entry.
+ * @param working_directory The directory the paths of the options are relative to, empty for the current one.
+ * @param errors The output of the error messages.
  *
  * @return True on success, false on error.
  */
-bool setAdditionalOptions(int argc, std::string& filename, char* argv[], std::string& directory_path, std::string& log_filename, std::string& result_filename, int& thread_cnt)
+bool setAdditionalOptions(int argc, std::string& filename, char* argv[], ProgramOptions& options, const fs::path& working_directory, std::ostream& errors)
 {
-	// If no arguments are given or the number of arguments is invalid, print an error message and exit
+	// If no arguments are given, print the usage and exit
 	if (argc == 1) {
-		std::cerr << "Error: wrong usage of the program\n"
+		errors << "Error: wrong usage of the program\n"
 			<< "Usage: " << filename << " <search string> [options]\n"
 			<< "Options:\n"
 			<< "  -d <directory> - directory to search in (default: current directory)\n"
 			<< "  -l <log filename> - log filename (default: <program name>.log)\n"
-			<< "  -r <result filename> - result filename (default: <program name>.txt)\n"
-			<< "  -t <thread count> - number of threads to use (default: 4)\n";
-		return false;
-	}
-
-	if (!(argc % 2 == 0) || argc > 10) {
-		std::cerr << "Error: wrong number of arguments" << std::endl;
+			<< "  -r <result filename> - result filename without its extension (default: <program name>.txt)\n"
+			<< "  --format <text|binary|jsonl> - write the result file as text, as a binary file of fixed-size records with the paths, line numbers and byte offsets of the matches (.sgr), or as a JSON object per line and match (.jsonl) (default: text)\n"
+			<< "  -t <thread count> - number of threads to use (default: one per CPU the program may run on)\n"
+			<< "  --pin <none|cpu|node> - run every thread on a CPU of its own, or on the CPUs of one NUMA node with the threads spread over the nodes (default: none)\n"
+			<< "  --read_mode <auto|read|mmap|uring> - map files into memory, read them into a buffer, or read many at once with io_uring (default: auto, maps files from 1 MiB)\n"
+			<< "  --split_size <size> - split files of at least the size into ranges of the size that are searched at the same time, in bytes or with a K, M or G suffix, at least 256K, 0 to never split (default: 64M)\n"
+			<< "  --binary <skip|report|text> - skip files with a NUL byte in their first 32 KiB, report their first match as \"Binary file matches\", or search them as text (default: report)\n"
+			<< "  -e, --regex - search for lines matching the search string as an extended regular expression (default: search for the literal string)\n"
+			<< "  -f, --pattern_file - search for all literal patterns in the file named by the search string, one per line, and tag every match with the line of its pattern\n"
+			<< "  -i, --ignore_case - ignore the case of letters in the search string and the content\n"
+			<< "  --include <glob> - only search the files matching the glob, can be given several times (default: search every file)\n"
+			<< "  --exclude <glob> - leave out the files and directories matching the glob, can be given several times\n"
+			<< "  --gitignore - leave out the .git directories and what the .gitignore and .ignore files of the directory tree ignore\n"
+			<< "  --index <index file> - skip the files that cannot match with a trigram index of the directory, which is created or brought up to date by the search\n"
+			<< "  --cache <cache file> - take the matches of the files unchanged since the same search from a result cache, which is created or brought up to date by the search\n"
+			<< "  -c, --count - write the number of matches of every file with matches instead of the lines\n"
+			<< "  --files_with_matches - write the name of every file with a match instead of the lines, reading each file only up to its first match\n"
+			<< "  --max_count <count> - stop the whole search once it has found the number of matches (default: no limit)\n"
+			<< "  -A, --after_context <count> - write the number of lines after every match with it, files are then not split (default: 0)\n"
+			<< "  -B, --before_context <count> - write the number of lines before every match with it, files are then not split (default: 0)\n"
+			<< "  -C, --context <count> - write the number of lines before and after every match with it, unless -A or -B set them\n"
+			<< "  -b, --byte_offset - write the byte offset of every line in its file after the line number\n"
+			<< "  --stats <file> - write the statistics of the search as JSON: the bytes read, the files opened, the matches, and the time of every stage and the tasks and steals of every thread\n"
+			<< "  --trace <file> - write every stage of every thread in the Chrome trace event format, for chrome://tracing or Perfetto\n"
+			<< "  --server <socket> - send the search to the server listening on the socket, which was started with: " << filename << " --serve <socket> [options]\n"
+			<< "  --stream - write the matches of each file as soon as it is searched, in no particular file order (default: sort files by number of matches)\n";
 		return false;
 	}
 
-	// Calculate the number of additional options passed
-	int additional_options_cnt = (argc - 2) / 2;
-	bool dir_opt = false, log_filename_opt = false, result_filename_opt = false, thread_cnt_opt = false;
+	bool dir_opt = false, log_filename_opt = false, result_filename_opt = false, thread_cnt_opt = false, read_mode_opt = false, stream_opt = false, regex_opt = false, pattern_file_opt = false, ignore_case_opt = false, index_opt = false, cache_opt = false, binary_opt = false, gitignore_opt = false, split_size_opt = false, count_opt = false, files_opt = false, max_count_opt = false, server_opt = false, pin_opt = false, stats_opt = false, trace_opt = false, format_opt = false, after_opt = false, before_opt = false, context_opt = false, byte_offset_opt = false;
+	bool count = false, files_with_matches = false;
+	std::size_t context_lines = 0;
 
 	// Loop through the additional options
-	for (int i = 1; i <= additional_options_cnt; i++) {
+	for (int i = 2; i < argc; i++) {
+		// If the option is the --stream option, stream the results
+		if (strcmp(argv[i], "--stream") == 0) {
+			if (!setFlag(stream_opt, options.stream_results, "stream", errors)) return false;
+			continue;
+		}
+		// If the option is the -e or --regex option, treat the search string as a regular expression
+		if (strcmp(argv[i], "-e") == 0 || strcmp(argv[i], "--regex") == 0) {
+			if (!setFlag(regex_opt, options.search.regex, "regex", errors)) return false;
+			continue;
+		}
+		// If the option is the -f or --pattern_file option, read the patterns from the file named by the search string
+		if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--pattern_file") == 0) {
+			if (!setFlag(pattern_file_opt, options.search.pattern_file, "pattern file", errors)) return false;
+			continue;
+		}
+		// If the option is the -i or --ignore_case option, ignore the case of letters
+		if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--ignore_case") == 0) {
+			if (!setFlag(ignore_case_opt, options.search.case_insensitive, "ignore case", errors)) return false;
+			continue;
+		}
+		// If the option is the -c or --count option, only count the matches of every file
+		if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--count") == 0) {
+			if (!setFlag(count_opt, count, "count", errors)) return false;
+			continue;
+		}
+		// If the option is the --files_with_matches option, only find the files with a match
+		if (strcmp(argv[i], "--files_with_matches") == 0) {
+			if (!setFlag(files_opt, files_with_matches, "files with matches", errors)) return false;
+			continue;
+		}
+		// If the option is the -b or --byte_offset option, write the byte offsets of the lines
+		if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--byte_offset") == 0) {
+			if (!setFlag(byte_offset_opt, options.byte_offsets, "byte offset", errors)) return false;
+			continue;
+		}
+		// If the option is the --gitignore option, leave out what the ignore files ignore
+		if (strcmp(argv[i], "--gitignore") == 0) {
+			if (!setFlag(gitignore_opt, options.search.ignore_files, "gitignore", errors)) return false;
+			continue;
+		}
+
+		// All other options take a value
+		if (i + 1 == argc) {
+			errors << "Error: wrong number of arguments" << std::endl;
+			return false;
+		}
+
 		// If the option is the -d or --dir option, set the directory path
-		if (strcmp(argv[i * 2], "-d") == 0 || strcmp(argv[i * 2], "--dir") == 0) {
-			int directory_func_success = setStartingDirectory(dir_opt, directory_path, argv, i);
+		if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--dir") == 0) {
+			int directory_func_success = setStartingDirectory(dir_opt, options.search.directory_path, argv, ++i, working_directory, errors);
 
 			// If the directory path is invalid, return false
 			if (!directory_func_success) return directory_func_success;
 		}
 		// If the option is the -l or --log_file option, set the log filename
-		else if (strcmp(argv[i * 2], "-l") == 0 || strcmp(argv[i * 2], "--log_file") == 0) {
-			int log_func_success = setLogFilename(log_filename_opt, log_filename, argv, i);
+		else if (strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--log_file") == 0) {
+			int log_func_success = setLogFilename(log_filename_opt, options.log_filename, argv, ++i, errors);
 
 			// If the log filename is invalid, return false
 			if (!log_func_success) return log_func_success;
 		}
 		// If the option is the -r or --result_file option, set the result filename
-		else if (strcmp(argv[i * 2], "-r") == 0 || strcmp(argv[i * 2], "--result_file") == 0) {
-			int result_func_success = setResultFilename(result_filename_opt, result_filename, argv, i);
+		else if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--result_file") == 0) {
+			int result_func_success = setResultFilename(result_filename_opt, options.result_filename, argv, ++i, errors);
 
 			// If the result filename is invalid, return false
 			if (!result_func_success) return result_func_success;
 		}
 		// If the option is the -t or --threads option, set the threads count
-		else if (strcmp(argv[i * 2], "-t") == 0 || strcmp(argv[i * 2], "--threads") == 0) {
-			int thread_func_success = setThreadCount(thread_cnt_opt, thread_cnt, argv, i);
+		else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0) {
+			int thread_func_success = setThreadCount(thread_cnt_opt, options.search.thread_count, argv, ++i, errors);
 
 			// If the thread count is invalid, return false
 			if (!thread_func_success) return thread_func_success;
 		}
+		// If the option is the --format option, set the format of the result file
+		else if (strcmp(argv[i], "--format") == 0) {
+			if (!setResultFormat(format_opt, options.result_format, argv, ++i, errors)) return false;
+		}
+		// If the option is the --pin option, set where the threads run
+		else if (strcmp(argv[i], "--pin") == 0) {
+			if (!setPinMode(pin_opt, options.search.pin_mode, argv, ++i, errors)) return false;
+		}
+		// If the option is the --read_mode option, set the read mode
+		else if (strcmp(argv[i], "--read_mode") == 0) {
+			int read_mode_func_success = setReadMode(read_mode_opt, options.search.read_mode, argv, ++i, errors);
+
+			// If the read mode is invalid, return false
+			if (!read_mode_func_success) return read_mode_func_success;
+		}
+		// If the option is the --max_count option, set the number of matches after which the search stops
+		else if (strcmp(argv[i], "--max_count") == 0) {
+			int max_count_func_success = setMaxCount(max_count_opt, options.search.max_count, argv, ++i, errors);
+
+			// If the max count is invalid, return false
+			if (!max_count_func_success) return max_count_func_success;
+		}
+		// If the option is the -A, -B or -C option or their long forms, set the number of context lines
+		else if (strcmp(argv[i], "-A") == 0 || strcmp(argv[i], "--after_context") == 0) {
+			if (!setContextLines(after_opt, options.search.after_context, "after context", argv, ++i, errors)) return false;
+		}
+		else if (strcmp(argv[i], "-B") == 0 || strcmp(argv[i], "--before_context") == 0) {
+			if (!setContextLines(before_opt, options.search.before_context, "before context", argv, ++i, errors)) return false;
+		}
+		else if (strcmp(argv[i], "-C") == 0 || strcmp(argv[i], "--context") == 0) {
+			if (!setContextLines(context_opt, context_lines, "context", argv, ++i, errors)) return false;
+		}
+		// If the option is the --split_size option, set the size from which files are split
+		else if (strcmp(argv[i], "--split_size") == 0) {
+			int split_size_func_success = setSplitSize(split_size_opt, options.search.split_size, argv, ++i, errors);
+
+			// If the split size is invalid, return false
+			if (!split_size_func_success) return split_size_func_success;
+		}
+		// If the option is the --binary option, set the binary policy
+		else if (strcmp(argv[i], "--binary") == 0) {
+			int binary_func_success = setBinaryPolicy(binary_opt, options.search.binary_policy, argv, ++i, errors);
+
+			// If the binary policy is invalid, return false
+			if (!binary_func_success) return binary_func_success;
+		}
+		// If the option is the --include option, add a glob of the files to search
+		else if (strcmp(argv[i], "--include") == 0) {
+			if (!addGlob(options.search.include_globs, argv, ++i, errors)) return false;
+		}
+		// If the option is the --exclude option, add a glob of the files and directories to leave out
+		else if (strcmp(argv[i], "--exclude") == 0) {
+			if (!addGlob(options.search.exclude_globs, argv, ++i, errors)) return false;
+		}
+		// If the option is the --index option, set the path of the trigram index
+		else if (strcmp(argv[i], "--index") == 0) {
+			int index_func_success = setIndexPath(index_opt, options.index_path, argv, ++i, working_directory, errors);
+
+			// If the index path is invalid, return false
+			if (!index_func_success) return index_func_success;
+		}
+		// If the option is the --server option, set the socket of the server to search with
+		else if (strcmp(argv[i], "--server") == 0) {
+			if (!setServerSocket(server_opt, options.server_socket, argv, ++i, errors)) return false;
+		}
+		// If the option is the --stats option, set the path of the statistics report
+		else if (strcmp(argv[i], "--stats") == 0) {
+			if (!setReportPath(stats_opt, options.stats_path, "stats", argv, ++i, working_directory, errors)) return false;
+		}
+		// If the option is the --trace option, set the path of the trace
+		else if (strcmp(argv[i], "--trace") == 0) {
+			if (!setReportPath(trace_opt, options.trace_path, "trace", argv, ++i, working_directory, errors)) return false;
+		}
+		// If the option is the --cache option, set the path of the result cache
+		else if (strcmp(argv[i], "--cache") == 0) {
+			int cache_func_success = setCachePath(cache_opt, options.cache_path, argv, ++i, working_directory, errors);
+
+			// If the cache path is invalid, return false
+			if (!cache_func_success) return cache_func_success;
+		}
 		// If option not recognized, print error message
 		else {
-			std::cerr << "Wrong usage of the additional parameters." << std::endl;
+			errors << "Wrong usage of the additional parameters." << std::endl;
 			return false;
 		}
 	}
 
+	// The patterns of a pattern file are literals
+	if (options.search.regex && options.search.pattern_file) {
+		errors << "Error: the regex and pattern file options cannot be combined" << std::endl;
+		return false;
+	}
+
+	// Counts and files are written once the search is done, there are no lines to stream
+	if (count && files_with_matches) {
+		errors << "Error: the count and files with matches options cannot be combined" << std::endl;
+		return false;
+	}
+	if ((count || files_with_matches) && options.stream_results) {
+		errors << "Error: the stream option cannot be combined with the count or files with matches options" << std::endl;
+		return false;
+	}
+	// The context goes before and after the matches, unless set for one side on its own
+	if (context_opt) {
+		options.search.before_context = before_opt ? options.search.before_context : context_lines;
+		options.search.after_context = after_opt ? options.search.after_context : context_lines;
+	}
+	if ((count || files_with_matches) && (options.search.before_context != 0 || options.search.after_context != 0)) {
+		errors << "Error: the context options cannot be combined with the count or files with matches options" << std::endl;
+		return false;
+	}
+
+	// The header of the binary result file holds the sizes of the whole result
+	if (options.result_format == ResultFormat::Binary && options.stream_results) {
+		errors << "Error: the stream option cannot be combined with the binary format" << std::endl;
+		return false;
+	}
+	options.search.result_mode = count ? ResultMode::Count : files_with_matches ? ResultMode::Files : ResultMode::Lines;
+
 	return true;
 }
 
 
-int main(int argc, char* argv[]) {
-	// Initialize the timer
-	int timer_start;
+/**
+ * Runs a search and writes its results, its log and its summary.
+ *
+ * @param searcher The searcher to search with.
+ * @param options The settings of the search.
+ * @param matcher The matcher for the search string.
+ * @param files The files to search, or nullptr to walk the directory for them.
+ * @param result_output The output of the result file.
+ * @param log_output The output of the log file.
+ * @param summary The output of the summary, the console or a client of the server.
+ * @param cancel The token to cancel the search with, or nullptr.
+ * @param timer_start The time at which the search began.
+ */
+void runSearch(Searcher& searcher, const ProgramOptions& options, const LineMatcher& matcher, const std::vector<fs::path>* files, std::ostream& result_output, std::ostream& log_output, std::ostream& summary, const CancelToken* cancel, const Clock::time_point& timer_start) {
+	// The matches are written with the patterns of a pattern file, and with their context
+	ResultLayout layout;
+	layout.format = options.result_format;
+	layout.tag_patterns = options.search.pattern_file;
+	layout.byte_offsets = options.byte_offsets;
+	layout.context = options.search.before_context != 0 || options.search.after_context != 0;
+
+	// With streaming, the result file is written while the search goes on
+	std::unique_ptr<ResultStream> stream;
+	if (options.stream_results) {
+		stream = std::make_unique<ResultStream>(result_output, layout);
+	}
+
+	// With an index, only the files that may contain what every match contains are searched
+	std::unique_ptr<TrigramIndex> index;
+	if (!options.index_path.empty()) {
+		index = std::make_unique<TrigramIndex>(options.index_path, searcher.threadCount());
+		index->setQuery(matcher.requiredLiterals());
+	}
+
+	// With a result cache, only the files that changed since the same search are read
+	std::unique_ptr<ResultCache> cache;
+	if (!options.cache_path.empty()) {
+		cache = std::make_unique<ResultCache>(options.cache_path, ResultCache::hashQuery(describeQuery(options.search)));
+	}
+
+	// With a statistics report or a trace, every thread counts its work, this one what it writes
+	std::unique_ptr<SearchStats> stats;
+	if (!options.stats_path.empty() || !options.trace_path.empty()) {
+		stats = std::make_unique<SearchStats>(searcher.threadCount(), !options.trace_path.empty());
+	}
+	const StatsBinding stats_binding(stats ? &stats->caller() : nullptr);
+
+	// Search directory for string with specified options
+	SearchHooks hooks;
+	hooks.files = files;
+	hooks.stream = stream.get();
+	hooks.index = index.get();
+	hooks.cache = cache.get();
+	hooks.stats = stats.get();
+	hooks.cancel = cancel;
+	const SearchResults results = searcher.search(options.search, matcher, hooks);
+
+	// Write back the index with the files that changed since it was last written
+	if (index) {
+		std::string index_error;
+		if (!index->save(index_error)) {
+			std::cerr << "Warning: the index was not updated, " << index_error << std::endl;
+		}
+	}
+
+	// Write back the cache with the files that were searched
+	if (cache) {
+		std::string cache_error;
+		if (!cache->save(cache_error)) {
+			std::cerr << "Warning: the result cache was not updated, " << cache_error << std::endl;
+		}
+	}
+
+	// Write the results, unless they were streamed already; the log has the stems of the files, the binary and JSON formats their paths
+	std::optional<StageTimer> merge_timer(std::in_place, SearchStage::Merge);
+	const std::vector<std::string> file_names = fileNames(results, false, searcher.scheduler());
+	const bool full_paths = !stream && options.result_format != ResultFormat::Text;
+	const std::vector<std::string> file_paths = full_paths ? fileNames(results, true, searcher.scheduler()) : std::vector<std::string>();
+	const std::vector<std::string>& result_names = full_paths ? file_paths : file_names;
+	merge_timer.reset();
+	if (stream) {
+		const StageTimer timer(SearchStage::Write);
+		stream->close();
+	}
+	else if (options.search.result_mode != ResultMode::Lines) {
+		writeCounts(result_output, results, result_names, options.result_format, options.search.result_mode, searcher.scheduler());
+	}
+	else {
+		writeResults(result_output, results, result_names, layout, searcher.scheduler());
+	}
+
+	// Write the log
+	writeLog(log_output, results, file_names);
+
+	// Print the results of the program
+	printSearchResults(summary, results, static_cast<int>(searcher.threadCount()), options.log_filename, options.result_filename, options.result_format, options.output_directory, timer_start);
+	if (index) {
+		summary << "Files skipped by the index: " << index->filesSkipped() << ", files indexed: " << index->filesIndexed() << std::endl;
+	}
+	if (cache) {
+		summary << "Files from the result cache: " << cache->filesCached() << ", files searched again: " << cache->filesStored() << std::endl;
+	}
 
+	// Write the statistics and the trace, with the time up to here
+	if (!options.stats_path.empty()) {
+		std::ofstream stats_file(options.stats_path);
+		stats->writeReport(stats_file, results, std::chrono::duration<double, std::milli>(Clock::now() - timer_start).count());
+		if (!stats_file) {
+			std::cerr << "Warning: could not write the statistics file " << options.stats_path << std::endl;
+		}
+	}
+	if (!options.trace_path.empty()) {
+		std::ofstream trace_file(options.trace_path);
+		stats->writeTrace(trace_file);
+		if (!trace_file) {
+			std::cerr << "Warning: could not write the trace file " << options.trace_path << std::endl;
+		}
+	}
+}
+
+
+/**
+ * Answers a query of a client of the server as if run in the working directory of the client: parses
+ * its command line like main does, with the paths relative to that directory and the settings the
+ * server was started with as the defaults, and searches the resident file list. The directory, the
+ * file filters and the threads are the server's own. The process, with its working directory and
+ * its console, is shared by all queries and left as it is.
+ *
+ * @param searcher The searcher of the server.
+ * @param server_options The settings the server was started with.
+ * @param file_list The files of the directory of the server.
+ * @param working_directory The working directory of the client.
+ * @param arguments The command line of the query, the search string first.
+ * @param results The output of the result file.
+ * @param log The output of the log file.
+ * @param summary The output of the summary.
+ * @param cancel The token the server cancels the search with once the client is gone.
+ * @param error Set to the reason if the query is rejected.
+ * @return True on success, false on error.
+ */
+bool answerQuery(Searcher& searcher, const ProgramOptions& server_options, FileList& file_list, const fs::path& working_directory, const std::vector<std::string>& arguments, std::ostream& results, std::ostream& log, std::ostream& summary, const CancelToken& cancel, std::string& error) {
+	const Clock::time_point timer_start = Clock::now();
+	if (arguments.empty()) {
+		error = "wrong usage of the program";
+		return false;
+	}
+
+	// The messages of the options and the search string go to the client instead of the console of the server
+	std::ostringstream messages;
+	std::string filename = "specific_grep";
+	std::vector<std::string> command_line = { filename };
+	command_line.insert(command_line.end(), arguments.begin(), arguments.end());
+	std::vector<char*> argv;
+	for (auto& argument : command_line) {
+		argv.push_back(argument.data());
+	}
+	argv.push_back(nullptr);
+	ProgramOptions options = server_options;
+	options.output_directory = working_directory.string();
+	std::unique_ptr<LineMatcher> matcher;
+	if (setAdditionalOptions(static_cast<int>(command_line.size()), filename, argv.data(), options, working_directory, messages)) {
+		// The search string of a pattern file names the file
+		options.search.search_string = options.search.pattern_file ? (working_directory / arguments.front()).string() : arguments.front();
+		std::string matcher_error;
+		matcher = createMatcher(options.search, matcher_error);
+		if (matcher == nullptr) {
+			messages << "Error: " << matcher_error << std::endl;
+		}
+	}
+	if (matcher == nullptr) {
+		error = messages.str();
+		if (error.starts_with("Error: ")) {
+			error.erase(0, 7);
+		}
+		while (!error.empty() && error.back() == '\n') {
+			error.pop_back();
+		}
+		return false;
+	}
+
+	// The resident list was walked with the directory and the filters of the server, and the threads of the server run every search,
+	// so a query may only ask for as many threads as the server has, or leave the number to the server
+	std::error_code directory_error;
+	const bool same_threads = options.search.thread_count == server_options.search.thread_count
+		|| static_cast<std::size_t>(options.search.thread_count) == searcher.threadCount();
+	if (!fs::equivalent(options.search.directory_path, server_options.search.directory_path, directory_error) || options.search.include_globs != server_options.search.include_globs
+		|| options.search.exclude_globs != server_options.search.exclude_globs || options.search.ignore_files != server_options.search.ignore_files
+		|| !same_threads || options.search.pin_mode != server_options.search.pin_mode) {
+		error = "the directory, the file filters and the number of threads are set when the server starts";
+		return false;
+	}
+
+	runSearch(searcher, options, *matcher, &file_list.files(), results, log, summary, &cancel, timer_start);
+	return true;
+}
+
+
+/**
+ * Runs the program as a server, started as: <program> --serve <socket> [options]. The options set
+ * the directory, the file filters, the threads and the defaults of the other settings of every
+ * search, the file list of the directory and the threads are kept from one search to the next, and
+ * the searches of the clients are answered until the process is stopped.
+ *
+ * @param argc The number of command line arguments.
+ * @param filename The name of the program.
+ * @param argv An array of the command line arguments.
+ * @return The exit code of the program.
+ */
+int runServer(int argc, std::string& filename, char* argv[]) {
+	// The socket takes the place of the search string, the defaults are those of main
+	ProgramOptions options;
+	options.search.directory_path = fs::current_path().string();
+	const std::string program_name = filename.substr(0, filename.find_last_of("."));
+	options.log_filename = program_name;
+	options.result_filename = program_name;
+	if (!setAdditionalOptions(argc - 1, filename, argv + 1, options, fs::path(), std::cerr)) return 1;
+	options.search.directory_path = fs::absolute(options.search.directory_path).lexically_normal().string();
+
+	std::optional<PathFilter> filter;
+	if (!options.search.include_globs.empty() || !options.search.exclude_globs.empty() || options.search.ignore_files) {
+		filter.emplace(options.search.include_globs, options.search.exclude_globs, options.search.ignore_files);
+	}
+	// The file list is walked on the threads of the searches
+	Searcher searcher(options.search.thread_count, options.search.pin_mode);
+	FileList file_list(options.search.directory_path, filter ? &*filter : nullptr, searcher.scheduler());
+
+	SearchServer server(argv[2]);
+	std::string error;
+	if (!server.listen(error)) {
+		std::cerr << "Error: " << error << std::endl;
+		return 1;
+	}
+	std::cout << "Serving " << options.search.directory_path << " with " << file_list.files().size() << " files on " << argv[2] << std::endl;
+
+	server.serve([&](const fs::path& working_directory, const std::vector<std::string>& arguments, std::ostream& results, std::ostream& log, std::ostream& summary, const CancelToken& cancel, std::string& query_error) {
+		// Every query runs as if started in the directory of its client, one after another
+		if (!working_directory.is_absolute()) {
+			query_error = "the working directory " + working_directory.string() + " is not absolute";
+			return false;
+		}
+		return answerQuery(searcher, options, file_list, working_directory, arguments, results, log, summary, cancel, query_error);
+	});
+	return 0;
+}
+
+
+int main(int argc, char* argv[]) {
 	// Start the timer
-	timer_start = clock();
+	const Clock::time_point timer_start = Clock::now();
 
 	// Extract the filename from the first argument
 	std::string filename = fs::path(argv[0]).filename().string();
-	// Extract the string to search for from the second argument
-	std::string search_string = argv[1];
-	// Initialize the directory path to the current directory
-	std::string directory_path = fs::current_path().string();
 
-	// Set default values for log filename, result filename, and thread count
-	int thread_cnt = 4;
+	// A server keeps the files of its directory in memory and answers the searches of its clients
+	if (argc > 1 && strcmp(argv[1], "--serve") == 0) {
+		return runServer(argc, filename, argv);
+	}
 
-	// Extract the program name from the filename
+	// Set default values: search the current directory with one thread per CPU, and name the log and result files after the program
+	ProgramOptions options;
+	options.search.directory_path = fs::current_path().string();
+	options.output_directory = options.search.directory_path;
 	std::size_t last_dot = filename.find_last_of(".");
 	std::string program_name = filename.substr(0, last_dot);
-	std::string log_filename = program_name;
-	std::string result_filename = program_name;
+	options.log_filename = program_name;
+	options.result_filename = program_name;
 
 	// Parse the additional options using the setAdditionalOptions function
-	int options_func_success = setAdditionalOptions(argc, filename, argv, directory_path, log_filename, result_filename, thread_cnt);
+	int options_func_success = setAdditionalOptions(argc, filename, argv, options, fs::path(), std::cerr);
 
 	// If any of the additional options is invalid, return false
 	if (!options_func_success) return 1;
 
-	// Search directory for string with specified thread count
-	std::pair<std::vector<std::tuple<std::thread::id, std::string, int, std::string>>, int> results = searchDirectoryForString(search_string, directory_path, thread_cnt);
+	// Extract the string to search for from the second argument
+	options.search.search_string = argv[1];
+
+	// With a server, the search runs there and only its answer is written here
+	std::unique_ptr<LineMatcher> matcher;
+	if (options.server_socket.empty()) {
+		// Compile the search string before anything is written
+		std::string matcher_error;
+		matcher = createMatcher(options.search, matcher_error);
+		if (matcher == nullptr) {
+			std::cerr << "Error: " << matcher_error << std::endl;
+			return 1;
+		}
+	}
 
-	// Write results to the file specified by result_filename variable
-	writeResultsToFile(result_filename, std::get<0>(results));
+	// Open the result file and the log file
+	// The binary result file is written byte for byte
+	const std::ios::openmode result_mode = options.result_format == ResultFormat::Binary ? std::ios::out | std::ios::binary : std::ios::out;
+	std::ofstream result_file(options.result_filename + resultFileExtension(options.result_format), result_mode);
+	if (!result_file.is_open()) {
+		std::cerr << "Could not open output file" << std::endl;
+		return 1;
+	}
+	std::ofstream log_file(options.log_filename + ".log");
+	if (!log_file.is_open()) {
+		std::cerr << "Unable to open file for writing: " << options.log_filename << std::endl;
+	}
 
-	// Write the log file to the file specified by log_filename variable
-	writeLogToFile(log_filename, std::get<0>(results));
+	if (!options.server_socket.empty()) {
+		// Send the command line without the server option
+		std::vector<std::string> arguments;
+		for (int i = 1; i < argc; i++) {
+			if (i > 1 && strcmp(argv[i], "--server") == 0) {
+				i++;
+				continue;
+			}
+			arguments.push_back(argv[i]);
+		}
+		std::string server_error;
+		if (!querySearchServer(options.server_socket, arguments, result_file, log_file, std::cout, server_error)) {
+			std::cerr << "Error: " << server_error << std::endl;
+			return 1;
+		}
+		return 0;
+	}
 
-	// Print the results of the program
-	printSearchResults(results, thread_cnt, log_filename, result_filename, timer_start);
+	Searcher searcher(options.search.thread_count, options.search.pin_mode);
+	runSearch(searcher, options, *matcher, nullptr, result_file, log_file, std::cout, nullptr, timer_start);
 
 	// Return success
 	return 0;
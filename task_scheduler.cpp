@@ -0,0 +1,240 @@
+#include "task_scheduler.h"
+
+#include <chrono>
+#include <cstddef>
+
+namespace {
+	// The scheduler and the worker index of the current thread, if it is a worker thread.
+	thread_local const TaskScheduler* current_scheduler = nullptr;
+	thread_local std::size_t current_worker = 0;
+}
+
+
+TaskScheduler::TaskScheduler(std::size_t worker_count, PinMode pin_mode, std::size_t injection_capacity) : injected_(injection_capacity) {
+	if (worker_count == 0) {
+		worker_count = 1;
+	}
+	worker_cpus_ = planWorkerCpus(pin_mode, worker_count);
+
+	// Create all deques before any worker starts, since workers steal from each other right away.
+	for (std::size_t i = 0; i < worker_count; ++i) {
+		queues_.push_back(std::make_unique<WorkerQueue>());
+	}
+	for (std::size_t i = 0; i < worker_count; ++i) {
+		workers_.emplace_back(&TaskScheduler::workerLoop, this, i);
+	}
+}
+
+
+TaskScheduler::~TaskScheduler() {
+	wait();
+
+	// Wake up every sleeping worker and let it exit.
+	{
+		std::lock_guard<std::mutex> lock(idle_mutex_);
+		stopping_ = true;
+	}
+	idle_cv_.notify_all();
+
+	for (auto& worker : workers_) {
+		worker.join();
+	}
+}
+
+
+void TaskScheduler::submit(Task task) {
+	pending_.fetch_add(1);
+
+	// Keep tasks spawned by a worker in that worker's deque.
+	if (current_scheduler == this) {
+		push(current_worker, std::move(task));
+		return;
+	}
+
+	// Queue external tasks for the workers, sleeping while the queue is full until a worker takes a task
+	// from it. The waiter is counted before the last attempt, and the fences on both sides make a worker
+	// either leave room for that attempt or see the waiter and wake it.
+	while (!injected_.tryPush(task)) {
+		std::unique_lock<std::mutex> lock(room_mutex_);
+		room_waiters_.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!injected_.tryPush(task)) {
+			room_cv_.wait(lock);
+			room_waiters_.fetch_sub(1);
+			continue;
+		}
+		room_waiters_.fetch_sub(1);
+		break;
+	}
+	queued_.fetch_add(1);
+	notifyIdle();
+}
+
+
+void TaskScheduler::wait() {
+	std::unique_lock<std::mutex> lock(done_mutex_);
+	done_cv_.wait(lock, [this] { return pending_.load() == 0; });
+}
+
+
+std::size_t TaskScheduler::workerCount() const {
+	return workers_.size();
+}
+
+
+std::thread::id TaskScheduler::workerThreadId(std::size_t worker_index) const {
+	return workers_[worker_index].get_id();
+}
+
+
+void TaskScheduler::setStats(SearchStats* stats) {
+	stats_.store(stats, std::memory_order_release);
+}
+
+
+/**
+ * Runs tasks from the worker's own deque, steals when it is empty, and sleeps when there is nothing to steal.
+ *
+ * @param worker_index The index of the worker running the loop.
+ */
+void TaskScheduler::workerLoop(std::size_t worker_index) {
+	current_scheduler = this;
+	current_worker = worker_index;
+	if (!worker_cpus_.empty()) {
+		pinCurrentThread(worker_cpus_[worker_index]);
+	}
+
+	Task task;
+	while (true) {
+		bool stolen = false;
+		if (popLocal(worker_index, task) || popInjected(task) || (stolen = steal(worker_index, task))) {
+			// With statistics, everything the task counts goes to the worker's own.
+			if (SearchStats* const stats = stats_.load(std::memory_order_acquire)) {
+				WorkerStats& worker_stats = stats->worker(worker_index);
+				const StatsBinding binding(&worker_stats);
+				const auto start = std::chrono::steady_clock::now();
+				task(worker_index);
+				worker_stats.busy_ns += static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+				++worker_stats.tasks;
+				worker_stats.steals += stolen ? 1 : 0;
+			}
+			else {
+				task(worker_index);
+			}
+			task = nullptr;
+
+			// Wake up wait() once the last outstanding task is done.
+			if (pending_.fetch_sub(1) == 1) {
+				std::lock_guard<std::mutex> lock(done_mutex_);
+				done_cv_.notify_all();
+			}
+			continue;
+		}
+
+		// Nothing to run: sleep until a task is queued somewhere or the scheduler shuts down.
+		std::unique_lock<std::mutex> lock(idle_mutex_);
+		idle_cv_.wait(lock, [this] { return stopping_ || queued_.load() > 0; });
+		if (stopping_ && queued_.load() <= 0) {
+			return;
+		}
+	}
+}
+
+
+/**
+ * Pops the newest task from the worker's own deque.
+ *
+ * @param worker_index The index of the worker.
+ * @param task Receives the task.
+ * @return True if a task was taken, false if the deque is empty.
+ */
+bool TaskScheduler::popLocal(std::size_t worker_index, Task& task) {
+	WorkerQueue& queue = *queues_[worker_index];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.tasks.empty()) {
+		return false;
+	}
+
+	task = std::move(queue.tasks.back());
+	queue.tasks.pop_back();
+	queued_.fetch_sub(1);
+	return true;
+}
+
+
+/**
+ * Pops the oldest task from the injection queue.
+ *
+ * @param task Receives the task.
+ * @return True if a task was taken, false if the injection queue is empty.
+ */
+bool TaskScheduler::popInjected(Task& task) {
+	if (!injected_.tryPop(task)) {
+		return false;
+	}
+
+	queued_.fetch_sub(1);
+	// Taking the room mutex orders the notification after the wait of a producer that saw no room.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (room_waiters_.load() > 0) {
+		{
+			std::lock_guard<std::mutex> lock(room_mutex_);
+		}
+		room_cv_.notify_all();
+	}
+	return true;
+}
+
+
+/**
+ * Steals the oldest task from the first other worker that has one, starting with the next worker.
+ *
+ * @param worker_index The index of the stealing worker.
+ * @param task Receives the task.
+ * @return True if a task was stolen, false if all other deques are empty.
+ */
+bool TaskScheduler::steal(std::size_t worker_index, Task& task) {
+	for (std::size_t offset = 1; offset < queues_.size(); ++offset) {
+		WorkerQueue& victim = *queues_[(worker_index + offset) % queues_.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (victim.tasks.empty()) {
+			continue;
+		}
+
+		task = std::move(victim.tasks.front());
+		victim.tasks.pop_front();
+		queued_.fetch_sub(1);
+		return true;
+	}
+
+	return false;
+}
+
+
+/**
+ * Pushes a task to the back of a worker's deque and wakes up one sleeping worker.
+ *
+ * @param worker_index The index of the worker that owns the deque.
+ * @param task The task to push.
+ */
+void TaskScheduler::push(std::size_t worker_index, Task task) {
+	{
+		WorkerQueue& queue = *queues_[worker_index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+	queued_.fetch_add(1);
+	notifyIdle();
+}
+
+
+/**
+ * Wakes up one sleeping worker after a task was queued.
+ */
+void TaskScheduler::notifyIdle() {
+	// Taking the idle mutex orders the notification after a worker's predicate check.
+	{
+		std::lock_guard<std::mutex> lock(idle_mutex_);
+	}
+	idle_cv_.notify_one();
+}
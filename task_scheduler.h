@@ -0,0 +1,127 @@
+#ifndef SPECIFIC_GREP_TASK_SCHEDULER_H
+#define SPECIFIC_GREP_TASK_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "cpu_topology.h"
+#include "search_stats.h"
+
+/**
+ * A work-stealing task scheduler.
+ *
+ * Every worker owns a deque of tasks. A worker pops its own tasks from the back (newest first)
+ * and, once its deque runs dry, steals from the front (oldest first) of the other workers' deques.
+ * Tasks may submit further tasks while running; those land in the submitting worker's own deque
+ * so that the work stays local until somebody else is idle enough to take it.
+ *
+ * Threads outside the scheduler submit through a bounded lock-free injection queue instead, which
+ * the workers drain before stealing. A producer that outruns the workers sleeps once the queue is
+ * full, until a worker takes a task from it, so a fast producer such as a directory walk streams work
+ * in without buffering it all up.
+ */
+class TaskScheduler {
+public:
+	/**
+	 * A unit of work. The argument is the index of the worker that runs the task.
+	 */
+	using Task = std::function<void(std::size_t)>;
+
+	/**
+	 * Starts the worker threads. A pinned worker pins itself before it runs any task, so the memory
+	 * it allocates for its tasks is close to its CPUs.
+	 *
+	 * @param worker_count The number of worker threads to start (at least one is always started).
+	 * @param pin_mode Where the worker threads may run.
+	 * @param injection_capacity The number of externally submitted tasks that may wait for a worker.
+	 */
+	explicit TaskScheduler(std::size_t worker_count, PinMode pin_mode = PinMode::None, std::size_t injection_capacity = 4096);
+
+	/**
+	 * Waits for all outstanding tasks and joins the worker threads.
+	 */
+	~TaskScheduler();
+
+	TaskScheduler(const TaskScheduler&) = delete;
+	TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+	/**
+	 * Submits a task. Called from a worker thread of this scheduler, the task goes to that worker's
+	 * own deque; called from any other thread, it goes to the injection queue, blocking while it is full.
+	 *
+	 * @param task The task to run.
+	 */
+	void submit(Task task);
+
+	/**
+	 * Blocks until every submitted task, including the ones submitted by other tasks, has finished.
+	 */
+	void wait();
+
+	/**
+	 * @return The number of worker threads.
+	 */
+	std::size_t workerCount() const;
+
+	/**
+	 * @param worker_index The index of the worker.
+	 * @return The ID of the worker's thread.
+	 */
+	std::thread::id workerThreadId(std::size_t worker_index) const;
+
+	/**
+	 * Makes every task from now on count in the statistics of its worker, and records the tasks,
+	 * the steals and the busy time of every worker. Only to be set while no task is outstanding.
+	 *
+	 * @param stats The statistics to count in, with a worker for each of the scheduler, or nullptr to count nothing.
+	 */
+	void setStats(SearchStats* stats);
+
+private:
+	// A worker's deque of tasks, guarded by its own mutex so that stealing only contends with the victim.
+	struct WorkerQueue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void workerLoop(std::size_t worker_index);
+	bool popLocal(std::size_t worker_index, Task& task);
+	bool popInjected(Task& task);
+	bool steal(std::size_t worker_index, Task& task);
+	void push(std::size_t worker_index, Task task);
+	void notifyIdle();
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues_;
+	// The CPUs of every worker, empty if the workers are not pinned.
+	std::vector<std::vector<unsigned int>> worker_cpus_;
+	std::vector<std::thread> workers_;
+	BoundedQueue<Task> injected_;
+
+	// Number of tasks sitting in the deques and the injection queue, used to put idle workers to sleep.
+	// A task is counted once it is queued, so the count dips below zero for a moment when a worker takes
+	// a task before its producer has counted it, but it never counts a task that is not there.
+	std::atomic<std::ptrdiff_t> queued_{ 0 };
+	// Number of submitted tasks that have not finished yet, used by wait().
+	std::atomic<std::size_t> pending_{ 0 };
+	std::atomic<SearchStats*> stats_{ nullptr };
+
+	std::mutex idle_mutex_;
+	std::condition_variable idle_cv_;
+	// Producers waiting for room in the full injection queue, woken by the workers that take from it.
+	std::atomic<std::size_t> room_waiters_{ 0 };
+	std::mutex room_mutex_;
+	std::condition_variable room_cv_;
+	std::mutex done_mutex_;
+	std::condition_variable done_cv_;
+	bool stopping_ = false;
+};
+
+#endif
@@ -0,0 +1,572 @@
+#include "trigram_index.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <system_error>
+
+#include "buffer_scanner.h"
+#include "case_folding.h"
+#include "file_reader.h"
+
+namespace fs = std::filesystem;
+
+/**
+ * The start of the index file. All offsets are in bytes from the start of the file.
+ */
+struct TrigramIndex::Header {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t file_count;
+	std::uint64_t trigram_count;
+	std::uint64_t files_offset;
+	std::uint64_t trigrams_offset;
+	std::uint64_t paths_offset;
+	std::uint64_t paths_size;
+	std::uint64_t postings_offset;
+	std::uint64_t postings_size;
+};
+
+/**
+ * A file of the index, in the order of the paths.
+ */
+struct TrigramIndex::FileEntry {
+	std::uint64_t size;
+	std::int64_t modified_ns;
+	std::uint64_t inode;
+	// The path, from the start of the paths.
+	std::uint64_t path_offset;
+	std::uint32_t path_length;
+	std::uint32_t reserved;
+};
+
+/**
+ * A trigram of the index, in the order of the values. Its posting list runs up to the next one's.
+ */
+struct TrigramIndex::TrigramEntry {
+	std::uint32_t trigram;
+	std::uint32_t file_count;
+	// The posting list, from the start of the postings.
+	std::uint64_t postings_offset;
+};
+
+namespace {
+	constexpr char index_magic[8] = {'S', 'G', 'T', 'R', 'I', 'G', 'R', 'M'};
+	constexpr std::uint32_t index_version = 1;
+
+	/**
+	 * A scanner that searches nothing, for reading a file only for the lines its observer takes.
+	 */
+	class ReadingScanner final : public BufferScanner {
+	protected:
+		void scanLines(const char*, const char*) override {
+		}
+	};
+
+	void appendVarint(std::vector<char>& out, std::uint32_t value) {
+		while (value >= 0x80) {
+			out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<char>(value));
+	}
+
+	template <typename T>
+	void appendRaw(std::vector<char>& out, const T& value) {
+		const char* bytes = reinterpret_cast<const char*>(&value);
+		out.insert(out.end(), bytes, bytes + sizeof(T));
+	}
+
+	/**
+	 * @return The varint at a position, which is moved on after it. A varint that runs out of the data ends where it does.
+	 */
+	std::uint32_t readVarint(const char*& position, const char* end) {
+		std::uint32_t value = 0;
+		int shift = 0;
+		while (position < end && shift < 32) {
+			const auto byte = static_cast<unsigned char>(*position++);
+			value |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+			shift += 7;
+			if ((byte & 0x80) == 0) {
+				break;
+			}
+		}
+		return value;
+	}
+
+	void alignTo8(std::vector<char>& out) {
+		out.resize((out.size() + 7) & ~std::size_t{7}, 0);
+	}
+
+	/**
+	 * Reads the delta-encoded trigrams of a file indexed again, one after the other, for the merge of
+	 * the posting lists.
+	 */
+	struct TrigramCursor {
+		const char* position;
+		const char* end;
+		std::uint32_t trigram = 0;
+
+		/**
+		 * Moves on to the next trigram.
+		 *
+		 * @return False once there is none.
+		 */
+		bool next() {
+			if (position >= end) {
+				return false;
+			}
+			trigram += readVarint(position, end);
+			return true;
+		}
+	};
+
+	/**
+	 * @return The distinct trigrams of a literal, folded like the index's.
+	 */
+	std::vector<std::uint32_t> literalTrigrams(const std::string& literal) {
+		std::vector<std::uint32_t> trigrams;
+		for (std::size_t i = 0; i + 3 <= literal.size(); ++i) {
+			trigrams.push_back((static_cast<unsigned char>(foldAscii(literal[i])) << 16)
+				| (static_cast<unsigned char>(foldAscii(literal[i + 1])) << 8)
+				| static_cast<unsigned char>(foldAscii(literal[i + 2])));
+		}
+		std::sort(trigrams.begin(), trigrams.end());
+		trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+		return trigrams;
+	}
+}
+
+
+TrigramCollector::~TrigramCollector() {
+	take();
+}
+
+
+std::vector<std::uint32_t> TrigramCollector::take() {
+	for (const std::uint32_t trigram : found_) {
+		seen()[trigram >> 6] &= ~(std::uint64_t{1} << (trigram & 63));
+	}
+	std::sort(found_.begin(), found_.end());
+	return std::move(found_);
+}
+
+
+void TrigramCollector::observeLines(const char* begin, const char* end) {
+	std::vector<std::uint64_t>& seen = this->seen();
+	std::uint32_t trigram = 0;
+	int length = 0;
+	for (const char* position = begin; position < end; ++position) {
+		if (*position == '\n') {
+			length = 0;
+			continue;
+		}
+		trigram = ((trigram << 8) | static_cast<unsigned char>(foldAscii(*position))) & 0xffffff;
+		if (++length < 3) {
+			continue;
+		}
+		std::uint64_t& word = seen[trigram >> 6];
+		const std::uint64_t bit = std::uint64_t{1} << (trigram & 63);
+		if ((word & bit) == 0) {
+			word |= bit;
+			found_.push_back(trigram);
+		}
+	}
+}
+
+
+/**
+ * @return The bit set of the trigrams already found, one per thread and cleared after every file.
+ */
+std::vector<std::uint64_t>& TrigramCollector::seen() {
+	thread_local std::vector<std::uint64_t> bits((std::size_t{1} << 24) / 64);
+	return bits;
+}
+
+
+TrigramIndex::TrigramIndex(fs::path index_path, std::size_t worker_count) : index_path_(std::move(index_path)), workers_(worker_count) {
+	std::error_code error;
+	if (fs::exists(index_path_, error) && !open()) {
+		std::cerr << "Warning: ignoring the invalid index " << index_path_.string() << ", it is rebuilt." << std::endl;
+		close();
+	}
+}
+
+
+TrigramIndex::~TrigramIndex() {
+	close();
+}
+
+
+/**
+ * Maps the old index and checks that its tables lie within the file.
+ */
+bool TrigramIndex::open() {
+	if (!file_.open(index_path_) || file_.size() < sizeof(Header)) {
+		return false;
+	}
+	data_ = file_.data();
+	size_ = file_.size();
+
+	header_ = reinterpret_cast<const Header*>(data_);
+	auto fits = [&](std::uint64_t offset, std::uint64_t count, std::uint64_t element_size) {
+		return offset <= size_ && count <= (size_ - offset) / element_size;
+	};
+	if (std::memcmp(header_->magic, index_magic, sizeof(index_magic)) != 0 || header_->version != index_version
+		|| !fits(header_->files_offset, header_->file_count, sizeof(FileEntry))
+		|| !fits(header_->trigrams_offset, header_->trigram_count, sizeof(TrigramEntry))
+		|| !fits(header_->paths_offset, header_->paths_size, 1)
+		|| !fits(header_->postings_offset, header_->postings_size, 1)) {
+		return false;
+	}
+	files_ = reinterpret_cast<const FileEntry*>(data_ + header_->files_offset);
+	trigrams_ = reinterpret_cast<const TrigramEntry*>(data_ + header_->trigrams_offset);
+	for (std::uint32_t id = 0; id < header_->file_count; ++id) {
+		if (files_[id].path_offset > header_->paths_size || files_[id].path_length > header_->paths_size - files_[id].path_offset) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+void TrigramIndex::close() {
+	file_.close();
+	data_ = nullptr;
+	size_ = 0;
+	header_ = nullptr;
+	files_ = nullptr;
+	trigrams_ = nullptr;
+}
+
+
+std::string_view TrigramIndex::filePath(const FileEntry& entry) const {
+	return std::string_view(data_ + header_->paths_offset + entry.path_offset, entry.path_length);
+}
+
+
+/**
+ * @return The ID of a file in the old index, or no_file if it is not in it.
+ */
+std::uint32_t TrigramIndex::findFile(std::string_view path) const {
+	if (header_ == nullptr) {
+		return no_file;
+	}
+	const FileEntry* end = files_ + header_->file_count;
+	const FileEntry* found = std::lower_bound(files_, end, path, [&](const FileEntry& entry, std::string_view value) {
+		return filePath(entry) < value;
+	});
+	return found != end && filePath(*found) == path ? static_cast<std::uint32_t>(found - files_) : no_file;
+}
+
+
+const TrigramIndex::TrigramEntry* TrigramIndex::findTrigram(std::uint32_t trigram) const {
+	if (header_ == nullptr) {
+		return nullptr;
+	}
+	const TrigramEntry* end = trigrams_ + header_->trigram_count;
+	const TrigramEntry* found = std::lower_bound(trigrams_, end, trigram, [](const TrigramEntry& entry, std::uint32_t value) {
+		return entry.trigram < value;
+	});
+	return found != end && found->trigram == trigram ? found : nullptr;
+}
+
+
+/**
+ * Decodes the posting list of a trigram into the IDs of its files, in increasing order.
+ * A list that runs out of the postings ends where they end.
+ */
+void TrigramIndex::decodePostings(const TrigramEntry& entry, std::vector<std::uint32_t>& ids) const {
+	ids.clear();
+	const std::uint64_t end_offset = &entry + 1 < trigrams_ + header_->trigram_count ? (&entry + 1)->postings_offset : header_->postings_size;
+	const char* position = data_ + header_->postings_offset + std::min(entry.postings_offset, header_->postings_size);
+	const char* const end = data_ + header_->postings_offset + std::min(end_offset, header_->postings_size);
+
+	std::uint32_t id = 0;
+	while (position < end) {
+		id += readVarint(position, end);
+		if (id >= header_->file_count) {
+			break;
+		}
+		ids.push_back(id);
+	}
+}
+
+
+void TrigramIndex::setQuery(const std::vector<std::string>& literals) {
+	all_candidates_ = true;
+	if (header_ == nullptr || literals.empty()) {
+		return;
+	}
+
+	// A file may match if it contains every trigram of one of the literals.
+	std::vector<std::uint8_t> candidates(header_->file_count, 0);
+	std::vector<std::uint32_t> ids;
+	std::vector<std::uint32_t> postings;
+	std::vector<std::uint32_t> common;
+	for (const auto& literal : literals) {
+		// A literal with a newline never matches within a line.
+		if (literal.find('\n') != std::string::npos) {
+			continue;
+		}
+		// A literal without a trigram may be in any file.
+		if (literal.size() < 3) {
+			return;
+		}
+
+		// Intersect the posting lists, the shortest first.
+		std::vector<const TrigramEntry*> entries;
+		bool missing = false;
+		for (const std::uint32_t trigram : literalTrigrams(literal)) {
+			const TrigramEntry* entry = findTrigram(trigram);
+			if (entry == nullptr) {
+				missing = true;
+				break;
+			}
+			entries.push_back(entry);
+		}
+		if (missing) {
+			continue;
+		}
+		std::sort(entries.begin(), entries.end(), [](const TrigramEntry* lhs, const TrigramEntry* rhs) {
+			return lhs->file_count < rhs->file_count;
+		});
+		decodePostings(*entries[0], ids);
+		for (std::size_t i = 1; i < entries.size() && !ids.empty(); ++i) {
+			decodePostings(*entries[i], postings);
+			common.clear();
+			std::set_intersection(ids.begin(), ids.end(), postings.begin(), postings.end(), std::back_inserter(common));
+			ids.swap(common);
+		}
+		for (const std::uint32_t id : ids) {
+			candidates[id] = 1;
+		}
+	}
+	candidates_ = std::move(candidates);
+	all_candidates_ = false;
+}
+
+
+TrigramIndex::Action TrigramIndex::check(const fs::path& file_path, std::size_t worker_index, FileStamp& stamp) {
+	if (!readFileStamp(file_path, stamp)) {
+		// Leave it to the search to report the file, it is left out of the index.
+		return Action::Search;
+	}
+
+	std::string path = file_path.string();
+	const std::uint32_t id = findFile(path);
+	if (id == no_file || !(stamp == FileStamp{files_[id].size, files_[id].modified_ns, files_[id].inode})) {
+		return Action::IndexAndSearch;
+	}
+
+	WorkerEntries& worker = workers_[worker_index];
+	worker.entries.push_back({std::move(path), stamp, id, {}});
+	if (!all_candidates_ && candidates_[id] == 0) {
+		++worker.skipped;
+		return Action::Skip;
+	}
+	return Action::Search;
+}
+
+
+void TrigramIndex::indexFile(const fs::path& file_path, const FileStamp& stamp, std::size_t worker_index) {
+	TrigramCollector collector;
+	ReadingScanner scanner;
+	scanner.setObserver(&collector);
+	if (scanFile(file_path, ReadMode::Auto, scanner)) {
+		addFile(file_path, stamp, collector.take(), worker_index);
+	}
+}
+
+
+void TrigramIndex::addFile(const fs::path& file_path, const FileStamp& stamp, const std::vector<std::uint32_t>& trigrams, std::size_t worker_index) {
+	// Most trigrams of a file are close to the one before, a byte or two as varints against four.
+	std::vector<char> encoded;
+	std::uint32_t previous = 0;
+	for (const std::uint32_t trigram : trigrams) {
+		appendVarint(encoded, trigram - previous);
+		previous = trigram;
+	}
+	workers_[worker_index].entries.push_back({file_path.string(), stamp, no_file, std::move(encoded)});
+	++workers_[worker_index].indexed;
+}
+
+
+bool TrigramIndex::save(std::string& error) {
+	std::vector<Entry> entries;
+	for (auto& worker : workers_) {
+		entries.insert(entries.end(), std::make_move_iterator(worker.entries.begin()), std::make_move_iterator(worker.entries.end()));
+		worker.entries.clear();
+	}
+
+	// The files of an incomplete walk that it did not get to keep their entries, unless it indexed them again.
+	const std::uint32_t old_count = header_ == nullptr ? 0 : header_->file_count;
+	if (incomplete_ && old_count > 0) {
+		std::vector<std::uint8_t> found(old_count, 0);
+		std::vector<std::string_view> indexed;
+		for (const auto& entry : entries) {
+			if (entry.old_id != no_file) {
+				found[entry.old_id] = 1;
+			}
+			else {
+				indexed.push_back(entry.path);
+			}
+		}
+		std::sort(indexed.begin(), indexed.end());
+		std::vector<Entry> unvisited;
+		for (std::uint32_t id = 0; id < old_count; ++id) {
+			const std::string_view path = filePath(files_[id]);
+			if (found[id] == 0 && !std::binary_search(indexed.begin(), indexed.end(), path)) {
+				unvisited.push_back({std::string(path), FileStamp{files_[id].size, files_[id].modified_ns, files_[id].inode}, id, {}});
+			}
+		}
+		entries.insert(entries.end(), std::make_move_iterator(unvisited.begin()), std::make_move_iterator(unvisited.end()));
+	}
+
+	// Nothing to write when every file of the old index is still there and unchanged.
+	const bool changed = header_ == nullptr || entries.size() != old_count || std::any_of(entries.begin(), entries.end(), [](const Entry& entry) {
+		return entry.old_id == no_file;
+	});
+	if (!changed) {
+		return true;
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs) {
+		return lhs.path < rhs.path;
+	});
+
+	// The files of the old index renumbered in path order, which keeps the order of their IDs.
+	std::vector<std::uint32_t> new_ids(old_count, no_file);
+	for (std::uint32_t id = 0; id < entries.size(); ++id) {
+		if (entries[id].old_id != no_file) {
+			new_ids[entries[id].old_id] = id;
+		}
+	}
+
+	// Lay out the tables and the posting lists.
+	std::vector<char> file_table;
+	std::vector<char> paths;
+	for (const auto& entry : entries) {
+		appendRaw(file_table, FileEntry{entry.stamp.size, entry.stamp.modified_ns, entry.stamp.inode, paths.size(), static_cast<std::uint32_t>(entry.path.size()), 0});
+		paths.insert(paths.end(), entry.path.begin(), entry.path.end());
+	}
+
+	// The trigrams of the files indexed again are merged in order, each next one of every file in a heap
+	// by trigram and file ID, so the posting lists come out one trigram at a time next to the old ones.
+	std::vector<TrigramCursor> cursors;
+	// The cursor of every file indexed again, by its ID.
+	std::vector<std::uint32_t> cursor_of(entries.size(), no_file);
+	std::vector<std::uint64_t> heap;
+	for (std::uint32_t id = 0; id < entries.size(); ++id) {
+		if (entries[id].old_id != no_file) {
+			continue;
+		}
+		TrigramCursor cursor{entries[id].trigrams.data(), entries[id].trigrams.data() + entries[id].trigrams.size()};
+		if (cursor.next()) {
+			heap.push_back(std::uint64_t{cursor.trigram} << 32 | id);
+		}
+		cursor_of[id] = static_cast<std::uint32_t>(cursors.size());
+		cursors.push_back(cursor);
+	}
+	std::make_heap(heap.begin(), heap.end(), std::greater<>());
+
+	std::vector<char> trigram_table;
+	std::vector<char> postings;
+	std::uint64_t trigram_count = 0;
+	const std::uint64_t old_trigram_count = header_ == nullptr ? 0 : header_->trigram_count;
+	std::uint64_t old_trigram = 0;
+	std::vector<std::uint32_t> ids;
+	std::vector<std::uint32_t> file_ids;
+	while (old_trigram < old_trigram_count || !heap.empty()) {
+		std::uint32_t trigram = heap.empty() ? trigrams_[old_trigram].trigram : static_cast<std::uint32_t>(heap.front() >> 32);
+		if (old_trigram < old_trigram_count) {
+			trigram = std::min(trigram, trigrams_[old_trigram].trigram);
+		}
+
+		// The files of the old index that are kept, then the ones indexed again, each in ID order.
+		file_ids.clear();
+		if (old_trigram < old_trigram_count && trigrams_[old_trigram].trigram == trigram) {
+			decodePostings(trigrams_[old_trigram], ids);
+			for (const std::uint32_t id : ids) {
+				if (new_ids[id] != no_file) {
+					file_ids.push_back(new_ids[id]);
+				}
+			}
+			++old_trigram;
+		}
+		const std::size_t kept = file_ids.size();
+		while (!heap.empty() && static_cast<std::uint32_t>(heap.front() >> 32) == trigram) {
+			const auto id = static_cast<std::uint32_t>(heap.front());
+			std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+			heap.pop_back();
+			file_ids.push_back(id);
+			TrigramCursor& cursor = cursors[cursor_of[id]];
+			if (cursor.next()) {
+				heap.push_back(std::uint64_t{cursor.trigram} << 32 | id);
+				std::push_heap(heap.begin(), heap.end(), std::greater<>());
+			}
+		}
+		if (file_ids.empty()) {
+			continue;
+		}
+		std::inplace_merge(file_ids.begin(), file_ids.begin() + static_cast<std::ptrdiff_t>(kept), file_ids.end());
+
+		const std::uint64_t offset = postings.size();
+		std::uint32_t previous = 0;
+		for (const std::uint32_t id : file_ids) {
+			appendVarint(postings, id - previous);
+			previous = id;
+		}
+		appendRaw(trigram_table, TrigramEntry{trigram, static_cast<std::uint32_t>(file_ids.size()), offset});
+		++trigram_count;
+	}
+
+	Header header{};
+	std::memcpy(header.magic, index_magic, sizeof(index_magic));
+	header.version = index_version;
+	header.file_count = static_cast<std::uint32_t>(entries.size());
+	header.trigram_count = trigram_count;
+	std::vector<char> content;
+	appendRaw(content, header);
+	alignTo8(content);
+	header.files_offset = content.size();
+	content.insert(content.end(), file_table.begin(), file_table.end());
+	header.trigrams_offset = content.size();
+	content.insert(content.end(), trigram_table.begin(), trigram_table.end());
+	header.paths_offset = content.size();
+	header.paths_size = paths.size();
+	content.insert(content.end(), paths.begin(), paths.end());
+	header.postings_offset = content.size();
+	header.postings_size = postings.size();
+	content.insert(content.end(), postings.begin(), postings.end());
+	std::memcpy(content.data(), &header, sizeof(header));
+
+	// The old index is unmapped before it is replaced.
+	close();
+	return replaceFile(index_path_, content, error);
+}
+
+
+void TrigramIndex::markIncomplete() {
+	incomplete_ = true;
+}
+
+
+std::size_t TrigramIndex::filesSkipped() const {
+	std::size_t skipped = 0;
+	for (const auto& worker : workers_) {
+		skipped += worker.skipped;
+	}
+	return skipped;
+}
+
+
+std::size_t TrigramIndex::filesIndexed() const {
+	std::size_t indexed = 0;
+	for (const auto& worker : workers_) {
+		indexed += worker.indexed;
+	}
+	return indexed;
+}
@@ -0,0 +1,202 @@
+#ifndef SPECIFIC_GREP_TRIGRAM_INDEX_H
+#define SPECIFIC_GREP_TRIGRAM_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "buffer_scanner.h"
+#include "file_reader.h"
+#include "mapped_file.h"
+
+/**
+ * Collects the trigrams of the lines of a file from the runs of lines a scanner is fed, see
+ * BufferScanner::setObserver(). The trigrams found are marked in a bit set of the thread, so a thread
+ * collects the trigrams of one file at a time.
+ */
+class TrigramCollector final : public LineObserver {
+public:
+	TrigramCollector() = default;
+	~TrigramCollector() override;
+
+	TrigramCollector(const TrigramCollector&) = delete;
+	TrigramCollector& operator=(const TrigramCollector&) = delete;
+
+	/**
+	 * @return The trigrams found, sorted. Leaves the collector empty.
+	 */
+	std::vector<std::uint32_t> take();
+
+	void observeLines(const char* begin, const char* end) override;
+
+private:
+	static std::vector<std::uint64_t>& seen();
+
+	std::vector<std::uint32_t> found_;
+};
+
+/**
+ * An on-disk index of the trigrams, the sequences of three bytes, found in the lines of every file of
+ * a directory tree, for searching the same tree over and over.
+ *
+ * A line can only contain a literal if its file contains every trigram of the literal, so the index
+ * tells which files may match before any of them is read; only those are searched, and the others
+ * are skipped. The trigrams are taken with ASCII folded to lower case and never span a newline, so
+ * they serve case-insensitive searches as well.
+ *
+ * The file is memory-mapped, so opening it costs nothing but the lookups of the query's trigrams: a
+ * table of the files sorted by path, and a table of the trigrams sorted by value, each pointing to its
+ * posting list, the IDs of the files containing it as delta-encoded varints.
+ *
+ * The index is brought up to date by the same walk that searches the tree: a file whose size, mtime
+ * and inode match its entry keeps its trigrams, any other file has them collected by its search,
+ * which reads it to its end. The postings are written by merging the sorted trigrams of the files
+ * indexed again into the posting lists of the old index, one trigram at a time.
+ * The new index is written next to the old one and renamed over it once the search is done. A search
+ * that stops before its walk is done keeps the entries of the files it did not get to.
+ */
+class TrigramIndex {
+public:
+	/**
+	 * What the walk does with a file.
+	 */
+	enum class Action {
+		// The file is unchanged and cannot match.
+		Skip,
+		// The file is unchanged and may match.
+		Search,
+		// The file is new or has changed: it is searched, and indexed again from the content the search reads.
+		IndexAndSearch
+	};
+
+	/**
+	 * Opens the index. A missing index is empty; an unreadable one is ignored with a warning and rebuilt.
+	 *
+	 * @param index_path The path of the index file.
+	 * @param worker_count The number of workers that call the index during the walk.
+	 */
+	TrigramIndex(std::filesystem::path index_path, std::size_t worker_count);
+	~TrigramIndex();
+
+	TrigramIndex(const TrigramIndex&) = delete;
+	TrigramIndex& operator=(const TrigramIndex&) = delete;
+
+	/**
+	 * Sets the literals to look files up for. Call before the walk.
+	 *
+	 * @param literals Literals one of which every matching line contains, see LineMatcher::requiredLiterals().
+	 */
+	void setQuery(const std::vector<std::string>& literals);
+
+	/**
+	 * Looks up a file found by the walk and keeps it in the index. Safe to call from all workers at once.
+	 *
+	 * @param file_path The path of the file.
+	 * @param worker_index The index of the calling worker.
+	 * @param stamp Set to the stamp of the file, for indexFile().
+	 * @return What to do with the file.
+	 */
+	Action check(const std::filesystem::path& file_path, std::size_t worker_index, FileStamp& stamp);
+
+	/**
+	 * Reads a file that is new or has changed and records its trigrams, for a file the search does not
+	 * read, such as one whose matches come from the result cache. Safe to call from all workers at once.
+	 *
+	 * @param file_path The path of the file.
+	 * @param stamp The stamp check() gave for the file.
+	 * @param worker_index The index of the calling worker.
+	 */
+	void indexFile(const std::filesystem::path& file_path, const FileStamp& stamp, std::size_t worker_index);
+
+	/**
+	 * Records the trigrams of a file that is new or has changed, collected while the search read it.
+	 * Safe to call from all workers at once.
+	 *
+	 * @param file_path The path of the file.
+	 * @param stamp The stamp of the file taken before it was read.
+	 * @param trigrams The trigrams of the file, sorted, see TrigramCollector::take().
+	 * @param worker_index The index of the calling worker.
+	 */
+	void addFile(const std::filesystem::path& file_path, const FileStamp& stamp, const std::vector<std::uint32_t>& trigrams, std::size_t worker_index);
+
+	/**
+	 * Tells the index that the walk stopped before it found every file, so the files of the old index
+	 * it did not find are kept rather than dropped as deleted. Call after the walk, before save().
+	 */
+	void markIncomplete();
+
+	/**
+	 * Writes the index of the files the walk found, if any of them changed. Call once after the walk.
+	 *
+	 * @param error Set to the reason on failure.
+	 * @return True on success, false if the index could not be written.
+	 */
+	bool save(std::string& error);
+
+	/**
+	 * @return The number of unchanged files skipped because they cannot match.
+	 */
+	std::size_t filesSkipped() const;
+
+	/**
+	 * @return The number of files read to be indexed.
+	 */
+	std::size_t filesIndexed() const;
+
+private:
+	struct Header;
+	struct FileEntry;
+	struct TrigramEntry;
+
+	/**
+	 * A file the walk found, with where its trigrams come from.
+	 */
+	struct Entry {
+		std::string path;
+		FileStamp stamp;
+		// The ID of the file in the old index, or no_file when it was indexed again.
+		std::uint32_t old_id;
+		// The trigrams of a file indexed again, sorted, as delta-encoded varints.
+		std::vector<char> trigrams;
+	};
+
+	/**
+	 * The walk's findings of one worker, only ever touched by that worker.
+	 */
+	struct WorkerEntries {
+		std::vector<Entry> entries;
+		std::size_t skipped = 0;
+		std::size_t indexed = 0;
+	};
+
+	static constexpr std::uint32_t no_file = 0xffffffff;
+
+	bool open();
+	void close();
+	std::uint32_t findFile(std::string_view path) const;
+	const TrigramEntry* findTrigram(std::uint32_t trigram) const;
+	void decodePostings(const TrigramEntry& entry, std::vector<std::uint32_t>& ids) const;
+	std::string_view filePath(const FileEntry& entry) const;
+
+	std::filesystem::path index_path_;
+	// The old index as mapped from disk, empty if there is none.
+	MappedFile file_;
+	const char* data_ = nullptr;
+	std::size_t size_ = 0;
+	const Header* header_ = nullptr;
+	const FileEntry* files_ = nullptr;
+	const TrigramEntry* trigrams_ = nullptr;
+
+	// Whether every file of the old index may match, or else which of them may.
+	bool all_candidates_ = true;
+	// Whether the walk stopped before it found every file.
+	bool incomplete_ = false;
+	std::vector<std::uint8_t> candidates_;
+
+	std::vector<WorkerEntries> workers_;
+};
+
+#endif